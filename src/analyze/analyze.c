@@ -955,6 +955,91 @@ static int analyze_blame(sd_bus *bus) {
         return 0;
 }
 
+static int compare_execute_timing(const void *a, const void *b) {
+        return compare(((ExecuteTiming *)b)->wall,
+                       ((ExecuteTiming *)a)->wall);
+}
+
+static int analyze_generators(sd_bus *bus, char **args) {
+        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
+        ExecuteTiming *timings = NULL;
+        size_t n_allocated = 0;
+        unsigned n = 0, i;
+        const char *path;
+        uint64_t wall, cpu;
+        int r;
+
+        assert(bus);
+
+        if (!strv_isempty(args)) {
+                log_error("Too many arguments.");
+                return -E2BIG;
+        }
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "Generators",
+                        &error,
+                        &reply,
+                        "a(stt)");
+        if (r < 0) {
+                log_error("Failed to get generator times: %s", bus_error_message(&error, -r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stt)", &path, &wall, &cpu)) > 0) {
+                if (!GREEDY_REALLOC(timings, n_allocated, n + 1)) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                /* Only borrowed from the message */
+                timings[n++] = (ExecuteTiming) {
+                        .path = (char*) path,
+                        .wall = wall,
+                        .cpu = cpu,
+                };
+        }
+        if (r < 0) {
+                r = bus_log_parse_error(r);
+                goto finish;
+        }
+
+        if (n == 0) {
+                log_info("No generators were run.");
+                goto finish;
+        }
+
+        qsort(timings, n, sizeof(ExecuteTiming), compare_execute_timing);
+
+        pager_open_if_enabled();
+
+        printf("%16s %16s %s\n", "WALL", "CPU", "GENERATOR");
+
+        for (i = 0; i < n; i++) {
+                char tw[FORMAT_TIMESPAN_MAX], tc[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %16s %s\n",
+                       format_timespan(tw, sizeof(tw), timings[i].wall, USEC_PER_MSEC),
+                       format_timespan(tc, sizeof(tc), timings[i].cpu, USEC_PER_MSEC),
+                       timings[i].path);
+        }
+
+        r = 0;
+
+finish:
+        free(timings);
+        return r;
+}
+
 static int analyze_time(sd_bus *bus) {
         _cleanup_free_ char *buf = NULL;
         int r;
@@ -1128,6 +1213,64 @@ static int dump(sd_bus *bus, char **args) {
         return 0;
 }
 
+static int analyze_unit_cache(sd_bus *bus, char **args) {
+        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ char *path = NULL;
+        uint64_t hits, misses;
+        int r;
+
+        assert(bus);
+
+        if (!strv_isempty(args)) {
+                log_error("Too many arguments.");
+                return -E2BIG;
+        }
+
+        r = sd_bus_get_property_string(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "UnitFileCache",
+                        &error,
+                        &path);
+        if (r < 0) {
+                log_error("Failed to get unit file cache: %s", bus_error_message(&error, -r));
+                return r;
+        }
+
+        if (isempty(path)) {
+                printf("Unit file cache disabled.\n");
+                return 0;
+        }
+
+        r = bus_get_uint64_property(bus,
+                                    "/org/freedesktop/systemd1",
+                                    "org.freedesktop.systemd1.Manager",
+                                    "UnitFileCacheHits",
+                                    &hits);
+        if (r < 0)
+                return r;
+
+        r = bus_get_uint64_property(bus,
+                                    "/org/freedesktop/systemd1",
+                                    "org.freedesktop.systemd1.Manager",
+                                    "UnitFileCacheMisses",
+                                    &misses);
+        if (r < 0)
+                return r;
+
+        printf("   Cache: %s\n"
+               "    Hits: %" PRIu64 "\n"
+               "  Misses: %" PRIu64 "\n",
+               path, hits, misses);
+
+        if (hits + misses > 0)
+                printf("Hit rate: %" PRIu64 "%%\n", hits * 100 / (hits + misses));
+
+        return 0;
+}
+
 static int set_log_level(sd_bus *bus, char **args) {
         _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
         int r;
@@ -1182,9 +1325,11 @@ static void help(void) {
                "  blame                   Print list of running units ordered by time to init\n"
                "  critical-chain          Print a tree of the time critical chain of units\n"
                "  plot                    Output SVG graphic showing service initialization\n"
+               "  generators              Print list of generators ordered by time they took\n"
                "  dot                     Output dependency graph in dot(1) format\n"
                "  set-log-level LEVEL     Set logging threshold for systemd\n"
                "  dump                    Output state serialization of service manager\n"
+               "  unit-cache              Show unit file cache statistics\n"
                "  verify FILE...          Check unit files for correctness\n"
                , program_invocation_short_name);
 
@@ -1346,10 +1491,14 @@ int main(int argc, char *argv[]) {
                         r = analyze_critical_chain(bus, argv+optind+1);
                 else if (streq(argv[optind], "plot"))
                         r = analyze_plot(bus);
+                else if (streq(argv[optind], "generators"))
+                        r = analyze_generators(bus, argv+optind+1);
                 else if (streq(argv[optind], "dot"))
                         r = dot(bus, argv+optind+1);
                 else if (streq(argv[optind], "dump"))
                         r = dump(bus, argv+optind+1);
+                else if (streq(argv[optind], "unit-cache"))
+                        r = analyze_unit_cache(bus, argv+optind+1);
                 else if (streq(argv[optind], "set-log-level"))
                         r = set_log_level(bus, argv+optind+1);
                 else
@@ -41,9 +41,11 @@
 #include "capability.h"
 #include "bus-xml-policy.h"
 #include "proxy.h"
+#include "proxy-pool.h"
 
 static char *arg_address = NULL;
 static char **arg_configuration = NULL;
+static unsigned arg_threads = 0;
 
 typedef struct {
         int fd;
@@ -111,6 +113,7 @@ exit:
 
 static int loop_clients(int accept_fd, uid_t bus_uid) {
         _cleanup_(shared_policy_freep) SharedPolicy *sp = NULL;
+        _cleanup_(proxy_pool_freep) ProxyPool *pool = NULL;
         pthread_attr_t attr;
         int r;
 
@@ -129,6 +132,12 @@ static int loop_clients(int accept_fd, uid_t bus_uid) {
         if (r < 0)
                 goto finish;
 
+        if (arg_threads > 0) {
+                r = proxy_pool_new(&pool, arg_threads, arg_address, sp, arg_configuration, bus_uid);
+                if (r < 0)
+                        goto finish;
+        }
+
         for (;;) {
                 ClientContext *c;
                 pthread_t tid;
@@ -143,6 +152,13 @@ static int loop_clients(int accept_fd, uid_t bus_uid) {
                         goto finish;
                 }
 
+                if (pool) {
+                        r = proxy_pool_add(pool, fd);
+                        if (r < 0)
+                                close(fd);
+                        continue;
+                }
+
                 r = client_context_new(&c);
                 if (r < 0) {
                         log_oom();
@@ -176,7 +192,9 @@ static int help(void) {
                "     --configuration=PATH Configuration file or directory\n"
                "     --machine=MACHINE    Connect to specified machine\n"
                "     --address=ADDRESS    Connect to the bus specified by ADDRESS\n"
-               "                          (default: " DEFAULT_SYSTEM_BUS_ADDRESS ")\n",
+               "                          (default: " DEFAULT_SYSTEM_BUS_ADDRESS ")\n"
+               "     --threads=N          Serve clients from N worker threads, instead\n"
+               "                          of one thread per client\n",
                program_invocation_short_name);
 
         return 0;
@@ -189,6 +207,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_ADDRESS,
                 ARG_CONFIGURATION,
                 ARG_MACHINE,
+                ARG_THREADS,
         };
 
         static const struct option options[] = {
@@ -197,6 +216,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "address",         required_argument, NULL, ARG_ADDRESS         },
                 { "configuration",   required_argument, NULL, ARG_CONFIGURATION   },
                 { "machine",         required_argument, NULL, ARG_MACHINE         },
+                { "threads",         required_argument, NULL, ARG_THREADS         },
                 {},
         };
 
@@ -252,6 +272,14 @@ static int parse_argv(int argc, char *argv[]) {
                         break;
                 }
 
+                case ARG_THREADS:
+                        r = safe_atou(optarg, &arg_threads);
+                        if (r < 0) {
+                                log_error("Failed to parse number of threads: %s", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
                 case '?':
                         return -EINVAL;
 
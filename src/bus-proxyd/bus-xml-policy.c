@@ -24,6 +24,7 @@
 #include "strv.h"
 #include "set.h"
 #include "conf-files.h"
+#include "siphash24.h"
 #include "bus-internal.h"
 #include "bus-xml-policy.h"
 #include "sd-login.h"
@@ -664,6 +665,48 @@ struct policy_check_filter {
         const char *interface;
         const char *path;
         const char *member;
+
+        /* Whether the uid is logged in on a seat, if determined already */
+        bool console_known:1;
+        bool on_console:1;
+};
+
+/* Maximum number of verdicts to cache per policy, the cache is flushed
+ * when it is full */
+#define POLICY_VERDICT_CACHE_MAX 4096U
+
+typedef struct PolicyIndexEntry {
+        PolicyItem *item;
+        unsigned position;
+} PolicyIndexEntry;
+
+typedef struct PolicyIndexArray {
+        PolicyIndexEntry *entries;
+        unsigned n_entries;
+        size_t n_allocated;
+} PolicyIndexArray;
+
+typedef struct PolicyClassIndex {
+        /* Items not restricted to a specific name */
+        PolicyIndexArray any;
+
+        /* Name → PolicyIndexArray, for items applying to one name only */
+        Hashmap *by_name;
+} PolicyClassIndex;
+
+struct PolicyIndex {
+        PolicyClassIndex send;
+        PolicyClassIndex recv;
+};
+
+typedef struct PolicyVerdict {
+        struct policy_check_filter filter;
+        int verdict;
+} PolicyVerdict;
+
+struct PolicyVerdictCache {
+        pthread_mutex_t lock;
+        Hashmap *verdicts;
 };
 
 static int is_permissive(PolicyItem *i) {
@@ -757,7 +800,214 @@ static int check_policy_items(PolicyItem *items, const struct policy_check_filte
         return verdict;
 }
 
-static int policy_check(Policy *p, const struct policy_check_filter *filter) {
+static int policy_index_array_add(PolicyIndexArray *a, PolicyItem *i, unsigned position) {
+        assert(a);
+        assert(i);
+
+        if (!GREEDY_REALLOC(a->entries, a->n_allocated, a->n_entries + 1))
+                return -ENOMEM;
+
+        a->entries[a->n_entries++] = (PolicyIndexEntry) {
+                .item = i,
+                .position = position,
+        };
+
+        return 0;
+}
+
+static int policy_class_index_add(PolicyClassIndex *ci, PolicyItem *i, unsigned position) {
+        PolicyIndexArray *a;
+        int r;
+
+        assert(ci);
+        assert(i);
+
+        if (!i->name)
+                return policy_index_array_add(&ci->any, i, position);
+
+        r = hashmap_ensure_allocated(&ci->by_name, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        a = hashmap_get(ci->by_name, i->name);
+        if (!a) {
+                a = new0(PolicyIndexArray, 1);
+                if (!a)
+                        return -ENOMEM;
+
+                r = hashmap_put(ci->by_name, i->name, a);
+                if (r < 0) {
+                        free(a);
+                        return r;
+                }
+        }
+
+        return policy_index_array_add(a, i, position);
+}
+
+static void policy_class_index_done(PolicyClassIndex *ci) {
+        PolicyIndexArray *a;
+
+        assert(ci);
+
+        while ((a = hashmap_steal_first(ci->by_name))) {
+                free(a->entries);
+                free(a);
+        }
+
+        hashmap_free(ci->by_name);
+        free(ci->any.entries);
+}
+
+static PolicyIndex *policy_index_free(PolicyIndex *idx) {
+        if (!idx)
+                return NULL;
+
+        policy_class_index_done(&idx->send);
+        policy_class_index_done(&idx->recv);
+        free(idx);
+
+        return NULL;
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PolicyIndex*, policy_index_free);
+
+static int policy_index_new(PolicyIndex **out, PolicyItem *items) {
+        _cleanup_(policy_index_freep) PolicyIndex *idx = NULL;
+        unsigned position = 0;
+        PolicyItem *i;
+        int r;
+
+        assert(out);
+
+        idx = new0(PolicyIndex, 1);
+        if (!idx)
+                return -ENOMEM;
+
+        /* Remember the position of each item in the list, since
+         * later items override earlier ones */
+        LIST_FOREACH(items, i, items) {
+                position++;
+
+                if (i->class == POLICY_ITEM_SEND)
+                        r = policy_class_index_add(&idx->send, i, position);
+                else if (i->class == POLICY_ITEM_RECV)
+                        r = policy_class_index_add(&idx->recv, i, position);
+                else
+                        continue;
+                if (r < 0)
+                        return r;
+        }
+
+        *out = idx;
+        idx = NULL;
+        return 0;
+}
+
+static bool policy_index_has_class(PolicyIndex *idx, PolicyItemClass class) {
+        PolicyClassIndex *ci;
+
+        assert(idx);
+        assert(IN_SET(class, POLICY_ITEM_SEND, POLICY_ITEM_RECV));
+
+        ci = class == POLICY_ITEM_SEND ? &idx->send : &idx->recv;
+
+        return ci->any.n_entries > 0 || !hashmap_isempty(ci->by_name);
+}
+
+static int check_policy_index_array(PolicyIndexArray *a, const struct policy_check_filter *filter, unsigned min_position, unsigned *ret_position) {
+        unsigned j;
+
+        assert(a);
+        assert(filter);
+
+        for (j = a->n_entries; j > 0; j--) {
+                PolicyIndexEntry *e = a->entries + j - 1;
+                int v;
+
+                if (e->position < min_position)
+                        break;
+
+                v = check_policy_item(e->item, filter);
+                if (v != DUNNO) {
+                        *ret_position = e->position;
+                        return v;
+                }
+        }
+
+        return DUNNO;
+}
+
+static int check_policy_index(PolicyIndex *idx, const struct policy_check_filter *filter) {
+        PolicyClassIndex *ci;
+        unsigned position = 0;
+        int verdict = DUNNO, v;
+
+        assert(idx);
+        assert(filter);
+        assert(IN_SET(filter->class, POLICY_ITEM_SEND, POLICY_ITEM_RECV));
+
+        /* Equivalent to check_policy_items(), but only looks at the
+         * items of the right class that apply to the name. They are
+         * checked last to first, so that we can stop at the first
+         * match. */
+
+        ci = filter->class == POLICY_ITEM_SEND ? &idx->send : &idx->recv;
+
+        if (filter->name) {
+                PolicyIndexArray *a;
+
+                a = hashmap_get(ci->by_name, filter->name);
+                if (a)
+                        verdict = check_policy_index_array(a, filter, 0, &position);
+        }
+
+        /* Only items following the matching name specific item may
+         * override its verdict */
+        v = check_policy_index_array(&ci->any, filter, verdict != DUNNO ? position + 1 : 0, &position);
+        if (v != DUNNO)
+                verdict = v;
+
+        return verdict;
+}
+
+static int check_policy_list(PolicyItem *items, PolicyIndex *idx, const struct policy_check_filter *filter) {
+        assert(filter);
+
+        if (idx && IN_SET(filter->class, POLICY_ITEM_SEND, POLICY_ITEM_RECV))
+                return check_policy_index(idx, filter);
+
+        return check_policy_items(items, filter);
+}
+
+static bool policy_needs_console(Policy *p, PolicyItemClass class) {
+        assert(p);
+
+        /* Only if there are console specific items for this class,
+         * the verdict depends on whether the user is logged in on a
+         * seat. Without compiled indexes we can't tell. */
+
+        if (!p->on_console_index || !p->no_console_index)
+                return true;
+
+        if (!IN_SET(class, POLICY_ITEM_SEND, POLICY_ITEM_RECV))
+                return true;
+
+        return policy_index_has_class(p->on_console_index, class) ||
+               policy_index_has_class(p->no_console_index, class);
+}
+
+static void policy_check_console(struct policy_check_filter *filter) {
+        assert(filter);
+
+        if (filter->console_known)
+                return;
+
+        filter->on_console = filter->uid != UID_INVALID && sd_uid_get_seats(filter->uid, -1, NULL) > 0;
+        filter->console_known = true;
+}
+
+static int policy_check(Policy *p, struct policy_check_filter *filter) {
 
         PolicyItem *items;
         int verdict, v;
@@ -779,12 +1029,12 @@ static int policy_check(Policy *p, const struct policy_check_filter *filter) {
          *  Later rules override earlier rules.
          */
 
-        verdict = check_policy_items(p->default_items, filter);
+        verdict = check_policy_list(p->default_items, p->default_index, filter);
 
         if (filter->gid != GID_INVALID) {
                 items = hashmap_get(p->group_items, UINT32_TO_PTR(filter->gid));
                 if (items) {
-                        v = check_policy_items(items, filter);
+                        v = check_policy_list(items, hashmap_get(p->group_index, UINT32_TO_PTR(filter->gid)), filter);
                         if (v != DUNNO)
                                 verdict = v;
                 }
@@ -793,26 +1043,232 @@ static int policy_check(Policy *p, const struct policy_check_filter *filter) {
         if (filter->uid != UID_INVALID) {
                 items = hashmap_get(p->user_items, UINT32_TO_PTR(filter->uid));
                 if (items) {
-                        v = check_policy_items(items, filter);
+                        v = check_policy_list(items, hashmap_get(p->user_index, UINT32_TO_PTR(filter->uid)), filter);
                         if (v != DUNNO)
                                 verdict = v;
                 }
         }
 
-        if (filter->uid != UID_INVALID && sd_uid_get_seats(filter->uid, -1, NULL) > 0)
-                v = check_policy_items(p->on_console_items, filter);
-        else
-                v = check_policy_items(p->no_console_items, filter);
-        if (v != DUNNO)
-                verdict = v;
+        if (policy_needs_console(p, filter->class)) {
+                policy_check_console(filter);
 
-        v = check_policy_items(p->mandatory_items, filter);
+                if (filter->on_console)
+                        v = check_policy_list(p->on_console_items, p->on_console_index, filter);
+                else
+                        v = check_policy_list(p->no_console_items, p->no_console_index, filter);
+                if (v != DUNNO)
+                        verdict = v;
+        }
+
+        v = check_policy_list(p->mandatory_items, p->mandatory_index, filter);
         if (v != DUNNO)
                 verdict = v;
 
         return verdict;
 }
 
+static int strcmp_null(const char *a, const char *b) {
+        if (a && b)
+                return strcmp(a, b);
+
+        return (a != NULL) - (b != NULL);
+}
+
+static unsigned long policy_check_filter_hash_func(const void *a, const uint8_t hash_key[HASH_KEY_SIZE]) {
+        const struct policy_check_filter *f = a;
+        const char *strings[] = { f->name, f->interface, f->path, f->member };
+        uint32_t fixed[] = { f->class, f->uid, f->gid, f->message_type, f->console_known, f->on_console };
+        uint8_t hash_key2[HASH_KEY_SIZE];
+        unsigned long ret;
+        uint64_t u;
+        unsigned i;
+
+        siphash24((uint8_t*) &u, fixed, sizeof(fixed), hash_key);
+        ret = (unsigned long) u;
+
+        /* Use a slightly different hash key for each of the strings */
+        memcpy(hash_key2, hash_key, HASH_KEY_SIZE);
+        for (i = 0; i < ELEMENTSOF(strings); i++) {
+                hash_key2[0]++;
+
+                if (strings[i])
+                        ret ^= string_hash_func(strings[i], hash_key2);
+        }
+
+        return ret;
+}
+
+static int policy_check_filter_compare_func(const void *a, const void *b) {
+        const struct policy_check_filter *x = a, *y = b;
+        int r;
+
+        if (x->class != y->class)
+                return x->class < y->class ? -1 : 1;
+        if (x->uid != y->uid)
+                return x->uid < y->uid ? -1 : 1;
+        if (x->gid != y->gid)
+                return x->gid < y->gid ? -1 : 1;
+        if (x->message_type != y->message_type)
+                return x->message_type < y->message_type ? -1 : 1;
+        if (x->console_known != y->console_known)
+                return x->console_known < y->console_known ? -1 : 1;
+        if (x->on_console != y->on_console)
+                return x->on_console < y->on_console ? -1 : 1;
+
+        r = strcmp_null(x->name, y->name);
+        if (r != 0)
+                return r;
+
+        r = strcmp_null(x->interface, y->interface);
+        if (r != 0)
+                return r;
+
+        r = strcmp_null(x->path, y->path);
+        if (r != 0)
+                return r;
+
+        return strcmp_null(x->member, y->member);
+}
+
+static const struct hash_ops policy_check_filter_hash_ops = {
+        .hash = policy_check_filter_hash_func,
+        .compare = policy_check_filter_compare_func
+};
+
+static int policy_verdict_cache_new(PolicyVerdictCache **out) {
+        PolicyVerdictCache *c;
+        int r;
+
+        assert(out);
+
+        c = new0(PolicyVerdictCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->verdicts = hashmap_new(&policy_check_filter_hash_ops);
+        if (!c->verdicts) {
+                free(c);
+                return -ENOMEM;
+        }
+
+        r = pthread_mutex_init(&c->lock, NULL);
+        if (r > 0) {
+                hashmap_free(c->verdicts);
+                free(c);
+                return -r;
+        }
+
+        *out = c;
+        return 0;
+}
+
+static PolicyVerdictCache *policy_verdict_cache_free(PolicyVerdictCache *c) {
+        if (!c)
+                return NULL;
+
+        hashmap_free_free(c->verdicts);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+
+        return NULL;
+}
+
+static bool policy_verdict_cache_get(PolicyVerdictCache *c, const struct policy_check_filter *filter, int *verdict) {
+        PolicyVerdict *v;
+
+        assert(c);
+        assert(filter);
+        assert(verdict);
+
+        pthread_mutex_lock(&c->lock);
+
+        v = hashmap_get(c->verdicts, filter);
+        if (v)
+                *verdict = v->verdict;
+
+        pthread_mutex_unlock(&c->lock);
+
+        return !!v;
+}
+
+static void policy_verdict_cache_put(PolicyVerdictCache *c, const struct policy_check_filter *filter, int verdict) {
+        const char *strings[] = { filter->name, filter->interface, filter->path, filter->member };
+        const char **copies[ELEMENTSOF(strings)];
+        PolicyVerdict *v;
+        size_t size;
+        unsigned i;
+        char *e;
+        int r;
+
+        assert(c);
+        assert(filter);
+
+        size = sizeof(PolicyVerdict);
+        for (i = 0; i < ELEMENTSOF(strings); i++)
+                if (strings[i])
+                        size += strlen(strings[i]) + 1;
+
+        /* The cache is just an optimization, hence simply don't
+         * cache the verdict if we run out of memory */
+        v = malloc(size);
+        if (!v)
+                return;
+
+        v->filter = *filter;
+        v->verdict = verdict;
+
+        copies[0] = &v->filter.name;
+        copies[1] = &v->filter.interface;
+        copies[2] = &v->filter.path;
+        copies[3] = &v->filter.member;
+
+        e = (char*) (v + 1);
+        for (i = 0; i < ELEMENTSOF(strings); i++)
+                if (strings[i]) {
+                        *copies[i] = e;
+                        e = stpcpy(e, strings[i]) + 1;
+                }
+
+        pthread_mutex_lock(&c->lock);
+
+        if (hashmap_size(c->verdicts) >= POLICY_VERDICT_CACHE_MAX) {
+                PolicyVerdict *old;
+
+                while ((old = hashmap_steal_first(c->verdicts)))
+                        free(old);
+        }
+
+        r = hashmap_put(c->verdicts, &v->filter, v);
+
+        pthread_mutex_unlock(&c->lock);
+
+        if (r <= 0)
+                free(v);
+}
+
+static int policy_check_cached(Policy *p, struct policy_check_filter *filter) {
+        int verdict;
+
+        assert(p);
+        assert(filter);
+
+        if (!p->verdict_cache)
+                return policy_check(p, filter);
+
+        /* If the verdict depends on the console state, determine it
+         * first, so that it becomes part of the cache key */
+        if (policy_needs_console(p, filter->class))
+                policy_check_console(filter);
+
+        if (policy_verdict_cache_get(p->verdict_cache, filter, &verdict))
+                return verdict;
+
+        verdict = policy_check(p, filter);
+        policy_verdict_cache_put(p->verdict_cache, filter, verdict);
+
+        return verdict;
+}
+
 bool policy_check_own(Policy *p, uid_t uid, gid_t gid, const char *name) {
 
         struct policy_check_filter filter = {
@@ -887,7 +1343,7 @@ bool policy_check_one_recv(Policy *p,
 
         assert(p);
 
-        return policy_check(p, &filter) == ALLOW;
+        return policy_check_cached(p, &filter) == ALLOW;
 }
 
 bool policy_check_recv(Policy *p,
@@ -956,7 +1412,7 @@ bool policy_check_one_send(Policy *p,
 
         assert(p);
 
-        return policy_check(p, &filter) == ALLOW;
+        return policy_check_cached(p, &filter) == ALLOW;
 }
 
 bool policy_check_send(Policy *p,
@@ -1007,6 +1463,101 @@ bool policy_check_send(Policy *p,
         return allow;
 }
 
+static void policy_free_compiled(Policy *p) {
+        PolicyIndex *idx;
+
+        assert(p);
+
+        p->default_index = policy_index_free(p->default_index);
+        p->mandatory_index = policy_index_free(p->mandatory_index);
+        p->on_console_index = policy_index_free(p->on_console_index);
+        p->no_console_index = policy_index_free(p->no_console_index);
+
+        while ((idx = hashmap_steal_first(p->user_index)))
+                policy_index_free(idx);
+
+        while ((idx = hashmap_steal_first(p->group_index)))
+                policy_index_free(idx);
+
+        hashmap_free(p->user_index);
+        hashmap_free(p->group_index);
+        p->user_index = p->group_index = NULL;
+
+        p->verdict_cache = policy_verdict_cache_free(p->verdict_cache);
+}
+
+static int policy_compile_hashmap(Hashmap *items, Hashmap **index) {
+        PolicyItem *first;
+        Iterator i;
+        void *k;
+        int r;
+
+        assert(index);
+
+        HASHMAP_FOREACH_KEY(first, k, items, i) {
+                PolicyIndex *idx;
+
+                r = hashmap_ensure_allocated(index, NULL);
+                if (r < 0)
+                        return r;
+
+                r = policy_index_new(&idx, first);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(*index, k, idx);
+                if (r < 0) {
+                        policy_index_free(idx);
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+static int policy_compile(Policy *p) {
+        int r;
+
+        assert(p);
+
+        policy_free_compiled(p);
+
+        r = policy_index_new(&p->default_index, p->default_items);
+        if (r < 0)
+                goto fail;
+
+        r = policy_index_new(&p->mandatory_index, p->mandatory_items);
+        if (r < 0)
+                goto fail;
+
+        r = policy_index_new(&p->on_console_index, p->on_console_items);
+        if (r < 0)
+                goto fail;
+
+        r = policy_index_new(&p->no_console_index, p->no_console_items);
+        if (r < 0)
+                goto fail;
+
+        r = policy_compile_hashmap(p->user_items, &p->user_index);
+        if (r < 0)
+                goto fail;
+
+        r = policy_compile_hashmap(p->group_items, &p->group_index);
+        if (r < 0)
+                goto fail;
+
+        r = policy_verdict_cache_new(&p->verdict_cache);
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        /* Fall back to checking the item lists directly */
+        policy_free_compiled(p);
+        return r;
+}
+
 int policy_load(Policy *p, char **files) {
         char **i;
         int r;
@@ -1031,6 +1582,12 @@ int policy_load(Policy *p, char **files) {
                 /* We ignore all errors but EISDIR, and just proceed. */
         }
 
+        /* Without the indexes the item lists are checked directly,
+         * which is slower but gives the same verdicts */
+        r = policy_compile(p);
+        if (r < 0)
+                log_warning_errno(r, "Failed to compile policy, checking it uncompiled: %m");
+
         return 0;
 }
 
@@ -1040,6 +1597,8 @@ void policy_free(Policy *p) {
         if (!p)
                 return;
 
+        policy_free_compiled(p);
+
         while ((i = p->default_items)) {
                 LIST_REMOVE(items, p->default_items, i);
                 policy_item_free(i);
@@ -66,6 +66,9 @@ struct PolicyItem {
         LIST_FIELDS(PolicyItem, items);
 };
 
+typedef struct PolicyIndex PolicyIndex;
+typedef struct PolicyVerdictCache PolicyVerdictCache;
+
 typedef struct Policy {
         LIST_HEAD(PolicyItem, default_items);
         LIST_HEAD(PolicyItem, mandatory_items);
@@ -73,6 +76,20 @@ typedef struct Policy {
         LIST_HEAD(PolicyItem, no_console_items);
         Hashmap *user_items;
         Hashmap *group_items;
+
+        /* Send and receive items of the lists above, indexed by
+         * name, as compiled by policy_load() */
+        PolicyIndex *default_index;
+        PolicyIndex *mandatory_index;
+        PolicyIndex *on_console_index;
+        PolicyIndex *no_console_index;
+        Hashmap *user_index;
+        Hashmap *group_index;
+
+        /* Verdicts of previous send and receive checks. This goes
+         * away together with the policy, hence a reload starts out
+         * with an empty cache. */
+        PolicyVerdictCache *verdict_cache;
 } Policy;
 
 typedef struct SharedPolicy {
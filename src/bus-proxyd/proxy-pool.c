@@ -0,0 +1,303 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/prctl.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "util.h"
+#include "set.h"
+#include "strv.h"
+#include "sd-event.h"
+#include "proxy.h"
+#include "proxy-pool.h"
+
+typedef struct ProxyWorker {
+        ProxyPool *pool;
+        unsigned index;
+
+        pthread_t thread;
+        bool thread_started;
+
+        /* New client connections are handed to the worker by
+         * writing their fd to this pipe, -1 asks the worker to
+         * exit. */
+        int pipe_fds[2];
+
+        sd_event *event;
+        sd_event_source *pipe_source;
+
+        Set *proxies;
+} ProxyWorker;
+
+struct ProxyPool {
+        char *address;
+        char **configuration;
+        SharedPolicy *policy;
+        uid_t bus_uid;
+
+        ProxyWorker *workers;
+        unsigned n_workers;
+        unsigned next_worker;
+};
+
+static void worker_proxy_exit(Proxy *p, int error, void *userdata) {
+        ProxyWorker *w = userdata;
+
+        assert(p);
+        assert(w);
+
+        set_remove(w->proxies, p);
+        proxy_free(p);
+}
+
+static void worker_add_client(ProxyWorker *w, int fd) {
+        _cleanup_(proxy_freep) Proxy *p = NULL;
+        int r;
+
+        assert(w);
+        assert(fd >= 0);
+
+        /* Note that this still blocks the worker while the
+         * connection to the destination bus is authenticated. */
+        r = proxy_new(&p, fd, fd, w->pool->address);
+        if (r < 0) {
+                safe_close(fd);
+                return;
+        }
+
+        r = proxy_set_policy(p, w->pool->policy, w->pool->configuration);
+        if (r < 0)
+                return;
+
+        r = proxy_hello_policy(p, w->pool->bus_uid);
+        if (r < 0)
+                return;
+
+        r = set_put(w->proxies, p);
+        if (r < 0) {
+                log_oom();
+                return;
+        }
+
+        r = proxy_attach_event(p, w->event, worker_proxy_exit, w);
+        if (r < 0) {
+                log_error_errno(r, "Failed to attach proxy to event loop: %m");
+                set_remove(w->proxies, p);
+                return;
+        }
+
+        p = NULL;
+}
+
+static int worker_pipe_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        ProxyWorker *w = userdata;
+        int fds[64];
+        ssize_t n;
+        size_t i;
+
+        assert(w);
+
+        for (;;) {
+                n = read(fd, fds, sizeof(fds));
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                return 0;
+
+                        log_error_errno(errno, "Failed to read from worker pipe: %m");
+                        return sd_event_exit(w->event, -errno);
+                }
+                if (n == 0)
+                        return sd_event_exit(w->event, 0);
+
+                assert(n % sizeof(int) == 0);
+
+                for (i = 0; i < n / sizeof(int); i++) {
+                        if (fds[i] < 0)
+                                return sd_event_exit(w->event, 0);
+
+                        worker_add_client(w, fds[i]);
+                }
+        }
+}
+
+static void *worker_run(void *userdata) {
+        ProxyWorker *w = userdata;
+        char comm[16];
+        Proxy *p;
+        int r;
+
+        assert(w);
+
+        snprintf(comm, sizeof(comm), "proxy-worker%u", w->index);
+        (void) prctl(PR_SET_NAME, comm);
+
+        r = sd_event_loop(w->event);
+        if (r < 0)
+                log_error_errno(r, "Proxy worker event loop failed: %m");
+
+        while ((p = set_steal_first(w->proxies)))
+                proxy_free(p);
+
+        return NULL;
+}
+
+static int worker_init(ProxyWorker *w, ProxyPool *pool, unsigned index) {
+        int r;
+
+        assert(w);
+        assert(pool);
+
+        w->pool = pool;
+        w->index = index;
+        w->pipe_fds[0] = w->pipe_fds[1] = -1;
+
+        w->proxies = set_new(NULL);
+        if (!w->proxies)
+                return log_oom();
+
+        if (pipe2(w->pipe_fds, O_CLOEXEC) < 0)
+                return log_error_errno(errno, "Failed to create worker pipe: %m");
+
+        r = fd_nonblock(w->pipe_fds[0], true);
+        if (r < 0)
+                return log_error_errno(r, "Failed to make worker pipe non-blocking: %m");
+
+        r = sd_event_new(&w->event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        r = sd_event_add_io(w->event, &w->pipe_source, w->pipe_fds[0], EPOLLIN, worker_pipe_handler, w);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch worker pipe: %m");
+
+        r = pthread_create(&w->thread, NULL, worker_run, w);
+        if (r > 0)
+                return log_error_errno(r, "Cannot spawn worker thread: %m");
+
+        w->thread_started = true;
+        return 0;
+}
+
+static void worker_done(ProxyWorker *w) {
+        assert(w);
+
+        if (w->thread_started) {
+                int fd = -1;
+
+                if (write(w->pipe_fds[1], &fd, sizeof(fd)) != sizeof(fd))
+                        log_error_errno(errno, "Failed to stop proxy worker: %m");
+                else
+                        (void) pthread_join(w->thread, NULL);
+        }
+
+        w->pipe_source = sd_event_source_unref(w->pipe_source);
+        w->event = sd_event_unref(w->event);
+        safe_close_pair(w->pipe_fds);
+        set_free(w->proxies);
+}
+
+int proxy_pool_new(ProxyPool **out, unsigned n_workers, const char *address, SharedPolicy *policy, char **configuration, uid_t bus_uid) {
+        _cleanup_(proxy_pool_freep) ProxyPool *pool = NULL;
+        unsigned i;
+        int r;
+
+        assert(out);
+        assert(n_workers > 0);
+        assert(address);
+        assert(policy);
+
+        pool = new0(ProxyPool, 1);
+        if (!pool)
+                return log_oom();
+
+        pool->policy = policy;
+        pool->bus_uid = bus_uid;
+
+        pool->address = strdup(address);
+        if (!pool->address)
+                return log_oom();
+
+        if (configuration) {
+                pool->configuration = strv_copy(configuration);
+                if (!pool->configuration)
+                        return log_oom();
+        }
+
+        pool->workers = new0(ProxyWorker, n_workers);
+        if (!pool->workers)
+                return log_oom();
+
+        for (i = 0; i < n_workers; i++) {
+                r = worker_init(pool->workers + i, pool, i);
+                pool->n_workers++;
+                if (r < 0)
+                        return r;
+        }
+
+        *out = pool;
+        pool = NULL;
+        return 0;
+}
+
+ProxyPool *proxy_pool_free(ProxyPool *pool) {
+        unsigned i;
+
+        if (!pool)
+                return NULL;
+
+        for (i = 0; i < pool->n_workers; i++)
+                worker_done(pool->workers + i);
+
+        free(pool->workers);
+        strv_free(pool->configuration);
+        free(pool->address);
+        free(pool);
+
+        return NULL;
+}
+
+int proxy_pool_add(ProxyPool *pool, int fd) {
+        ProxyWorker *w;
+        ssize_t n;
+
+        assert(pool);
+        assert(fd >= 0);
+
+        /* Hand out connections round-robin. On success the worker
+         * takes possession of the fd. */
+        w = pool->workers + pool->next_worker;
+        pool->next_worker = (pool->next_worker + 1) % pool->n_workers;
+
+        do
+                n = write(w->pipe_fds[1], &fd, sizeof(fd));
+        while (n < 0 && errno == EINTR);
+
+        if (n < 0)
+                return log_error_errno(errno, "Failed to pass connection to proxy worker: %m");
+        if (n != sizeof(fd))
+                return log_error_errno(EIO, "Short write to proxy worker pipe.");
+
+        return 0;
+}
@@ -0,0 +1,34 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "macro.h"
+#include "bus-xml-policy.h"
+
+/* A fixed set of worker threads, each running an event loop that
+ * multiplexes any number of proxy connections. */
+typedef struct ProxyPool ProxyPool;
+
+int proxy_pool_new(ProxyPool **out, unsigned n_workers, const char *address, SharedPolicy *policy, char **configuration, uid_t bus_uid);
+ProxyPool *proxy_pool_free(ProxyPool *pool);
+
+int proxy_pool_add(ProxyPool *pool, int fd);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ProxyPool*, proxy_pool_free);
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/epoll.h>
 
 #include "log.h"
 #include "util.h"
@@ -237,6 +238,7 @@ Proxy *proxy_free(Proxy *p) {
         if (!p)
                 return NULL;
 
+        proxy_detach_event(p);
         sd_bus_close_unrefp(&p->local_bus);
         sd_bus_close_unrefp(&p->destination_bus);
         set_free_free(p->owned_names);
@@ -813,42 +815,251 @@ static int proxy_process_local_to_destination(Proxy *p) {
         return 1;
 }
 
+static int proxy_process(Proxy *p) {
+        bool busy = false;
+        int r;
+
+        assert(p);
+
+        if (p->got_hello) {
+                /* Read messages from bus, to pass them on to our client */
+                r = proxy_process_destination_to_local(p);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        busy = true;
+        }
+
+        /* Read messages from our client, to pass them on to the bus */
+        r = proxy_process_local_to_destination(p);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                busy = true;
+
+        return busy;
+}
+
 int proxy_run(Proxy *p) {
         int r;
 
         assert(p);
 
         for (;;) {
-                bool busy = false;
+                r = proxy_process(p);
+                if (r == -ECONNRESET || r == -ENOTCONN)
+                        return 0;
+                if (r < 0)
+                        return r;
 
-                if (p->got_hello) {
-                        /* Read messages from bus, to pass them on to our client */
-                        r = proxy_process_destination_to_local(p);
+                if (r == 0) {
+                        r = proxy_wait(p);
                         if (r == -ECONNRESET || r == -ENOTCONN)
                                 return 0;
                         if (r < 0)
                                 return r;
-                        if (r > 0)
-                                busy = true;
                 }
+        }
+
+        return 0;
+}
+
+static int proxy_update_events(Proxy *p) {
+        uint64_t timeout_destination, timeout_local, t, old;
+        int events_destination, events_local, r;
+
+        assert(p);
+
+        events_destination = sd_bus_get_events(p->destination_bus);
+        if (events_destination < 0)
+                return events_destination;
+
+        r = sd_bus_get_timeout(p->destination_bus, &timeout_destination);
+        if (r < 0)
+                return r;
+
+        events_local = sd_bus_get_events(p->local_bus);
+        if (events_local < 0)
+                return events_local;
+
+        r = sd_bus_get_timeout(p->local_bus, &timeout_local);
+        if (r < 0)
+                return r;
+
+        /* Watch the fds edge-triggered: with many connections ready
+         * at the same time, level-triggered fds would be reported
+         * again on every event loop iteration until they are
+         * dispatched. Updating edge-triggered sources always re-arms
+         * them, hence we don't miss data left unprocessed. */
+
+        r = sd_event_source_set_io_events(p->destination_source, events_destination | EPOLLET);
+        if (r < 0)
+                return r;
+
+        if (p->local_out_source) {
+                r = sd_event_source_set_io_events(p->local_in_source, (events_local & POLLIN) | EPOLLET);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_io_events(p->local_out_source, (events_local & POLLOUT) | EPOLLET);
+                if (r < 0)
+                        return r;
+        } else {
+                r = sd_event_source_set_io_events(p->local_in_source, events_local | EPOLLET);
+                if (r < 0)
+                        return r;
+        }
+
+        t = timeout_destination;
+        if (t == (uint64_t) -1 || (timeout_local != (uint64_t) -1 && timeout_local < timeout_destination))
+                t = timeout_local;
+
+        if (t == (uint64_t) -1)
+                return sd_event_source_set_enabled(p->time_source, SD_EVENT_OFF);
+
+        r = sd_event_source_get_time(p->time_source, &old);
+        if (r < 0)
+                return r;
+
+        if (old != t) {
+                r = sd_event_source_set_time(p->time_source, t);
+                if (r < 0)
+                        return r;
+        }
 
-                /* Read messages from our client, to pass them on to the bus */
-                r = proxy_process_local_to_destination(p);
+        return sd_event_source_set_enabled(p->time_source, SD_EVENT_ONESHOT);
+}
+
+static int proxy_dispatch(Proxy *p) {
+        unsigned i;
+        int r;
+
+        assert(p);
+
+        /* Process a bounded number of messages, so that a single busy
+         * client cannot starve the other proxies sharing the event
+         * loop. If there's more to do, continue on the next
+         * iteration. */
+
+        for (i = 0; i < PROXY_DISPATCH_MAX; i++) {
+                r = proxy_process(p);
                 if (r == -ECONNRESET || r == -ENOTCONN)
                         return 0;
                 if (r < 0)
                         return r;
-                if (r > 0)
-                        busy = true;
+                if (r == 0)
+                        break;
+        }
 
-                if (!busy) {
-                        r = proxy_wait(p);
-                        if (r == -ECONNRESET || r == -ENOTCONN)
-                                return 0;
-                        if (r < 0)
-                                return r;
-                }
+        r = sd_event_source_set_enabled(p->defer_source, i >= PROXY_DISPATCH_MAX ? SD_EVENT_ONESHOT : SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        r = proxy_update_events(p);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int proxy_handle_event(Proxy *p) {
+        int r;
+
+        assert(p);
+
+        r = proxy_dispatch(p);
+        if (r <= 0) {
+                if (r < 0)
+                        log_debug_errno(r, "Failed to process proxy connection: %m");
+
+                /* Detach right-away, so that no further events are
+                 * dispatched for this proxy, even if the callback
+                 * doesn't free it immediately. */
+                proxy_detach_event(p);
+
+                if (p->exit_callback)
+                        p->exit_callback(p, r, p->exit_userdata);
         }
 
         return 0;
 }
+
+static int io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        return proxy_handle_event(userdata);
+}
+
+static int time_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        return proxy_handle_event(userdata);
+}
+
+static int defer_handler(sd_event_source *s, void *userdata) {
+        return proxy_handle_event(userdata);
+}
+
+int proxy_attach_event(Proxy *p, sd_event *e, proxy_exit_t callback, void *userdata) {
+        int fd, r;
+
+        assert(p);
+        assert(e);
+        assert(!p->event);
+
+        p->event = sd_event_ref(e);
+        p->exit_callback = callback;
+        p->exit_userdata = userdata;
+
+        fd = sd_bus_get_fd(p->destination_bus);
+        if (fd < 0) {
+                r = fd;
+                goto fail;
+        }
+
+        r = sd_event_add_io(e, &p->destination_source, fd, 0, io_handler, p);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_add_io(e, &p->local_in_source, p->local_in, 0, io_handler, p);
+        if (r < 0)
+                goto fail;
+
+        if (p->local_in != p->local_out) {
+                r = sd_event_add_io(e, &p->local_out_source, p->local_out, 0, io_handler, p);
+                if (r < 0)
+                        goto fail;
+        }
+
+        r = sd_event_add_time(e, &p->time_source, CLOCK_MONOTONIC, 0, 0, time_handler, p);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_add_defer(e, &p->defer_source, defer_handler, p);
+        if (r < 0)
+                goto fail;
+
+        /* There might be data already queued from the initial
+         * handshake, hence process right-away on the first
+         * iteration. */
+        r = sd_event_source_set_enabled(p->defer_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                goto fail;
+
+        r = proxy_update_events(p);
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        proxy_detach_event(p);
+        return r;
+}
+
+void proxy_detach_event(Proxy *p) {
+        assert(p);
+
+        p->destination_source = sd_event_source_unref(p->destination_source);
+        p->local_in_source = sd_event_source_unref(p->local_in_source);
+        p->local_out_source = sd_event_source_unref(p->local_out_source);
+        p->time_source = sd_event_source_unref(p->time_source);
+        p->defer_source = sd_event_source_unref(p->defer_source);
+        p->event = sd_event_unref(p->event);
+}
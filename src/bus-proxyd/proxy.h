@@ -22,10 +22,17 @@
 ***/
 
 #include "sd-bus.h"
+#include "sd-event.h"
 #include "bus-xml-policy.h"
 
+/* Maximum number of messages to forward per event loop iteration and
+ * connection, when multiple proxies share one event loop */
+#define PROXY_DISPATCH_MAX 64U
+
 typedef struct Proxy Proxy;
 
+typedef void (*proxy_exit_t)(Proxy *p, int error, void *userdata);
+
 struct Proxy {
         sd_bus *local_bus;
         struct ucred local_creds;
@@ -37,6 +44,15 @@ struct Proxy {
         Set *owned_names;
         SharedPolicy *policy;
 
+        sd_event *event;
+        sd_event_source *destination_source;
+        sd_event_source *local_in_source;
+        sd_event_source *local_out_source;
+        sd_event_source *time_source;
+        sd_event_source *defer_source;
+        proxy_exit_t exit_callback;
+        void *exit_userdata;
+
         bool got_hello : 1;
         bool queue_overflow : 1;
 };
@@ -48,4 +64,7 @@ int proxy_set_policy(Proxy *p, SharedPolicy *policy, char **configuration);
 int proxy_hello_policy(Proxy *p, uid_t original_uid);
 int proxy_run(Proxy *p);
 
+int proxy_attach_event(Proxy *p, sd_event *e, proxy_exit_t callback, void *userdata);
+void proxy_detach_event(Proxy *p);
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(Proxy*, proxy_free);
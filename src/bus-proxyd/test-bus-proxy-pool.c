@@ -0,0 +1,353 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <fcntl.h>
+
+#include "log.h"
+#include "util.h"
+#include "macro.h"
+#include "set.h"
+#include "fileio.h"
+#include "socket-util.h"
+#include "time-util.h"
+
+#include "sd-bus.h"
+#include "sd-event.h"
+#include "event-util.h"
+#include "bus-util.h"
+#include "bus-xml-policy.h"
+#include "proxy-pool.h"
+
+/* Connects many clients through a small pool of proxy worker threads
+ * to a bus peer, and reports memory use and method call latency. Run
+ * as "test-bus-proxy-pool 5000" to see how that scales. */
+
+static unsigned arg_n_clients = 50;
+static unsigned arg_n_threads = 4;
+static unsigned arg_n_rounds = 10;
+
+typedef struct Server {
+        int listen_fd;
+        int quit_fds[2];
+        sd_event *event;
+        Set *buses;
+        unsigned n_hello;
+} Server;
+
+typedef struct Client {
+        sd_bus *bus;
+        sd_event_source *io;
+        usec_t sent;
+} Client;
+
+static unsigned n_replies = 0;
+static usec_t latency_min = USEC_INFINITY, latency_max = 0, latency_sum = 0;
+
+static int method_hello(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Server *s = userdata;
+        char name[DECIMAL_STR_MAX(unsigned) + 4];
+
+        xsprintf(name, ":1.%u", ++s->n_hello);
+
+        return sd_bus_reply_method_return(m, "s", name);
+}
+
+static int method_ping(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable driver_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Hello", NULL, "s", method_hello, 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable test_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Ping", NULL, NULL, method_ping, 0),
+        SD_BUS_VTABLE_END
+};
+
+static int peer_io(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        sd_bus *bus = userdata;
+        int r;
+
+        /* sd_bus_attach_event() updates all buses on each event loop
+         * iteration, which doesn't scale to thousands of them, hence
+         * only update the bus that actually got woken up, and watch
+         * it edge-triggered, like the proxy does. */
+
+        do
+                r = sd_bus_process(bus, NULL);
+        while (r > 0);
+
+        if (r == -ECONNRESET || r == -ENOTCONN)
+                return sd_event_source_set_enabled(es, SD_EVENT_OFF);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_events(bus);
+        assert_se(r >= 0);
+
+        return sd_event_source_set_io_events(es, r | EPOLLET);
+}
+
+static int peer_attach(sd_bus *bus, sd_event *e, sd_event_source **ret) {
+        return sd_event_add_io(e, ret, sd_bus_get_fd(bus), sd_bus_get_events(bus) | EPOLLET, peer_io, bus);
+}
+
+static int server_accept(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        for (;;) {
+                _cleanup_bus_unref_ sd_bus *bus = NULL;
+                sd_id128_t id;
+                int nfd;
+
+                nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+                if (nfd < 0) {
+                        assert_se(errno == EAGAIN || errno == EINTR);
+                        return 0;
+                }
+
+                assert_se(sd_id128_randomize(&id) >= 0);
+
+                assert_se(sd_bus_new(&bus) >= 0);
+                assert_se(sd_bus_set_fd(bus, nfd, nfd) >= 0);
+                assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+                assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+                assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/DBus", "org.freedesktop.DBus", driver_vtable, s) >= 0);
+                assert_se(sd_bus_add_object_vtable(bus, NULL, "/", "org.freedesktop.systemd.test", test_vtable, s) >= 0);
+                assert_se(sd_bus_start(bus) >= 0);
+                assert_se(peer_attach(bus, s->event, NULL) >= 0);
+
+                assert_se(set_put(s->buses, bus) >= 0);
+                bus = NULL;
+        }
+}
+
+static int server_quit(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        return sd_event_exit(s->event, 0);
+}
+
+static void *server_thread(void *userdata) {
+        Server *s = userdata;
+
+        assert_se(sd_event_loop(s->event) >= 0);
+
+        return NULL;
+}
+
+static int reply_handler(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        Client *c = userdata;
+        usec_t t;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+
+        t = now(CLOCK_MONOTONIC) - c->sent;
+        latency_min = MIN(latency_min, t);
+        latency_max = MAX(latency_max, t);
+        latency_sum += t;
+
+        n_replies++;
+        return 1;
+}
+
+static void ping_all(sd_event *e, Client *clients, unsigned n) {
+        unsigned i;
+
+        n_replies = 0;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+
+                assert_se(sd_bus_message_new_method_call(clients[i].bus, &m, NULL, "/", "org.freedesktop.systemd.test", "Ping") >= 0);
+
+                clients[i].sent = now(CLOCK_MONOTONIC);
+                assert_se(sd_bus_call_async(clients[i].bus, NULL, m, reply_handler, clients + i, 0) >= 0);
+        }
+
+        while (n_replies < n)
+                assert_se(sd_event_run(e, USEC_INFINITY) >= 0);
+}
+
+static unsigned long get_rss_kb(void) {
+        _cleanup_free_ char *v = NULL;
+        unsigned long kb;
+
+        assert_se(get_status_field("/proc/self/status", "\nVmRSS:", &v) >= 0);
+        assert_se(sscanf(v, "%lu", &kb) == 1);
+
+        return kb;
+}
+
+static unsigned get_max_clients(void) {
+        struct rlimit rl;
+
+        assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
+
+        rl.rlim_cur = rl.rlim_max;
+        (void) setrlimit(RLIMIT_NOFILE, &rl);
+        assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
+
+        /* Each client needs a socket pair, plus the proxy's and
+         * the server's end of the destination connection */
+        if (rl.rlim_cur < 200)
+                return 0;
+
+        return (rl.rlim_cur - 100) / 4;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(shared_policy_freep) SharedPolicy *sp = NULL;
+        _cleanup_event_unref_ sd_event *e = NULL;
+        _cleanup_free_ Client *clients = NULL;
+        _cleanup_free_ char *address = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        ProxyPool *pool = NULL;
+        unsigned long rss;
+        sd_bus *bus;
+        Server s = {};
+        pthread_t server;
+        unsigned i, max;
+        usec_t t;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_clients) >= 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_n_threads) >= 0);
+        if (argc > 3)
+                assert_se(safe_atou(argv[3], &arg_n_rounds) >= 0);
+
+        max = get_max_clients();
+        if (max == 0)
+                return EXIT_TEST_SKIP;
+        if (arg_n_clients > max) {
+                log_info("Limiting to %u clients due to RLIMIT_NOFILE.", max);
+                arg_n_clients = max;
+        }
+
+        /* Set up the bus peer the proxies connect to */
+        s.listen_fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        assert_se(s.listen_fd >= 0);
+        snprintf(sa.un.sun_path + 1, sizeof(sa.un.sun_path) - 1, "test-bus-proxy-pool/%" PRIu64, random_u64());
+        assert_se(bind(s.listen_fd, &sa.sa, offsetof(struct sockaddr_un, sun_path) + 1 + strlen(sa.un.sun_path + 1)) >= 0);
+        assert_se(listen(s.listen_fd, SOMAXCONN) >= 0);
+        assert_se(asprintf(&address, "unix:abstract=%s", sa.un.sun_path + 1) >= 0);
+
+        assert_se(pipe2(s.quit_fds, O_CLOEXEC) >= 0);
+        assert_se(s.buses = set_new(NULL));
+        assert_se(sd_event_new(&s.event) >= 0);
+        assert_se(sd_event_add_io(s.event, NULL, s.listen_fd, EPOLLIN, server_accept, &s) >= 0);
+        assert_se(sd_event_add_io(s.event, NULL, s.quit_fds[0], EPOLLIN, server_quit, &s) >= 0);
+        assert_se(pthread_create(&server, NULL, server_thread, &s) == 0);
+
+        rss = get_rss_kb();
+
+        assert_se(shared_policy_new(&sp) >= 0);
+        assert_se(proxy_pool_new(&pool, arg_n_threads, address, sp, NULL, getuid()) >= 0);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(clients = new0(Client, arg_n_clients));
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_clients; i++) {
+                int fds[2];
+
+                assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0, fds) >= 0);
+                assert_se(proxy_pool_add(pool, fds[0]) >= 0);
+
+                assert_se(sd_bus_new(&clients[i].bus) >= 0);
+                assert_se(sd_bus_set_fd(clients[i].bus, fds[1], fds[1]) >= 0);
+                assert_se(sd_bus_set_bus_client(clients[i].bus, true) >= 0);
+                assert_se(sd_bus_set_anonymous(clients[i].bus, true) >= 0);
+                assert_se(sd_bus_start(clients[i].bus) >= 0);
+                assert_se(peer_attach(clients[i].bus, e, &clients[i].io) >= 0);
+        }
+
+        /* The first round also waits for the connections to be
+         * set up, and Hello() to complete */
+        ping_all(e, clients, arg_n_clients);
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Connected %u clients through %u proxy threads in %s, RSS grew by %lu KiB (%lu bytes per client, including both peers).",
+                 arg_n_clients, arg_n_threads,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 get_rss_kb() - rss,
+                 (get_rss_kb() - rss) * 1024UL / arg_n_clients);
+
+        latency_min = USEC_INFINITY;
+        latency_max = latency_sum = 0;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_rounds; i++)
+                ping_all(e, clients, arg_n_clients);
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u rounds of %u concurrent calls in %s (%g calls/s).",
+                 arg_n_rounds, arg_n_clients,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) arg_n_rounds * arg_n_clients * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        if (arg_n_rounds > 0) {
+                log_info("Call latency min %s.", format_timespan(ts, sizeof(ts), latency_min, 1));
+                log_info("Call latency avg %s.", format_timespan(ts, sizeof(ts), latency_sum / ((usec_t) arg_n_rounds * arg_n_clients), 1));
+                log_info("Call latency max %s.", format_timespan(ts, sizeof(ts), latency_max, 1));
+        }
+
+        for (i = 0; i < arg_n_clients; i++) {
+                sd_event_source_unref(clients[i].io);
+                sd_bus_close_unrefp(&clients[i].bus);
+        }
+
+        proxy_pool_free(pool);
+
+        assert_se(write(s.quit_fds[1], "x", 1) == 1);
+        assert_se(pthread_join(server, NULL) == 0);
+
+        assert_se(s.n_hello == arg_n_clients);
+
+        /* This also frees the server's io event sources */
+        sd_event_unref(s.event);
+
+        while ((bus = set_steal_first(s.buses)))
+                sd_bus_close_unrefp(&bus);
+
+        set_free(s.buses);
+        safe_close_pair(s.quit_fds);
+        safe_close(s.listen_fd);
+
+        return 0;
+}
@@ -27,6 +27,7 @@
 #include "util.h"
 #include "sd-bus.h"
 #include "strv.h"
+#include "time-util.h"
 #include "bus-xml-policy.h"
 
 static int test_policy_load(Policy *p, const char *name) {
@@ -60,6 +61,104 @@ static int show_policy(const char *fn) {
         return 0;
 }
 
+static void test_policy_benchmark(unsigned n_services, unsigned n_checks) {
+        char fn[] = "/tmp/test-bus-xml-policy.XXXXXX";
+        char ts[FORMAT_TIMESPAN_MAX];
+        _cleanup_fclose_ FILE *f = NULL;
+        Policy p = {};
+        unsigned i;
+        usec_t t;
+        int fd;
+
+        /* Generate a policy with a few rules for each of a large
+         * number of services, and check the permissions of
+         * messages to and from a subset of them. */
+
+        fd = mkostemp_safe(fn, O_RDWR|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(f = fdopen(fd, "w"));
+
+        fputs("<busconfig>\n"
+              "  <policy context=\"default\">\n"
+              "    <deny send_type=\"method_call\"/>\n"
+              "    <allow send_type=\"signal\"/>\n", f);
+
+        for (i = 0; i < n_services; i++)
+                fprintf(f,
+                        "    <deny send_destination=\"org.test.service%1$u\"/>\n"
+                        "    <allow send_destination=\"org.test.service%1$u\" send_interface=\"org.test.service%1$u.Manager\"/>\n"
+                        "    <deny send_destination=\"org.test.service%1$u\" send_interface=\"org.test.service%1$u.Manager\" send_member=\"Reboot\"/>\n"
+                        "    <allow receive_sender=\"org.test.service%1$u\"/>\n",
+                        i);
+
+        fputs("  </policy>\n"
+              "  <policy user=\"root\">\n"
+              "    <allow send_destination=\"org.test.service0\"/>\n"
+              "  </policy>\n"
+              "  <policy context=\"mandatory\">\n"
+              "    <deny send_interface=\"org.test.Forbidden\"/>\n"
+              "  </policy>\n"
+              "</busconfig>\n", f);
+
+        assert_se(fflush(f) == 0);
+        assert_se(policy_load(&p, STRV_MAKE(fn)) >= 0);
+        unlink(fn);
+
+        assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_METHOD_CALL, "org.test.service1", "/", "org.test.service1.Manager", "Ping") == true);
+        assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_METHOD_CALL, "org.test.service1", "/", "org.test.service1.Manager", "Reboot") == false);
+        assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_METHOD_CALL, "org.test.service1", "/", "org.test.service2.Manager", "Ping") == false);
+        assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_METHOD_CALL, "org.test.service0", "/", "org.test.Other", "Ping") == false);
+        assert_se(policy_check_one_send(&p, 0, 0, SD_BUS_MESSAGE_METHOD_CALL, "org.test.service0", "/", "org.test.Other", "Ping") == true);
+        assert_se(policy_check_one_send(&p, 0, 0, SD_BUS_MESSAGE_METHOD_CALL, "org.test.service0", "/", "org.test.Forbidden", "Ping") == false);
+        assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_SIGNAL, NULL, "/", "org.test.Signal", "Changed") == true);
+        assert_se(policy_check_one_recv(&p, 1000, 1000, SD_BUS_MESSAGE_SIGNAL, "org.test.service1", "/", "org.test.Signal", "Changed") == true);
+        assert_se(policy_check_one_recv(&p, 1000, 1000, SD_BUS_MESSAGE_SIGNAL, "org.test.unknown", "/", "org.test.Signal", "Changed") == false);
+
+        /* Each message checked for the first time, with a distinct
+         * member name each */
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_checks; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 17], interface[DECIMAL_STR_MAX(unsigned) + 25], member[DECIMAL_STR_MAX(unsigned) + 7];
+                unsigned k = i % 64;
+
+                xsprintf(name, "org.test.service%u", k);
+                xsprintf(interface, "org.test.service%u.Manager", k);
+                xsprintf(member, "Method%u", i);
+
+                assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_METHOD_CALL, name, "/", interface, member) == true);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u distinct send checks against %u rules in %s (%g checks/s).",
+                 n_checks, 4 * n_services + 4,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) n_checks * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        /* The same messages checked over and over again */
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_checks; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 17], interface[DECIMAL_STR_MAX(unsigned) + 25];
+                unsigned k = i % 64;
+
+                xsprintf(name, "org.test.service%u", k);
+                xsprintf(interface, "org.test.service%u.Manager", k);
+
+                assert_se(policy_check_one_send(&p, 1000, 1000, SD_BUS_MESSAGE_METHOD_CALL, name, "/", interface, "Ping") == true);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u repeated send checks against %u rules in %s (%g checks/s).",
+                 n_checks, 4 * n_services + 4,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) n_checks * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        policy_free(&p);
+}
+
 int main(int argc, char *argv[]) {
 
         Policy p = {};
@@ -165,5 +264,7 @@ int main(int argc, char *argv[]) {
 
         policy_free(&p);
 
+        test_policy_benchmark(1000, argc > 1 ? (unsigned) atoi(argv[1]) : 200000);
+
         return EXIT_SUCCESS;
 }
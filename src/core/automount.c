@@ -94,6 +94,7 @@ static void unmount_autofs(Automount *a) {
          * around */
         if (a->where &&
             (UNIT(a)->manager->exit_code != MANAGER_RELOAD &&
+             UNIT(a)->manager->exit_code != MANAGER_RELOAD_INCREMENTAL &&
              UNIT(a)->manager->exit_code != MANAGER_REEXECUTE))
                 repeat_unmount(a->where);
 }
@@ -24,6 +24,7 @@
 
 #include "path-util.h"
 #include "special.h"
+#include "strv.h"
 #include "cgroup-util.h"
 #include "cgroup.h"
 
@@ -174,6 +175,143 @@ static int lookup_blkio_device(const char *p, dev_t *dev) {
         return 0;
 }
 
+/* We remember what we last wrote to the attributes of each cgroup, so
+ * that realizing a unit again, for example because one of its
+ * siblings was started, or after a daemon-reload, doesn't write the
+ * same values again. Attributes that are written in several steps,
+ * like the device whitelist, are remembered by the configuration they
+ * were written from. The entries of a cgroup are dropped when we
+ * remove it or find it newly created. */
+
+static const char *cgroup_attributes_key(const char *path) {
+        return isempty(path) ? "/" : path;
+}
+
+static char **cgroup_attribute_find(char **l, const char *attribute) {
+        char **i;
+
+        STRV_FOREACH(i, l) {
+                const char *e;
+
+                e = startswith(*i, attribute);
+                if (e && *e == '=')
+                        return i;
+        }
+
+        return NULL;
+}
+
+static bool cgroup_attribute_is_cached(Manager *m, const char *path, const char *attribute, const char *value) {
+        char **i;
+
+        i = cgroup_attribute_find(hashmap_get(m->cgroup_attributes, cgroup_attributes_key(path)), attribute);
+        if (!i)
+                return false;
+
+        return streq(*i + strlen(attribute) + 1, value);
+}
+
+static void cgroup_attribute_remember(Manager *m, const char *path, const char *attribute, const char *value) {
+        char **l, **i, *k, *s;
+        int r;
+
+        /* If we fail here we'll simply write the value again the
+         * next time */
+
+        s = strjoin(attribute, "=", value, NULL);
+        if (!s) {
+                log_oom();
+                return;
+        }
+
+        path = cgroup_attributes_key(path);
+        l = hashmap_get2(m->cgroup_attributes, path, (void**) &k);
+
+        i = cgroup_attribute_find(l, attribute);
+        if (i) {
+                free(*i);
+                *i = s;
+                return;
+        }
+
+        if (l) {
+                r = strv_consume(&l, s);
+                if (r < 0) {
+                        log_oom();
+                        return;
+                }
+
+                assert_se(hashmap_update(m->cgroup_attributes, k, l) >= 0);
+                return;
+        }
+
+        r = hashmap_ensure_allocated(&m->cgroup_attributes, &string_hash_ops);
+        if (r < 0) {
+                free(s);
+                log_oom();
+                return;
+        }
+
+        k = strdup(path);
+        if (!k) {
+                free(s);
+                log_oom();
+                return;
+        }
+
+        r = strv_consume(&l, s);
+        if (r < 0) {
+                free(k);
+                log_oom();
+                return;
+        }
+
+        r = hashmap_put(m->cgroup_attributes, k, l);
+        if (r < 0) {
+                free(k);
+                strv_free(l);
+                log_oom();
+        }
+}
+
+static void cgroup_attribute_forget(Manager *m, const char *path, const char *attribute) {
+        char **i;
+
+        i = cgroup_attribute_find(hashmap_get(m->cgroup_attributes, cgroup_attributes_key(path)), attribute);
+        if (!i)
+                return;
+
+        free(*i);
+        memmove(i, i + 1, (strv_length(i + 1) + 1) * sizeof(char*));
+}
+
+static void cgroup_attributes_forget_all(Manager *m, const char *path) {
+        char **l, *k;
+
+        l = hashmap_remove2(m->cgroup_attributes, cgroup_attributes_key(path), (void**) &k);
+        if (!l)
+                return;
+
+        strv_free(l);
+        free(k);
+}
+
+static int cgroup_set_attribute(Manager *m, const char *controller, const char *path, const char *attribute, const char *value) {
+        int r;
+
+        if (cgroup_attribute_is_cached(m, path, attribute, value))
+                return 0;
+
+        r = cg_set_attribute(controller, path, attribute, value);
+        if (r < 0) {
+                cgroup_attribute_forget(m, path, attribute);
+                return r;
+        }
+
+        cgroup_attribute_remember(m, path, attribute, value);
+        return 0;
+}
+
 static int whitelist_device(const char *path, const char *node, const char *acc) {
         char buf[2+DECIMAL_STR_MAX(dev_t)*2+2+4];
         struct stat st;
@@ -210,7 +348,7 @@ static int whitelist_major(const char *path, const char *name, char type, const
         _cleanup_fclose_ FILE *f = NULL;
         char line[LINE_MAX];
         bool good = false;
-        int r;
+        int r, ret = 0;
 
         assert(path);
         assert(acc);
@@ -270,22 +408,163 @@ static int whitelist_major(const char *path, const char *name, char type, const
                         acc);
 
                 r = cg_set_attribute("devices", path, "devices.allow", buf);
-                if (r < 0)
+                if (r < 0) {
                         log_full_errno(IN_SET(r, -ENOENT, -EROFS, -EINVAL) ? LOG_DEBUG : LOG_WARNING, r,
                                        "Failed to set devices.allow on %s: %m", path);
+                        if (ret == 0)
+                                ret = r;
+                }
         }
 
-        return 0;
+        return ret;
 
 fail:
         log_warning_errno(errno, "Failed to read /proc/devices: %m");
         return -errno;
 }
 
-void cgroup_context_apply(CGroupContext *c, CGroupControllerMask mask, const char *path, ManagerState state) {
+static char *blockio_device_weights_to_string(CGroupContext *c) {
+        CGroupBlockIODeviceWeight *w;
+        char *s = NULL;
+
+        LIST_FOREACH(device_weights, w, c->blockio_device_weights) {
+                char buf[DECIMAL_STR_MAX(unsigned long)];
+
+                xsprintf(buf, "%lu", w->weight);
+                if (!strextend(&s, w->path, " ", buf, "\n", NULL)) {
+                        free(s);
+                        return NULL;
+                }
+        }
+
+        return s ?: strdup("");
+}
+
+static char *blockio_device_bandwidths_to_string(CGroupContext *c) {
+        CGroupBlockIODeviceBandwidth *b;
+        char *s = NULL;
+
+        LIST_FOREACH(device_bandwidths, b, c->blockio_device_bandwidths) {
+                char buf[DECIMAL_STR_MAX(uint64_t)];
+
+                xsprintf(buf, "%" PRIu64, b->bandwidth);
+                if (!strextend(&s, b->read ? "r " : "w ", b->path, " ", buf, "\n", NULL)) {
+                        free(s);
+                        return NULL;
+                }
+        }
+
+        return s ?: strdup("");
+}
+
+static char *device_allow_to_string(CGroupContext *c) {
+        CGroupDeviceAllow *a;
+        char *s;
+
+        s = strdup(cgroup_device_policy_to_string(c->device_policy));
+        if (!s)
+                return NULL;
+
+        LIST_FOREACH(device_allow, a, c->device_allow)
+                if (!strextend(&s, " ", a->path, ":", a->r ? "r" : "", a->w ? "w" : "", a->m ? "m" : "", NULL)) {
+                        free(s);
+                        return NULL;
+                }
+
+        return s;
+}
+
+static bool cgroup_apply_device_allow(CGroupContext *c, const char *path) {
+        CGroupDeviceAllow *a;
+        bool good = true;
+        int r;
+
+        /* Changing the devices list of a populated cgroup
+         * might result in EINVAL, hence ignore EINVAL
+         * here. Returns whether every entry was written. */
+
+        if (c->device_allow || c->device_policy != CGROUP_AUTO)
+                r = cg_set_attribute("devices", path, "devices.deny", "a");
+        else
+                r = cg_set_attribute("devices", path, "devices.allow", "a");
+        if (r < 0) {
+                log_full_errno(IN_SET(r, -ENOENT, -EROFS, -EINVAL) ? LOG_DEBUG : LOG_WARNING, r,
+                               "Failed to reset devices.list on %s: %m", path);
+                good = false;
+        }
+
+        if (c->device_policy == CGROUP_CLOSED ||
+            (c->device_policy == CGROUP_AUTO && c->device_allow)) {
+                static const char auto_devices[] =
+                        "/dev/null\0" "rwm\0"
+                        "/dev/zero\0" "rwm\0"
+                        "/dev/full\0" "rwm\0"
+                        "/dev/random\0" "rwm\0"
+                        "/dev/urandom\0" "rwm\0"
+                        "/dev/tty\0" "rwm\0"
+                        "/dev/pts/ptmx\0" "rw\0"; /* /dev/pts/ptmx may not be duplicated, but accessed */
+
+                const char *x, *y;
+
+                NULSTR_FOREACH_PAIR(x, y, auto_devices)
+                        if (whitelist_device(path, x, y) < 0)
+                                good = false;
+
+                if (whitelist_major(path, "pts", 'c', "rw") < 0)
+                        good = false;
+                if (whitelist_major(path, "kdbus", 'c', "rw") < 0)
+                        good = false;
+                if (whitelist_major(path, "kdbus/*", 'c', "rw") < 0)
+                        good = false;
+        }
+
+        LIST_FOREACH(device_allow, a, c->device_allow) {
+                char acc[4];
+                unsigned k = 0;
+
+                if (a->r)
+                        acc[k++] = 'r';
+                if (a->w)
+                        acc[k++] = 'w';
+                if (a->m)
+                        acc[k++] = 'm';
+
+                if (k == 0)
+                        continue;
+
+                acc[k++] = 0;
+
+                if (startswith(a->path, "/dev/"))
+                        r = whitelist_device(path, a->path, acc);
+                else if (startswith(a->path, "block-"))
+                        r = whitelist_major(path, a->path + 6, 'b', acc);
+                else if (startswith(a->path, "char-"))
+                        r = whitelist_major(path, a->path + 5, 'c', acc);
+                else {
+                        log_debug("Ignoring device %s while writing cgroup attribute.", a->path);
+                        continue;
+                }
+
+                if (r < 0)
+                        good = false;
+        }
+
+        return good;
+}
+
+void cgroup_context_apply(Unit *u, CGroupControllerMask mask, ManagerState state) {
+        CGroupContext *c;
+        const char *path;
+        Manager *m;
         bool is_root;
         int r;
 
+        assert(u);
+
+        c = unit_get_cgroup_context(u);
+        path = u->cgroup_path;
+        m = u->manager;
+
         assert(c);
         assert(path);
 
@@ -309,22 +588,22 @@ void cgroup_context_apply(CGroupContext *c, CGroupControllerMask mask, const cha
                 sprintf(buf, "%lu\n",
                         IN_SET(state, MANAGER_STARTING, MANAGER_INITIALIZING) && c->startup_cpu_shares != (unsigned long) -1 ? c->startup_cpu_shares :
                         c->cpu_shares != (unsigned long) -1 ? c->cpu_shares : 1024);
-                r = cg_set_attribute("cpu", path, "cpu.shares", buf);
+                r = cgroup_set_attribute(m, "cpu", path, "cpu.shares", buf);
                 if (r < 0)
                         log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
                                        "Failed to set cpu.shares on %s: %m", path);
 
                 sprintf(buf, USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
-                r = cg_set_attribute("cpu", path, "cpu.cfs_period_us", buf);
+                r = cgroup_set_attribute(m, "cpu", path, "cpu.cfs_period_us", buf);
                 if (r < 0)
                         log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
                                        "Failed to set cpu.cfs_period_us on %s: %m", path);
 
                 if (c->cpu_quota_per_sec_usec != USEC_INFINITY) {
                         sprintf(buf, USEC_FMT "\n", c->cpu_quota_per_sec_usec * CGROUP_CPU_QUOTA_PERIOD_USEC / USEC_PER_SEC);
-                        r = cg_set_attribute("cpu", path, "cpu.cfs_quota_us", buf);
+                        r = cgroup_set_attribute(m, "cpu", path, "cpu.cfs_quota_us", buf);
                 } else
-                        r = cg_set_attribute("cpu", path, "cpu.cfs_quota_us", "-1");
+                        r = cgroup_set_attribute(m, "cpu", path, "cpu.cfs_quota_us", "-1");
                 if (r < 0)
                         log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
                                        "Failed to set cpu.cfs_quota_us on %s: %m", path);
@@ -336,47 +615,80 @@ void cgroup_context_apply(CGroupContext *c, CGroupControllerMask mask, const cha
                               DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1)];
                 CGroupBlockIODeviceWeight *w;
                 CGroupBlockIODeviceBandwidth *b;
+                _cleanup_free_ char *weights = NULL, *bandwidths = NULL;
+                bool good;
 
                 if (!is_root) {
                         sprintf(buf, "%lu\n", IN_SET(state, MANAGER_STARTING, MANAGER_INITIALIZING) && c->startup_blockio_weight != (unsigned long) -1 ? c->startup_blockio_weight :
                                 c->blockio_weight != (unsigned long) -1 ? c->blockio_weight : 1000);
-                        r = cg_set_attribute("blkio", path, "blkio.weight", buf);
+                        r = cgroup_set_attribute(m, "blkio", path, "blkio.weight", buf);
                         if (r < 0)
                                 log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
                                                "Failed to set blkio.weight on %s: %m", path);
 
+                        weights = blockio_device_weights_to_string(c);
+                        if (!weights || !cgroup_attribute_is_cached(m, path, "blkio.weight_device", weights)) {
+                                good = true;
+
+                                /* FIXME: no way to reset this list */
+                                LIST_FOREACH(device_weights, w, c->blockio_device_weights) {
+                                        dev_t dev;
+
+                                        r = lookup_blkio_device(w->path, &dev);
+                                        if (r < 0) {
+                                                good = false;
+                                                continue;
+                                        }
+
+                                        sprintf(buf, "%u:%u %lu", major(dev), minor(dev), w->weight);
+                                        r = cg_set_attribute("blkio", path, "blkio.weight_device", buf);
+                                        if (r < 0) {
+                                                log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
+                                                               "Failed to set blkio.weight_device on %s: %m", path);
+                                                good = false;
+                                        }
+                                }
+
+                                if (good && weights)
+                                        cgroup_attribute_remember(m, path, "blkio.weight_device", weights);
+                                else
+                                        cgroup_attribute_forget(m, path, "blkio.weight_device");
+                        }
+                }
+
+                /* The read and write bandwidths are remembered
+                 * together, under a name that is not an actual
+                 * attribute */
+                bandwidths = blockio_device_bandwidths_to_string(c);
+                if (!bandwidths || !cgroup_attribute_is_cached(m, path, "blkio.throttle", bandwidths)) {
+                        good = true;
+
                         /* FIXME: no way to reset this list */
-                        LIST_FOREACH(device_weights, w, c->blockio_device_weights) {
+                        LIST_FOREACH(device_bandwidths, b, c->blockio_device_bandwidths) {
+                                const char *a;
                                 dev_t dev;
 
-                                r = lookup_blkio_device(w->path, &dev);
-                                if (r < 0)
+                                r = lookup_blkio_device(b->path, &dev);
+                                if (r < 0) {
+                                        good = false;
                                         continue;
+                                }
+
+                                a = b->read ? "blkio.throttle.read_bps_device" : "blkio.throttle.write_bps_device";
 
-                                sprintf(buf, "%u:%u %lu", major(dev), minor(dev), w->weight);
-                                r = cg_set_attribute("blkio", path, "blkio.weight_device", buf);
-                                if (r < 0)
+                                sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), b->bandwidth);
+                                r = cg_set_attribute("blkio", path, a, buf);
+                                if (r < 0) {
                                         log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
-                                                       "Failed to set blkio.weight_device on %s: %m", path);
+                                                       "Failed to set %s on %s: %m", a, path);
+                                        good = false;
+                                }
                         }
-                }
 
-                /* FIXME: no way to reset this list */
-                LIST_FOREACH(device_bandwidths, b, c->blockio_device_bandwidths) {
-                        const char *a;
-                        dev_t dev;
-
-                        r = lookup_blkio_device(b->path, &dev);
-                        if (r < 0)
-                                continue;
-
-                        a = b->read ? "blkio.throttle.read_bps_device" : "blkio.throttle.write_bps_device";
-
-                        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), b->bandwidth);
-                        r = cg_set_attribute("blkio", path, a, buf);
-                        if (r < 0)
-                                log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
-                                               "Failed to set %s on %s: %m", a, path);
+                        if (good && bandwidths)
+                                cgroup_attribute_remember(m, path, "blkio.throttle", bandwidths);
+                        else
+                                cgroup_attribute_forget(m, path, "blkio.throttle");
                 }
         }
 
@@ -385,9 +697,9 @@ void cgroup_context_apply(CGroupContext *c, CGroupControllerMask mask, const cha
                         char buf[DECIMAL_STR_MAX(uint64_t) + 1];
 
                         sprintf(buf, "%" PRIu64 "\n", c->memory_limit);
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", buf);
+                        r = cgroup_set_attribute(m, "memory", path, "memory.limit_in_bytes", buf);
                 } else
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", "-1");
+                        r = cgroup_set_attribute(m, "memory", path, "memory.limit_in_bytes", "-1");
 
                 if (r < 0)
                         log_full_errno(IN_SET(r, -ENOENT, -EROFS) ? LOG_DEBUG : LOG_WARNING, r,
@@ -395,65 +707,17 @@ void cgroup_context_apply(CGroupContext *c, CGroupControllerMask mask, const cha
         }
 
         if ((mask & CGROUP_DEVICE) && !is_root) {
-                CGroupDeviceAllow *a;
-
-                /* Changing the devices list of a populated cgroup
-                 * might result in EINVAL, hence ignore EINVAL
-                 * here. */
-
-                if (c->device_allow || c->device_policy != CGROUP_AUTO)
-                        r = cg_set_attribute("devices", path, "devices.deny", "a");
-                else
-                        r = cg_set_attribute("devices", path, "devices.allow", "a");
-                if (r < 0)
-                        log_full_errno(IN_SET(r, -ENOENT, -EROFS, -EINVAL) ? LOG_DEBUG : LOG_WARNING, r,
-                                       "Failed to reset devices.list on %s: %m", path);
-
-                if (c->device_policy == CGROUP_CLOSED ||
-                    (c->device_policy == CGROUP_AUTO && c->device_allow)) {
-                        static const char auto_devices[] =
-                                "/dev/null\0" "rwm\0"
-                                "/dev/zero\0" "rwm\0"
-                                "/dev/full\0" "rwm\0"
-                                "/dev/random\0" "rwm\0"
-                                "/dev/urandom\0" "rwm\0"
-                                "/dev/tty\0" "rwm\0"
-                                "/dev/pts/ptmx\0" "rw\0"; /* /dev/pts/ptmx may not be duplicated, but accessed */
-
-                        const char *x, *y;
-
-                        NULSTR_FOREACH_PAIR(x, y, auto_devices)
-                                whitelist_device(path, x, y);
-
-                        whitelist_major(path, "pts", 'c', "rw");
-                        whitelist_major(path, "kdbus", 'c', "rw");
-                        whitelist_major(path, "kdbus/*", 'c', "rw");
-                }
-
-                LIST_FOREACH(device_allow, a, c->device_allow) {
-                        char acc[4];
-                        unsigned k = 0;
-
-                        if (a->r)
-                                acc[k++] = 'r';
-                        if (a->w)
-                                acc[k++] = 'w';
-                        if (a->m)
-                                acc[k++] = 'm';
-
-                        if (k == 0)
-                                continue;
-
-                        acc[k++] = 0;
-
-                        if (startswith(a->path, "/dev/"))
-                                whitelist_device(path, a->path, acc);
-                        else if (startswith(a->path, "block-"))
-                                whitelist_major(path, a->path + 6, 'b', acc);
-                        else if (startswith(a->path, "char-"))
-                                whitelist_major(path, a->path + 5, 'c', acc);
+                _cleanup_free_ char *allow = NULL;
+
+                /* The whitelist is written in many steps, hence
+                 * remember the configuration it was written from,
+                 * under a name that is not an actual attribute */
+                allow = device_allow_to_string(c);
+                if (!allow || !cgroup_attribute_is_cached(m, path, "devices", allow)) {
+                        if (cgroup_apply_device_allow(c, path) && allow)
+                                cgroup_attribute_remember(m, path, "devices", allow);
                         else
-                                log_debug("Ignoring device %s while writing cgroup attribute.", a->path);
+                                cgroup_attribute_forget(m, path, "devices");
                 }
         }
 }
@@ -658,6 +922,10 @@ static int unit_create_cgroups(Unit *u, CGroupControllerMask mask) {
         if (r < 0)
                 return log_error_errno(r, "Failed to create cgroup %s: %m", u->cgroup_path);
 
+        /* Whatever we wrote to a cgroup of this name before is gone */
+        if (r > 0)
+                cgroup_attributes_forget_all(u->manager, u->cgroup_path);
+
         /* Keep track that this is now realized */
         u->cgroup_realized = true;
         u->cgroup_realized_mask = mask;
@@ -708,7 +976,9 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
 
         assert(u);
 
-        if (u->in_cgroup_queue) {
+        /* Slices stay queued until their members were gone
+         * through */
+        if (u->in_cgroup_queue && !u->cgroup_members_queued) {
                 LIST_REMOVE(cgroup_queue, u->manager->cgroup_queue, u);
                 u->in_cgroup_queue = false;
         }
@@ -731,7 +1001,7 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
                 return r;
 
         /* Finally, apply the necessary attributes. */
-        cgroup_context_apply(unit_get_cgroup_context(u), mask, u->cgroup_path, state);
+        cgroup_context_apply(u, mask, state);
 
         return 0;
 }
@@ -745,6 +1015,34 @@ static void unit_add_to_cgroup_queue(Unit *u) {
         u->in_cgroup_queue = true;
 }
 
+static void unit_queue_members(Unit *slice) {
+        Iterator i;
+        Unit *m;
+
+        assert(slice);
+
+        SET_FOREACH(m, slice->dependencies[UNIT_BEFORE], i) {
+
+                /* Skip units that have a dependency on the slice
+                 * but aren't actually in it. */
+                if (UNIT_DEREF(m->slice) != slice)
+                        continue;
+
+                /* No point in doing cgroup application for units
+                 * without active processes. */
+                if (UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(m)))
+                        continue;
+
+                /* If the unit doesn't need any new controllers
+                 * and has current ones realized, it doesn't need
+                 * any changes. */
+                if (unit_has_mask_realized(m, unit_get_target_mask(m)))
+                        continue;
+
+                unit_add_to_cgroup_queue(m);
+        }
+}
+
 unsigned manager_dispatch_cgroup_queue(Manager *m) {
         ManagerState state;
         unsigned n = 0;
@@ -754,12 +1052,20 @@ unsigned manager_dispatch_cgroup_queue(Manager *m) {
         state = manager_state(m);
 
         while ((i = m->cgroup_queue)) {
+                bool members;
+
                 assert(i->in_cgroup_queue);
 
+                members = i->cgroup_members_queued;
+                i->cgroup_members_queued = false;
+
                 r = unit_realize_cgroup_now(i, state);
                 if (r < 0)
                         log_warning_errno(r, "Failed to realize cgroups for queued unit %s: %m", i->id);
 
+                if (members)
+                        unit_queue_members(i);
+
                 n++;
         }
 
@@ -769,36 +1075,18 @@ unsigned manager_dispatch_cgroup_queue(Manager *m) {
 static void unit_queue_siblings(Unit *u) {
         Unit *slice;
 
-        /* This adds the siblings of the specified unit and the
-         * siblings of all parent units to the cgroup queue. (But
-         * neither the specified unit itself nor the parents.) */
+        /* This makes sure the siblings of the specified unit and the
+         * siblings of all parent units are realized, too, the next
+         * time the cgroup queue is dispatched. Instead of going
+         * through all members of the slices right away, we queue the
+         * slices themselves, so that they are gone through only once
+         * however many of their members are started in the same
+         * event loop iteration. */
 
         while ((slice = UNIT_DEREF(u->slice))) {
-                Iterator i;
-                Unit *m;
-
-                SET_FOREACH(m, slice->dependencies[UNIT_BEFORE], i) {
-                        if (m == u)
-                                continue;
 
-                        /* Skip units that have a dependency on the slice
-                         * but aren't actually in it. */
-                        if (UNIT_DEREF(m->slice) != slice)
-                                continue;
-
-                        /* No point in doing cgroup application for units
-                         * without active processes. */
-                        if (UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(m)))
-                                continue;
-
-                        /* If the unit doesn't need any new controllers
-                         * and has current ones realized, it doesn't need
-                         * any changes. */
-                        if (unit_has_mask_realized(m, unit_get_target_mask(m)))
-                                continue;
-
-                        unit_add_to_cgroup_queue(m);
-                }
+                slice->cgroup_members_queued = true;
+                unit_add_to_cgroup_queue(slice);
 
                 u = slice;
         }
@@ -846,6 +1134,7 @@ void unit_destroy_cgroup_if_empty(Unit *u) {
         }
 
         hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
+        cgroup_attributes_forget_all(u->manager, u->cgroup_path);
 
         free(u->cgroup_path);
         u->cgroup_path = NULL;
@@ -976,6 +1265,11 @@ void manager_shutdown_cgroup(Manager *m, bool delete) {
 
         free(m->cgroup_root);
         m->cgroup_root = NULL;
+
+        while (!hashmap_isempty(m->cgroup_attributes))
+                cgroup_attributes_forget_all(m, hashmap_first_key(m->cgroup_attributes));
+        hashmap_free(m->cgroup_attributes);
+        m->cgroup_attributes = NULL;
 }
 
 Unit* manager_get_unit_by_cgroup(Manager *m, const char *cgroup) {
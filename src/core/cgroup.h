@@ -96,7 +96,7 @@ struct CGroupContext {
 void cgroup_context_init(CGroupContext *c);
 void cgroup_context_done(CGroupContext *c);
 void cgroup_context_dump(CGroupContext *c, FILE* f, const char *prefix);
-void cgroup_context_apply(CGroupContext *c, CGroupControllerMask mask, const char *path, ManagerState state);
+void cgroup_context_apply(Unit *u, CGroupControllerMask mask, ManagerState state);
 
 CGroupControllerMask cgroup_context_get_mask(CGroupContext *c);
 
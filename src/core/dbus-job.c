@@ -184,8 +184,15 @@ void bus_job_send_removed_signal(Job *j) {
 
         assert(j);
 
-        if (!j->sent_dbus_new_signal)
-                bus_job_send_change_signal(j);
+        /* A job that comes and goes while signals are held back is
+         * announced only by its JobRemoved signal */
+        if (!j->sent_dbus_new_signal) {
+                if (j->manager->dbus_coalesce_usec > 0 && j->in_dbus_queue) {
+                        LIST_REMOVE(dbus_queue, j->manager->dbus_job_queue, j);
+                        j->in_dbus_queue = false;
+                } else
+                        bus_job_send_change_signal(j);
+        }
 
         r = bus_foreach_bus(j->manager, j->clients, send_removed_signal, j);
         if (r < 0)
@@ -222,6 +222,39 @@ static int property_set_log_level(
         return log_set_max_level_from_string(t);
 }
 
+static int property_get_generators(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        unsigned i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(stt)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_generator_timings; i++) {
+                r = sd_bus_message_append(reply, "(stt)",
+                                          m->generator_timings[i].path,
+                                          m->generator_timings[i].wall,
+                                          m->generator_timings[i].cpu);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int property_get_n_names(
                 sd_bus *bus,
                 const char *path,
@@ -1158,7 +1191,7 @@ static int method_remove_snapshot(sd_bus *bus, sd_bus_message *message, void *us
         return bus_snapshot_method_remove(bus, message, u, error);
 }
 
-static int method_reload(sd_bus *bus, sd_bus_message *message, void *userdata, sd_bus_error *error) {
+static int reload_common(sd_bus *bus, sd_bus_message *message, void *userdata, ManagerExitCode code, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
 
@@ -1187,11 +1220,19 @@ static int method_reload(sd_bus *bus, sd_bus_message *message, void *userdata, s
                 return r;
 
         m->queued_message_bus = sd_bus_ref(bus);
-        m->exit_code = MANAGER_RELOAD;
+        m->exit_code = code;
 
         return 1;
 }
 
+static int method_reload(sd_bus *bus, sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return reload_common(bus, message, userdata, MANAGER_RELOAD, error);
+}
+
+static int method_reload_incremental(sd_bus *bus, sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return reload_common(bus, message, userdata, MANAGER_RELOAD_INCREMENTAL, error);
+}
+
 static int method_reexecute(sd_bus *bus, sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -1977,6 +2018,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         BUS_PROPERTY_DUAL_TIMESTAMP("SecurityFinishTimestamp", offsetof(Manager, security_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsStartTimestamp", offsetof(Manager, generators_start_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsFinishTimestamp", offsetof(Manager, generators_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Generators", "a(stt)", property_get_generators, 0, 0),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadStartTimestamp", offsetof(Manager, units_load_start_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadFinishTimestamp", offsetof(Manager, units_load_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_WRITABLE_PROPERTY("LogLevel", "s", property_get_log_level, property_set_log_level, 0, 0),
@@ -1997,6 +2039,9 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_WRITABLE_PROPERTY("ShutdownWatchdogUSec", "t", bus_property_get_usec, bus_property_set_usec, offsetof(Manager, shutdown_watchdog), 0),
         SD_BUS_PROPERTY("ControlGroup", "s", NULL, offsetof(Manager, cgroup_root), 0),
         SD_BUS_PROPERTY("SystemState", "s", property_get_system_state, 0, 0),
+        SD_BUS_PROPERTY("UnitFileCache", "s", NULL, offsetof(Manager, unit_cache_path), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("UnitFileCacheHits", "t", NULL, offsetof(Manager, unit_cache_hits), 0),
+        SD_BUS_PROPERTY("UnitFileCacheMisses", "t", NULL, offsetof(Manager, unit_cache_misses), 0),
 
         SD_BUS_METHOD("GetUnit", "s", "o", method_get_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetUnitByPID", "u", "o", method_get_unit_by_pid, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -2026,6 +2071,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("CreateSnapshot", "sb", "o", method_create_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("RemoveSnapshot", "s", NULL, method_remove_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reload", NULL, NULL, method_reload, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ReloadIncremental", NULL, NULL, method_reload_incremental, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reexecute", NULL, NULL, method_reexecute, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
         SD_BUS_METHOD("Reboot", NULL, NULL, method_reboot, SD_BUS_VTABLE_CAPABILITY(CAP_SYS_BOOT)),
@@ -2058,6 +2104,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_SIGNAL("StartupFinished", "tttttt", 0),
         SD_BUS_SIGNAL("UnitFilesChanged", NULL, 0),
         SD_BUS_SIGNAL("Reloading", "b", 0),
+        SD_BUS_SIGNAL("UnitsChanged", "a(sosss)", 0),
 
         SD_BUS_VTABLE_END
 };
@@ -2137,6 +2184,65 @@ void bus_manager_send_reloading(Manager *m, bool active) {
                 log_debug_errno(r, "Failed to send reloading signal: %m");
 }
 
+static int send_units_changed(sd_bus *bus, void *userdata) {
+        _cleanup_bus_message_unref_ sd_bus_message *message = NULL;
+        Manager *m = userdata;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(bus);
+        assert(m);
+
+        r = sd_bus_message_new_signal(bus, &message, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager", "UnitsChanged");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(message, 'a', "(sosss)");
+        if (r < 0)
+                return r;
+
+        SET_FOREACH(u, m->dbus_units_changed, i) {
+                _cleanup_free_ char *p = NULL;
+
+                p = unit_dbus_path(u);
+                if (!p)
+                        return -ENOMEM;
+
+                r = sd_bus_message_append(
+                                message, "(sosss)",
+                                u->id,
+                                p,
+                                unit_load_state_to_string(u->load_state),
+                                unit_active_state_to_string(unit_active_state(u)),
+                                unit_sub_state_to_string(u));
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(message);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(bus, message, NULL);
+}
+
+void bus_manager_send_units_changed(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* Sends the current state of all units whose change signal
+         * went out since the last time, in one go, for clients that
+         * cannot keep up with a signal per unit */
+
+        r = bus_foreach_bus(m, NULL, send_units_changed, m);
+        if (r < 0)
+                log_debug_errno(r, "Failed to send units changed signal: %m");
+
+        set_clear(m->dbus_units_changed);
+}
+
 static int send_changed_signal(sd_bus *bus, void *userdata) {
         assert(bus);
 
@@ -784,6 +784,15 @@ void bus_unit_send_change_signal(Unit *u) {
                 log_debug_errno(r, "Failed to send unit change signal for %s: %m", u->id);
 
         u->sent_dbus_new_signal = true;
+
+        /* Also include it in the next UnitsChanged signal */
+        if (u->manager->send_units_changed) {
+                r = set_ensure_allocated(&u->manager->dbus_units_changed, NULL);
+                if (r >= 0)
+                        r = set_put(u->manager->dbus_units_changed, u);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to queue unit %s for UnitsChanged signal: %m", u->id);
+        }
 }
 
 static int send_removed_signal(sd_bus *bus, void *userdata) {
@@ -966,7 +975,7 @@ static int bus_unit_set_transient_property(
                                 return -EINVAL;
 
                         if (mode != UNIT_CHECK) {
-                                unit_ref_set(&u->slice, slice);
+                                unit_ref_set(&u->slice, u, slice);
                                 unit_write_drop_in_private_format(u, mode, name, "Slice=%s\n", s);
                         }
                 }
@@ -615,72 +615,46 @@ static int bus_setup_disconnected_match(Manager *m, sd_bus *bus) {
         return 0;
 }
 
-static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+int bus_add_private_connection(Manager *m, int fd) {
         _cleanup_bus_unref_ sd_bus *bus = NULL;
-        _cleanup_close_ int nfd = -1;
-        Manager *m = userdata;
+        _cleanup_close_ int nfd = fd;
         sd_id128_t id;
         int r;
 
-        assert(s);
         assert(m);
-
-        nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
-        if (nfd < 0) {
-                log_warning_errno(errno, "Failed to accept private connection, ignoring: %m");
-                return 0;
-        }
-
-        if (set_size(m->private_buses) >= CONNECTIONS_MAX) {
-                log_warning("Too many concurrent connections, refusing");
-                return 0;
-        }
+        assert(fd >= 0);
 
         r = set_ensure_allocated(&m->private_buses, NULL);
-        if (r < 0) {
-                log_oom();
-                return 0;
-        }
+        if (r < 0)
+                return log_oom();
 
         r = sd_bus_new(&bus);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to allocate new private connection bus: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to allocate new private connection bus: %m");
 
         r = sd_bus_set_fd(bus, nfd, nfd);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to set fd on new connection bus: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to set fd on new connection bus: %m");
 
         nfd = -1;
 
         r = bus_check_peercred(bus);
-        if (r < 0) {
-                log_warning_errno(r, "Incoming private connection from unprivileged client, refusing: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Incoming private connection from unprivileged client, refusing: %m");
 
         assert_se(sd_id128_randomize(&id) >= 0);
 
         r = sd_bus_set_server(bus, 1, id);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to enable server support for new connection bus: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to enable server support for new connection bus: %m");
 
         r = sd_bus_start(bus);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to start new connection bus: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to start new connection bus: %m");
 
         r = sd_bus_attach_event(bus, m->event, SD_EVENT_PRIORITY_NORMAL);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to attach new connection bus to event loop: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to attach new connection bus to event loop: %m");
 
         if (m->running_as == SYSTEMD_SYSTEM) {
                 /* When we run as system instance we get the Released
@@ -695,27 +669,21 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                                 "path='/org/freedesktop/systemd1/agent'",
                                 signal_agent_released, m);
 
-                if (r < 0) {
-                        log_warning_errno(r, "Failed to register Released match on new connection bus: %m");
-                        return 0;
-                }
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to register Released match on new connection bus: %m");
         }
 
         r = bus_setup_disconnected_match(m, bus);
         if (r < 0)
-                return 0;
+                return r;
 
         r = bus_setup_api_vtables(m, bus);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to set up API vtables on new connection bus: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to set up API vtables on new connection bus: %m");
 
         r = set_put(m->private_buses, bus);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to add new conenction bus to set: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add new conenction bus to set: %m");
 
         bus = NULL;
 
@@ -724,6 +692,30 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
         return 0;
 }
 
+static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        int nfd;
+        Manager *m = userdata;
+
+        assert(s);
+        assert(m);
+
+        nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (nfd < 0) {
+                log_warning_errno(errno, "Failed to accept private connection, ignoring: %m");
+                return 0;
+        }
+
+        if (set_size(m->private_buses) >= CONNECTIONS_MAX) {
+                log_warning("Too many concurrent connections, refusing");
+                safe_close(nfd);
+                return 0;
+        }
+
+        (void) bus_add_private_connection(m, nfd);
+
+        return 0;
+}
+
 static int bus_list_names(Manager *m, sd_bus *bus) {
         _cleanup_strv_free_ char **names = NULL;
         char **i;
@@ -1133,27 +1125,26 @@ int bus_foreach_bus(
         return ret;
 }
 
-void bus_track_serialize(sd_bus_track *t, FILE *f) {
+void bus_track_serialize(sd_bus_track *t, FILE *f, SerializationFormat format) {
         const char *n;
 
         assert(f);
 
         for (n = sd_bus_track_first(t); n; n = sd_bus_track_next(t))
-                fprintf(f, "subscribed=%s\n", n);
+                serialize_item(f, format, "subscribed", n);
 }
 
-int bus_track_deserialize_item(char ***l, const char *line) {
-        const char *e;
+int bus_track_deserialize_item(char ***l, const char *key, const char *value) {
         int r;
 
         assert(l);
-        assert(line);
+        assert(key);
+        assert(value);
 
-        e = startswith(line, "subscribed=");
-        if (!e)
+        if (!streq(key, "subscribed"))
                 return 0;
 
-        r = strv_extend(l, e);
+        r = strv_extend(l, value);
         if (r < 0)
                 return r;
 
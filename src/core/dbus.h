@@ -26,12 +26,13 @@
 int bus_send_queued_message(Manager *m);
 
 int bus_init(Manager *m, bool try_bus_connect);
+int bus_add_private_connection(Manager *m, int fd);
 void bus_done(Manager *m);
 
 int bus_fdset_add_all(Manager *m, FDSet *fds);
 
-void bus_track_serialize(sd_bus_track *t, FILE *f);
-int bus_track_deserialize_item(char ***l, const char *line);
+void bus_track_serialize(sd_bus_track *t, FILE *f, SerializationFormat format);
+int bus_track_deserialize_item(char ***l, const char *key, const char *value);
 int bus_track_coldplug(Manager *m, sd_bus_track **t, char ***l);
 
 int bus_foreach_bus(Manager *m, sd_bus_track *subscribed2, int (*send_message)(sd_bus *bus, void *userdata), void *userdata);
@@ -32,6 +32,10 @@
 #include <poll.h>
 #include <glob.h>
 #include <sys/personality.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <dirent.h>
 
 #ifdef HAVE_PAM
 #include <security/pam_appl.h>
@@ -256,21 +260,51 @@ static int connect_journal_socket(int fd, uid_t uid, gid_t gid) {
         return r;
 }
 
-static int connect_logger_as(const ExecContext *context, ExecOutput output, const char *ident, const char *unit_id, int nfd, uid_t uid, gid_t gid) {
-        int fd, r;
+static char *logger_header(const ExecContext *context, ExecOutput output, const char *ident, const char *unit_id) {
+        char *h;
 
         assert(context);
         assert(output < _EXEC_OUTPUT_MAX);
         assert(ident);
+
+        if (asprintf(&h,
+                     "%s\n"
+                     "%s\n"
+                     "%i\n"
+                     "%i\n"
+                     "%i\n"
+                     "%i\n"
+                     "%i\n",
+                     context->syslog_identifier ? context->syslog_identifier : ident,
+                     unit_id,
+                     context->syslog_priority,
+                     !!context->syslog_level_prefix,
+                     output == EXEC_OUTPUT_SYSLOG || output == EXEC_OUTPUT_SYSLOG_AND_CONSOLE,
+                     output == EXEC_OUTPUT_KMSG || output == EXEC_OUTPUT_KMSG_AND_CONSOLE,
+                     is_terminal_output(output)) < 0)
+                return NULL;
+
+        return h;
+}
+
+static int connect_logger_header_as(const char *header, int nfd, uid_t uid, gid_t gid) {
+        int fd, r;
+
+        assert(header);
         assert(nfd >= 0);
 
+        /* Does not allocate memory, so that it may be called from a
+         * child sharing our address space. */
+
         fd = socket(AF_UNIX, SOCK_STREAM, 0);
         if (fd < 0)
                 return -errno;
 
         r = connect_journal_socket(fd, uid, gid);
-        if (r < 0)
+        if (r < 0) {
+                safe_close(fd);
                 return r;
+        }
 
         if (shutdown(fd, SHUT_RD) < 0) {
                 safe_close(fd);
@@ -279,21 +313,11 @@ static int connect_logger_as(const ExecContext *context, ExecOutput output, cons
 
         fd_inc_sndbuf(fd, SNDBUF_SIZE);
 
-        dprintf(fd,
-                "%s\n"
-                "%s\n"
-                "%i\n"
-                "%i\n"
-                "%i\n"
-                "%i\n"
-                "%i\n",
-                context->syslog_identifier ? context->syslog_identifier : ident,
-                unit_id,
-                context->syslog_priority,
-                !!context->syslog_level_prefix,
-                output == EXEC_OUTPUT_SYSLOG || output == EXEC_OUTPUT_SYSLOG_AND_CONSOLE,
-                output == EXEC_OUTPUT_KMSG || output == EXEC_OUTPUT_KMSG_AND_CONSOLE,
-                is_terminal_output(output));
+        r = loop_write(fd, header, strlen(header), false);
+        if (r < 0) {
+                safe_close(fd);
+                return r;
+        }
 
         if (fd != nfd) {
                 r = dup2(fd, nfd) < 0 ? -errno : nfd;
@@ -303,6 +327,20 @@ static int connect_logger_as(const ExecContext *context, ExecOutput output, cons
 
         return r;
 }
+
+static int connect_logger_as(const ExecContext *context, ExecOutput output, const char *ident, const char *unit_id, int nfd, uid_t uid, gid_t gid) {
+        _cleanup_free_ char *header = NULL;
+
+        assert(context);
+        assert(nfd >= 0);
+
+        header = logger_header(context, output, ident, unit_id);
+        if (!header)
+                return -ENOMEM;
+
+        return connect_logger_header_as(header, nfd, uid, gid);
+}
+
 static int open_terminal_as(const char *path, mode_t mode, int nfd) {
         int fd, r;
 
@@ -1259,6 +1297,61 @@ static int build_environment(
         return 0;
 }
 
+static int apply_process_attributes(const ExecContext *context, int *exit_status) {
+        int r;
+
+        assert(context);
+        assert(exit_status);
+
+        if (context->nice_set)
+                if (setpriority(PRIO_PROCESS, 0, context->nice) < 0) {
+                        *exit_status = EXIT_NICE;
+                        return -errno;
+                }
+
+        if (context->cpu_sched_set) {
+                struct sched_param param = {
+                        .sched_priority = context->cpu_sched_priority,
+                };
+
+                r = sched_setscheduler(0,
+                                       context->cpu_sched_policy |
+                                       (context->cpu_sched_reset_on_fork ?
+                                        SCHED_RESET_ON_FORK : 0),
+                                       &param);
+                if (r < 0) {
+                        *exit_status = EXIT_SETSCHEDULER;
+                        return -errno;
+                }
+        }
+
+        if (context->cpuset)
+                if (sched_setaffinity(0, CPU_ALLOC_SIZE(context->cpuset_ncpus), context->cpuset) < 0) {
+                        *exit_status = EXIT_CPUAFFINITY;
+                        return -errno;
+                }
+
+        if (context->ioprio_set)
+                if (ioprio_set(IOPRIO_WHO_PROCESS, 0, context->ioprio) < 0) {
+                        *exit_status = EXIT_IOPRIO;
+                        return -errno;
+                }
+
+        if (context->timer_slack_nsec != NSEC_INFINITY)
+                if (prctl(PR_SET_TIMERSLACK, context->timer_slack_nsec) < 0) {
+                        *exit_status = EXIT_TIMERSLACK;
+                        return -errno;
+                }
+
+        if (context->personality != 0xffffffffUL)
+                if (personality(context->personality) < 0) {
+                        *exit_status = EXIT_PERSONALITY;
+                        return -errno;
+                }
+
+        return 0;
+}
+
 static int exec_child(
                 ExecCommand *command,
                 const ExecContext *context,
@@ -1420,51 +1513,9 @@ static int exec_child(
                 }
         }
 
-        if (context->nice_set)
-                if (setpriority(PRIO_PROCESS, 0, context->nice) < 0) {
-                        *exit_status = EXIT_NICE;
-                        return -errno;
-                }
-
-        if (context->cpu_sched_set) {
-                struct sched_param param = {
-                        .sched_priority = context->cpu_sched_priority,
-                };
-
-                r = sched_setscheduler(0,
-                                       context->cpu_sched_policy |
-                                       (context->cpu_sched_reset_on_fork ?
-                                        SCHED_RESET_ON_FORK : 0),
-                                       &param);
-                if (r < 0) {
-                        *exit_status = EXIT_SETSCHEDULER;
-                        return -errno;
-                }
-        }
-
-        if (context->cpuset)
-                if (sched_setaffinity(0, CPU_ALLOC_SIZE(context->cpuset_ncpus), context->cpuset) < 0) {
-                        *exit_status = EXIT_CPUAFFINITY;
-                        return -errno;
-                }
-
-        if (context->ioprio_set)
-                if (ioprio_set(IOPRIO_WHO_PROCESS, 0, context->ioprio) < 0) {
-                        *exit_status = EXIT_IOPRIO;
-                        return -errno;
-                }
-
-        if (context->timer_slack_nsec != NSEC_INFINITY)
-                if (prctl(PR_SET_TIMERSLACK, context->timer_slack_nsec) < 0) {
-                        *exit_status = EXIT_TIMERSLACK;
-                        return -errno;
-                }
-
-        if (context->personality != 0xffffffffUL)
-                if (personality(context->personality) < 0) {
-                        *exit_status = EXIT_PERSONALITY;
-                        return -errno;
-                }
+        r = apply_process_attributes(context, exit_status);
+        if (r < 0)
+                return r;
 
         if (context->utmp_id)
                 utmp_put_init_process(context->utmp_id, getpid(), getsid(0), context->tty_path);
@@ -1811,6 +1862,642 @@ static int exec_child(
         return -errno;
 }
 
+/* Spawning via clone(CLONE_VM|CLONE_VFORK) avoids copying our page
+ * tables, which for a big PID 1 dominates the cost of fork(). The
+ * child shares our memory until it calls execve(), hence it must not
+ * allocate, log, or modify anything but its own stack and the
+ * ExecCloneArgs we hand it. All strings are therefore prepared in
+ * the parent, and only contexts whose setup boils down to plain
+ * system calls take this path. Everything that needs NSS, PAM,
+ * namespaces, MAC or seccomp still forks. */
+
+#define EXEC_CLONE_STACK_SIZE (64*1024)
+
+static bool arg_spawn_clone = true;
+
+typedef struct ExecCloneArgs {
+        const char *path;
+        const ExecContext *context;
+        const ExecParameters *params;
+
+        int socket_fd;
+        int *fds;
+        unsigned n_fds;
+
+        char **argv;
+        char **envp;
+
+        /* Buffers the child fills in with its own PID */
+        char *listen_pid, *watchdog_pid;
+
+        char **cgroup_paths;
+        const char *logger_header[2];
+        const char *working_directory;
+
+        /* Results, written by the child */
+        int exit_status;
+        int error;
+        int logger_error[2];
+        int oom_score_adjust_error;
+} ExecCloneArgs;
+
+void exec_spawn_set_clone(bool b) {
+        arg_spawn_clone = b;
+}
+
+static bool exec_context_may_clone(const ExecContext *c, const ExecParameters *p, char **argv) {
+        char **i;
+
+        assert(c);
+        assert(p);
+
+        if (!arg_spawn_clone)
+                return false;
+
+        if (p->confirm_spawn ||
+            p->idle_pipe ||
+            p->selinux_context_net ||
+            p->bus_endpoint_path ||
+            p->bus_endpoint_fd >= 0)
+                return false;
+
+        if (c->user ||
+            c->group ||
+            c->supplementary_groups ||
+            c->pam_name ||
+            c->utmp_id)
+                return false;
+
+        if (is_terminal_input(c->std_input) ||
+            is_terminal_output(c->std_output) ||
+            is_terminal_output(c->std_error) ||
+            c->tty_path ||
+            c->tty_reset ||
+            c->tty_vhangup ||
+            c->tty_vt_disallocate)
+                return false;
+
+        if (c->root_directory ||
+            !strv_isempty(c->runtime_directory) ||
+            !strv_isempty(c->read_write_dirs) ||
+            !strv_isempty(c->read_only_dirs) ||
+            !strv_isempty(c->inaccessible_dirs) ||
+            c->mount_flags != 0 ||
+            c->private_tmp ||
+            c->private_network ||
+            c->private_devices ||
+            c->protect_system != PROTECT_SYSTEM_NO ||
+            c->protect_home != PROTECT_HOME_NO)
+                return false;
+
+        if (c->capability_bounding_set_drop ||
+            c->capabilities ||
+            c->selinux_context ||
+            c->apparmor_profile ||
+            c->smack_process_label ||
+            c->syscall_whitelist ||
+            !set_isempty(c->syscall_filter) ||
+            !set_isempty(c->syscall_archs) ||
+            c->address_families_whitelist ||
+            !set_isempty(c->address_families))
+                return false;
+
+        /* The command line is expanded before we know the PID of
+         * the child, hence let fork() handle references to it */
+        STRV_FOREACH(i, argv)
+                if (strstr(*i, "LISTEN_PID") || strstr(*i, "WATCHDOG_PID"))
+                        return false;
+
+        return true;
+}
+
+static void format_pid(char *buf, pid_t pid) {
+        char t[DECIMAL_STR_MAX(pid_t)];
+        unsigned n = 0;
+
+        /* Like sprintf(buf, PID_FMT, pid), but async signal safe */
+
+        do {
+                t[n++] = '0' + pid % 10;
+                pid /= 10;
+        } while (pid > 0);
+
+        while (n > 0)
+                *(buf++) = t[--n];
+
+        *buf = 0;
+}
+
+static int close_all_fds_nomalloc(const int except[], unsigned n_except) {
+        union {
+                struct dirent64 de;
+                uint8_t buf[2048];
+        } u;
+        int dir, r = 0;
+
+        /* Like close_all_fds(), but reads /proc/self/fd with a buffer
+         * on the stack rather than via opendir(). There is no
+         * fallback if /proc is not available, as that would allocate
+         * memory in the child sharing our address space, hence the
+         * caller fails with EXIT_FDS then. */
+
+        dir = open("/proc/self/fd", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir < 0)
+                return -errno;
+
+        for (;;) {
+                struct dirent64 *de;
+                ssize_t n;
+                size_t k;
+
+                n = syscall(SYS_getdents64, dir, &u, sizeof(u));
+                if (n < 0) {
+                        r = -errno;
+                        break;
+                }
+                if (n == 0)
+                        break;
+
+                for (k = 0; k < (size_t) n; k += de->d_reclen) {
+                        unsigned j;
+                        int fd;
+
+                        de = (struct dirent64*) (u.buf + k);
+
+                        if (safe_atoi(de->d_name, &fd) < 0)
+                                continue;
+
+                        if (fd < 3 || fd == dir)
+                                continue;
+
+                        for (j = 0; j < n_except; j++)
+                                if (except[j] == fd)
+                                        break;
+                        if (j < n_except)
+                                continue;
+
+                        if (close_nointr(fd) < 0 && errno != EBADF && r == 0)
+                                r = -errno;
+                }
+        }
+
+        safe_close(dir);
+        return r;
+}
+
+static int write_string_file_nomalloc(const char *fn, const char *line) {
+        int fd, r;
+
+        fd = open(fn, O_WRONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        r = loop_write(fd, line, strlen(line), false);
+        safe_close(fd);
+
+        return r;
+}
+
+static int clone_setup_output(ExecCloneArgs *a, int fileno) {
+        const ExecContext *context = a->context;
+        ExecOutput o;
+        ExecInput i;
+        int r;
+
+        /* A reduced setup_output() for the contexts
+         * exec_context_may_clone() accepts, i.e. without any TTY
+         * handling */
+
+        i = fixup_input(context->std_input, a->socket_fd, a->params->apply_tty_stdin);
+        o = fixup_output(context->std_output, a->socket_fd);
+
+        if (fileno == STDERR_FILENO) {
+                ExecOutput e;
+                e = fixup_output(context->std_error, a->socket_fd);
+
+                if (e == EXEC_OUTPUT_INHERIT &&
+                    o == EXEC_OUTPUT_INHERIT &&
+                    i == EXEC_INPUT_NULL &&
+                    getppid () != 1)
+                        return fileno;
+
+                if (e == o || e == EXEC_OUTPUT_INHERIT)
+                        return dup2(STDOUT_FILENO, fileno) < 0 ? -errno : fileno;
+
+                o = e;
+
+        } else if (o == EXEC_OUTPUT_INHERIT) {
+
+                if (i != EXEC_INPUT_NULL)
+                        return dup2(STDIN_FILENO, fileno) < 0 ? -errno : fileno;
+
+                if (getppid() != 1)
+                        return fileno;
+
+                return open_null_as(O_WRONLY, fileno);
+        }
+
+        switch (o) {
+
+        case EXEC_OUTPUT_NULL:
+                return open_null_as(O_WRONLY, fileno);
+
+        case EXEC_OUTPUT_SYSLOG:
+        case EXEC_OUTPUT_KMSG:
+        case EXEC_OUTPUT_JOURNAL:
+                r = connect_logger_header_as(a->logger_header[fileno - 1], fileno, UID_INVALID, GID_INVALID);
+                if (r < 0) {
+                        /* The parent logs this for us */
+                        a->logger_error[fileno - 1] = r;
+                        r = open_null_as(O_WRONLY, fileno);
+                }
+                return r;
+
+        case EXEC_OUTPUT_SOCKET:
+                return dup2(a->socket_fd, fileno) < 0 ? -errno : fileno;
+
+        default:
+                return -EINVAL;
+        }
+}
+
+static int clone_attach_cgroup(ExecCloneArgs *a) {
+        char t[DECIMAL_STR_MAX(pid_t) + 1];
+        bool attached = false;
+        char **p;
+        int r;
+
+        if (!a->cgroup_paths)
+                return 0;
+
+        format_pid(t, getpid());
+
+        /* Our own hierarchy is mandatory, for the other controllers
+         * we follow cg_attach_fallback() and ignore failures. See
+         * cg_get_attach_paths() for the layout of the list. */
+
+        r = write_string_file_nomalloc(a->cgroup_paths[0], t);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(p, a->cgroup_paths + 1) {
+                if (isempty(*p)) {
+                        attached = false;
+                        continue;
+                }
+
+                if (attached)
+                        continue;
+
+                attached = write_string_file_nomalloc(*p, t) >= 0;
+        }
+
+        return 0;
+}
+
+static int exec_clone_child_setup(ExecCloneArgs *a, int *exit_status) {
+        const ExecContext *context = a->context;
+        const ExecParameters *params = a->params;
+        int i, r;
+
+        default_signals(SIGNALS_CRASH_HANDLER,
+                        SIGNALS_IGNORE, -1);
+
+        if (context->ignore_sigpipe)
+                ignore_signals(SIGPIPE, -1);
+
+        r = reset_signal_mask();
+        if (r < 0) {
+                *exit_status = EXIT_SIGNAL_MASK;
+                return r;
+        }
+
+        if (a->socket_fd >= 0)
+                r = close_all_fds_nomalloc(&a->socket_fd, 1);
+        else
+                r = close_all_fds_nomalloc(a->fds, a->n_fds);
+        if (r < 0) {
+                *exit_status = EXIT_FDS;
+                return r;
+        }
+
+        if (!context->same_pgrp)
+                if (setsid() < 0) {
+                        *exit_status = EXIT_SETSID;
+                        return -errno;
+                }
+
+        if (a->socket_fd >= 0)
+                fd_nonblock(a->socket_fd, false);
+
+        if (fixup_input(context->std_input, a->socket_fd, params->apply_tty_stdin) == EXEC_INPUT_SOCKET)
+                r = dup2(a->socket_fd, STDIN_FILENO) < 0 ? -errno : STDIN_FILENO;
+        else
+                r = open_null_as(O_RDONLY, STDIN_FILENO);
+        if (r < 0) {
+                *exit_status = EXIT_STDIN;
+                return r;
+        }
+
+        r = clone_setup_output(a, STDOUT_FILENO);
+        if (r < 0) {
+                *exit_status = EXIT_STDOUT;
+                return r;
+        }
+
+        r = clone_setup_output(a, STDERR_FILENO);
+        if (r < 0) {
+                *exit_status = EXIT_STDERR;
+                return r;
+        }
+
+        r = clone_attach_cgroup(a);
+        if (r < 0) {
+                *exit_status = EXIT_CGROUP;
+                return r;
+        }
+
+        if (context->oom_score_adjust_set) {
+                char t[DECIMAL_STR_MAX(context->oom_score_adjust)];
+
+                if (context->oom_score_adjust < 0) {
+                        t[0] = '-';
+                        format_pid(t + 1, -context->oom_score_adjust);
+                } else
+                        format_pid(t, context->oom_score_adjust);
+
+                r = write_string_file_nomalloc("/proc/self/oom_score_adj", t);
+                if (r == -EPERM || r == -EACCES)
+                        a->oom_score_adjust_error = r;
+                else if (r < 0) {
+                        *exit_status = EXIT_OOM_ADJUST;
+                        return r;
+                }
+        }
+
+        r = apply_process_attributes(context, exit_status);
+        if (r < 0)
+                return r;
+
+        umask(context->umask);
+
+        if (chdir(a->working_directory) < 0 &&
+            !context->working_directory_missing_ok) {
+                *exit_status = EXIT_CHDIR;
+                return -errno;
+        }
+
+        if (a->socket_fd >= 0)
+                safe_close(a->socket_fd);
+
+        r = shift_fds(a->fds, a->n_fds);
+        if (r >= 0)
+                r = flags_fds(a->fds, a->n_fds, context->non_blocking);
+        if (r < 0) {
+                *exit_status = EXIT_FDS;
+                return r;
+        }
+
+        if (params->apply_permissions) {
+
+                for (i = 0; i < _RLIMIT_MAX; i++) {
+                        if (!context->rlimit[i])
+                                continue;
+
+                        if (setrlimit_closest(i, context->rlimit[i]) < 0) {
+                                *exit_status = EXIT_LIMITS;
+                                return -errno;
+                        }
+                }
+
+                if (prctl(PR_GET_SECUREBITS) != context->secure_bits)
+                        if (prctl(PR_SET_SECUREBITS, context->secure_bits) < 0) {
+                                *exit_status = EXIT_SECUREBITS;
+                                return -errno;
+                        }
+
+                if (context->no_new_privileges)
+                        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+                                *exit_status = EXIT_NO_NEW_PRIVILEGES;
+                                return -errno;
+                        }
+        }
+
+        if (a->listen_pid)
+                format_pid(a->listen_pid, getpid());
+        if (a->watchdog_pid)
+                format_pid(a->watchdog_pid, getpid());
+
+        execve(a->path, a->argv, a->envp);
+        *exit_status = EXIT_EXEC;
+        return -errno;
+}
+
+static int exec_clone_child(void *userdata) {
+        ExecCloneArgs *a = userdata;
+
+        a->error = exec_clone_child_setup(a, &a->exit_status);
+        _exit(a->exit_status);
+}
+
+static int env_make_pid_placeholder(char **env, const char *field, char **ret) {
+        char t[DECIMAL_STR_MAX(pid_t)], *e, **i;
+        size_t l;
+
+        /* build_environment() put our own PID in, replace it by a
+         * buffer large enough for any PID, which the child fills in
+         * after clone(). If the setting has been overridden leave it
+         * alone. */
+
+        l = strlen(field);
+        xsprintf(t, PID_FMT, getpid());
+
+        STRV_FOREACH(i, env) {
+                if (!strneq(*i, field, l) || (*i)[l] != '=')
+                        continue;
+
+                if (!streq(*i + l + 1, t))
+                        return 0;
+
+                e = new(char, l + 1 + DECIMAL_STR_MAX(pid_t));
+                if (!e)
+                        return -ENOMEM;
+
+                strcpy(stpcpy(e, field), "=");
+                free(*i);
+                *i = e;
+
+                *ret = e + l + 1;
+                return 0;
+        }
+
+        return 0;
+}
+
+static int exec_spawn_clone(
+                ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                char **argv,
+                int socket_fd,
+                int *fds, unsigned n_fds,
+                char **files_env,
+                pid_t *ret) {
+
+        _cleanup_strv_free_ char **our_env = NULL, **final_env = NULL, **final_argv = NULL, **cgroup_paths = NULL;
+        _cleanup_free_ char *stdout_header = NULL, *stderr_header = NULL, *working_directory = NULL;
+        _cleanup_free_ int *fds_copy = NULL;
+        ExecCloneArgs a = {
+                .path = command->path,
+                .context = context,
+                .params = params,
+                .socket_fd = socket_fd,
+                .n_fds = n_fds,
+        };
+        sigset_t ss, saved_ss;
+        ExecOutput o, e;
+        void *stack;
+        pid_t pid;
+        int r;
+
+        /* Prepare everything exec_child() would allocate */
+
+        r = build_environment(context, n_fds, params->watchdog_usec, NULL, NULL, NULL, &our_env);
+        if (r < 0)
+                return log_oom();
+
+        final_env = strv_env_merge(4,
+                                   params->environment,
+                                   our_env,
+                                   context->environment,
+                                   files_env,
+                                   NULL);
+        if (!final_env)
+                return log_oom();
+
+        final_argv = replace_env_argv(argv, final_env);
+        if (!final_argv)
+                return log_oom();
+
+        final_env = strv_env_clean(final_env);
+
+        if (n_fds > 0) {
+                r = env_make_pid_placeholder(final_env, "LISTEN_PID", &a.listen_pid);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        if (params->watchdog_usec > 0) {
+                r = env_make_pid_placeholder(final_env, "WATCHDOG_PID", &a.watchdog_pid);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        /* shift_fds() sorts the array, make sure it doesn't sort
+         * the caller's */
+        if (n_fds > 0) {
+                fds_copy = newdup(int, fds, n_fds);
+                if (!fds_copy)
+                        return log_oom();
+        }
+
+        if (params->cgroup_path) {
+                r = cg_get_attach_paths(params->cgroup_supported, params->cgroup_path, &cgroup_paths);
+                if (r < 0)
+                        return log_unit_error_errno(params->unit_id, r, "Failed to determine cgroup paths: %m");
+        }
+
+        o = fixup_output(context->std_output, socket_fd);
+        e = fixup_output(context->std_error, socket_fd);
+
+        if (IN_SET(o, EXEC_OUTPUT_SYSLOG, EXEC_OUTPUT_KMSG, EXEC_OUTPUT_JOURNAL)) {
+                stdout_header = logger_header(context, o, basename(command->path), params->unit_id);
+                if (!stdout_header)
+                        return log_oom();
+        }
+
+        if (IN_SET(e, EXEC_OUTPUT_SYSLOG, EXEC_OUTPUT_KMSG, EXEC_OUTPUT_JOURNAL)) {
+                stderr_header = logger_header(context, e, basename(command->path), params->unit_id);
+                if (!stderr_header)
+                        return log_oom();
+        }
+
+        if (params->apply_chroot)
+                working_directory = strdup(context->working_directory ?: "/");
+        else
+                working_directory = strappend("/", context->working_directory);
+        if (!working_directory)
+                return log_oom();
+
+        a.fds = fds_copy;
+        a.argv = final_argv;
+        a.envp = final_env;
+        a.cgroup_paths = cgroup_paths;
+        a.logger_header[0] = stdout_header;
+        a.logger_header[1] = stderr_header;
+        a.working_directory = working_directory;
+
+        if (_unlikely_(log_get_max_level() >= LOG_DEBUG)) {
+                _cleanup_free_ char *line;
+
+                line = exec_command_line(final_argv);
+                if (line)
+                        log_unit_struct(params->unit_id,
+                                        LOG_DEBUG,
+                                        "EXECUTABLE=%s", command->path,
+                                        LOG_MESSAGE("Executing: %s", line),
+                                        NULL);
+        }
+
+        stack = mmap(NULL, EXEC_CLONE_STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0);
+        if (stack == MAP_FAILED)
+                return log_unit_error_errno(params->unit_id, errno, "Failed to allocate stack: %m");
+
+        /* Make sure none of our signal handlers runs in the child
+         * before it had a chance to reset them */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigprocmask(SIG_BLOCK, &ss, &saved_ss) >= 0);
+
+        pid = clone(exec_clone_child, (uint8_t*) stack + EXEC_CLONE_STACK_SIZE, CLONE_VM|CLONE_VFORK|SIGCHLD, &a);
+        r = pid < 0 ? -errno : 0;
+
+        assert_se(sigprocmask(SIG_SETMASK, &saved_ss, NULL) >= 0);
+        munmap(stack, EXEC_CLONE_STACK_SIZE);
+
+        if (r < 0)
+                return log_unit_error_errno(params->unit_id, r, "Failed to clone: %m");
+
+        /* The child has either called execve() successfully or
+         * exited by now, in which case it left us the reason */
+
+        if (a.oom_score_adjust_error < 0)
+                log_unit_debug_errno(params->unit_id, a.oom_score_adjust_error, "Failed to adjust OOM setting, assuming containerized execution, ignoring: %m");
+
+        for (r = 0; r < 2; r++)
+                if (a.logger_error[r] < 0)
+                        log_unit_struct(params->unit_id,
+                                        LOG_ERR,
+                                        LOG_MESSAGE("Failed to connect %s of %s to the journal socket: %s",
+                                                    r == 0 ? "stdout" : "stderr",
+                                                    params->unit_id, strerror(-a.logger_error[r])),
+                                        LOG_ERRNO(-a.logger_error[r]),
+                                        NULL);
+
+        if (a.error < 0)
+                log_unit_struct(params->unit_id,
+                                LOG_ERR,
+                                LOG_MESSAGE_ID(SD_MESSAGE_SPAWN_FAILED),
+                                "EXECUTABLE=%s", command->path,
+                                LOG_MESSAGE("Failed at step %s spawning %s: %s",
+                                            exit_status_to_string(a.exit_status, EXIT_STATUS_SYSTEMD),
+                                            command->path, strerror(-a.error)),
+                                LOG_ERRNO(a.error),
+                                NULL);
+
+        *ret = pid;
+        return 0;
+}
+
 int exec_spawn(ExecCommand *command,
                const ExecContext *context,
                const ExecParameters *params,
@@ -1860,6 +2547,16 @@ int exec_spawn(ExecCommand *command,
                         "EXECUTABLE=%s", command->path,
                         LOG_MESSAGE("About to execute: %s", line),
                         NULL);
+
+        if (exec_context_may_clone(context, params, argv)) {
+                r = exec_spawn_clone(command, context, params, argv, socket_fd, fds, n_fds, files_env, &pid);
+                if (r < 0)
+                        return r;
+
+                log_unit_debug(params->unit_id, "Cloned %s as "PID_FMT, command->path, pid);
+                goto finish;
+        }
+
         pid = fork();
         if (pid < 0)
                 return log_unit_error_errno(params->unit_id, r, "Failed to fork: %m");
@@ -1902,6 +2599,7 @@ int exec_spawn(ExecCommand *command,
         if (params->cgroup_path)
                 cg_attach(SYSTEMD_CGROUP_CONTROLLER, params->cgroup_path, pid);
 
+finish:
         exec_status_start(&command->exec_status, pid);
 
         *ret = pid;
@@ -221,6 +221,7 @@ int exec_spawn(ExecCommand *command,
                const ExecParameters *exec_params,
                ExecRuntime *runtime,
                pid_t *ret);
+void exec_spawn_set_clone(bool b);
 
 void exec_command_done(ExecCommand *c);
 void exec_command_done_array(ExecCommand *c, unsigned n);
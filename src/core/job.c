@@ -33,6 +33,7 @@
 #include "async.h"
 #include "virt.h"
 #include "dbus.h"
+#include "serialize.h"
 
 Job* job_new_raw(Unit *unit) {
         Job *j;
@@ -977,21 +978,23 @@ char *job_dbus_path(Job *j) {
 }
 
 int job_serialize(Job *j, FILE *f, FDSet *fds) {
-        fprintf(f, "job-id=%u\n", j->id);
-        fprintf(f, "job-type=%s\n", job_type_to_string(j->type));
-        fprintf(f, "job-state=%s\n", job_state_to_string(j->state));
-        fprintf(f, "job-override=%s\n", yes_no(j->override));
-        fprintf(f, "job-irreversible=%s\n", yes_no(j->irreversible));
-        fprintf(f, "job-sent-dbus-new-signal=%s\n", yes_no(j->sent_dbus_new_signal));
-        fprintf(f, "job-ignore-order=%s\n", yes_no(j->ignore_order));
+        SerializationFormat format = j->manager->serialization_format;
+
+        serialize_item_format(f, format, "job-id", "%u", j->id);
+        serialize_item(f, format, "job-type", job_type_to_string(j->type));
+        serialize_item(f, format, "job-state", job_state_to_string(j->state));
+        serialize_item(f, format, "job-override", yes_no(j->override));
+        serialize_item(f, format, "job-irreversible", yes_no(j->irreversible));
+        serialize_item(f, format, "job-sent-dbus-new-signal", yes_no(j->sent_dbus_new_signal));
+        serialize_item(f, format, "job-ignore-order", yes_no(j->ignore_order));
 
         if (j->begin_usec > 0)
-                fprintf(f, "job-begin="USEC_FMT"\n", j->begin_usec);
+                serialize_item_format(f, format, "job-begin", USEC_FMT, j->begin_usec);
 
-        bus_track_serialize(j->clients, f);
+        bus_track_serialize(j->clients, f, format);
 
         /* End marker */
-        fputc('\n', f);
+        serialize_end_marker(f, format);
         return 0;
 }
 
@@ -999,29 +1002,16 @@ int job_deserialize(Job *j, FILE *f, FDSet *fds) {
         assert(j);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
-                size_t k;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
+                SerializationItem item;
+                const char *l, *v;
+                int r;
 
-                char_array_0(line);
-                l = strstrip(line);
-
-                /* End marker */
-                if (l[0] == 0)
-                        return 0;
-
-                k = strcspn(l, "=");
+                r = deserialize_item(f, j->manager->serialization_format, &item);
+                if (r <= 0)
+                        return r;
 
-                if (l[k] == '=') {
-                        l[k] = 0;
-                        v = l+k+1;
-                } else
-                        v = l+k;
+                l = item.key;
+                v = deserialize_item_value(&item);
 
                 if (streq(l, "job-id")) {
 
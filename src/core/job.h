@@ -137,6 +137,10 @@ struct Job {
         Job* marker;
         unsigned generation;
 
+        /* Used by the ordering cycle check */
+        unsigned order_index;
+        unsigned order_lowlink;
+
         uint32_t id;
 
         JobType type;
@@ -165,6 +169,7 @@ struct Job {
         bool sent_dbus_new_signal:1;
         bool ignore_order:1;
         bool irreversible:1;
+        bool on_order_stack:1;
 };
 
 Job* job_new(Unit *unit, JobType type);
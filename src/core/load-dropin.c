@@ -38,6 +38,8 @@ static int add_dependency_consumer(
 
         assert(u);
 
+        u->n_dropin_dependencies++;
+
         r = unit_add_dependency_by_name(u, dependency, entry, filepath, true);
         if (r < 0)
                 log_error_errno(r, "Cannot add dependency %s to %s, ignoring: %m", entry, u->id);
@@ -45,6 +47,57 @@ static int add_dependency_consumer(
         return 0;
 }
 
+typedef struct DropinCheck {
+        Unit *unit;
+        unsigned n_found;
+        bool changed;
+} DropinCheck;
+
+static int check_dependency_consumer(
+                UnitDependency dependency,
+                const char *entry,
+                const char* filepath,
+                void *arg) {
+        DropinCheck *c = arg;
+
+        assert(c);
+
+        c->n_found++;
+
+        if (!unit_has_dependency_by_name(c->unit, dependency, entry))
+                c->changed = true;
+
+        return 0;
+}
+
+bool unit_dropin_dependencies_changed(Unit *u) {
+        DropinCheck c = {
+                .unit = u,
+        };
+        Iterator i;
+        char *t;
+
+        assert(u);
+
+        /* Checks whether the .wants/ and .requires/ directories still
+         * contain exactly the dependencies we loaded from them: each
+         * entry must still be there, and there must be as many as
+         * before. */
+
+        SET_FOREACH(t, u->names, i) {
+                char **p;
+
+                STRV_FOREACH(p, u->manager->lookup_paths.unit_path) {
+                        unit_file_process_dir(u->manager->unit_path_cache, *p, t, ".wants", UNIT_WANTS,
+                                              check_dependency_consumer, &c, NULL);
+                        unit_file_process_dir(u->manager->unit_path_cache, *p, t, ".requires", UNIT_REQUIRES,
+                                              check_dependency_consumer, &c, NULL);
+                }
+        }
+
+        return c.changed || c.n_found != u->n_dropin_dependencies;
+}
+
 int unit_load_dropin(Unit *u) {
         Iterator i;
         char *t, **f;
@@ -69,12 +122,8 @@ int unit_load_dropin(Unit *u) {
         if (r <= 0)
                 return 0;
 
-        STRV_FOREACH(f, u->dropin_paths) {
-                config_parse(u->id, *f, NULL,
-                             UNIT_VTABLE(u)->sections,
-                             config_item_perf_lookup, load_fragment_gperf_lookup,
-                             false, false, false, u);
-        }
+        STRV_FOREACH(f, u->dropin_paths)
+                unit_config_parse(u, *f, NULL, NULL, false);
 
         u->dropin_mtime = now(CLOCK_REALTIME);
 
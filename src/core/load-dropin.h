@@ -34,3 +34,4 @@ static inline int unit_find_dropin_paths(Unit *u, char ***paths) {
 }
 
 int unit_load_dropin(Unit *u);
+bool unit_dropin_dependencies_changed(Unit *u);
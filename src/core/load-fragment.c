@@ -165,6 +165,92 @@ int config_parse_unit_string_printf(
         return config_parse_string(unit, filename, line, section, section_line, lvalue, ltype, k, data, userdata);
 }
 
+int config_parse_unit_description(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        _cleanup_free_ char *k = NULL;
+        Unit *u = userdata;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(u);
+
+        /* Many units share their description, e.g. all instances of
+         * a template without specifiers in it, hence intern it */
+
+        r = unit_full_printf(u, rvalue, &k);
+        if (r < 0) {
+                log_syntax(unit, LOG_ERR, filename, line, r, "Failed to resolve unit specifiers on %s, ignoring: %m", rvalue);
+                return 0;
+        }
+
+        if (!utf8_is_valid(k)) {
+                log_invalid_utf8(unit, LOG_ERR, filename, line, EINVAL, k);
+                return 0;
+        }
+
+        r = string_pool_replace(u->manager->strings, &u->description, isempty(k) ? NULL : k);
+        if (r < 0)
+                return log_oom();
+
+        return 0;
+}
+
+int config_parse_unit_source_path(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        Unit *u = userdata;
+        char *p;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(u);
+
+        /* All units generated from the same file share it, hence
+         * intern it, like the fragment path */
+
+        if (!utf8_is_valid(rvalue)) {
+                log_invalid_utf8(unit, LOG_ERR, filename, line, EINVAL, rvalue);
+                return 0;
+        }
+
+        if (!path_is_absolute(rvalue)) {
+                log_syntax(unit, LOG_ERR, filename, line, EINVAL, "Not an absolute path, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        p = strdupa(rvalue);
+        path_kill_slashes(p);
+
+        r = string_pool_replace(u->manager->strings, &u->source_path, p);
+        if (r < 0)
+                return log_oom();
+
+        return 0;
+}
+
 int config_parse_unit_strv_printf(const char *unit,
                                   const char *filename,
                                   unsigned line,
@@ -1597,7 +1683,7 @@ int config_parse_socket_service(
                 return 0;
         }
 
-        unit_ref_set(&s->service, x);
+        unit_ref_set(&s->service, UNIT(s), x);
 
         return 0;
 }
@@ -1767,7 +1853,7 @@ int config_parse_busname_service(
                 return 0;
         }
 
-        unit_ref_set(&n->service, x);
+        unit_ref_set(&n->service, UNIT(n), x);
 
         return 0;
 }
@@ -2629,7 +2715,7 @@ int config_parse_unit_slice(
                 return 0;
         }
 
-        unit_ref_set(&u->slice, slice);
+        unit_ref_set(&u->slice, u, slice);
         return 0;
 }
 
@@ -3438,6 +3524,33 @@ static int open_follow(char **filename, FILE **_f, Set *names, char **_final) {
         return 0;
 }
 
+int unit_config_parse(Unit *u, const char *filename, FILE *f, const struct stat *st, bool allow_include) {
+        ConfigFile *c;
+        struct stat buf;
+
+        assert(u);
+        assert(filename);
+
+        /* Use the copy read during startup or reload, if the file
+         * didn't change since */
+        c = hashmap_get(u->manager->preparsed_files, filename);
+        if (c) {
+                if (!st && stat(filename, &buf) >= 0)
+                        st = &buf;
+
+                if (st && config_file_is_current(c, st))
+                        return config_file_apply(u->id, c,
+                                                 UNIT_VTABLE(u)->sections,
+                                                 config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                 false, false, u);
+        }
+
+        return config_parse(u->id, filename, f,
+                            UNIT_VTABLE(u)->sections,
+                            config_item_perf_lookup, load_fragment_gperf_lookup,
+                            false, allow_include, false, u);
+}
+
 static int merge_by_names(Unit **u, Set *names, const char *id) {
         char *k;
         int r;
@@ -3570,17 +3683,14 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_LOADED;
 
                 /* Now, parse the file contents */
-                r = config_parse(u->id, filename, f,
-                                 UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup, load_fragment_gperf_lookup,
-                                 false, true, false, u);
+                r = unit_config_parse(u, filename, f, &st, true);
                 if (r < 0)
                         return r;
         }
 
-        free(u->fragment_path);
-        u->fragment_path = filename;
-        filename = NULL;
+        r = string_pool_replace(u->manager->strings, &u->fragment_path, filename);
+        if (r < 0)
+                return r;
 
         u->fragment_mtime = timespec_load(&st.st_mtim);
 
@@ -3637,8 +3747,7 @@ int unit_load_fragment(Unit *u) {
                         /* Hmm, this didn't work? Then let's get rid
                          * of the fragment path stored for us, so that
                          * we don't point to an invalid location. */
-                        free(u->fragment_path);
-                        u->fragment_path = NULL;
+                        u->fragment_path = string_pool_unref(u->manager->strings, u->fragment_path);
                 }
         }
 
@@ -3731,6 +3840,8 @@ void unit_dump_config_items(FILE *f) {
                 { config_parse_unit_requires_mounts_for, "PATH [...]" },
                 { config_parse_exec_mount_flags,      "MOUNTFLAG [...]" },
                 { config_parse_unit_string_printf,    "STRING" },
+                { config_parse_unit_description,      "STRING" },
+                { config_parse_unit_source_path,      "PATH" },
                 { config_parse_trigger_unit,          "UNIT" },
                 { config_parse_timer,                 "TIMER" },
                 { config_parse_path_spec,             "PATH" },
@@ -110,6 +110,8 @@ static FILE* arg_serialization = NULL;
 static bool arg_default_cpu_accounting = false;
 static bool arg_default_blockio_accounting = false;
 static bool arg_default_memory_accounting = false;
+static usec_t arg_dbus_coalesce_usec = 0;
+static bool arg_dbus_units_changed = false;
 
 static void nop_handler(int sig) {}
 
@@ -668,6 +670,8 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultCPUAccounting",      config_parse_bool,             0, &arg_default_cpu_accounting            },
                 { "Manager", "DefaultBlockIOAccounting",  config_parse_bool,             0, &arg_default_blockio_accounting        },
                 { "Manager", "DefaultMemoryAccounting",   config_parse_bool,             0, &arg_default_memory_accounting         },
+                { "Manager", "DBusCoalesceSec",           config_parse_sec,              0, &arg_dbus_coalesce_usec                },
+                { "Manager", "DBusUnitsChangedSignal",    config_parse_bool,             0, &arg_dbus_units_changed                },
                 {}
         };
 
@@ -1000,7 +1004,10 @@ static int prepare_reexecute(Manager *m, FILE **_f, FDSet **_fds, bool switching
                 goto fail;
         }
 
-        r = manager_serialize(m, f, fds, switching_root);
+        /* The systemd binary we execute might be an older one, after
+         * a downgrade or in the new root, so let's use the format
+         * everybody understands */
+        r = manager_serialize(m, f, fds, SERIALIZATION_TEXT, switching_root);
         if (r < 0) {
                 log_error_errno(r, "Failed to serialize state: %m");
                 goto fail;
@@ -1644,6 +1651,8 @@ int main(int argc, char *argv[]) {
         m->default_memory_accounting = arg_default_memory_accounting;
         m->runtime_watchdog = arg_runtime_watchdog;
         m->shutdown_watchdog = arg_shutdown_watchdog;
+        m->dbus_coalesce_usec = arg_dbus_coalesce_usec;
+        m->send_units_changed = arg_dbus_units_changed;
 
         m->userspace_timestamp = userspace_timestamp;
         m->kernel_timestamp = kernel_timestamp;
@@ -1769,6 +1778,13 @@ int main(int argc, char *argv[]) {
                                 log_error_errno(r, "Failed to reload: %m");
                         break;
 
+                case MANAGER_RELOAD_INCREMENTAL:
+                        log_info("Reloading incrementally.");
+                        r = manager_reload_incremental(m);
+                        if (r < 0)
+                                log_error_errno(r, "Failed to reload: %m");
+                        break;
+
                 case MANAGER_REEXECUTE:
 
                         if (prepare_reexecute(m, &arg_serialization, &fds, false) < 0) {
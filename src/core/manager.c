@@ -71,6 +71,8 @@
 #include "dbus-manager.h"
 #include "bus-kernel.h"
 #include "time-util.h"
+#include "conf-parser.h"
+#include "load-dropin.h"
 
 /* Initial delay and the interval for printing status messages about running jobs */
 #define JOBS_IN_PROGRESS_WAIT_USEC (5*USEC_PER_SEC)
@@ -544,6 +546,16 @@ int manager_new(SystemdRunningAs running_as, bool test_run, Manager **_m) {
 
         m->test_run = test_run;
 
+        /* Tests have to opt in to the unit file cache. It is kept
+         * below /run, since the unit files are read long before /var
+         * is mounted, and the root file system might be read-only. */
+        if (!test_run) {
+                if (running_as == SYSTEMD_SYSTEM)
+                        m->unit_cache_path = strdup("/run/systemd/unit-files.cache");
+                else if (getenv("XDG_RUNTIME_DIR"))
+                        m->unit_cache_path = strappend(getenv("XDG_RUNTIME_DIR"), "/systemd/unit-files.cache");
+        }
+
         /* Reboot immediately if the user hits C-A-D more often than 7x per 2s */
         RATELIMIT_INIT(m->ctrl_alt_del_ratelimit, 2 * USEC_PER_SEC, 7);
 
@@ -559,6 +571,12 @@ int manager_new(SystemdRunningAs running_as, bool test_run, Manager **_m) {
         if (r < 0)
                 goto fail;
 
+        m->strings = string_pool_new();
+        if (!m->strings) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
         r = hashmap_ensure_allocated(&m->cgroup_unit, &string_hash_ops);
         if (r < 0)
                 goto fail;
@@ -898,17 +916,20 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->units);
         hashmap_free(m->jobs);
+        string_pool_free(m->strings);
         hashmap_free(m->watch_pids1);
         hashmap_free(m->watch_pids2);
         hashmap_free(m->watch_bus);
 
         set_free(m->startup_units);
         set_free(m->failed_units);
+        set_free(m->dbus_units_changed);
 
         sd_event_source_unref(m->signal_event_source);
         sd_event_source_unref(m->notify_event_source);
         sd_event_source_unref(m->time_change_event_source);
         sd_event_source_unref(m->jobs_in_progress_event_source);
+        sd_event_source_unref(m->dbus_coalesce_event_source);
         sd_event_source_unref(m->idle_pipe_event_source);
         sd_event_source_unref(m->run_queue_event_source);
 
@@ -931,6 +952,9 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        manager_free_preparsed_files(m);
+        free(m->unit_cache_path);
+        execute_timings_free(m->generator_timings, m->n_generator_timings);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -973,7 +997,7 @@ int manager_enumerate(Manager *m) {
         return r;
 }
 
-static int manager_coldplug(Manager *m) {
+static int manager_coldplug(Manager *m, Set *only) {
         int r = 0;
         Iterator i;
         Unit *u;
@@ -1010,6 +1034,9 @@ static int manager_coldplug(Manager *m) {
                 if (u->id != k)
                         continue;
 
+                if (only && !set_contains(only, u))
+                        continue;
+
                 q = unit_coldplug(u, deferred_work);
                 if (q < 0)
                         r = q;
@@ -1087,6 +1114,200 @@ fail:
 }
 
 
+void manager_free_preparsed_files(Manager *m) {
+        ConfigFile *c;
+
+        assert(m);
+
+        while ((c = hashmap_steal_first(m->preparsed_files)))
+                config_file_free(c);
+
+        hashmap_free(m->preparsed_files);
+        m->preparsed_files = NULL;
+
+        /* Only after the files referring to it are gone */
+        m->unit_cache = unit_cache_free(m->unit_cache);
+}
+
+static int manager_add_preparsed_files(Manager *m, char **paths, bool allow_include, unsigned *n_hits, unsigned *n_misses) {
+        _cleanup_free_ char **misses = NULL;
+        ConfigFile **files = NULL;
+        unsigned i, n, n_threads, k = 0;
+        long cpus;
+        int r;
+
+        assert(m);
+        assert(n_hits);
+        assert(n_misses);
+
+        n = strv_length(paths);
+        if (n == 0)
+                return 0;
+
+        misses = new(char*, n + 1);
+        if (!misses)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                ConfigFile *c;
+
+                c = unit_cache_take(m->unit_cache, paths[i], allow_include);
+                if (!c) {
+                        misses[k++] = paths[i];
+                        continue;
+                }
+
+                r = hashmap_put(m->preparsed_files, config_file_get_filename(c), c);
+                if (r < 0) {
+                        config_file_free(c);
+                        return r;
+                }
+
+                (*n_hits)++;
+        }
+
+        misses[k] = NULL;
+
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = cpus > 0 ? (unsigned) cpus : 1;
+
+        r = config_file_load_many(misses, allow_include, n_threads, &files);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < k; i++) {
+                if (!files[i])
+                        continue;
+
+                if (r >= 0)
+                        r = hashmap_put(m->preparsed_files, config_file_get_filename(files[i]), files[i]);
+
+                if (r < 0)
+                        config_file_free(files[i]);
+                else
+                        (*n_misses)++;
+        }
+
+        free(files);
+        return r;
+}
+
+int manager_preparse_unit_files(Manager *m) {
+        _cleanup_free_ char **fragments = NULL;
+        _cleanup_strv_free_ char **dropins = NULL;
+        size_t n_fragments = 0, n_dropins = 0, n_dropins_allocated = 0;
+        unsigned n_hits = 0, n_misses = 0;
+        char ts[FORMAT_TIMESPAN_MAX];
+        dual_timestamp t;
+        Iterator i;
+        char *p;
+        int r;
+
+        assert(m);
+
+        /* Reading and tokenizing unit files takes a good part of
+         * the time we spend loading units. Do that for all files in
+         * the unit path on all CPUs ahead of time, so that
+         * unit_load() only has to interpret the result. Files that
+         * did not change since the last time are taken from the
+         * unit file cache instead. */
+
+        manager_free_preparsed_files(m);
+
+        if (!m->unit_path_cache)
+                return 0;
+
+        dual_timestamp_get(&t);
+
+        if (m->unit_cache_path) {
+                r = unit_cache_open(m->unit_cache_path, &m->unit_cache);
+                if (r < 0 && r != -ENOENT)
+                        log_debug_errno(r, "Failed to open unit file cache %s, ignoring: %m", m->unit_cache_path);
+        }
+
+        m->preparsed_files = hashmap_new(&string_hash_ops);
+        if (!m->preparsed_files)
+                return -ENOMEM;
+
+        fragments = new(char*, set_size(m->unit_path_cache) + 1);
+        if (!fragments)
+                return -ENOMEM;
+
+        SET_FOREACH(p, m->unit_path_cache, i) {
+                _cleanup_closedir_ DIR *d = NULL;
+                _cleanup_free_ char *name = NULL;
+                struct dirent *de;
+                const char *e;
+
+                if (unit_name_is_valid(basename(p), TEMPLATE_VALID)) {
+                        fragments[n_fragments++] = p;
+                        continue;
+                }
+
+                e = endswith(p, ".d");
+                if (!e)
+                        continue;
+
+                name = strndup(basename(p), e - basename(p));
+                if (!name)
+                        return -ENOMEM;
+
+                if (!unit_name_is_valid(name, TEMPLATE_VALID))
+                        continue;
+
+                d = opendir(p);
+                if (!d)
+                        continue;
+
+                FOREACH_DIRENT(de, d, break) {
+                        if (!dirent_is_file_with_suffix(de, ".conf"))
+                                continue;
+
+                        if (!GREEDY_REALLOC(dropins, n_dropins_allocated, n_dropins + 2))
+                                return -ENOMEM;
+
+                        dropins[n_dropins] = strjoin(p, "/", de->d_name, NULL);
+                        if (!dropins[n_dropins])
+                                return -ENOMEM;
+
+                        dropins[++n_dropins] = NULL;
+                }
+        }
+
+        fragments[n_fragments] = NULL;
+
+        r = manager_add_preparsed_files(m, fragments, true, &n_hits, &n_misses);
+        if (r < 0)
+                return r;
+
+        r = manager_add_preparsed_files(m, dropins, false, &n_hits, &n_misses);
+        if (r < 0)
+                return r;
+
+        log_debug("Read %u of %zu unit files and drop-ins ahead of time in %s, %u of them from the cache.",
+                  hashmap_size(m->preparsed_files), n_fragments + n_dropins,
+                  format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - t.monotonic, USEC_PER_MSEC),
+                  n_hits);
+
+        if (!m->unit_cache_path)
+                return 0;
+
+        m->unit_cache_hits += n_hits;
+        m->unit_cache_misses += n_misses;
+
+        /* Rewrite the cache if anything changed. Leave out files
+         * modified shortly before we started reading, as a later
+         * modification might end up with the same timestamp. */
+        if (n_misses > 0 || n_hits != unit_cache_size(m->unit_cache)) {
+                r = unit_cache_write(m->unit_cache_path, m->preparsed_files,
+                                      t.realtime > USEC_PER_SEC ? t.realtime - USEC_PER_SEC : 0);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write unit file cache %s, ignoring: %m", m->unit_cache_path);
+        }
+
+        return 0;
+}
+
 static int manager_distribute_fds(Manager *m, FDSet *fds) {
         Unit *u;
         Iterator i;
@@ -1131,6 +1352,12 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         manager_build_unit_path_cache(m);
 
+        r = manager_preparse_unit_files(m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to read unit files ahead of time, ignoring: %m");
+                manager_free_preparsed_files(m);
+        }
+
         /* If we will deserialize make sure that during enumeration
          * this is already known, so we increase the counter here
          * already */
@@ -1169,7 +1396,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         bus_track_coldplug(m, &m->subscribed, &m->deserialized_subscribed);
 
         /* Third, fire things up! */
-        q = manager_coldplug(m);
+        q = manager_coldplug(m, NULL);
         if (q < 0 && r == 0)
                 r = q;
 
@@ -1337,10 +1564,10 @@ int manager_load_unit_prepare(
                 return -ENOMEM;
 
         if (path) {
-                ret->fragment_path = strdup(path);
-                if (!ret->fragment_path) {
+                r = string_pool_replace(m->strings, &ret->fragment_path, path);
+                if (r < 0) {
                         unit_free(ret);
-                        return -ENOMEM;
+                        return r;
                 }
         }
 
@@ -1443,16 +1670,13 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         return 1;
 }
 
-static unsigned manager_dispatch_dbus_queue(Manager *m) {
+static unsigned manager_flush_dbus_queue(Manager *m) {
         Job *j;
         Unit *u;
         unsigned n = 0;
 
         assert(m);
 
-        if (m->dispatching_dbus_queue)
-                return 0;
-
         m->dispatching_dbus_queue = true;
 
         while ((u = m->dbus_unit_queue)) {
@@ -1469,6 +1693,11 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
                 n++;
         }
 
+        if (!set_isempty(m->dbus_units_changed)) {
+                bus_manager_send_units_changed(m);
+                n++;
+        }
+
         m->dispatching_dbus_queue = false;
 
         if (m->send_reloading_done) {
@@ -1483,6 +1712,56 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
         return n;
 }
 
+static int manager_dispatch_dbus_coalesce(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(source);
+
+        m->dbus_coalesce_event_source = sd_event_source_unref(m->dbus_coalesce_event_source);
+
+        manager_flush_dbus_queue(m);
+        return 0;
+}
+
+static unsigned manager_dispatch_dbus_queue(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->dispatching_dbus_queue)
+                return 0;
+
+        if (!m->dbus_unit_queue && !m->dbus_job_queue &&
+            set_isempty(m->dbus_units_changed) &&
+            !m->send_reloading_done && !m->queued_message)
+                return 0;
+
+        /* Hold back the signals for a bit, unless somebody waits
+         * for the reply to a reload */
+        if (m->dbus_coalesce_usec > 0 &&
+            !m->send_reloading_done && !m->queued_message) {
+
+                if (m->dbus_coalesce_event_source)
+                        return 0;
+
+                r = sd_event_add_time(
+                                m->event,
+                                &m->dbus_coalesce_event_source,
+                                CLOCK_MONOTONIC,
+                                now(CLOCK_MONOTONIC) + m->dbus_coalesce_usec, 1,
+                                manager_dispatch_dbus_coalesce, m);
+                if (r >= 0)
+                        return 0;
+
+                log_warning_errno(r, "Failed to add D-Bus coalescing timer, sending signals right away: %m");
+        }
+
+        m->dbus_coalesce_event_source = sd_event_source_unref(m->dbus_coalesce_event_source);
+
+        return manager_flush_dbus_queue(m);
+}
+
 static void manager_invoke_notify_message(Manager *m, Unit *u, pid_t pid, char *buf, size_t n, FDSet *fds) {
         _cleanup_strv_free_ char **tags = NULL;
 
@@ -2003,6 +2282,7 @@ int manager_loop(Manager *m) {
         /* Release the path cache */
         set_free_free(m->unit_path_cache);
         m->unit_path_cache = NULL;
+        manager_free_preparsed_files(m);
 
         manager_check_finished(m);
 
@@ -2238,7 +2518,7 @@ int manager_open_serialization(Manager *m, FILE **_f) {
         return 0;
 }
 
-int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
+int manager_serialize(Manager *m, FILE *f, FDSet *fds, SerializationFormat format, bool switching_root) {
         Iterator i;
         Unit *u;
         const char *t;
@@ -2250,26 +2530,29 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
         assert(fds);
 
         m->n_reloading ++;
+        m->serialization_format = format;
+
+        serialize_header(f, format);
 
-        fprintf(f, "current-job-id=%"PRIu32"\n", m->current_job_id);
-        fprintf(f, "taint-usr=%s\n", yes_no(m->taint_usr));
-        fprintf(f, "n-installed-jobs=%u\n", m->n_installed_jobs);
-        fprintf(f, "n-failed-jobs=%u\n", m->n_failed_jobs);
+        serialize_item_format(f, format, "current-job-id", "%"PRIu32, m->current_job_id);
+        serialize_item(f, format, "taint-usr", yes_no(m->taint_usr));
+        serialize_item_format(f, format, "n-installed-jobs", "%u", m->n_installed_jobs);
+        serialize_item_format(f, format, "n-failed-jobs", "%u", m->n_failed_jobs);
 
-        dual_timestamp_serialize(f, "firmware-timestamp", &m->firmware_timestamp);
-        dual_timestamp_serialize(f, "loader-timestamp", &m->loader_timestamp);
-        dual_timestamp_serialize(f, "kernel-timestamp", &m->kernel_timestamp);
-        dual_timestamp_serialize(f, "initrd-timestamp", &m->initrd_timestamp);
+        serialize_dual_timestamp(f, format, "firmware-timestamp", &m->firmware_timestamp);
+        serialize_dual_timestamp(f, format, "loader-timestamp", &m->loader_timestamp);
+        serialize_dual_timestamp(f, format, "kernel-timestamp", &m->kernel_timestamp);
+        serialize_dual_timestamp(f, format, "initrd-timestamp", &m->initrd_timestamp);
 
         if (!in_initrd()) {
-                dual_timestamp_serialize(f, "userspace-timestamp", &m->userspace_timestamp);
-                dual_timestamp_serialize(f, "finish-timestamp", &m->finish_timestamp);
-                dual_timestamp_serialize(f, "security-start-timestamp", &m->security_start_timestamp);
-                dual_timestamp_serialize(f, "security-finish-timestamp", &m->security_finish_timestamp);
-                dual_timestamp_serialize(f, "generators-start-timestamp", &m->generators_start_timestamp);
-                dual_timestamp_serialize(f, "generators-finish-timestamp", &m->generators_finish_timestamp);
-                dual_timestamp_serialize(f, "units-load-start-timestamp", &m->units_load_start_timestamp);
-                dual_timestamp_serialize(f, "units-load-finish-timestamp", &m->units_load_finish_timestamp);
+                serialize_dual_timestamp(f, format, "userspace-timestamp", &m->userspace_timestamp);
+                serialize_dual_timestamp(f, format, "finish-timestamp", &m->finish_timestamp);
+                serialize_dual_timestamp(f, format, "security-start-timestamp", &m->security_start_timestamp);
+                serialize_dual_timestamp(f, format, "security-finish-timestamp", &m->security_finish_timestamp);
+                serialize_dual_timestamp(f, format, "generators-start-timestamp", &m->generators_start_timestamp);
+                serialize_dual_timestamp(f, format, "generators-finish-timestamp", &m->generators_finish_timestamp);
+                serialize_dual_timestamp(f, format, "units-load-start-timestamp", &m->units_load_start_timestamp);
+                serialize_dual_timestamp(f, format, "units-load-finish-timestamp", &m->units_load_finish_timestamp);
         }
 
         if (!switching_root) {
@@ -2280,7 +2563,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                         if (!ce)
                                 return -ENOMEM;
 
-                        fprintf(f, "env=%s\n", *e);
+                        serialize_item(f, format, "env", *e);
                 }
         }
 
@@ -2291,8 +2574,8 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy < 0)
                         return copy;
 
-                fprintf(f, "notify-fd=%i\n", copy);
-                fprintf(f, "notify-socket=%s\n", m->notify_socket);
+                serialize_item_format(f, format, "notify-fd", "%i", copy);
+                serialize_item(f, format, "notify-socket", m->notify_socket);
         }
 
         if (m->kdbus_fd >= 0) {
@@ -2302,20 +2585,19 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy < 0)
                         return copy;
 
-                fprintf(f, "kdbus-fd=%i\n", copy);
+                serialize_item_format(f, format, "kdbus-fd", "%i", copy);
         }
 
-        bus_track_serialize(m->subscribed, f);
+        bus_track_serialize(m->subscribed, f, format);
 
-        fputc('\n', f);
+        serialize_end_marker(f, format);
 
         HASHMAP_FOREACH_KEY(u, t, m->units, i) {
                 if (u->id != t)
                         continue;
 
                 /* Start marker */
-                fputs(u->id, f);
-                fputc('\n', f);
+                serialize_item(f, format, u->id, NULL);
 
                 r = unit_serialize(u, f, fds, !switching_root);
                 if (r < 0) {
@@ -2345,88 +2627,87 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
 
         log_debug("Deserializing state...");
 
+        m->serialization_format = deserialize_header(f);
+        if (m->serialization_format < 0)
+                return -EBADMSG;
+
         m->n_reloading ++;
 
         for (;;) {
-                char line[LINE_MAX], *l;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
+                SerializationItem item;
+                const char *l, *v;
 
+                r = deserialize_item(f, m->serialization_format, &item);
+                if (r < 0)
                         goto finish;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                if (l[0] == 0)
+                if (r == 0)
                         break;
 
-                if (startswith(l, "current-job-id=")) {
+                l = item.key;
+                v = item.value;
+
+                if (streq(l, "current-job-id")) {
                         uint32_t id;
 
-                        if (safe_atou32(l+15, &id) < 0)
-                                log_debug("Failed to parse current job id value %s", l+15);
+                        if (safe_atou32(v, &id) < 0)
+                                log_debug("Failed to parse current job id value %s", v);
                         else
                                 m->current_job_id = MAX(m->current_job_id, id);
 
-                } else if (startswith(l, "n-installed-jobs=")) {
+                } else if (streq(l, "n-installed-jobs")) {
                         uint32_t n;
 
-                        if (safe_atou32(l+17, &n) < 0)
-                                log_debug("Failed to parse installed jobs counter %s", l+17);
+                        if (safe_atou32(v, &n) < 0)
+                                log_debug("Failed to parse installed jobs counter %s", v);
                         else
                                 m->n_installed_jobs += n;
 
-                } else if (startswith(l, "n-failed-jobs=")) {
+                } else if (streq(l, "n-failed-jobs")) {
                         uint32_t n;
 
-                        if (safe_atou32(l+14, &n) < 0)
-                                log_debug("Failed to parse failed jobs counter %s", l+14);
+                        if (safe_atou32(v, &n) < 0)
+                                log_debug("Failed to parse failed jobs counter %s", v);
                         else
                                 m->n_failed_jobs += n;
 
-                } else if (startswith(l, "taint-usr=")) {
+                } else if (streq(l, "taint-usr")) {
                         int b;
 
-                        b = parse_boolean(l+10);
+                        b = parse_boolean(v);
                         if (b < 0)
-                                log_debug("Failed to parse taint /usr flag %s", l+10);
+                                log_debug("Failed to parse taint /usr flag %s", v);
                         else
                                 m->taint_usr = m->taint_usr || b;
 
-                } else if (startswith(l, "firmware-timestamp="))
-                        dual_timestamp_deserialize(l+19, &m->firmware_timestamp);
-                else if (startswith(l, "loader-timestamp="))
-                        dual_timestamp_deserialize(l+17, &m->loader_timestamp);
-                else if (startswith(l, "kernel-timestamp="))
-                        dual_timestamp_deserialize(l+17, &m->kernel_timestamp);
-                else if (startswith(l, "initrd-timestamp="))
-                        dual_timestamp_deserialize(l+17, &m->initrd_timestamp);
-                else if (startswith(l, "userspace-timestamp="))
-                        dual_timestamp_deserialize(l+20, &m->userspace_timestamp);
-                else if (startswith(l, "finish-timestamp="))
-                        dual_timestamp_deserialize(l+17, &m->finish_timestamp);
-                else if (startswith(l, "security-start-timestamp="))
-                        dual_timestamp_deserialize(l+25, &m->security_start_timestamp);
-                else if (startswith(l, "security-finish-timestamp="))
-                        dual_timestamp_deserialize(l+26, &m->security_finish_timestamp);
-                else if (startswith(l, "generators-start-timestamp="))
-                        dual_timestamp_deserialize(l+27, &m->generators_start_timestamp);
-                else if (startswith(l, "generators-finish-timestamp="))
-                        dual_timestamp_deserialize(l+28, &m->generators_finish_timestamp);
-                else if (startswith(l, "units-load-start-timestamp="))
-                        dual_timestamp_deserialize(l+27, &m->units_load_start_timestamp);
-                else if (startswith(l, "units-load-finish-timestamp="))
-                        dual_timestamp_deserialize(l+28, &m->units_load_finish_timestamp);
-                else if (startswith(l, "env=")) {
+                } else if (streq(l, "firmware-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->firmware_timestamp);
+                else if (streq(l, "loader-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->loader_timestamp);
+                else if (streq(l, "kernel-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->kernel_timestamp);
+                else if (streq(l, "initrd-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->initrd_timestamp);
+                else if (streq(l, "userspace-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->userspace_timestamp);
+                else if (streq(l, "finish-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->finish_timestamp);
+                else if (streq(l, "security-start-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->security_start_timestamp);
+                else if (streq(l, "security-finish-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->security_finish_timestamp);
+                else if (streq(l, "generators-start-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->generators_start_timestamp);
+                else if (streq(l, "generators-finish-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->generators_finish_timestamp);
+                else if (streq(l, "units-load-start-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->units_load_start_timestamp);
+                else if (streq(l, "units-load-finish-timestamp"))
+                        deserialize_dual_timestamp(&item, &m->units_load_finish_timestamp);
+                else if (streq(l, "env")) {
                         _cleanup_free_ char *uce = NULL;
                         char **e;
 
-                        r = cunescape(l + 4, UNESCAPE_RELAX, &uce);
+                        r = cunescape(v, UNESCAPE_RELAX, &uce);
                         if (r < 0)
                                 goto finish;
 
@@ -2439,21 +2720,21 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         strv_free(m->environment);
                         m->environment = e;
 
-                } else if (startswith(l, "notify-fd=")) {
+                } else if (streq(l, "notify-fd")) {
                         int fd;
 
-                        if (safe_atoi(l + 10, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
-                                log_debug("Failed to parse notify fd: %s", l + 10);
+                        if (safe_atoi(v, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
+                                log_debug("Failed to parse notify fd: %s", v);
                         else {
                                 m->notify_event_source = sd_event_source_unref(m->notify_event_source);
                                 safe_close(m->notify_fd);
                                 m->notify_fd = fdset_remove(fds, fd);
                         }
 
-                } else if (startswith(l, "notify-socket=")) {
+                } else if (streq(l, "notify-socket")) {
                         char *n;
 
-                        n = strdup(l+14);
+                        n = strdup(v);
                         if (!n) {
                                 r = -ENOMEM;
                                 goto finish;
@@ -2462,11 +2743,11 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         free(m->notify_socket);
                         m->notify_socket = n;
 
-                } else if (startswith(l, "kdbus-fd=")) {
+                } else if (streq(l, "kdbus-fd")) {
                         int fd;
 
-                        if (safe_atoi(l + 9, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
-                                log_debug("Failed to parse kdbus fd: %s", l + 9);
+                        if (safe_atoi(v, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
+                                log_debug("Failed to parse kdbus fd: %s", v);
                         else {
                                 safe_close(m->kdbus_fd);
                                 m->kdbus_fd = fdset_remove(fds, fd);
@@ -2475,7 +2756,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 } else {
                         int k;
 
-                        k = bus_track_deserialize_item(&m->deserialized_subscribed, l);
+                        k = bus_track_deserialize_item(&m->deserialized_subscribed, l, deserialize_item_value(&item));
                         if (k < 0)
                                 log_debug_errno(k, "Failed to deserialize bus tracker object: %m");
                         else if (k == 0)
@@ -2484,22 +2765,15 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
         }
 
         for (;;) {
+                SerializationItem item;
                 Unit *u;
-                char name[UNIT_NAME_MAX+2];
 
                 /* Start marker */
-                if (!fgets(name, sizeof(name), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
-
+                r = deserialize_item(f, m->serialization_format, &item);
+                if (r <= 0)
                         goto finish;
-                }
 
-                char_array_0(name);
-
-                r = manager_load_unit(m, strstrip(name), NULL, NULL, &u);
+                r = manager_load_unit(m, item.key, NULL, NULL, &u);
                 if (r < 0)
                         goto finish;
 
@@ -2538,7 +2812,7 @@ int manager_reload(Manager *m) {
                 return -ENOMEM;
         }
 
-        r = manager_serialize(m, f, fds, false);
+        r = manager_serialize(m, f, fds, SERIALIZATION_BINARY, false);
         if (r < 0) {
                 m->n_reloading --;
                 return r;
@@ -2570,6 +2844,12 @@ int manager_reload(Manager *m) {
 
         manager_build_unit_path_cache(m);
 
+        q = manager_preparse_unit_files(m);
+        if (q < 0) {
+                log_warning_errno(q, "Failed to read unit files ahead of time, ignoring: %m");
+                manager_free_preparsed_files(m);
+        }
+
         /* First, enumerate what we can from all config files */
         q = manager_enumerate(m);
         if (q < 0 && r >= 0)
@@ -2589,10 +2869,326 @@ int manager_reload(Manager *m) {
                 r = q;
 
         /* Third, fire things up! */
-        q = manager_coldplug(m);
+        q = manager_coldplug(m, NULL);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        manager_free_preparsed_files(m);
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        m->send_reloading_done = true;
+
+        return r;
+}
+
+typedef struct OwnedDependencies {
+        Unit *owner;
+        char *id;
+        unsigned to, from;
+} OwnedDependencies;
+
+typedef struct SavedRef {
+        UnitRef *ref;
+        Unit *source;
+        char *id;
+} SavedRef;
+
+static bool manager_unit_file_moved(Manager *m, Unit *u) {
+        _cleanup_free_ char *template = NULL, *a = NULL, *b = NULL;
+        const char *names[3] = {};
+        char **p;
+
+        assert(m);
+        assert(u);
+
+        /* Checks whether the unit's fragment would now be found
+         * somewhere else than where we loaded it from, for example
+         * because a file was created in a directory earlier in the
+         * search path, or because a unit file appeared for a unit
+         * that had none before. */
+
+        names[0] = u->id;
+        if (u->instance) {
+                template = unit_name_template(u->id);
+                names[1] = template;
+        }
+
+        STRV_FOREACH(p, m->lookup_paths.unit_path) {
+                const char **n;
+
+                for (n = names; *n; n++) {
+                        _cleanup_free_ char *path = NULL;
+
+                        path = strjoin(*p, "/", *n, NULL);
+                        if (!path)
+                                return true;
+
+                        if (m->unit_path_cache ? !set_get(m->unit_path_cache, path) : access(path, F_OK) < 0)
+                                continue;
+
+                        if (!u->fragment_path)
+                                return true;
+
+                        if (path_equal(path, u->fragment_path))
+                                return false;
+
+                        a = canonicalize_file_name(path);
+                        b = canonicalize_file_name(u->fragment_path);
+
+                        return !a || !b || !path_equal(a, b);
+                }
+        }
+
+        return !!u->fragment_path;
+}
+
+int manager_reload_incremental(Manager *m) {
+        _cleanup_set_free_ Set *changed = NULL, *reloaded = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        OwnedDependencies *owned = NULL;
+        SavedRef *refs = NULL;
+        size_t n_owned = 0, n_owned_allocated = 0, n_refs = 0, n_refs_allocated = 0, k;
+        Iterator i;
+        char **n;
+        Unit *u;
+        const char *t;
+        int r, q;
+
+        assert(m);
+
+        /* Like manager_reload(), but only reloads the units whose
+         * fragments, drop-ins or .wants/ and .requires/ directories
+         * changed, leaving all other units untouched. Generators are
+         * not rerun. Dependencies between the reloaded units and the
+         * others that were configured by the other side are restored
+         * afterwards. */
+
+        manager_dispatch_cleanup_queue(m);
+        manager_build_unit_path_cache(m);
+
+        changed = set_new(NULL);
+        if (!changed)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(u, t, m->units, i) {
+                if (u->id != t)
+                        continue;
+
+                if (u->transient || u->load_state == UNIT_MERGED)
+                        continue;
+
+                if (!unit_need_daemon_reload(u) &&
+                    !unit_dropin_dependencies_changed(u) &&
+                    !manager_unit_file_moved(m, u))
+                        continue;
+
+                if (UNIT_VTABLE(u)->enumerate) {
+                        /* Units of these types are created by
+                         * enumeration, too, which we don't know how
+                         * to do for just some of them. */
+                        log_debug("Unit %s changed, which we cannot reload incrementally, doing a full reload.", u->id);
+                        return manager_reload(m);
+                }
+
+                log_debug("Unit %s changed, reloading it.", u->id);
+
+                r = set_put(changed, u);
+                if (r < 0)
+                        return r;
+        }
+
+        if (set_isempty(changed)) {
+                log_debug("No unit files changed, nothing to reload.");
+                return 0;
+        }
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return r;
+
+        fds = fdset_new();
+        if (!fds)
+                return -ENOMEM;
+
+        m->n_reloading ++;
+        bus_manager_send_reloading(m, true);
+
+        /* Everything we need to know about the changed units after
+         * they are gone: their state... */
+        m->serialization_format = SERIALIZATION_BINARY;
+        serialize_header(f, m->serialization_format);
+        serialize_end_marker(f, m->serialization_format);
+
+        SET_FOREACH(u, changed, i) {
+                serialize_item(f, m->serialization_format, u->id, NULL);
+
+                r = unit_serialize(u, f, fds, true);
+                if (r < 0)
+                        goto finish;
+        }
+
+        if (fflush(f) != 0 || ferror(f)) {
+                r = -EIO;
+                goto finish;
+        }
+
+        if (fseeko(f, 0, SEEK_SET) < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        SET_FOREACH(u, changed, i) {
+                Iterator j;
+                UnitDependency d;
+                UnitRef *ref;
+                Unit *other;
+                char *name;
+
+                /* ...the names they were loaded by... */
+                r = strv_extend(&names, u->id);
+                if (r < 0)
+                        goto finish;
+
+                SET_FOREACH(name, u->names, j)
+                        if (name != u->id) {
+                                r = strv_extend(&names, name);
+                                if (r < 0)
+                                        goto finish;
+                        }
+
+                /* ...the dependencies other units configured on
+                 * them... */
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                        SET_FOREACH(other, u->dependencies[d], j) {
+                                unsigned to, from;
+
+                                if (set_contains(changed, other))
+                                        continue;
+
+                                unit_get_owned_dependencies(other, u, &to, &from);
+                                if (to == 0 && from == 0)
+                                        continue;
+
+                                for (k = 0; k < n_owned; k++)
+                                        if (owned[k].owner == other && streq(owned[k].id, u->id))
+                                                break;
+                                if (k < n_owned)
+                                        continue;
+
+                                if (!GREEDY_REALLOC(owned, n_owned_allocated, n_owned + 1)) {
+                                        r = -ENOMEM;
+                                        goto finish;
+                                }
+
+                                owned[n_owned] = (OwnedDependencies) {
+                                        .owner = other,
+                                        .id = strdup(u->id),
+                                        .to = to,
+                                        .from = from,
+                                };
+                                if (!owned[n_owned++].id) {
+                                        r = -ENOMEM;
+                                        goto finish;
+                                }
+                        }
+
+                /* ...and the references other units hold to them */
+                LIST_FOREACH(refs, ref, u->refs) {
+                        if (set_contains(changed, ref->source))
+                                continue;
+
+                        if (!GREEDY_REALLOC(refs, n_refs_allocated, n_refs + 1)) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        refs[n_refs] = (SavedRef) {
+                                .ref = ref,
+                                .source = ref->source,
+                                .id = strdup(u->id),
+                        };
+                        if (!refs[n_refs++].id) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+                }
+        }
+
+        /* From here on there is no way back. */
+        SET_FOREACH(u, changed, i) {
+                ExecContext *ec;
+
+                /* Coldplugging will count them again */
+                ec = unit_get_exec_context(u);
+                if (ec && exec_context_may_touch_console(ec) &&
+                    !UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(u)) &&
+                    m->n_on_console > 0)
+                        m->n_on_console --;
+        }
+
+        while ((u = set_steal_first(changed)))
+                unit_free(u);
+
+        reloaded = set_new(NULL);
+        if (!reloaded) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        STRV_FOREACH(n, names) {
+                q = manager_load_unit(m, *n, NULL, NULL, &u);
+                if (q < 0) {
+                        log_warning_errno(q, "Failed to reload unit %s: %m", *n);
+                        if (r >= 0)
+                                r = q;
+                        continue;
+                }
+
+                q = set_put(reloaded, unit_follow_merge(u));
+                if (q < 0 && r >= 0)
+                        r = q;
+        }
+
+        for (k = 0; k < n_owned; k++) {
+                u = manager_get_unit(m, owned[k].id);
+                if (!u)
+                        continue;
+
+                q = unit_add_owned_dependencies(owned[k].owner, u, owned[k].to, owned[k].from);
+                if (q < 0) {
+                        log_warning_errno(q, "Failed to restore dependencies of %s on %s: %m", owned[k].owner->id, u->id);
+                        if (r >= 0)
+                                r = q;
+                }
+        }
+
+        for (k = 0; k < n_refs; k++) {
+                u = manager_get_unit(m, refs[k].id);
+                if (u && !UNIT_ISSET(*refs[k].ref))
+                        unit_ref_set(refs[k].ref, refs[k].source, u);
+        }
+
+        q = manager_deserialize(m, f, fds);
         if (q < 0 && r >= 0)
                 r = q;
 
+        q = manager_coldplug(m, reloaded);
+        if (q < 0 && r >= 0)
+                r = q;
+
+finish:
+        for (k = 0; k < n_owned; k++)
+                free(owned[k].id);
+        free(owned);
+
+        for (k = 0; k < n_refs; k++)
+                free(refs[k].id);
+        free(refs);
+
         assert(m->n_reloading > 0);
         m->n_reloading--;
 
@@ -2740,7 +3336,7 @@ void manager_check_finished(Manager *m) {
 
         SET_FOREACH(u, m->startup_units, i)
                 if (u->cgroup_path)
-                        cgroup_context_apply(unit_get_cgroup_context(u), unit_get_cgroup_mask(u), u->cgroup_path, manager_state(m));
+                        cgroup_context_apply(u, unit_get_cgroup_mask(u), manager_state(m));
 }
 
 static int create_generator_dir(Manager *m, char **generator, const char *name) {
@@ -2817,8 +3413,20 @@ static void trim_generator_dir(Manager *m, char **generator) {
         return;
 }
 
+static unsigned generator_parallelism(void) {
+        long cpus;
+
+        /* Generators mostly wait for the file system, so run a few
+         * more of them than we have CPUs */
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        return cpus > 0 ? (unsigned) cpus * 2 : 2;
+}
+
 static int manager_run_generators(Manager *m) {
         _cleanup_free_ char **paths = NULL;
+        ExecuteTiming *timings = NULL;
+        unsigned n_timings = 0, i;
         const char *argv[5];
         char **path;
         int r;
@@ -2863,7 +3471,22 @@ static int manager_run_generators(Manager *m) {
         argv[4] = NULL;
 
         RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC, (char**) argv);
+                (void) execute_directories_full((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
+                                                generator_parallelism(), (char**) argv,
+                                                &timings, &n_timings);
+
+        for (i = 0; i < n_timings; i++) {
+                char tw[FORMAT_TIMESPAN_MAX], tc[FORMAT_TIMESPAN_MAX];
+
+                log_debug("%s took %s (%s CPU).",
+                          timings[i].path,
+                          format_timespan(tw, sizeof(tw), timings[i].wall, USEC_PER_MSEC),
+                          format_timespan(tc, sizeof(tc), timings[i].cpu, USEC_PER_MSEC));
+        }
+
+        execute_timings_free(m->generator_timings, m->n_generator_timings);
+        m->generator_timings = timings;
+        m->n_generator_timings = n_timings;
 
 finish:
         trim_generator_dir(m, &m->generator_unit_path);
@@ -31,6 +31,7 @@
 #include "hashmap.h"
 #include "list.h"
 #include "ratelimit.h"
+#include "string-pool.h"
 
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
@@ -52,6 +53,7 @@ typedef enum ManagerExitCode {
         MANAGER_OK,
         MANAGER_EXIT,
         MANAGER_RELOAD,
+        MANAGER_RELOAD_INCREMENTAL,
         MANAGER_REEXECUTE,
         MANAGER_REBOOT,
         MANAGER_POWEROFF,
@@ -73,6 +75,8 @@ typedef enum StatusType {
 #include "execute.h"
 #include "unit-name.h"
 #include "show-status.h"
+#include "unit-cache.h"
+#include "serialize.h"
 
 struct Manager {
         /* Note that the set of units we know of is allowed to be
@@ -83,6 +87,11 @@ struct Manager {
         Hashmap *units;  /* name string => Unit object n:1 */
         Hashmap *jobs;   /* job id => Job object 1:1 */
 
+        /* Strings shared among many units, such as the fragment
+         * path of template instances, or the descriptions and
+         * source paths of device and mount units */
+        StringPool *strings;
+
         /* To make it easy to iterate through the units of a specific
          * type we maintain a per type linked list */
         LIST_HEAD(Unit, units_by_type[_UNIT_TYPE_MAX]);
@@ -90,6 +99,10 @@ struct Manager {
         /* Units that need to be loaded */
         LIST_HEAD(Unit, load_queue); /* this is actually more a stack than a queue, but uh. */
 
+        /* The unit currently being loaded, which dependencies added
+         * meanwhile are attributed to */
+        Unit *loading_unit;
+
         /* Jobs that need to be run */
         LIST_HEAD(Job, run_queue);   /* more a stack than a queue, too */
 
@@ -100,6 +113,18 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* If non-zero, the queues above are only dispatched this long
+         * after something was added to them, so that a unit or job
+         * changing several times in a row results in a single
+         * signal */
+        usec_t dbus_coalesce_usec;
+        sd_event_source *dbus_coalesce_event_source;
+
+        /* Units whose change signal went out since the last
+         * UnitsChanged signal, if that is enabled */
+        bool send_units_changed;
+        Set *dbus_units_changed;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -145,6 +170,18 @@ struct Manager {
         LookupPaths lookup_paths;
         Set *unit_path_cache;
 
+        /* Unit files and drop-ins read ahead of time on worker
+         * threads, by path. Only valid during startup and reload. */
+        Hashmap *preparsed_files;
+
+        /* The unit file cache, which the preparsed files taken from
+         * it point into, and where it is stored. No cache is used if
+         * the path is NULL. */
+        UnitCache *unit_cache;
+        char *unit_cache_path;
+        uint64_t unit_cache_hits;
+        uint64_t unit_cache_misses;
+
         char **environment;
 
         usec_t runtime_watchdog;
@@ -168,6 +205,10 @@ struct Manager {
         char *generator_unit_path_early;
         char *generator_unit_path_late;
 
+        /* How long each generator took on the last run */
+        ExecuteTiming *generator_timings;
+        unsigned n_generator_timings;
+
         struct udev* udev;
 
         /* Data specific to the device subsystem */
@@ -177,6 +218,7 @@ struct Manager {
 
         /* Data specific to the mount subsystem */
         FILE *proc_self_mountinfo;
+        struct MountTable *mount_table;
         sd_event_source *mount_event_source;
         int utab_inotify_fd;
         sd_event_source *mount_utab_event_source;
@@ -220,6 +262,10 @@ struct Manager {
         CGroupControllerMask cgroup_supported;
         char *cgroup_root;
 
+        /* cgroup path → strv of "attribute=value", what we last
+         * wrote to the attributes of the cgroup */
+        Hashmap *cgroup_attributes;
+
         int gc_marker;
         unsigned n_in_gc_queue;
 
@@ -261,6 +307,9 @@ struct Manager {
         /* non-zero if we are reloading or reexecuting, */
         int n_reloading;
 
+        /* The format of the serialization we are writing or reading */
+        SerializationFormat serialization_format;
+
         unsigned n_installed_jobs;
         unsigned n_failed_jobs;
 
@@ -302,6 +351,9 @@ Manager* manager_free(Manager *m);
 int manager_enumerate(Manager *m);
 int manager_startup(Manager *m, FILE *serialization, FDSet *fds);
 
+int manager_preparse_unit_files(Manager *m);
+void manager_free_preparsed_files(Manager *m);
+
 Job *manager_get_job(Manager *m, uint32_t id);
 Unit *manager_get_unit(Manager *m, const char *name);
 
@@ -332,10 +384,11 @@ void manager_dispatch_bus_name_owner_changed(Manager *m, const char *name, const
 
 int manager_open_serialization(Manager *m, FILE **_f);
 
-int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
+int manager_serialize(Manager *m, FILE *f, FDSet *fds, SerializationFormat format, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_reload_incremental(Manager *m);
 
 bool manager_is_reloading_or_reexecuting(Manager *m) _pure_;
 
@@ -0,0 +1,362 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <string.h>
+
+#include "util.h"
+#include "log.h"
+#include "mount-table.h"
+
+static MountTableEntry *mount_table_entry_free(MountTableEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->what);
+        free(e);
+
+        return NULL;
+}
+
+MountTable *mount_table_new(void) {
+        MountTable *t;
+
+        t = new0(MountTable, 1);
+        if (!t)
+                return NULL;
+
+        t->entries = hashmap_new(NULL);
+        t->by_where = hashmap_new(&string_hash_ops);
+        if (!t->entries || !t->by_where)
+                return mount_table_free(t);
+
+        return t;
+}
+
+MountTable *mount_table_free(MountTable *t) {
+        MountTableEntry *e;
+
+        if (!t)
+                return NULL;
+
+        while ((e = hashmap_steal_first(t->entries)))
+                mount_table_entry_free(e);
+
+        hashmap_free(t->entries);
+        hashmap_free(t->by_where);
+        free(t);
+
+        return NULL;
+}
+
+MountTableEntry *mount_table_get_by_where(MountTable *t, const char *where) {
+        MountTableEntry *e, *i;
+
+        assert(t);
+        assert(where);
+
+        e = hashmap_get(t->by_where, where);
+
+        LIST_FOREACH(same_where, i, e)
+                if (i->position > e->position)
+                        e = i;
+
+        return e;
+}
+
+static int unescape(const char *s, char **buf, const char **ret) {
+        int r;
+
+        assert(buf);
+        assert(ret);
+
+        /* Only allocate if there is actually something to unescape,
+         * which is rare */
+
+        *buf = NULL;
+
+        if (!s)
+                s = "";
+        else if (strchr(s, '\\')) {
+                r = cunescape(s, UNESCAPE_RELAX, buf);
+                if (r < 0)
+                        return r;
+
+                s = *buf;
+        }
+
+        *ret = s;
+        return 0;
+}
+
+static int add_changed(Set **changed, const char *where) {
+        char *w;
+        int r;
+
+        assert(where);
+
+        if (!changed)
+                return 0;
+
+        r = set_ensure_allocated(changed, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        if (set_contains(*changed, where))
+                return 0;
+
+        w = strdup(where);
+        if (!w)
+                return -ENOMEM;
+
+        r = set_consume(*changed, w);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+static void unlink_where(MountTable *t, MountTableEntry *e) {
+        MountTableEntry *head;
+
+        assert(t);
+        assert(e);
+
+        head = hashmap_get(t->by_where, e->where);
+        assert(head);
+
+        LIST_REMOVE(same_where, head, e);
+
+        if (head)
+                hashmap_replace(t->by_where, head->where, head);
+        else
+                hashmap_remove(t->by_where, e->where);
+}
+
+static int link_where(MountTable *t, MountTableEntry *e) {
+        MountTableEntry *head;
+
+        assert(t);
+        assert(e);
+
+        head = hashmap_get(t->by_where, e->where);
+        LIST_PREPEND(same_where, head, e);
+
+        return hashmap_replace(t->by_where, e->where, head);
+}
+
+static int entry_update(
+                MountTable *t,
+                MountTableEntry *e,
+                const char *what,
+                const char *where,
+                const char *options,
+                const char *fstype,
+                Set **changed) {
+
+        size_t lw, lp, lo, lf;
+        char *buf, *old;
+        bool moved;
+        int r;
+
+        assert(t);
+        assert(e);
+
+        lw = strlen(what);
+        lp = strlen(where);
+        lo = strlen(options);
+        lf = strlen(fstype);
+
+        buf = new(char, lw + lp + lo + lf + 4);
+        if (!buf)
+                return -ENOMEM;
+
+        /* The old mount point is affected, too, if the mount was
+         * moved elsewhere */
+        if (e->where) {
+                r = add_changed(changed, e->where);
+                if (r < 0)
+                        goto fail;
+        }
+
+        r = add_changed(changed, where);
+        if (r < 0)
+                goto fail;
+
+        moved = !streq_ptr(e->where, where);
+        if (moved && e->where)
+                unlink_where(t, e);
+
+        old = e->what;
+
+        e->what = memcpy(buf, what, lw + 1);
+        e->where = memcpy(e->what + lw + 1, where, lp + 1);
+        e->options = memcpy(e->where + lp + 1, options, lo + 1);
+        e->fstype = memcpy(e->options + lo + 1, fstype, lf + 1);
+
+        if (!moved && old) {
+                MountTableEntry *head;
+
+                /* The key might point into the buffer we are about
+                 * to free */
+                head = hashmap_get(t->by_where, e->where);
+                hashmap_replace(t->by_where, head->where, head);
+        }
+
+        free(old);
+
+        if (moved) {
+                r = link_where(t, e);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+
+fail:
+        free(buf);
+        return r;
+}
+
+static void entry_remove(MountTable *t, MountTableEntry *e) {
+        assert(t);
+        assert(e);
+
+        hashmap_remove(t->entries, INT_TO_PTR(e->id));
+
+        if (e->where)
+                unlink_where(t, e);
+
+        mount_table_entry_free(e);
+}
+
+int mount_table_update(MountTable *t, struct libmnt_table *tb, Set **changed) {
+        _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        unsigned position = 0, n_seen = 0;
+        MountTableEntry *e;
+        Iterator j;
+        int r;
+
+        assert(t);
+        assert(tb);
+
+        /* Entries are matched up with the previous snapshot by their
+         * mount ID. Unchanged ones only cost a lookup and a few string
+         * comparisons, everything else is only done for entries that
+         * were added, removed or changed. Note that mount IDs are
+         * unique among the mounts that exist at the same time, hence
+         * no two entries of the same snapshot collide. */
+
+        i = mnt_new_iter(MNT_ITER_FORWARD);
+        if (!i)
+                return -ENOMEM;
+
+        t->generation++;
+
+        for (;;) {
+                _cleanup_free_ char *dbuf = NULL, *pbuf = NULL;
+                const char *what, *where, *options, *fstype;
+                struct libmnt_fs *fs;
+                int id;
+
+                r = mnt_table_next_fs(tb, i, &fs);
+                if (r == 1)
+                        break;
+                if (r < 0)
+                        return r;
+
+                /* Tables parsed from files other than mountinfo
+                 * carry no IDs. Fall back to the position then, which
+                 * is correct, but makes everything after an added or
+                 * removed line look changed. */
+                id = mnt_fs_get_id(fs);
+                if (id <= 0)
+                        id = -(int) position - 1;
+
+                r = unescape(mnt_fs_get_source(fs), &dbuf, &what);
+                if (r < 0)
+                        return r;
+
+                r = unescape(mnt_fs_get_target(fs), &pbuf, &where);
+                if (r < 0)
+                        return r;
+
+                options = strempty(mnt_fs_get_options(fs));
+                fstype = strempty(mnt_fs_get_fstype(fs));
+
+                e = hashmap_get(t->entries, INT_TO_PTR(id));
+                if (e && e->generation == t->generation) {
+                        /* The same mount ID twice in one snapshot? */
+                        log_debug("Duplicate mount ID %i in mount table, ignoring.", id);
+                        continue;
+                }
+
+                if (!e) {
+                        e = new0(MountTableEntry, 1);
+                        if (!e)
+                                return -ENOMEM;
+
+                        e->id = id;
+
+                        r = hashmap_put(t->entries, INT_TO_PTR(id), e);
+                        if (r < 0) {
+                                mount_table_entry_free(e);
+                                return r;
+                        }
+                }
+
+                e->position = position++;
+                e->generation = t->generation;
+                n_seen++;
+
+                if (streq_ptr(e->what, what) &&
+                    streq_ptr(e->where, where) &&
+                    streq_ptr(e->options, options) &&
+                    streq_ptr(e->fstype, fstype))
+                        continue;
+
+                r = entry_update(t, e, what, where, options, fstype, changed);
+                if (r < 0) {
+                        /* Don't leave a half initialized entry
+                         * behind */
+                        if (!e->where)
+                                entry_remove(t, e);
+
+                        return r;
+                }
+        }
+
+        /* If every entry we know was seen again, nothing was
+         * removed and we don't have to look for stale ones */
+        if (n_seen == hashmap_size(t->entries))
+                return 0;
+
+        HASHMAP_FOREACH(e, t->entries, j) {
+                if (e->generation == t->generation)
+                        continue;
+
+                r = add_changed(changed, e->where);
+                if (r < 0)
+                        return r;
+
+                entry_remove(t, e);
+        }
+
+        return 0;
+}
@@ -0,0 +1,75 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <libmount.h>
+
+#include "hashmap.h"
+#include "set.h"
+#include "list.h"
+
+/* The last parsed state of /proc/self/mountinfo, keyed by mount
+ * ID. Updating it with a new snapshot yields the mount points whose
+ * entries were added, removed or changed, so that only the units
+ * for those need to be looked at. */
+
+typedef struct MountTable MountTable;
+typedef struct MountTableEntry MountTableEntry;
+
+struct MountTableEntry {
+        int id;
+
+        /* Line of the entry in the last snapshot. Of several mounts
+         * stacked on the same mount point the last one is visible. */
+        unsigned position;
+        unsigned generation;
+
+        /* All four point into one allocation, so that comparing
+         * an unchanged entry touches as few cache lines as
+         * possible */
+        char *what;
+        char *where;
+        char *options;
+        char *fstype;
+
+        LIST_FIELDS(MountTableEntry, same_where);
+};
+
+struct MountTable {
+        Hashmap *entries;  /* mount id => MountTableEntry */
+        Hashmap *by_where; /* mount point => list of MountTableEntry */
+
+        unsigned generation;
+};
+
+MountTable *mount_table_new(void);
+MountTable *mount_table_free(MountTable *t);
+
+int mount_table_update(MountTable *t, struct libmnt_table *tb, Set **changed);
+
+MountTableEntry *mount_table_get_by_where(MountTable *t, const char *where);
+
+static inline unsigned mount_table_size(MountTable *t) {
+        return t ? hashmap_size(t->entries) : 0;
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountTable*, mount_table_free);
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
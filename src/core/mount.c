@@ -23,7 +23,6 @@
 #include <stdio.h>
 #include <sys/epoll.h>
 #include <signal.h>
-#include <libmount.h>
 #include <sys/inotify.h>
 
 #include "manager.h"
@@ -40,12 +39,10 @@
 #include "special.h"
 #include "exit-status.h"
 #include "fstab-util.h"
+#include "mount-table.h"
 
 #define RETRY_UMOUNT_MAX 32
 
-DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
-DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
-
 static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
         [MOUNT_DEAD] = UNIT_INACTIVE,
         [MOUNT_MOUNTING] = UNIT_ACTIVATING,
@@ -1448,11 +1445,9 @@ static int mount_setup_unit(
                         goto fail;
                 }
 
-                u->source_path = strdup("/proc/self/mountinfo");
-                if (!u->source_path) {
-                        r = -ENOMEM;
+                r = string_pool_replace(m->strings, &u->source_path, "/proc/self/mountinfo");
+                if (r < 0)
                         goto fail;
-                }
 
                 if (m->running_as == SYSTEMD_SYSTEM) {
                         const char* target;
@@ -1557,54 +1552,82 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+static int mount_setup_where(Manager *m, const char *where, bool set_flags) {
+        MountTableEntry *e, *i;
+
+        assert(m);
+        assert(where);
+
+        e = mount_table_get_by_where(m->mount_table, where);
+        if (!e)
+                /* Not mounted anymore */
+                return 0;
+
+        /* All devices mounted here are in use, but only the
+         * topmost of several stacked mounts is visible */
+        LIST_FOREACH(same_where, i, hashmap_get(m->mount_table->by_where, where))
+                (void) device_found_node(m, i->what, true, DEVICE_FOUND_MOUNT, set_flags);
+
+        return mount_setup_unit(m, e->what, e->where, e->options, e->fstype, set_flags);
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set **changed) {
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
-        _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
-        int r = 0;
+        _cleanup_set_free_free_ Set *c = NULL;
+        MountTableEntry *e;
+        const char *where;
+        Iterator i;
+        bool full;
+        int r, k;
 
         assert(m);
 
+        /* The previous state of the table is kept, so that only the
+         * mount points whose entries were added, removed or changed
+         * since the last call need to be looked at. These are
+         * returned in *changed. If there is no previous state, all
+         * mount points are set up, and *changed is set to NULL. */
+
         t = mnt_new_table();
         if (!t)
                 return log_oom();
 
-        i = mnt_new_iter(MNT_ITER_FORWARD);
-        if (!i)
-                return log_oom();
-
         r = mnt_table_parse_mtab(t, NULL);
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
-        r = 0;
-        for (;;) {
-                const char *device, *path, *options, *fstype;
-                _cleanup_free_ char *d = NULL, *p = NULL;
-                struct libmnt_fs *fs;
-                int k;
-
-                k = mnt_table_next_fs(t, i, &fs);
-                if (k == 1)
-                        break;
-                if (k < 0)
-                        return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
-
-                device = mnt_fs_get_source(fs);
-                path = mnt_fs_get_target(fs);
-                options = mnt_fs_get_options(fs);
-                fstype = mnt_fs_get_fstype(fs);
-
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
+        full = !m->mount_table;
+        if (full) {
+                m->mount_table = mount_table_new();
+                if (!m->mount_table)
                         return log_oom();
+        }
 
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
-                        return log_oom();
+        r = mount_table_update(m->mount_table, t, full ? NULL : &c);
+        if (r < 0) {
+                /* We don't know what is in the table now, hence start
+                 * over with the next call */
+                m->mount_table = mount_table_free(m->mount_table);
+                return log_error_errno(r, "Failed to update mount table: %m");
+        }
 
-                (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+        r = 0;
+        if (full) {
+                HASHMAP_FOREACH_KEY(e, where, m->mount_table->by_where, i) {
+                        k = mount_setup_where(m, where, set_flags);
+                        if (r == 0 && k < 0)
+                                r = k;
+                }
+        } else
+                SET_FOREACH(where, c, i) {
+                        k = mount_setup_where(m, where, set_flags);
+                        if (r == 0 && k < 0)
+                                r = k;
+                }
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
-                if (r == 0 && k < 0)
-                        r = k;
+        if (changed) {
+                *changed = c;
+                c = NULL;
         }
 
         return r;
@@ -1620,6 +1643,7 @@ static void mount_shutdown(Manager *m) {
                 fclose(m->proc_self_mountinfo);
                 m->proc_self_mountinfo = NULL;
         }
+        m->mount_table = mount_table_free(m->mount_table);
         m->utab_inotify_fd = safe_close(m->utab_inotify_fd);
 }
 
@@ -1684,7 +1708,10 @@ static int mount_enumerate(Manager *m) {
                         goto fail;
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        /* The units are all new, hence set all of them up */
+        m->mount_table = mount_table_free(m->mount_table);
+
+        r = mount_load_proc_self_mountinfo(m, false, NULL);
         if (r < 0)
                 goto fail;
 
@@ -1695,8 +1722,68 @@ fail:
         return r;
 }
 
+static void mount_process_proc_self_mountinfo(Mount *mount) {
+        assert(mount);
+
+        if (!mount->is_mounted) {
+
+                mount->from_proc_self_mountinfo = false;
+
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
+                }
+
+                if (mount->parameters_proc_self_mountinfo.what)
+                        (void) device_found_node(UNIT(mount)->manager, mount->parameters_proc_self_mountinfo.what, false, DEVICE_FOUND_MOUNT, true);
+
+
+        } else if (mount->just_mounted || mount->just_changed) {
+
+                /* New or changed mount entry */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+                        /* This has just been mounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
+        }
+
+        /* Reset the flags for later calls */
+        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+}
+
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        _cleanup_set_free_free_ Set *changed = NULL;
         Manager *m = userdata;
+        const char *where;
+        Iterator i;
         Unit *u;
         int r;
 
@@ -1744,7 +1831,7 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         return 0;
         }
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        r = mount_load_proc_self_mountinfo(m, true, &changed);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
@@ -1758,61 +1845,24 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
-
-                if (!mount->is_mounted) {
-
-                        mount->from_proc_self_mountinfo = false;
+        if (!changed) {
+                /* We started over, so check all units */
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                        mount_process_proc_self_mountinfo(MOUNT(u));
 
-                        switch (mount->state) {
-
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
-
-                        default:
-                                break;
-                        }
-
-                        if (mount->parameters_proc_self_mountinfo.what)
-                                (void) device_found_node(m, mount->parameters_proc_self_mountinfo.what, false, DEVICE_FOUND_MOUNT, true);
-
-
-                } else if (mount->just_mounted || mount->just_changed) {
-
-                        /* New or changed mount entry */
-
-                        switch (mount->state) {
-
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
-                                /* This has just been mounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
+                return 0;
+        }
 
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
+        SET_FOREACH(where, changed, i) {
+                _cleanup_free_ char *e = NULL;
 
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
-                                break;
-                        }
-                }
+                e = unit_name_from_path(where, ".mount");
+                if (!e)
+                        return log_oom();
 
-                /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+                u = manager_get_unit(m, e);
+                if (u)
+                        mount_process_proc_self_mountinfo(MOUNT(u));
         }
 
         return 0;
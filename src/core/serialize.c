@@ -0,0 +1,381 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "util.h"
+#include "log.h"
+#include "serialize.h"
+
+/* A binary serialization starts with this header. The text format
+ * never starts with a NUL byte, which is how we tell the two
+ * apart. The records are only ever passed between processes on the
+ * same machine, hence all fields are in native byte order. */
+#define SERIALIZATION_VERSION 1
+
+typedef struct SerializationHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+} SerializationHeader;
+
+static const char serialization_magic[8] = { 0, 'S', 'D', 'S', 'T', 'A', 'T', 'E' };
+
+enum {
+        RECORD_END,
+        RECORD_STRING,
+        RECORD_DUAL_TIMESTAMP,
+};
+
+/* Each record is followed by the NUL terminated key, and the value:
+ * a NUL terminated string for RECORD_STRING, or two 64bit
+ * timestamps for RECORD_DUAL_TIMESTAMP. */
+typedef struct SerializationRecord {
+        uint8_t type;
+        uint8_t reserved;
+        uint16_t key_size;
+        uint32_t value_size;
+} SerializationRecord;
+
+void serialize_header(FILE *f, SerializationFormat format) {
+        SerializationHeader h = {
+                .version = SERIALIZATION_VERSION,
+                .byte_order = 0x01020304,
+        };
+
+        assert(f);
+
+        if (format != SERIALIZATION_BINARY)
+                return;
+
+        memcpy(h.magic, serialization_magic, sizeof(h.magic));
+        fwrite(&h, sizeof(h), 1, f);
+}
+
+void serialize_end_marker(FILE *f, SerializationFormat format) {
+        SerializationRecord r = {
+                .type = RECORD_END,
+        };
+
+        assert(f);
+
+        if (format == SERIALIZATION_BINARY)
+                fwrite(&r, sizeof(r), 1, f);
+        else
+                fputc('\n', f);
+}
+
+static void write_record(FILE *f, unsigned type, const char *key, const void *value, size_t value_size) {
+        SerializationRecord *r;
+        uint8_t buffer[sizeof(SerializationRecord) + LINE_MAX];
+        size_t key_size;
+
+        key_size = strlen(key) + 1;
+        assert(key_size <= UINT16_MAX);
+        assert(value_size <= UINT32_MAX);
+
+        r = (SerializationRecord*) buffer;
+        *r = (SerializationRecord) {
+                .type = type,
+                .key_size = key_size,
+                .value_size = value_size,
+        };
+
+        /* Usually a record is small enough to be written in one go */
+        if (key_size + value_size <= LINE_MAX) {
+                memcpy(buffer + sizeof(*r), key, key_size);
+                if (value_size > 0)
+                        memcpy(buffer + sizeof(*r) + key_size, value, value_size);
+                fwrite(buffer, 1, sizeof(*r) + key_size + value_size, f);
+                return;
+        }
+
+        fwrite(r, sizeof(*r), 1, f);
+        fwrite(key, 1, key_size, f);
+        fwrite(value, 1, value_size, f);
+}
+
+void serialize_item(FILE *f, SerializationFormat format, const char *key, const char *value) {
+        assert(f);
+        assert(key);
+
+        /* Items without a value are used as start markers */
+
+        if (format == SERIALIZATION_BINARY)
+                write_record(f, RECORD_STRING, key, value, value ? strlen(value) + 1 : 0);
+        else if (value)
+                fprintf(f, "%s=%s\n", key, value);
+        else {
+                fputs(key, f);
+                fputc('\n', f);
+        }
+}
+
+void serialize_item_formatv(FILE *f, SerializationFormat format, const char *key, const char *value, va_list ap) {
+        _cleanup_free_ char *allocated = NULL;
+        char buffer[LINE_MAX];
+        const char *s = buffer;
+        va_list aq;
+        int n;
+
+        assert(f);
+        assert(key);
+        assert(value);
+
+        if (format != SERIALIZATION_BINARY) {
+                fputs(key, f);
+                fputc('=', f);
+                vfprintf(f, value, ap);
+                fputc('\n', f);
+                return;
+        }
+
+        va_copy(aq, ap);
+        n = vsnprintf(buffer, sizeof(buffer), value, aq);
+        va_end(aq);
+
+        if (n < 0)
+                return;
+
+        if ((size_t) n >= sizeof(buffer)) {
+                n = vasprintf(&allocated, value, ap);
+                if (n < 0) {
+                        log_oom();
+                        return;
+                }
+
+                s = allocated;
+        }
+
+        write_record(f, RECORD_STRING, key, s, n + 1);
+}
+
+void serialize_item_format(FILE *f, SerializationFormat format, const char *key, const char *value, ...) {
+        va_list ap;
+
+        va_start(ap, value);
+        serialize_item_formatv(f, format, key, value, ap);
+        va_end(ap);
+}
+
+void serialize_dual_timestamp(FILE *f, SerializationFormat format, const char *key, dual_timestamp *t) {
+        uint64_t v[2];
+
+        assert(f);
+        assert(key);
+        assert(t);
+
+        if (format != SERIALIZATION_BINARY) {
+                dual_timestamp_serialize(f, key, t);
+                return;
+        }
+
+        if (!dual_timestamp_is_set(t))
+                return;
+
+        v[0] = t->realtime;
+        v[1] = t->monotonic;
+
+        write_record(f, RECORD_DUAL_TIMESTAMP, key, v, sizeof(v));
+}
+
+SerializationFormat deserialize_header(FILE *f) {
+        SerializationHeader h;
+        int c;
+
+        assert(f);
+
+        c = fgetc(f);
+        if (c == EOF)
+                return SERIALIZATION_TEXT;
+
+        if (c != 0) {
+                ungetc(c, f);
+                return SERIALIZATION_TEXT;
+        }
+
+        h.magic[0] = 0;
+        if (fread(h.magic + 1, sizeof(h) - 1, 1, f) != 1 ||
+            memcmp(h.magic, serialization_magic, sizeof(h.magic)) != 0 ||
+            h.byte_order != 0x01020304) {
+                log_debug("Serialization has an invalid header.");
+                return _SERIALIZATION_FORMAT_INVALID;
+        }
+
+        if (h.version != SERIALIZATION_VERSION) {
+                log_debug("Serialization is in unsupported binary format version %" PRIu32 ".", h.version);
+                return _SERIALIZATION_FORMAT_INVALID;
+        }
+
+        return SERIALIZATION_BINARY;
+}
+
+static int deserialize_item_text(FILE *f, SerializationItem *item) {
+        char *l;
+        size_t k;
+
+        if (!fgets(item->buffer, sizeof(item->buffer), f)) {
+                if (feof(f))
+                        return 0;
+
+                return errno > 0 ? -errno : -EIO;
+        }
+
+        char_array_0(item->buffer);
+        l = strstrip(item->buffer);
+
+        /* End marker */
+        if (l[0] == 0)
+                return 0;
+
+        k = strcspn(l, "=");
+
+        item->key = l;
+        if (l[k] == '=') {
+                l[k] = 0;
+                item->value = l+k+1;
+        } else
+                item->value = l+k;
+
+        return 1;
+}
+
+static int deserialize_item_binary(FILE *f, SerializationItem *item) {
+        SerializationRecord r;
+
+        for (;;) {
+                if (fread(&r, sizeof(r), 1, f) != 1) {
+                        if (feof(f))
+                                return 0;
+
+                        return -EIO;
+                }
+
+                if (r.type == RECORD_END)
+                        return 0;
+
+                if (r.key_size == 0)
+                        return -EBADMSG;
+
+                if ((size_t) r.key_size + r.value_size <= sizeof(item->buffer))
+                        break;
+
+                /* Like overly long lines of the text format, we
+                 * don't care for overly long items */
+                log_debug("Ignoring serialization item of %zu bytes.", (size_t) r.key_size + r.value_size);
+                if (fseeko(f, (off_t) r.key_size + r.value_size, SEEK_CUR) < 0)
+                        return -errno;
+        }
+
+        if (fread(item->buffer, 1, r.key_size + r.value_size, f) != r.key_size + r.value_size)
+                return -EIO;
+
+        item->key = item->buffer;
+        if (item->key[r.key_size - 1] != 0)
+                return -EBADMSG;
+
+        switch (r.type) {
+
+        case RECORD_STRING:
+                if (r.value_size == 0)
+                        item->value = (char*) "";
+                else {
+                        item->value = item->buffer + r.key_size;
+                        if (item->value[r.value_size - 1] != 0)
+                                return -EBADMSG;
+                }
+
+                break;
+
+        case RECORD_DUAL_TIMESTAMP: {
+                uint64_t v[2];
+
+                if (r.value_size != sizeof(v))
+                        return -EBADMSG;
+
+                memcpy(v, item->buffer + r.key_size, sizeof(v));
+                item->timestamp.realtime = v[0];
+                item->timestamp.monotonic = v[1];
+                item->has_timestamp = true;
+                item->value = (char*) "";
+                break;
+        }
+
+        default:
+                /* Something a later version knows how to write,
+                 * let the callers complain about the key */
+                item->value = (char*) "";
+                break;
+        }
+
+        return 1;
+}
+
+int deserialize_item(FILE *f, SerializationFormat format, SerializationItem *item) {
+        assert(f);
+        assert(item);
+
+        /* Reads the next item. Returns 0 at an end marker or at the
+         * end of the file. */
+
+        item->key = item->value = NULL;
+        item->has_timestamp = false;
+
+        if (format == SERIALIZATION_BINARY)
+                return deserialize_item_binary(f, item);
+
+        return deserialize_item_text(f, item);
+}
+
+void deserialize_dual_timestamp(SerializationItem *item, dual_timestamp *t) {
+        assert(item);
+        assert(t);
+
+        if (item->has_timestamp)
+                *t = item->timestamp;
+        else
+                dual_timestamp_deserialize(item->value, t);
+}
+
+const char *deserialize_item_value(SerializationItem *item) {
+        assert(item);
+
+        /* Returns the value of the item as it would have been
+         * written in the text format */
+
+        if (!item->has_timestamp)
+                return item->value;
+
+        item->value = item->buffer + strlen(item->key) + 1;
+        snprintf(item->value, sizeof(item->buffer) - (item->value - item->buffer),
+                 USEC_FMT " " USEC_FMT,
+                 item->timestamp.realtime,
+                 item->timestamp.monotonic);
+
+        return item->value;
+}
+
+static const char* const serialization_format_table[_SERIALIZATION_FORMAT_MAX] = {
+        [SERIALIZATION_TEXT] = "text",
+        [SERIALIZATION_BINARY] = "binary",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(serialization_format, SerializationFormat);
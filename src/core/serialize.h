@@ -0,0 +1,71 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* The state we pass on across daemon-reload, daemon-reexec and
+ * switch-root is a stream of items, each a key with an optional
+ * value, grouped into sections by end markers. It is written either
+ * as "key=value" lines, or as length-prefixed binary records, which
+ * are a lot cheaper to write and to read back. Versions of systemd
+ * from before the binary format was introduced take its header for
+ * an end marker, hence it is only used for reloading within the
+ * same process, and the text format whenever another binary is
+ * executed. */
+
+typedef enum SerializationFormat {
+        SERIALIZATION_TEXT,
+        SERIALIZATION_BINARY,
+        _SERIALIZATION_FORMAT_MAX,
+        _SERIALIZATION_FORMAT_INVALID = -1
+} SerializationFormat;
+
+typedef struct SerializationItem {
+        char *key;
+        char *value;
+
+        /* Set if the value is a dual timestamp in binary form, see
+         * deserialize_item_value() for getting it as a string */
+        bool has_timestamp;
+        dual_timestamp timestamp;
+
+        char buffer[LINE_MAX];
+} SerializationItem;
+
+void serialize_header(FILE *f, SerializationFormat format);
+void serialize_end_marker(FILE *f, SerializationFormat format);
+void serialize_item(FILE *f, SerializationFormat format, const char *key, const char *value);
+void serialize_item_formatv(FILE *f, SerializationFormat format, const char *key, const char *value, va_list ap) _printf_(4,0);
+void serialize_item_format(FILE *f, SerializationFormat format, const char *key, const char *value, ...) _printf_(4,5);
+void serialize_dual_timestamp(FILE *f, SerializationFormat format, const char *key, dual_timestamp *t);
+
+SerializationFormat deserialize_header(FILE *f);
+int deserialize_item(FILE *f, SerializationFormat format, SerializationItem *item);
+void deserialize_dual_timestamp(SerializationItem *item, dual_timestamp *t);
+const char *deserialize_item_value(SerializationItem *item);
+
+const char* serialization_format_to_string(SerializationFormat i) _const_;
+SerializationFormat serialization_format_from_string(const char *s) _pure_;
@@ -339,133 +339,249 @@ _pure_ static bool unit_matters_to_anchor(Unit *u, Job *j) {
         return false;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
-        Iterator i;
+static Job* transaction_order_successor(Transaction *tr, Job *j, Iterator *i) {
         Unit *u;
-        int r;
 
-        assert(tr);
-        assert(j);
-        assert(!j->transaction_prev);
+        /* Returns the next job that is ordered after j. We assume
+         * that the dependencies are bidirectional, and hence can
+         * ignore UNIT_AFTER */
 
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+        while ((u = set_iterate(j->unit->dependencies[UNIT_BEFORE], i))) {
+                Job *o;
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete;
+                /* Is there a job for this unit? */
+                o = hashmap_get(tr->jobs, u);
+                if (o)
+                        return o;
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+                /* Ok, there is no job for this in the transaction,
+                 * but maybe there is already one running? */
+                if (u->job)
+                        return u->job;
+        }
 
-                /* So, the marker is not NULL and we already have been
-                 * here. We have a cycle. Let's try to break it. We go
-                 * backwards in our path and try to find a suitable
-                 * job to remove. We use the marker to find our way
-                 * back, since smart how we are we stored our way back
-                 * in there. */
-                log_unit_warning(j->unit->id,
-                                 "Found ordering cycle on %s/%s",
-                                 j->unit->id, job_type_to_string(j->type));
+        return NULL;
+}
 
-                delete = NULL;
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+typedef struct OrderCycle {
+        Unit *unit;
+        JobType type;
+        Unit *delete_unit;
+        JobType delete_type;
+} OrderCycle;
 
-                        /* logging for j not k here here to provide consistent narrative */
-                        log_unit_warning(j->unit->id,
-                                         "Found dependency on %s/%s",
-                                         k->unit->id, job_type_to_string(k->type));
+static int transaction_find_order_cycle(Transaction *tr, Job *root, OrderCycle *c) {
+        _cleanup_free_ Job **queue = NULL;
+        size_t n_queue = 0, n_allocated = 0, k;
+        Job *j, *o, *delete = NULL;
 
-                        if (!delete && hashmap_get(tr->jobs, k->unit) &&
-                            !unit_matters_to_anchor(k->unit, k)) {
-                                /* Ok, we can drop this one, so let's
-                                 * do so. */
-                                delete = k;
-                        }
+        /* Finds a shortest ordering cycle through root within its
+         * strongly connected component, whose members are those
+         * jobs still on the Tarjan stack with an index not lower than
+         * root's, and picks a job to delete from it to break it. We
+         * use the marker to find our way back. */
 
-                        /* Check if this in fact was the beginning of
-                         * the cycle */
-                        if (k == j)
-                                break;
-                }
+        root->marker = NULL;
 
+        if (!GREEDY_REALLOC(queue, n_allocated, 1))
+                return -ENOMEM;
+        queue[n_queue++] = root;
 
-                if (delete) {
-                        /* logging for j not k here here to provide consistent narrative */
-                        log_unit_warning(j->unit->id,
-                                         "Breaking ordering cycle by deleting job %s/%s",
-                                         delete->unit->id, job_type_to_string(delete->type));
-                        log_unit_error(delete->unit->id,
-                                       "Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                       delete->unit->id, job_type_to_string(delete->type),
-                                       j->unit->id, job_type_to_string(j->type));
-                        unit_status_printf(delete->unit, ANSI_HIGHLIGHT_RED_ON " SKIP " ANSI_HIGHLIGHT_OFF,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
+        for (k = 0, j = NULL; k < n_queue && !j; k++) {
+                Iterator i = ITERATOR_FIRST;
 
-                log_error("Unable to break cycle");
+                while ((o = transaction_order_successor(tr, queue[k], &i))) {
+                        if (!o->on_order_stack || o->order_index < root->order_index)
+                                continue;
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
-        }
+                        if (o == root) {
+                                /* We are back where we started */
+                                j = queue[k];
+                                break;
+                        }
 
-        /* Make the marker point to where we come from, so that we can
-         * find our way backwards if we want to break a cycle. We use
-         * a special marker for the beginning: we point to
-         * ourselves. */
-        j->marker = from ? from : j;
-        j->generation = generation;
+                        if (o->marker != o)
+                                continue;
 
-        /* We assume that the dependencies are bidirectional, and
-         * hence can ignore UNIT_AFTER */
-        SET_FOREACH(u, j->unit->dependencies[UNIT_BEFORE], i) {
-                Job *o;
+                        if (!GREEDY_REALLOC(queue, n_allocated, n_queue + 1))
+                                return -ENOMEM;
 
-                /* Is there a job for this unit? */
-                o = hashmap_get(tr->jobs, u);
-                if (!o) {
-                        /* Ok, there is no job for this in the
-                         * transaction, but maybe there is already one
-                         * running? */
-                        o = u->job;
-                        if (!o)
-                                continue;
+                        o->marker = queue[k];
+                        queue[n_queue++] = o;
                 }
+        }
 
-                r = transaction_verify_order_one(tr, o, j, generation, e);
-                if (r < 0)
-                        return r;
+        assert(j);
+
+        log_unit_warning(root->unit->id,
+                         "Found ordering cycle on %s/%s",
+                         root->unit->id, job_type_to_string(root->type));
+
+        for (; j; j = j->marker) {
+
+                /* logging for root not j here to provide consistent narrative */
+                log_unit_warning(root->unit->id,
+                                 "Found dependency on %s/%s",
+                                 j->unit->id, job_type_to_string(j->type));
+
+                if (!delete && hashmap_get(tr->jobs, j->unit) &&
+                    !unit_matters_to_anchor(j->unit, j))
+                        /* Ok, we can drop this one, so let's do
+                         * so. */
+                        delete = j;
         }
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+        c->unit = root->unit;
+        c->type = root->type;
 
-        return 0;
+        if (!delete)
+                return 0;
+
+        c->delete_unit = delete->unit;
+        c->delete_type = delete->type;
+
+        return 1;
 }
 
+typedef struct OrderFrame {
+        Job *job;
+        Iterator i;
+} OrderFrame;
+
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
-        Job *j;
-        int r;
+        _cleanup_free_ OrderFrame *frames = NULL;
+        _cleanup_free_ Job **stack = NULL;
+        _cleanup_free_ OrderCycle *cycles = NULL;
+        size_t n_frames = 0, n_frames_allocated = 0;
+        size_t n_stack = 0, n_stack_allocated = 0;
+        size_t n_cycles = 0, n_cycles_allocated = 0, k;
+        unsigned g, index = 0;
+        bool unbreakable = false;
         Iterator i;
-        unsigned g;
+        Job *j;
 
         assert(tr);
         assert(generation);
 
         /* Check if the ordering graph is cyclic. If it is, try to fix
-         * that up by dropping one of the jobs. */
+         * that up by dropping one of the jobs in each cycle we
+         * find. We find the strongly connected components of the
+         * graph with Tarjan's algorithm, walking it iteratively, so
+         * that we don't need a stack frame per job, and visiting each
+         * job and ordering dependency only once. */
 
         g = (*generation)++;
 
-        HASHMAP_FOREACH(j, tr->jobs, i)
-                if ((r = transaction_verify_order_one(tr, j, NULL, g, e)) < 0)
-                        return r;
+        HASHMAP_FOREACH(j, tr->jobs, i) {
+                if (j->generation == g)
+                        continue;
+
+                j->generation = g;
+                j->order_index = j->order_lowlink = index++;
+                j->on_order_stack = true;
+                j->marker = j;
+
+                if (!GREEDY_REALLOC(stack, n_stack_allocated, n_stack + 1) ||
+                    !GREEDY_REALLOC(frames, n_frames_allocated, n_frames + 1))
+                        return -ENOMEM;
+
+                stack[n_stack++] = j;
+                frames[n_frames++] = (OrderFrame) { j, ITERATOR_FIRST };
+
+                while (n_frames > 0) {
+                        OrderFrame *f = frames + n_frames - 1;
+                        Job *o;
+
+                        o = transaction_order_successor(tr, f->job, &f->i);
+                        if (o) {
+                                if (o->generation != g) {
+                                        /* Not seen yet, descend */
+                                        o->generation = g;
+                                        o->order_index = o->order_lowlink = index++;
+                                        o->on_order_stack = true;
+                                        o->marker = o;
+
+                                        if (!GREEDY_REALLOC(stack, n_stack_allocated, n_stack + 1) ||
+                                            !GREEDY_REALLOC(frames, n_frames_allocated, n_frames + 1))
+                                                return -ENOMEM;
+
+                                        stack[n_stack++] = o;
+                                        frames[n_frames++] = (OrderFrame) { o, ITERATOR_FIRST };
+
+                                } else if (o->on_order_stack)
+                                        f->job->order_lowlink = MIN(f->job->order_lowlink, o->order_index);
+
+                                continue;
+                        }
+
+                        /* All successors done, let's backtrack */
+                        o = f->job;
+                        n_frames--;
+
+                        if (n_frames > 0)
+                                frames[n_frames - 1].job->order_lowlink =
+                                        MIN(frames[n_frames - 1].job->order_lowlink, o->order_lowlink);
+
+                        if (o->order_lowlink != o->order_index)
+                                continue;
+
+                        /* o is the root of a strongly connected
+                         * component. If it has more than one member
+                         * we have a cycle. Let's try to break it. */
+                        if (stack[n_stack - 1] != o) {
+                                OrderCycle c = {};
+                                int r;
+
+                                r = transaction_find_order_cycle(tr, o, &c);
+                                if (r < 0)
+                                        return r;
+                                if (r == 0)
+                                        unbreakable = true;
+                                else {
+                                        if (!GREEDY_REALLOC(cycles, n_cycles_allocated, n_cycles + 1))
+                                                return -ENOMEM;
+
+                                        cycles[n_cycles++] = c;
+                                }
+                        }
+
+                        do
+                                stack[--n_stack]->on_order_stack = false;
+                        while (stack[n_stack] != o);
+                }
+        }
+
+        /* Deleting a job might delete jobs of other cycles too, hence
+         * check whether there is still something to delete */
+        for (k = 0; k < n_cycles; k++) {
+                OrderCycle *c = cycles + k;
+
+                if (!hashmap_get(tr->jobs, c->delete_unit))
+                        continue;
+
+                /* logging for the cycle's start not the deleted job here to provide consistent narrative */
+                log_unit_warning(c->unit->id,
+                                 "Breaking ordering cycle by deleting job %s/%s",
+                                 c->delete_unit->id, job_type_to_string(c->delete_type));
+                log_unit_error(c->delete_unit->id,
+                               "Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                               c->delete_unit->id, job_type_to_string(c->delete_type),
+                               c->unit->id, job_type_to_string(c->type));
+                unit_status_printf(c->delete_unit, ANSI_HIGHLIGHT_RED_ON " SKIP " ANSI_HIGHLIGHT_OFF,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, c->delete_unit);
+        }
+
+        /* Let's see whether the remaining graph is acyclic now */
+        if (n_cycles > 0)
+                return -EAGAIN;
+
+        if (unbreakable) {
+                log_error("Unable to break cycle");
+
+                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                         "Transaction order is cyclic. See system logs for details.");
+        }
 
         return 0;
 }
@@ -743,6 +859,22 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
         return 0;
 }
 
+static Job* transaction_find_job(Transaction *tr, JobType type, Unit *unit) {
+        Job *j;
+
+        assert(tr);
+        assert(unit);
+
+        LIST_FOREACH(transaction, j, (Job*) hashmap_get(tr->jobs, unit)) {
+                assert(j->unit == unit);
+
+                if (j->type == type)
+                        return j;
+        }
+
+        return NULL;
+}
+
 static Job* transaction_add_one_job(Transaction *tr, JobType type, Unit *unit, bool override, bool *is_new) {
         Job *j, *f;
 
@@ -753,18 +885,15 @@ static Job* transaction_add_one_job(Transaction *tr, JobType type, Unit *unit, b
          * it doesn't exist it is created and added to the prospective
          * jobs list. */
 
-        f = hashmap_get(tr->jobs, unit);
-
-        LIST_FOREACH(transaction, j, f) {
-                assert(j->unit == unit);
-
-                if (j->type == type) {
-                        if (is_new)
-                                *is_new = false;
-                        return j;
-                }
+        j = transaction_find_job(tr, type, unit);
+        if (j) {
+                if (is_new)
+                        *is_new = false;
+                return j;
         }
 
+        f = hashmap_get(tr->jobs, unit);
+
         j = job_new(unit, type);
         if (!j)
                 return NULL;
@@ -825,6 +954,25 @@ static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependen
         }
 }
 
+static int transaction_dependency_log_level(Transaction *tr, Unit *dep, int r) {
+        assert(tr);
+        assert(dep);
+
+        /* A unit pulled in by many others would fail the same way
+         * for each of them, complain about it only once */
+
+        if (r == -EADDRNOTAVAIL)
+                return LOG_DEBUG;
+
+        if (set_contains(tr->warned_units, dep))
+                return LOG_DEBUG;
+
+        if (set_ensure_allocated(&tr->warned_units, NULL) >= 0)
+                (void) set_put(tr->warned_units, dep);
+
+        return LOG_WARNING;
+}
+
 int transaction_add_job_and_dependencies(
                 Transaction *tr,
                 JobType type,
@@ -852,6 +1000,21 @@ int transaction_add_job_and_dependencies(
         /*           by ? by->unit->id : "NA", */
         /*           by ? job_type_to_string(by->type) : "NA"); */
 
+        /* Every unit and job type pair is checked and expanded only
+         * once per transaction: if there is a job for it already,
+         * all that is left to do is to link to it. Large transactions
+         * reach the units everything depends on over and over
+         * again. */
+        ret = by ? transaction_find_job(tr, type, unit) : NULL;
+        if (ret) {
+                ret->ignore_order = ret->ignore_order || ignore_order;
+
+                if (!job_dependency_new(by, ret, matters, conflicts))
+                        return -ENOMEM;
+
+                return 0;
+        }
+
         if (!IN_SET(unit->load_state, UNIT_LOADED, UNIT_ERROR, UNIT_NOT_FOUND, UNIT_MASKED))
                 return sd_bus_error_setf(e, BUS_ERROR_LOAD_FAILED,
                                          "Unit %s is not loaded properly.", unit->id);
@@ -912,9 +1075,10 @@ int transaction_add_job_and_dependencies(
                         SET_FOREACH(dep, following, i) {
                                 r = transaction_add_job_and_dependencies(tr, type, dep, ret, false, override, false, false, ignore_order, e);
                                 if (r < 0) {
-                                        log_unit_warning(dep->id,
-                                                         "Cannot add dependency job for unit %s, ignoring: %s",
-                                                         dep->id, bus_error_message(e, r));
+                                        log_unit_full(dep->id,
+                                              transaction_dependency_log_level(tr, dep, r),
+                                              "Cannot add dependency job for unit %s, ignoring: %s",
+                                              dep->id, bus_error_message(e, r));
 
                                         if (e)
                                                 sd_bus_error_free(e);
@@ -952,7 +1116,7 @@ int transaction_add_job_and_dependencies(
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, !override, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_full(dep->id,
-                                                      r == -EADDRNOTAVAIL ? LOG_DEBUG : LOG_WARNING,
+                                                      transaction_dependency_log_level(tr, dep, r),
                                                       "Cannot add dependency job for unit %s, ignoring: %s",
                                                       dep->id, bus_error_message(e, r));
 
@@ -965,7 +1129,7 @@ int transaction_add_job_and_dependencies(
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_full(dep->id,
-                                                      r == -EADDRNOTAVAIL ? LOG_DEBUG : LOG_WARNING,
+                                                      transaction_dependency_log_level(tr, dep, r),
                                                       "Cannot add dependency job for unit %s, ignoring: %s",
                                                       dep->id, bus_error_message(e, r));
 
@@ -989,7 +1153,7 @@ int transaction_add_job_and_dependencies(
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, !override, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_full(dep->id,
-                                                      r == -EADDRNOTAVAIL ? LOG_DEBUG : LOG_WARNING,
+                                                      transaction_dependency_log_level(tr, dep, r),
                                                       "Cannot add dependency job for unit %s, ignoring: %s",
                                                       dep->id, bus_error_message(e, r));
 
@@ -1012,9 +1176,10 @@ int transaction_add_job_and_dependencies(
                         SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, override, false, false, ignore_order, e);
                                 if (r < 0) {
-                                        log_unit_warning(dep->id,
-                                                         "Cannot add dependency job for unit %s, ignoring: %s",
-                                                         dep->id, bus_error_message(e, r));
+                                        log_unit_full(dep->id,
+                                              transaction_dependency_log_level(tr, dep, r),
+                                              "Cannot add dependency job for unit %s, ignoring: %s",
+                                              dep->id, bus_error_message(e, r));
 
                                         if (e)
                                                 sd_bus_error_free(e);
@@ -1065,9 +1230,10 @@ int transaction_add_job_and_dependencies(
                         SET_FOREACH(dep, ret->unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_RELOAD, dep, ret, false, override, false, false, ignore_order, e);
                                 if (r < 0) {
-                                        log_unit_warning(dep->id,
-                                                         "Cannot add dependency reload job for unit %s, ignoring: %s",
-                                                         dep->id, bus_error_message(e, r));
+                                        log_unit_full(dep->id,
+                                              transaction_dependency_log_level(tr, dep, r),
+                                              "Cannot add dependency reload job for unit %s, ignoring: %s",
+                                              dep->id, bus_error_message(e, r));
 
                                         if (e)
                                                 sd_bus_error_free(e);
@@ -1141,5 +1307,6 @@ Transaction *transaction_new(bool irreversible) {
 void transaction_free(Transaction *tr) {
         assert(hashmap_isempty(tr->jobs));
         hashmap_free(tr->jobs);
+        set_free(tr->warned_units);
         free(tr);
 }
@@ -32,6 +32,7 @@ struct Transaction {
         /* Jobs to be added */
         Hashmap *jobs;      /* Unit object => Job object list 1:1 */
         Job *anchor_job;      /* the job the user asked for */
+        Set *warned_units;    /* units we already complained about */
         bool irreversible;
 };
 
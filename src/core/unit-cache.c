@@ -0,0 +1,258 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util.h"
+#include "mkdir.h"
+#include "unit-cache.h"
+
+#define UNIT_CACHE_SIGNATURE { 'S', 'D', 'U', 'N', 'I', 'T', 'C', '1' }
+
+/* The file consists of this header, followed by n_entries records as
+ * written by config_file_serialize(). Since the records are in
+ * native byte order, the header also carries the sizes of a few
+ * types, so that a cache left in /run by a manager built for a
+ * different architecture, e.g. the one of the initrd, is simply
+ * ignored. */
+typedef struct UnitCacheHeader {
+        uint8_t signature[8];
+        uint32_t header_size;
+        uint8_t sizeof_size_t;
+        uint8_t sizeof_dev_t;
+        uint8_t sizeof_ino_t;
+        uint8_t endian;
+        uint64_t n_entries;
+        uint64_t size;
+} UnitCacheHeader;
+
+struct UnitCache {
+        void *map;
+        size_t map_size;
+
+        /* Entries not taken yet, by file name */
+        Hashmap *entries;
+        unsigned n_entries;
+};
+
+static void unit_cache_header_init(UnitCacheHeader *h) {
+        static const uint8_t signature[] = UNIT_CACHE_SIGNATURE;
+
+        zero(*h);
+        memcpy(h->signature, signature, sizeof(signature));
+        h->header_size = sizeof(UnitCacheHeader);
+        h->sizeof_size_t = sizeof(size_t);
+        h->sizeof_dev_t = sizeof(dev_t);
+        h->sizeof_ino_t = sizeof(ino_t);
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+        h->endian = 'l';
+#else
+        h->endian = 'B';
+#endif
+}
+
+UnitCache *unit_cache_free(UnitCache *c) {
+        ConfigFile *f;
+
+        if (!c)
+                return NULL;
+
+        while ((f = hashmap_steal_first(c->entries)))
+                config_file_free(f);
+        hashmap_free(c->entries);
+
+        if (c->map)
+                munmap(c->map, c->map_size);
+
+        free(c);
+
+        return NULL;
+}
+
+int unit_cache_open(const char *path, UnitCache **ret) {
+        _cleanup_(unit_cache_freep) UnitCache *c = NULL;
+        _cleanup_close_ int fd = -1;
+        UnitCacheHeader expected;
+        const UnitCacheHeader *h;
+        const uint8_t *p;
+        struct stat st;
+        size_t left;
+        uint64_t i;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* Only trust a cache we wrote ourselves */
+        if (!S_ISREG(st.st_mode) || st.st_uid != getuid())
+                return -EPERM;
+
+        if ((size_t) st.st_size < sizeof(UnitCacheHeader) || st.st_size > SIZE_MAX)
+                return -EBADMSG;
+
+        c = new0(UnitCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->map_size = st.st_size;
+        c->map = mmap(NULL, c->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (c->map == MAP_FAILED) {
+                c->map = NULL;
+                return -errno;
+        }
+
+        h = c->map;
+        unit_cache_header_init(&expected);
+        if (memcmp(h, &expected, offsetof(UnitCacheHeader, n_entries)) != 0 ||
+            h->size != c->map_size)
+                return -EBADMSG;
+
+        c->entries = hashmap_new(&string_hash_ops);
+        if (!c->entries)
+                return -ENOMEM;
+
+        p = (const uint8_t*) c->map + sizeof(UnitCacheHeader);
+        left = c->map_size - sizeof(UnitCacheHeader);
+
+        for (i = 0; i < h->n_entries; i++) {
+                _cleanup_(config_file_freep) ConfigFile *f = NULL;
+
+                r = config_file_deserialize(&p, &left, &f);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(c->entries, config_file_get_filename(f), f);
+                if (r < 0)
+                        return r;
+
+                f = NULL;
+        }
+
+        if (left != 0)
+                return -EBADMSG;
+
+        c->n_entries = h->n_entries;
+
+        *ret = c;
+        c = NULL;
+
+        return 0;
+}
+
+unsigned unit_cache_size(UnitCache *c) {
+        return c ? c->n_entries : 0;
+}
+
+/* Returns the cached entry for the file if it is still up to date,
+ * and NULL otherwise. The result refers to the mapped cache file,
+ * and must be freed before the cache is. */
+ConfigFile *unit_cache_take(UnitCache *c, const char *filename, bool allow_include) {
+        ConfigFile *f;
+
+        assert(filename);
+
+        if (!c)
+                return NULL;
+
+        f = hashmap_remove(c->entries, filename);
+        if (!f)
+                return NULL;
+
+        if (config_file_get_allow_include(f) != allow_include ||
+            !config_file_is_up_to_date(f)) {
+                config_file_free(f);
+                return NULL;
+        }
+
+        return f;
+}
+
+/* Writes all files in the hashmap to a new cache. Files modified at
+ * or after not_after are left out: if they were changed again within
+ * the granularity of the file system timestamps after we read them,
+ * we would not be able to tell. */
+int unit_cache_write(const char *path, Hashmap *files, usec_t not_after) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        UnitCacheHeader h;
+        ConfigFile *c;
+        Iterator i;
+        long size;
+        int r;
+
+        assert(path);
+
+        unit_cache_header_init(&h);
+
+        r = mkdir_parents(path, 0755);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(path, &f, &t);
+        if (r < 0)
+                return r;
+
+        fwrite(&h, sizeof(h), 1, f);
+
+        HASHMAP_FOREACH(c, files, i) {
+                if (config_file_newest_mtime(c) >= not_after)
+                        continue;
+
+                r = config_file_serialize(c, f);
+                if (r < 0)
+                        goto fail;
+
+                h.n_entries++;
+        }
+
+        size = ftell(f);
+        if (size < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        h.size = size;
+        rewind(f);
+        fwrite(&h, sizeof(h), 1, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(t, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
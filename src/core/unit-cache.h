@@ -0,0 +1,41 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "conf-parser.h"
+#include "hashmap.h"
+#include "time-util.h"
+
+/* A persistent cache of tokenized unit files and drop-ins, so that
+ * we don't have to read and split them again on every boot and
+ * reload. Entries are validated against the inode, size and mtime of
+ * the files they were read from. */
+typedef struct UnitCache UnitCache;
+
+int unit_cache_open(const char *path, UnitCache **ret);
+UnitCache *unit_cache_free(UnitCache *c);
+unsigned unit_cache_size(UnitCache *c);
+ConfigFile *unit_cache_take(UnitCache *c, const char *filename, bool allow_include);
+
+int unit_cache_write(const char *path, Hashmap *files, usec_t not_after);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitCache*, unit_cache_free);
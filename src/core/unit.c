@@ -46,6 +46,7 @@
 #include "dbus.h"
 #include "execute.h"
 #include "dropin.h"
+#include "serialize.h"
 
 const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX] = {
         [UNIT_SERVICE] = &service_vtable,
@@ -252,20 +253,13 @@ int unit_choose_id(Unit *u, const char *name) {
 }
 
 int unit_set_description(Unit *u, const char *description) {
-        char *s;
+        int r;
 
         assert(u);
 
-        if (isempty(description))
-                s = NULL;
-        else {
-                s = strdup(description);
-                if (!s)
-                        return -ENOMEM;
-        }
-
-        free(u->description);
-        u->description = s;
+        r = string_pool_replace(u->manager->strings, &u->description, isempty(description) ? NULL : description);
+        if (r < 0)
+                return r;
 
         unit_add_to_dbus_queue(u);
         return 0;
@@ -364,6 +358,12 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
+/* Dependencies in u->owned_dependencies are keyed by the other unit,
+ * with the lowest bit set if they point from the other unit to u */
+#define OWNED_DEPENDENCY_KEY(other, reverse) ((void*) ((uintptr_t) (other) | !!(reverse)))
+
+assert_cc(_UNIT_DEPENDENCY_MAX <= 32);
+
 static void bidi_set_free(Unit *u, Set *s) {
         Iterator i;
         Unit *other;
@@ -379,6 +379,9 @@ static void bidi_set_free(Unit *u, Set *s) {
                 for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                         set_remove(other->dependencies[d], u);
 
+                hashmap_remove(other->owned_dependencies, OWNED_DEPENDENCY_KEY(u, false));
+                hashmap_remove(other->owned_dependencies, OWNED_DEPENDENCY_KEY(u, true));
+
                 unit_add_to_gc_queue(other);
         }
 
@@ -491,6 +494,8 @@ void unit_free(Unit *u) {
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 bidi_set_free(u, u->dependencies[d]);
 
+        hashmap_free(u->owned_dependencies);
+
         if (u->type != _UNIT_TYPE_INVALID)
                 LIST_REMOVE(units_by_type, u->manager->units_by_type[u->type], u);
 
@@ -500,6 +505,8 @@ void unit_free(Unit *u) {
         if (u->in_dbus_queue)
                 LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
 
+        set_remove(u->manager->dbus_units_changed, u);
+
         if (u->in_cleanup_queue)
                 LIST_REMOVE(cleanup_queue, u->manager->cleanup_queue, u);
 
@@ -519,10 +526,10 @@ void unit_free(Unit *u) {
         manager_update_failed_units(u->manager, u, false);
         set_remove(u->manager->startup_units, u);
 
-        free(u->description);
+        string_pool_unref(u->manager->strings, u->description);
         strv_free(u->documentation);
-        free(u->fragment_path);
-        free(u->source_path);
+        string_pool_unref(u->manager->strings, u->fragment_path);
+        string_pool_unref(u->manager->strings, u->source_path);
         strv_free(u->dropin_paths);
         free(u->instance);
 
@@ -626,6 +633,54 @@ static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
         return set_reserve(u->dependencies[d], n_reserve);
 }
 
+static void own_dependencies(Unit *u, void *key, unsigned mask) {
+        unsigned old;
+
+        /* This is only bookkeeping for incremental reloads, hence
+         * failing to allocate memory here is not fatal, it just
+         * makes us forget the dependencies again on the next one */
+
+        if (hashmap_ensure_allocated(&u->owned_dependencies, NULL) < 0)
+                return;
+
+        old = PTR_TO_UINT(hashmap_get(u->owned_dependencies, key));
+        (void) hashmap_replace(u->owned_dependencies, key, UINT_TO_PTR(old | mask));
+}
+
+static void merge_owned_dependencies(Unit *u, Unit *other) {
+        UnitDependency d;
+        Iterator i;
+        Unit *back;
+        void *key;
+        void *v;
+
+        assert(u);
+        assert(other);
+
+        /* What other units' configuration asked of other now applies
+         * to u... */
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                SET_FOREACH(back, other->dependencies[d], i) {
+                        unsigned reverse;
+
+                        for (reverse = 0; reverse < 2; reverse++) {
+                                unsigned mask;
+
+                                mask = PTR_TO_UINT(hashmap_remove(back->owned_dependencies, OWNED_DEPENDENCY_KEY(other, reverse)));
+                                if (mask != 0 && back != u)
+                                        own_dependencies(back, OWNED_DEPENDENCY_KEY(u, reverse), mask);
+                        }
+                }
+
+        /* ...and what other's configuration asked for is now u's */
+        HASHMAP_FOREACH_KEY(v, key, other->owned_dependencies, i)
+                if (((uintptr_t) key & ~(uintptr_t) 1) != (uintptr_t) u)
+                        own_dependencies(u, key, PTR_TO_UINT(v));
+
+        hashmap_free(other->owned_dependencies);
+        other->owned_dependencies = NULL;
+}
+
 static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
         Iterator i;
         Unit *back;
@@ -721,9 +776,10 @@ int unit_merge(Unit *u, Unit *other) {
 
         /* Redirect all references */
         while (other->refs)
-                unit_ref_set(other->refs, u);
+                unit_ref_set(other->refs, other->refs->source, u);
 
         /* Merge dependencies */
+        merge_owned_dependencies(u, other);
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 merge_dependencies(u, other, other_id, d);
 
@@ -1178,7 +1234,7 @@ static int unit_add_startup_units(Unit *u) {
         return r;
 }
 
-int unit_load(Unit *u) {
+static int unit_load_internal(Unit *u) {
         int r;
 
         assert(u);
@@ -1229,6 +1285,10 @@ int unit_load(Unit *u) {
                         goto fail;
                 }
 
+                /* Our subtree mask might have been calculated
+                 * already, before we knew our slice, make sure it
+                 * makes it into the slice now */
+                u->cgroup_subtree_mask_valid = false;
                 unit_update_cgroup_members_masks(u);
         }
 
@@ -1251,6 +1311,22 @@ fail:
         return r;
 }
 
+int unit_load(Unit *u) {
+        Unit *saved;
+        int r;
+
+        assert(u);
+
+        saved = u->manager->loading_unit;
+        u->manager->loading_unit = u;
+
+        r = unit_load_internal(u);
+
+        u->manager->loading_unit = saved;
+
+        return r;
+}
+
 static bool unit_condition_test_list(Unit *u, Condition *first, const char *(*to_string)(ConditionType t)) {
         Condition *c;
         int triggered = -1;
@@ -2276,6 +2352,14 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
                         goto fail;
         }
 
+        /* Remember whose configuration asked for this dependency, so
+         * that an incremental reload can restore it when the other
+         * unit is reloaded */
+        if (u->manager->loading_unit && unit_follow_merge(u->manager->loading_unit) == other)
+                own_dependencies(other, OWNED_DEPENDENCY_KEY(u, true), 1U << d | (add_reference ? 1U << UNIT_REFERENCES : 0));
+        else
+                own_dependencies(u, OWNED_DEPENDENCY_KEY(other, false), 1U << d | (add_reference ? 1U << UNIT_REFERENCES : 0));
+
         unit_add_to_dbus_queue(u);
         return 0;
 
@@ -2292,6 +2376,50 @@ fail:
         return r;
 }
 
+void unit_get_owned_dependencies(Unit *u, Unit *other, unsigned *to, unsigned *from) {
+        assert(u);
+        assert(other);
+        assert(to);
+        assert(from);
+
+        *to = PTR_TO_UINT(hashmap_get(u->owned_dependencies, OWNED_DEPENDENCY_KEY(other, false)));
+        *from = PTR_TO_UINT(hashmap_get(u->owned_dependencies, OWNED_DEPENDENCY_KEY(other, true)));
+}
+
+int unit_add_owned_dependencies(Unit *u, Unit *other, unsigned to, unsigned from) {
+        UnitDependency d;
+        Unit *saved;
+        int r = 0;
+
+        assert(u);
+        assert(other);
+
+        /* Restores the dependencies between u and other that u's
+         * configuration asked for, as returned by
+         * unit_get_owned_dependencies(). */
+
+        saved = u->manager->loading_unit;
+        u->manager->loading_unit = u;
+
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
+                if (to & (1U << d)) {
+                        r = unit_add_dependency(u, d, other, false);
+                        if (r < 0)
+                                break;
+                }
+
+                if (from & (1U << d)) {
+                        r = unit_add_dependency(other, d, u, false);
+                        if (r < 0)
+                                break;
+                }
+        }
+
+        u->manager->loading_unit = saved;
+
+        return r;
+}
+
 int unit_add_two_dependencies(Unit *u, UnitDependency d, UnitDependency e, Unit *other, bool add_reference) {
         int r;
 
@@ -2342,6 +2470,24 @@ static const char *resolve_template(Unit *u, const char *name, const char*path,
         return s;
 }
 
+bool unit_has_dependency_by_name(Unit *u, UnitDependency d, const char *name) {
+        _cleanup_free_ char *s = NULL;
+        Unit *other;
+
+        assert(u);
+        assert(name);
+
+        name = resolve_template(u, name, NULL, &s);
+        if (!name)
+                return false;
+
+        other = manager_get_unit(u->manager, name);
+        if (!other)
+                return false;
+
+        return set_contains(u->dependencies[d], unit_follow_merge(other));
+}
+
 int unit_add_dependency_by_name(Unit *u, UnitDependency d, const char *name, const char *path, bool add_reference) {
         Unit *other;
         int r;
@@ -2511,7 +2657,7 @@ int unit_add_default_slice(Unit *u, CGroupContext *c) {
         if (r < 0)
                 return r;
 
-        unit_ref_set(&u->slice, slice);
+        unit_ref_set(&u->slice, u, slice);
         return 0;
 }
 
@@ -2567,12 +2713,15 @@ bool unit_can_serialize(Unit *u) {
 }
 
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
+        SerializationFormat format;
         int r;
 
         assert(u);
         assert(f);
         assert(fds);
 
+        format = u->manager->serialization_format;
+
         if (unit_can_serialize(u)) {
                 ExecRuntime *rt;
 
@@ -2588,12 +2737,12 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
                 }
         }
 
-        dual_timestamp_serialize(f, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
-        dual_timestamp_serialize(f, "active-enter-timestamp", &u->active_enter_timestamp);
-        dual_timestamp_serialize(f, "active-exit-timestamp", &u->active_exit_timestamp);
-        dual_timestamp_serialize(f, "inactive-enter-timestamp", &u->inactive_enter_timestamp);
-        dual_timestamp_serialize(f, "condition-timestamp", &u->condition_timestamp);
-        dual_timestamp_serialize(f, "assert-timestamp", &u->assert_timestamp);
+        serialize_dual_timestamp(f, format, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
+        serialize_dual_timestamp(f, format, "active-enter-timestamp", &u->active_enter_timestamp);
+        serialize_dual_timestamp(f, format, "active-exit-timestamp", &u->active_exit_timestamp);
+        serialize_dual_timestamp(f, format, "inactive-enter-timestamp", &u->inactive_enter_timestamp);
+        serialize_dual_timestamp(f, format, "condition-timestamp", &u->condition_timestamp);
+        serialize_dual_timestamp(f, format, "assert-timestamp", &u->assert_timestamp);
 
         if (dual_timestamp_is_set(&u->condition_timestamp))
                 unit_serialize_item(u, f, "condition-result", yes_no(u->condition_result));
@@ -2609,18 +2758,18 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
 
         if (serialize_jobs) {
                 if (u->job) {
-                        fprintf(f, "job\n");
+                        serialize_item(f, format, "job", NULL);
                         job_serialize(u->job, f, fds);
                 }
 
                 if (u->nop_job) {
-                        fprintf(f, "job\n");
+                        serialize_item(f, format, "job", NULL);
                         job_serialize(u->nop_job, f, fds);
                 }
         }
 
         /* End marker */
-        fputc('\n', f);
+        serialize_end_marker(f, format);
         return 0;
 }
 
@@ -2632,14 +2781,9 @@ void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *f
         assert(key);
         assert(format);
 
-        fputs(key, f);
-        fputc('=', f);
-
         va_start(ap, format);
-        vfprintf(f, format, ap);
+        serialize_item_formatv(f, u->manager->serialization_format, key, format, ap);
         va_end(ap);
-
-        fputc('\n', f);
 }
 
 void unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value) {
@@ -2648,7 +2792,16 @@ void unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value) {
         assert(key);
         assert(value);
 
-        fprintf(f, "%s=%s\n", key, value);
+        serialize_item(f, u->manager->serialization_format, key, value);
+}
+
+void unit_serialize_dual_timestamp(Unit *u, FILE *f, const char *key, dual_timestamp *t) {
+        assert(u);
+        assert(f);
+        assert(key);
+        assert(t);
+
+        serialize_dual_timestamp(f, u->manager->serialization_format, key, t);
 }
 
 int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
@@ -2665,29 +2818,15 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 rt = (ExecRuntime**) ((uint8_t*) u + offset);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
-                size_t k;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                /* End marker */
-                if (l[0] == 0)
-                        return 0;
+                SerializationItem item;
+                const char *l, *v;
 
-                k = strcspn(l, "=");
+                r = deserialize_item(f, u->manager->serialization_format, &item);
+                if (r <= 0)
+                        return r;
 
-                if (l[k] == '=') {
-                        l[k] = 0;
-                        v = l+k+1;
-                } else
-                        v = l+k;
+                l = item.key;
+                v = item.value;
 
                 if (streq(l, "job")) {
                         if (v[0] == '\0') {
@@ -2728,22 +2867,22 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                         }
                         continue;
                 } else if (streq(l, "inactive-exit-timestamp")) {
-                        dual_timestamp_deserialize(v, &u->inactive_exit_timestamp);
+                        deserialize_dual_timestamp(&item, &u->inactive_exit_timestamp);
                         continue;
                 } else if (streq(l, "active-enter-timestamp")) {
-                        dual_timestamp_deserialize(v, &u->active_enter_timestamp);
+                        deserialize_dual_timestamp(&item, &u->active_enter_timestamp);
                         continue;
                 } else if (streq(l, "active-exit-timestamp")) {
-                        dual_timestamp_deserialize(v, &u->active_exit_timestamp);
+                        deserialize_dual_timestamp(&item, &u->active_exit_timestamp);
                         continue;
                 } else if (streq(l, "inactive-enter-timestamp")) {
-                        dual_timestamp_deserialize(v, &u->inactive_enter_timestamp);
+                        deserialize_dual_timestamp(&item, &u->inactive_enter_timestamp);
                         continue;
                 } else if (streq(l, "condition-timestamp")) {
-                        dual_timestamp_deserialize(v, &u->condition_timestamp);
+                        deserialize_dual_timestamp(&item, &u->condition_timestamp);
                         continue;
                 } else if (streq(l, "assert-timestamp")) {
-                        dual_timestamp_deserialize(v, &u->assert_timestamp);
+                        deserialize_dual_timestamp(&item, &u->assert_timestamp);
                         continue;
                 } else if (streq(l, "condition-result")) {
                         int b;
@@ -2805,6 +2944,8 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 }
 
                 if (unit_can_serialize(u)) {
+                        v = deserialize_item_value(&item);
+
                         if (rt) {
                                 r = exec_runtime_deserialize_item(rt, u, l, v, fds);
                                 if (r < 0)
@@ -3133,13 +3274,15 @@ int unit_get_unit_file_preset(Unit *u) {
         return u->unit_file_preset;
 }
 
-Unit* unit_ref_set(UnitRef *ref, Unit *u) {
+Unit* unit_ref_set(UnitRef *ref, Unit *source, Unit *u) {
         assert(ref);
+        assert(source);
         assert(u);
 
         if (ref->unit)
                 unit_ref_unset(ref);
 
+        ref->source = source;
         ref->unit = u;
         LIST_PREPEND(refs, u->refs, ref);
         return u;
@@ -3152,7 +3295,7 @@ void unit_ref_unset(UnitRef *ref) {
                 return;
 
         LIST_REMOVE(refs, ref->unit->refs, ref);
-        ref->unit = NULL;
+        ref->source = ref->unit = NULL;
 }
 
 int unit_patch_contexts(Unit *u) {
@@ -3426,6 +3569,7 @@ int unit_remove_drop_in(Unit *u, UnitSetPropertiesMode mode, const char *name) {
 }
 
 int unit_make_transient(Unit *u) {
+        _cleanup_free_ char *path = NULL;
         int r;
 
         assert(u);
@@ -3434,8 +3578,7 @@ int unit_make_transient(Unit *u) {
         u->load_error = 0;
         u->transient = true;
 
-        free(u->fragment_path);
-        u->fragment_path = NULL;
+        u->fragment_path = string_pool_unref(u->manager->strings, u->fragment_path);
 
         if (u->manager->running_as == SYSTEMD_USER) {
                 _cleanup_free_ char *c = NULL;
@@ -3446,19 +3589,23 @@ int unit_make_transient(Unit *u) {
                 if (r == 0)
                         return -ENOENT;
 
-                u->fragment_path = strjoin(c, "/", u->id, NULL);
-                if (!u->fragment_path)
+                path = strjoin(c, "/", u->id, NULL);
+                if (!path)
                         return -ENOMEM;
 
                 mkdir_p(c, 0755);
         } else {
-                u->fragment_path = strappend("/run/systemd/system/", u->id);
-                if (!u->fragment_path)
+                path = strappend("/run/systemd/system/", u->id);
+                if (!path)
                         return -ENOMEM;
 
                 mkdir_p("/run/systemd/system", 0755);
         }
 
+        r = string_pool_replace(u->manager->strings, &u->fragment_path, path);
+        if (r < 0)
+                return r;
+
         return write_string_file_atomic_label(u->fragment_path, "# Transient stub");
 }
 
@@ -77,7 +77,7 @@ struct UnitRef {
          * that we can merge two units if necessary and correct all
          * references to them */
 
-        Unit* unit;
+        Unit *source, *unit;
         LIST_FIELDS(UnitRef, refs);
 };
 
@@ -94,18 +94,28 @@ struct Unit {
         Set *names;
         Set *dependencies[_UNIT_DEPENDENCY_MAX];
 
+        /* The dependencies on other units our own configuration
+         * asked for, as opposed to those asked for by theirs. Maps
+         * the other unit to a mask of UnitDependency values, see
+         * unit_get_owned_dependencies(). */
+        Hashmap *owned_dependencies;
+
         char **requires_mounts_for;
 
-        char *description;
+        /* These three are interned in the manager's string pool */
+        const char *description;
         char **documentation;
 
-        char *fragment_path; /* if loaded from a config file this is the primary path to it */
-        char *source_path; /* if converted, the source file */
+        const char *fragment_path; /* if loaded from a config file this is the primary path to it */
+        const char *source_path; /* if converted, the source file */
         char **dropin_paths;
         usec_t fragment_mtime;
         usec_t source_mtime;
         usec_t dropin_mtime;
 
+        /* The number of .wants/ and .requires/ entries we found when loading */
+        unsigned n_dropin_dependencies;
+
         /* If there is something to do with this unit, then this is the installed job for it */
         Job *job;
 
@@ -222,6 +232,9 @@ struct Unit {
         bool in_gc_queue:1;
         bool in_cgroup_queue:1;
 
+        /* Set on slices queued to realize their members */
+        bool cgroup_members_queued:1;
+
         bool sent_dbus_new_signal:1;
 
         bool no_gc:1;
@@ -466,6 +479,7 @@ int unit_add_name(Unit *u, const char *name);
 int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference);
 int unit_add_two_dependencies(Unit *u, UnitDependency d, UnitDependency e, Unit *other, bool add_reference);
 
+bool unit_has_dependency_by_name(Unit *u, UnitDependency d, const char *name);
 int unit_add_dependency_by_name(Unit *u, UnitDependency d, const char *name, const char *filename, bool add_reference);
 int unit_add_two_dependencies_by_name(Unit *u, UnitDependency d, UnitDependency e, const char *name, const char *path, bool add_reference);
 
@@ -540,6 +554,7 @@ bool unit_can_serialize(Unit *u) _pure_;
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs);
 void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *value, ...) _printf_(4,5);
 void unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value);
+void unit_serialize_dual_timestamp(Unit *u, FILE *f, const char *key, dual_timestamp *t);
 int unit_deserialize(Unit *u, FILE *f, FDSet *fds);
 
 int unit_add_node_link(Unit *u, const char *what, bool wants);
@@ -571,7 +586,10 @@ void unit_trigger_notify(Unit *u);
 UnitFileState unit_get_unit_file_state(Unit *u);
 int unit_get_unit_file_preset(Unit *u);
 
-Unit* unit_ref_set(UnitRef *ref, Unit *u);
+void unit_get_owned_dependencies(Unit *u, Unit *other, unsigned *to, unsigned *from);
+int unit_add_owned_dependencies(Unit *u, Unit *other, unsigned to, unsigned from);
+
+Unit* unit_ref_set(UnitRef *ref, Unit *source, Unit *u);
 void unit_ref_unset(UnitRef *ref);
 
 #define UNIT_DEREF(ref) ((ref).unit)
@@ -190,6 +190,7 @@ global:
         sd_bus_negotiate_fds;
         sd_bus_negotiate_timestamp;
         sd_bus_negotiate_creds;
+        sd_bus_negotiate_memfd;
         sd_bus_start;
         sd_bus_close;
         sd_bus_try_close;
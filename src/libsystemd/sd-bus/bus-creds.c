@@ -27,6 +27,7 @@
 #include "cgroup-util.h"
 #include "fileio.h"
 #include "audit.h"
+#include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-util.h"
 #include "strv.h"
@@ -40,6 +41,72 @@ enum {
         CAP_OFFSET_BOUNDING = 3
 };
 
+/* Fields read from /proc/$PID/status */
+#define CREDS_STATUS_MASK                                               \
+        (SD_BUS_CREDS_UID|SD_BUS_CREDS_EUID|SD_BUS_CREDS_SUID|SD_BUS_CREDS_FSUID| \
+         SD_BUS_CREDS_GID|SD_BUS_CREDS_EGID|SD_BUS_CREDS_SGID|SD_BUS_CREDS_FSGID| \
+         SD_BUS_CREDS_SUPPLEMENTARY_GIDS|                               \
+         SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|     \
+         SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_BOUNDING_CAPS)
+
+/* Fields derived from /proc/$PID/cgroup */
+#define CREDS_CGROUP_MASK                                               \
+        (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|  \
+         SD_BUS_CREDS_SLICE|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_OWNER_UID)
+
+/* Fields that privilege checks are based on. These are never shared
+ * between calls from the same sender, as the process might change
+ * them at any time, and are always read from /proc again. */
+#define CREDS_UNSHARED_MASK                                             \
+        (CREDS_STATUS_MASK|SD_BUS_CREDS_SELINUX_CONTEXT)
+
+/* All fields we can augment from /proc */
+#define CREDS_PROC_MASK                                                 \
+        (CREDS_STATUS_MASK|CREDS_CGROUP_MASK|                           \
+         SD_BUS_CREDS_SELINUX_CONTEXT|SD_BUS_CREDS_COMM|SD_BUS_CREDS_TID_COMM| \
+         SD_BUS_CREDS_EXE|SD_BUS_CREDS_CMDLINE|                         \
+         SD_BUS_CREDS_AUDIT_SESSION_ID|SD_BUS_CREDS_AUDIT_LOGIN_UID)
+
+static int read_starttime(pid_t pid, unsigned long long *ret) {
+        _cleanup_free_ char *line = NULL;
+        unsigned long long starttime;
+        const char *p;
+        char state;
+        int r;
+
+        assert(pid > 0);
+        assert(ret);
+
+        p = procfs_file_alloca(pid, "stat");
+        r = read_one_line_file(p, &line);
+        if (r == -ENOENT)
+                return -ESRCH;
+        if (r < 0)
+                return r;
+
+        /* Skip over the comm field, which might contain spaces or
+         * parentheses, then read the state and the start time, which
+         * is the 22nd field. */
+        p = strrchr(line, ')');
+        if (!p)
+                return -EIO;
+
+        if (sscanf(p + 1,
+                   " %c"
+                   " %*s %*s %*s %*s %*s %*s %*s %*s %*s" /* ppid … cmajflt */
+                   " %*s %*s %*s %*s %*s %*s %*s %*s %*s" /* utime … itrealvalue */
+                   " %llu",
+                   &state, &starttime) != 2)
+                return -EIO;
+
+        /* A zombie won't tell us anything anymore */
+        if (state == 'Z')
+                return -ESRCH;
+
+        *ret = starttime;
+        return 0;
+}
+
 void bus_creds_done(sd_bus_creds *c) {
         assert(c);
 
@@ -102,6 +169,8 @@ _public_ sd_bus_creds *sd_bus_creds_unref(sd_bus_creds *c) {
                         free(c->cgroup_root);
                         free(c->description);
 
+                        sd_bus_creds_unref(c->source);
+
                         free(c->supplementary_gids);
                         c->supplementary_gids = NULL;
 
@@ -126,9 +195,28 @@ _public_ sd_bus_creds *sd_bus_creds_unref(sd_bus_creds *c) {
 _public_ uint64_t sd_bus_creds_get_mask(const sd_bus_creds *c) {
         assert_return(c, 0);
 
+        /* Fields that are collected lazily are only known to be
+         * available after they have been read, hence do so now */
+        (void) bus_creds_materialize((sd_bus_creds*) c, c->augment);
+
         return c->mask;
 }
 
+static int bus_creds_need(sd_bus_creds *c, uint64_t field) {
+        int r;
+
+        assert(c);
+
+        if (c->mask & field)
+                return 0;
+
+        r = bus_creds_materialize(c, field);
+        if (r < 0)
+                return r;
+
+        return c->mask & field ? 0 : -ENODATA;
+}
+
 sd_bus_creds* bus_creds_new(void) {
         sd_bus_creds *c;
 
@@ -162,45 +250,58 @@ _public_ int sd_bus_creds_new_from_pid(sd_bus_creds **ret, pid_t pid, uint64_t m
                 return r;
         }
 
-        /* Check if the process existed at all, in case we haven't
-         * figured that out already */
-        if (!pid_is_alive(pid)) {
+        /* Check if the process exists at all, and remember its start
+         * time, so that we notice if the PID is recycled before the
+         * fields are read */
+        r = read_starttime(pid, &c->starttime);
+        if (r < 0) {
                 sd_bus_creds_unref(c);
-                return -ESRCH;
+                return r;
         }
 
+        c->starttime_valid = true;
+
         *ret = c;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_uid(sd_bus_creds *c, uid_t *uid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(uid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_UID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_UID);
+        if (r < 0)
+                return r;
 
         *uid = c->uid;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_euid(sd_bus_creds *c, uid_t *euid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(euid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_EUID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_EUID);
+        if (r < 0)
+                return r;
 
         *euid = c->euid;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_suid(sd_bus_creds *c, uid_t *suid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(suid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_SUID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_SUID);
+        if (r < 0)
+                return r;
 
         *suid = c->suid;
         return 0;
@@ -208,22 +309,28 @@ _public_ int sd_bus_creds_get_suid(sd_bus_creds *c, uid_t *suid) {
 
 
 _public_ int sd_bus_creds_get_fsuid(sd_bus_creds *c, uid_t *fsuid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(fsuid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_FSUID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_FSUID);
+        if (r < 0)
+                return r;
 
         *fsuid = c->fsuid;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_gid(sd_bus_creds *c, gid_t *gid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(gid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_GID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_GID);
+        if (r < 0)
+                return r;
 
         *gid = c->gid;
         return 0;
@@ -231,44 +338,56 @@ _public_ int sd_bus_creds_get_gid(sd_bus_creds *c, gid_t *gid) {
 
 
 _public_ int sd_bus_creds_get_egid(sd_bus_creds *c, gid_t *egid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(egid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_EGID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_EGID);
+        if (r < 0)
+                return r;
 
         *egid = c->egid;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_sgid(sd_bus_creds *c, gid_t *sgid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(sgid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_SGID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_SGID);
+        if (r < 0)
+                return r;
 
         *sgid = c->sgid;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_fsgid(sd_bus_creds *c, gid_t *fsgid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(fsgid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_FSGID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_FSGID);
+        if (r < 0)
+                return r;
 
         *fsgid = c->fsgid;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_supplementary_gids(sd_bus_creds *c, const gid_t **gids) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(gids, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_SUPPLEMENTARY_GIDS))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_SUPPLEMENTARY_GIDS);
+        if (r < 0)
+                return r;
 
         *gids = c->supplementary_gids;
         return (int) c->n_supplementary_gids;
@@ -299,10 +418,13 @@ _public_ int sd_bus_creds_get_tid(sd_bus_creds *c, pid_t *tid) {
 }
 
 _public_ int sd_bus_creds_get_selinux_context(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_SELINUX_CONTEXT))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_SELINUX_CONTEXT);
+        if (r < 0)
+                return r;
 
         assert(c->label);
         *ret = c->label;
@@ -310,11 +432,14 @@ _public_ int sd_bus_creds_get_selinux_context(sd_bus_creds *c, const char **ret)
 }
 
 _public_ int sd_bus_creds_get_comm(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_COMM))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_COMM);
+        if (r < 0)
+                return r;
 
         assert(c->comm);
         *ret = c->comm;
@@ -322,11 +447,14 @@ _public_ int sd_bus_creds_get_comm(sd_bus_creds *c, const char **ret) {
 }
 
 _public_ int sd_bus_creds_get_tid_comm(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_TID_COMM))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_TID_COMM);
+        if (r < 0)
+                return r;
 
         assert(c->tid_comm);
         *ret = c->tid_comm;
@@ -334,11 +462,14 @@ _public_ int sd_bus_creds_get_tid_comm(sd_bus_creds *c, const char **ret) {
 }
 
 _public_ int sd_bus_creds_get_exe(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_EXE))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_EXE);
+        if (r < 0)
+                return r;
 
         assert(c->exe);
         *ret = c->exe;
@@ -346,11 +477,14 @@ _public_ int sd_bus_creds_get_exe(sd_bus_creds *c, const char **ret) {
 }
 
 _public_ int sd_bus_creds_get_cgroup(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_CGROUP))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_CGROUP);
+        if (r < 0)
+                return r;
 
         assert(c->cgroup);
         *ret = c->cgroup;
@@ -363,8 +497,9 @@ _public_ int sd_bus_creds_get_unit(sd_bus_creds *c, const char **ret) {
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_UNIT))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_UNIT);
+        if (r < 0)
+                return r;
 
         assert(c->cgroup);
 
@@ -390,8 +525,9 @@ _public_ int sd_bus_creds_get_user_unit(sd_bus_creds *c, const char **ret) {
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_USER_UNIT))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_USER_UNIT);
+        if (r < 0)
+                return r;
 
         assert(c->cgroup);
 
@@ -417,8 +553,9 @@ _public_ int sd_bus_creds_get_slice(sd_bus_creds *c, const char **ret) {
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_SLICE))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_SLICE);
+        if (r < 0)
+                return r;
 
         assert(c->cgroup);
 
@@ -444,8 +581,9 @@ _public_ int sd_bus_creds_get_session(sd_bus_creds *c, const char **ret) {
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_SESSION))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_SESSION);
+        if (r < 0)
+                return r;
 
         assert(c->cgroup);
 
@@ -472,8 +610,9 @@ _public_ int sd_bus_creds_get_owner_uid(sd_bus_creds *c, uid_t *uid) {
         assert_return(c, -EINVAL);
         assert_return(uid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_OWNER_UID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_OWNER_UID);
+        if (r < 0)
+                return r;
 
         assert(c->cgroup);
 
@@ -485,10 +624,13 @@ _public_ int sd_bus_creds_get_owner_uid(sd_bus_creds *c, uid_t *uid) {
 }
 
 _public_ int sd_bus_creds_get_cmdline(sd_bus_creds *c, char ***cmdline) {
+        int r;
+
         assert_return(c, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_CMDLINE))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_CMDLINE);
+        if (r < 0)
+                return r;
 
         assert_return(c->cmdline, -ESRCH);
         assert(c->cmdline);
@@ -504,22 +646,28 @@ _public_ int sd_bus_creds_get_cmdline(sd_bus_creds *c, char ***cmdline) {
 }
 
 _public_ int sd_bus_creds_get_audit_session_id(sd_bus_creds *c, uint32_t *sessionid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(sessionid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_AUDIT_SESSION_ID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_AUDIT_SESSION_ID);
+        if (r < 0)
+                return r;
 
         *sessionid = c->audit_session_id;
         return 0;
 }
 
 _public_ int sd_bus_creds_get_audit_login_uid(sd_bus_creds *c, uid_t *uid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(uid, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_AUDIT_LOGIN_UID))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_AUDIT_LOGIN_UID);
+        if (r < 0)
+                return r;
 
         *uid = c->audit_login_uid;
         return 0;
@@ -603,41 +751,53 @@ static int has_cap(sd_bus_creds *c, unsigned offset, int capability) {
 }
 
 _public_ int sd_bus_creds_has_effective_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_EFFECTIVE_CAPS))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_EFFECTIVE_CAPS);
+        if (r < 0)
+                return r;
 
         return has_cap(c, CAP_OFFSET_EFFECTIVE, capability);
 }
 
 _public_ int sd_bus_creds_has_permitted_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_PERMITTED_CAPS))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_PERMITTED_CAPS);
+        if (r < 0)
+                return r;
 
         return has_cap(c, CAP_OFFSET_PERMITTED, capability);
 }
 
 _public_ int sd_bus_creds_has_inheritable_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_INHERITABLE_CAPS))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_INHERITABLE_CAPS);
+        if (r < 0)
+                return r;
 
         return has_cap(c, CAP_OFFSET_INHERITABLE, capability);
 }
 
 _public_ int sd_bus_creds_has_bounding_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
-        if (!(c->mask & SD_BUS_CREDS_BOUNDING_CAPS))
-                return -ENODATA;
+        r = bus_creds_need(c, SD_BUS_CREDS_BOUNDING_CAPS);
+        if (r < 0)
+                return r;
 
         return has_cap(c, CAP_OFFSET_BOUNDING, capability);
 }
@@ -685,40 +845,11 @@ static int parse_caps(sd_bus_creds *c, unsigned offset, const char *p) {
         return 0;
 }
 
-int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
-        uint64_t missing;
+static int bus_creds_read_proc(sd_bus_creds *c, uint64_t missing, pid_t pid, pid_t tid) {
         int r;
 
         assert(c);
-        assert(c->allocated);
-
-        if (!(mask & SD_BUS_CREDS_AUGMENT))
-                return 0;
-
-        missing = mask & ~c->mask;
-        if (missing == 0)
-                return 0;
-
-        /* Try to retrieve PID from creds if it wasn't passed to us */
-        if (pid <= 0 && (c->mask & SD_BUS_CREDS_PID))
-                pid = c->pid;
-
-        if (tid <= 0 && (c->mask & SD_BUS_CREDS_TID))
-                tid = c->pid;
-
-        /* Without pid we cannot do much... */
-        if (pid <= 0)
-                return 0;
-
-        if (pid > 0) {
-                c->pid = pid;
-                c->mask |= SD_BUS_CREDS_PID;
-        }
-
-        if (tid > 0) {
-                c->tid = tid;
-                c->mask |= SD_BUS_CREDS_TID;
-        }
+        assert(pid > 0);
 
         if (missing & (SD_BUS_CREDS_UID | SD_BUS_CREDS_EUID | SD_BUS_CREDS_SUID | SD_BUS_CREDS_FSUID |
                        SD_BUS_CREDS_GID | SD_BUS_CREDS_EGID | SD_BUS_CREDS_SGID | SD_BUS_CREDS_FSGID |
@@ -959,86 +1090,77 @@ int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
         return 0;
 }
 
-int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
-        _cleanup_bus_creds_unref_ sd_bus_creds *n = NULL;
-        int r;
-
+static int bus_creds_copy(sd_bus_creds *n, sd_bus_creds *c, uint64_t mask) {
+        assert(n);
         assert(c);
-        assert(ret);
 
-        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
-                /* There's already all data we need, or augmentation
-                 * wasn't turned on. */
-
-                *ret = sd_bus_creds_ref(c);
-                return 0;
-        }
-
-        n = bus_creds_new();
-        if (!n)
-                return -ENOMEM;
+        /* Copies the fields in mask from c to n, unless n has them
+         * already */
 
-        /* Copy the original data over */
+        mask &= c->mask & ~n->mask;
 
-        if (c->mask & mask & SD_BUS_CREDS_UID) {
+        if (mask & SD_BUS_CREDS_UID) {
                 n->uid = c->uid;
                 n->mask |= SD_BUS_CREDS_UID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_EUID) {
+        if (mask & SD_BUS_CREDS_EUID) {
                 n->euid = c->euid;
                 n->mask |= SD_BUS_CREDS_EUID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SUID) {
+        if (mask & SD_BUS_CREDS_SUID) {
                 n->suid = c->suid;
                 n->mask |= SD_BUS_CREDS_SUID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_FSUID) {
+        if (mask & SD_BUS_CREDS_FSUID) {
                 n->fsuid = c->fsuid;
                 n->mask |= SD_BUS_CREDS_FSUID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_GID) {
+        if (mask & SD_BUS_CREDS_GID) {
                 n->gid = c->gid;
                 n->mask |= SD_BUS_CREDS_GID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_EGID) {
+        if (mask & SD_BUS_CREDS_EGID) {
                 n->egid = c->egid;
                 n->mask |= SD_BUS_CREDS_EGID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SGID) {
+        if (mask & SD_BUS_CREDS_SGID) {
                 n->sgid = c->sgid;
                 n->mask |= SD_BUS_CREDS_SGID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_FSGID) {
+        if (mask & SD_BUS_CREDS_FSGID) {
                 n->fsgid = c->fsgid;
                 n->mask |= SD_BUS_CREDS_FSGID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SUPPLEMENTARY_GIDS) {
-                n->supplementary_gids = newdup(gid_t, c->supplementary_gids, c->n_supplementary_gids);
-                if (!n->supplementary_gids)
-                        return -ENOMEM;
+        if (mask & SD_BUS_CREDS_SUPPLEMENTARY_GIDS) {
+                if (c->n_supplementary_gids > 0) {
+                        n->supplementary_gids = newdup(gid_t, c->supplementary_gids, c->n_supplementary_gids);
+                        if (!n->supplementary_gids)
+                                return -ENOMEM;
+                }
+
                 n->n_supplementary_gids = c->n_supplementary_gids;
                 n->mask |= SD_BUS_CREDS_SUPPLEMENTARY_GIDS;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_PID) {
+        if (mask & SD_BUS_CREDS_PID) {
                 n->pid = c->pid;
                 n->mask |= SD_BUS_CREDS_PID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_TID) {
+        if (mask & SD_BUS_CREDS_TID) {
                 n->tid = c->tid;
                 n->mask |= SD_BUS_CREDS_TID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_COMM) {
+        if (mask & SD_BUS_CREDS_COMM) {
                 n->comm = strdup(c->comm);
                 if (!n->comm)
                         return -ENOMEM;
@@ -1046,7 +1168,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_COMM;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_TID_COMM) {
+        if (mask & SD_BUS_CREDS_TID_COMM) {
                 n->tid_comm = strdup(c->tid_comm);
                 if (!n->tid_comm)
                         return -ENOMEM;
@@ -1054,7 +1176,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_TID_COMM;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_EXE) {
+        if (mask & SD_BUS_CREDS_EXE) {
                 n->exe = strdup(c->exe);
                 if (!n->exe)
                         return -ENOMEM;
@@ -1062,7 +1184,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_EXE;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_CMDLINE) {
+        if (mask & SD_BUS_CREDS_CMDLINE) {
                 n->cmdline = memdup(c->cmdline, c->cmdline_size);
                 if (!n->cmdline)
                         return -ENOMEM;
@@ -1071,72 +1193,409 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_CMDLINE;
         }
 
-        if (c->mask & mask & (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_OWNER_UID)) {
-                n->cgroup = strdup(c->cgroup);
-                if (!n->cgroup)
-                        return -ENOMEM;
+        if (mask & (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_OWNER_UID)) {
+                if (!n->cgroup) {
+                        n->cgroup = strdup(c->cgroup);
+                        if (!n->cgroup)
+                                return -ENOMEM;
 
-                n->cgroup_root = strdup(c->cgroup_root);
-                if (!n->cgroup_root)
-                        return -ENOMEM;
+                        n->cgroup_root = strdup(c->cgroup_root);
+                        if (!n->cgroup_root)
+                                return -ENOMEM;
+                }
 
                 n->mask |= mask & (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_OWNER_UID);
         }
 
-        if (c->mask & mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS)) {
-                n->capability = memdup(c->capability, DIV_ROUND_UP(cap_last_cap(), 32U) * 4 * 4);
-                if (!n->capability)
-                        return -ENOMEM;
+        if (mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS)) {
+                size_t max = DIV_ROUND_UP(cap_last_cap(), 32U);
 
-                n->mask |= c->mask & mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS);
+                if (!n->capability) {
+                        n->capability = new0(uint32_t, max * 4);
+                        if (!n->capability)
+                                return -ENOMEM;
+                }
+
+                if (mask & SD_BUS_CREDS_INHERITABLE_CAPS)
+                        memcpy(n->capability + CAP_OFFSET_INHERITABLE * max, c->capability + CAP_OFFSET_INHERITABLE * max, max * sizeof(uint32_t));
+                if (mask & SD_BUS_CREDS_PERMITTED_CAPS)
+                        memcpy(n->capability + CAP_OFFSET_PERMITTED * max, c->capability + CAP_OFFSET_PERMITTED * max, max * sizeof(uint32_t));
+                if (mask & SD_BUS_CREDS_EFFECTIVE_CAPS)
+                        memcpy(n->capability + CAP_OFFSET_EFFECTIVE * max, c->capability + CAP_OFFSET_EFFECTIVE * max, max * sizeof(uint32_t));
+                if (mask & SD_BUS_CREDS_BOUNDING_CAPS)
+                        memcpy(n->capability + CAP_OFFSET_BOUNDING * max, c->capability + CAP_OFFSET_BOUNDING * max, max * sizeof(uint32_t));
+
+                n->mask |= mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS);
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SELINUX_CONTEXT) {
+        if (mask & SD_BUS_CREDS_SELINUX_CONTEXT) {
                 n->label = strdup(c->label);
                 if (!n->label)
                         return -ENOMEM;
                 n->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_AUDIT_SESSION_ID) {
+        if (mask & SD_BUS_CREDS_AUDIT_SESSION_ID) {
                 n->audit_session_id = c->audit_session_id;
                 n->mask |= SD_BUS_CREDS_AUDIT_SESSION_ID;
         }
-        if (c->mask & mask & SD_BUS_CREDS_AUDIT_LOGIN_UID) {
+        if (mask & SD_BUS_CREDS_AUDIT_LOGIN_UID) {
                 n->audit_login_uid = c->audit_login_uid;
                 n->mask |= SD_BUS_CREDS_AUDIT_LOGIN_UID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_UNIQUE_NAME) {
+        if (mask & SD_BUS_CREDS_UNIQUE_NAME) {
                 n->unique_name = strdup(c->unique_name);
                 if (!n->unique_name)
                         return -ENOMEM;
                 n->mask |= SD_BUS_CREDS_UNIQUE_NAME;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
+        if (mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
                 n->well_known_names = strv_copy(c->well_known_names);
                 if (!n->well_known_names)
                         return -ENOMEM;
                 n->mask |= SD_BUS_CREDS_WELL_KNOWN_NAMES;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_DESCRIPTION) {
+        if (mask & SD_BUS_CREDS_DESCRIPTION) {
                 n->description = strdup(c->description);
                 if (!n->description)
                         return -ENOMEM;
                 n->mask |= SD_BUS_CREDS_DESCRIPTION;
         }
 
-        /* Get more data */
+        return 0;
+}
+
+static int bus_creds_load(sd_bus_creds *c, uint64_t missing) {
+        _cleanup_bus_creds_unref_ sd_bus_creds *t = NULL;
+        unsigned long long starttime;
+        int r;
+
+        assert(c);
+
+        missing &= ~c->mask;
+        if (missing == 0)
+                return 0;
+
+        if (!(c->mask & SD_BUS_CREDS_PID))
+                return 0;
+
+        t = bus_creds_new();
+        if (!t)
+                return -ENOMEM;
+
+        r = bus_creds_read_proc(t, missing, c->pid, c->mask & SD_BUS_CREDS_TID ? c->tid : 0);
+        if (r < 0)
+                return r;
+
+        /* Check the start time after reading the data, so that we
+         * notice if the PID was recycled in the meantime, and refuse
+         * to mix data of two different processes */
+        r = read_starttime(c->pid, &starttime);
+        if (r < 0)
+                return r;
+
+        if (!c->starttime_valid) {
+                c->starttime = starttime;
+                c->starttime_valid = true;
+        } else if (c->starttime != starttime)
+                return -ESRCH;
+
+        return bus_creds_copy(c, t, t->mask);
+}
+
+static int bus_creds_sync_starttime(sd_bus_creds *c) {
+        assert(c);
+        assert(c->source);
+
+        /* Makes sure the fields read into the shared object and the
+         * ones read directly belong to the same process */
+
+        if (!c->source->starttime_valid)
+                return 0;
+
+        if (!c->starttime_valid) {
+                c->starttime = c->source->starttime;
+                c->starttime_valid = true;
+        } else if (c->starttime != c->source->starttime)
+                return -ESRCH;
+
+        return 0;
+}
+
+int bus_creds_materialize(sd_bus_creds *c, uint64_t mask) {
+        uint64_t pending, shared;
+        int r;
+
+        assert(c);
+
+        pending = c->augment & mask;
+        if (pending == 0)
+                return 0;
+
+        /* Fields that come from the same file are read in one go */
+        if (pending & CREDS_STATUS_MASK)
+                pending |= c->augment & CREDS_STATUS_MASK;
+        if (pending & CREDS_CGROUP_MASK)
+                pending |= c->augment & CREDS_CGROUP_MASK;
+
+        /* Never try more than once, whatever happens */
+        c->augment &= ~pending;
+
+        if (!c->source)
+                return bus_creds_load(c, pending);
+
+        r = bus_creds_sync_starttime(c);
+        if (r < 0)
+                return r;
+
+        shared = pending & ~CREDS_UNSHARED_MASK;
+        if (shared != 0) {
+                r = bus_creds_load(c->source, shared);
+                if (r < 0)
+                        return r;
+
+                r = bus_creds_sync_starttime(c);
+                if (r < 0)
+                        return r;
+
+                r = bus_creds_copy(c, c->source, shared);
+                if (r < 0)
+                        return r;
+        }
+
+        return bus_creds_load(c, pending & CREDS_UNSHARED_MASK);
+}
+
+int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
+        uint64_t missing;
+
+        assert(c);
+        assert(c->allocated);
+
+        if (!(mask & SD_BUS_CREDS_AUGMENT))
+                return 0;
+
+        missing = mask & ~c->mask;
+        if (missing == 0)
+                return 0;
+
+        /* Try to retrieve PID from creds if it wasn't passed to us */
+        if (pid <= 0 && (c->mask & SD_BUS_CREDS_PID))
+                pid = c->pid;
+
+        if (tid <= 0 && (c->mask & SD_BUS_CREDS_TID))
+                tid = c->tid;
+
+        /* Without pid we cannot do much... */
+        if (pid <= 0)
+                return 0;
+
+        c->pid = pid;
+        c->mask |= SD_BUS_CREDS_PID;
+
+        if (tid > 0) {
+                c->tid = tid;
+                c->mask |= SD_BUS_CREDS_TID;
+        }
+
+        /* Nothing is read yet, the fields are collected from /proc
+         * when they are first accessed, see bus_creds_need() */
+        c->augment |= missing & CREDS_PROC_MASK;
+        if (tid <= 0)
+                c->augment &= ~SD_BUS_CREDS_TID_COMM;
+
+        return 0;
+}
+
+static int bus_creds_extend(sd_bus_creds *c, sd_bus_creds *source, uint64_t mask, sd_bus_creds **ret) {
+        _cleanup_bus_creds_unref_ sd_bus_creds *n = NULL;
+        int r;
 
+        assert(c);
+        assert(ret);
+
+        n = bus_creds_new();
+        if (!n)
+                return -ENOMEM;
+
+        /* Copy the original data over */
+        r = bus_creds_copy(n, c, mask);
+        if (r < 0)
+                return r;
+
+        /* Get more data, lazily */
         r = bus_creds_add_more(n, mask,
                                c->mask & SD_BUS_CREDS_PID ? c->pid : 0,
                                c->mask & SD_BUS_CREDS_TID ? c->tid : 0);
         if (r < 0)
                 return r;
 
+        if (source && n->augment != 0) {
+                /* Take over what was already read for an earlier
+                 * call, and read the rest into the shared object,
+                 * except for the fields privilege checks are based
+                 * on, which are always read again */
+                r = bus_creds_copy(n, source, n->augment & ~CREDS_UNSHARED_MASK);
+                if (r < 0)
+                        return r;
+
+                n->augment &= ~n->mask;
+                n->source = sd_bus_creds_ref(source);
+        }
+
         *ret = n;
         n = NULL;
         return 0;
 }
+
+int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
+        assert(c);
+        assert(ret);
+
+        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
+                /* There's already all data we need, or augmentation
+                 * wasn't turned on. */
+
+                *ret = sd_bus_creds_ref(c);
+                return 0;
+        }
+
+        return bus_creds_extend(c, NULL, mask, ret);
+}
+
+typedef struct BusCredsCacheEntry {
+        char *sender;
+        sd_bus_creds *creds;
+        usec_t timestamp;
+} BusCredsCacheEntry;
+
+static BusCredsCacheEntry *bus_creds_cache_entry_free(BusCredsCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        sd_bus_creds_unref(e->creds);
+        free(e->sender);
+        free(e);
+
+        return NULL;
+}
+
+static void bus_creds_cache_prune(sd_bus *bus, usec_t n) {
+        BusCredsCacheEntry *e;
+        Iterator i;
+
+        assert(bus);
+
+        HASHMAP_FOREACH(e, bus->creds_cache, i)
+                if (e->timestamp + BUS_CREDS_CACHE_USEC <= n) {
+                        hashmap_remove(bus->creds_cache, e->sender);
+                        bus_creds_cache_entry_free(e);
+                }
+
+        /* Still full? Then start over */
+        if (hashmap_size(bus->creds_cache) >= BUS_CREDS_CACHE_MAX)
+                bus_creds_cache_flush(bus);
+}
+
+static int bus_creds_cache_get(sd_bus *bus, const char *sender, pid_t pid, pid_t tid, sd_bus_creds **ret) {
+        BusCredsCacheEntry *e;
+        usec_t n;
+        int r;
+
+        assert(bus);
+        assert(pid > 0);
+        assert(ret);
+
+        /* Returns the shared object the /proc data of the specified
+         * sender is read into. Unique names are never reused, and on
+         * direct connections there's only a single peer, for which
+         * we use the empty string as key. Entries expire quickly, so
+         * that changes of the process are picked up. */
+
+        if (!sender)
+                sender = "";
+
+        n = now(CLOCK_MONOTONIC);
+
+        e = hashmap_get(bus->creds_cache, sender);
+        if (e) {
+                if (e->creds->pid == pid &&
+                    e->creds->tid == tid &&
+                    e->timestamp + BUS_CREDS_CACHE_USEC > n) {
+                        *ret = e->creds;
+                        return 0;
+                }
+
+                hashmap_remove(bus->creds_cache, sender);
+                bus_creds_cache_entry_free(e);
+
+        } else if (hashmap_size(bus->creds_cache) >= BUS_CREDS_CACHE_MAX)
+                bus_creds_cache_prune(bus, n);
+
+        r = hashmap_ensure_allocated(&bus->creds_cache, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        e = new0(BusCredsCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->timestamp = n;
+
+        e->sender = strdup(sender);
+        e->creds = bus_creds_new();
+        if (!e->sender || !e->creds) {
+                bus_creds_cache_entry_free(e);
+                return -ENOMEM;
+        }
+
+        e->creds->pid = pid;
+        e->creds->mask |= SD_BUS_CREDS_PID;
+
+        if (tid > 0) {
+                e->creds->tid = tid;
+                e->creds->mask |= SD_BUS_CREDS_TID;
+        }
+
+        r = hashmap_put(bus->creds_cache, e->sender, e);
+        if (r < 0) {
+                bus_creds_cache_entry_free(e);
+                return r;
+        }
+
+        *ret = e->creds;
+        return 0;
+}
+
+int bus_creds_extend_by_sender(sd_bus *bus, const char *sender, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
+        sd_bus_creds *source;
+        int r;
+
+        assert(bus);
+        assert(c);
+        assert(ret);
+
+        if ((mask & ~c->mask) == 0 || !(mask & SD_BUS_CREDS_AUGMENT) || !(c->mask & SD_BUS_CREDS_PID))
+                return bus_creds_extend_by_pid(c, mask, ret);
+
+        r = bus_creds_cache_get(bus, sender, c->pid, c->mask & SD_BUS_CREDS_TID ? c->tid : 0, &source);
+        if (r < 0)
+                return r;
+
+        return bus_creds_extend(c, source, mask, ret);
+}
+
+void bus_creds_cache_flush(sd_bus *bus) {
+        BusCredsCacheEntry *e;
+
+        assert(bus);
+
+        while ((e = hashmap_steal_first(bus->creds_cache)))
+                bus_creds_cache_entry_free(e);
+
+        hashmap_free(bus->creds_cache);
+        bus->creds_cache = NULL;
+}
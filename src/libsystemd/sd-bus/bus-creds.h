@@ -30,6 +30,18 @@ struct sd_bus_creds {
         unsigned n_ref;
         uint64_t mask;
 
+        /* Fields that are not collected yet, but will be read from
+         * /proc on first access. The start time of the process is
+         * recorded when data is first read and verified on every
+         * later read, so that we notice when the PID got
+         * recycled. If source is set the data is read into that
+         * object instead and copied over, so that it can be shared
+         * between multiple creds objects. */
+        uint64_t augment;
+        unsigned long long starttime;
+        bool starttime_valid;
+        sd_bus_creds *source;
+
         uid_t uid;
         uid_t euid;
         uid_t suid;
@@ -84,3 +96,12 @@ void bus_creds_done(sd_bus_creds *c);
 int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid);
 
 int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret);
+int bus_creds_extend_by_sender(sd_bus *bus, const char *sender, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret);
+int bus_creds_materialize(sd_bus_creds *c, uint64_t mask);
+
+/* Data read from /proc for a sender is kept around this long, and
+ * shared between the creds of further calls from the same sender */
+#define BUS_CREDS_CACHE_USEC (100 * USEC_PER_MSEC)
+#define BUS_CREDS_CACHE_MAX 64U
+
+void bus_creds_cache_flush(sd_bus *bus);
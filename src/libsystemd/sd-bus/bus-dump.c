@@ -342,6 +342,10 @@ int bus_creds_dump(sd_bus_creds *c, FILE *f, bool terse) {
         if (!f)
                 f = stdout;
 
+        /* We look at the fields directly below, hence make sure
+         * everything that is collected lazily is read first */
+        (void) bus_creds_materialize(c, c->augment);
+
         if (terse) {
                 prefix = "  ";
                 suffix = "";
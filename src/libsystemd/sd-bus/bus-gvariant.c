@@ -23,7 +23,7 @@
 #include "bus-gvariant.h"
 #include "bus-signature.h"
 
-int bus_gvariant_get_size(const char *signature) {
+static int gvariant_get_size(const char *signature) {
         const char *p;
         int sum = 0, r;
 
@@ -109,7 +109,19 @@ int bus_gvariant_get_size(const char *signature) {
         return ALIGN_TO(sum, r);
 }
 
-int bus_gvariant_get_alignment(const char *signature) {
+int bus_gvariant_get_size(const char *signature) {
+        int r;
+
+        if (signature_cache_get(signature, SIGNATURE_GVARIANT_SIZE, &r))
+                return r;
+
+        r = gvariant_get_size(signature);
+        signature_cache_put(signature, SIGNATURE_GVARIANT_SIZE, r);
+
+        return r;
+}
+
+static int gvariant_get_alignment(const char *signature) {
         size_t alignment = 1;
         const char *p;
         int r;
@@ -189,7 +201,19 @@ int bus_gvariant_get_alignment(const char *signature) {
         return alignment;
 }
 
-int bus_gvariant_is_fixed_size(const char *signature) {
+int bus_gvariant_get_alignment(const char *signature) {
+        int r;
+
+        if (signature_cache_get(signature, SIGNATURE_GVARIANT_ALIGNMENT, &r))
+                return r;
+
+        r = gvariant_get_alignment(signature);
+        signature_cache_put(signature, SIGNATURE_GVARIANT_ALIGNMENT, r);
+
+        return r;
+}
+
+static int gvariant_is_fixed_size(const char *signature) {
         const char *p;
         int r;
 
@@ -247,6 +271,18 @@ int bus_gvariant_is_fixed_size(const char *signature) {
         return true;
 }
 
+int bus_gvariant_is_fixed_size(const char *signature) {
+        int r;
+
+        if (signature_cache_get(signature, SIGNATURE_GVARIANT_FIXED_SIZE, &r))
+                return r;
+
+        r = gvariant_is_fixed_size(signature);
+        signature_cache_put(signature, SIGNATURE_GVARIANT_FIXED_SIZE, r);
+
+        return r;
+}
+
 size_t bus_gvariant_determine_word_size(size_t sz, size_t extra) {
         if (sz + extra <= 0xFF)
                 return 1;
@@ -306,3 +342,96 @@ void bus_gvariant_write_word_le(void *p, size_t sz, size_t value) {
 
         memcpy(p, &x, sz);
 }
+
+void bus_gvariant_write_words_le(void *p, size_t sz, const size_t *values, size_t n, size_t base) {
+        uint8_t *q = p;
+        size_t i;
+
+        assert(p || n == 0);
+        assert(values || n == 0);
+
+        /* Writes a whole offset table, each entry relative to
+         * base. There's a separate loop for each word width, which
+         * the compiler can turn into vector code, unlike a call to
+         * bus_gvariant_write_word_le() per entry. */
+
+        switch (sz) {
+
+        case 1:
+                for (i = 0; i < n; i++)
+                        q[i] = (uint8_t) (values[i] - base);
+                break;
+
+        case 2:
+                for (i = 0; i < n; i++) {
+                        uint16_t x = htole16((uint16_t) (values[i] - base));
+                        memcpy(q + i * 2, &x, 2);
+                }
+                break;
+
+        case 4:
+                for (i = 0; i < n; i++) {
+                        uint32_t x = htole32((uint32_t) (values[i] - base));
+                        memcpy(q + i * 4, &x, 4);
+                }
+                break;
+
+        case 8:
+                for (i = 0; i < n; i++) {
+                        uint64_t x = htole64((uint64_t) (values[i] - base));
+                        memcpy(q + i * 8, &x, 8);
+                }
+                break;
+
+        default:
+                assert_not_reached("unknown word width");
+        }
+}
+
+void bus_gvariant_read_words_le(const void *p, size_t sz, size_t *values, size_t n) {
+        const uint8_t *q = p;
+        size_t i;
+
+        assert(p || n == 0);
+        assert(values || n == 0);
+
+        /* Reads a whole offset table, see above */
+
+        switch (sz) {
+
+        case 1:
+                for (i = 0; i < n; i++)
+                        values[i] = q[i];
+                break;
+
+        case 2:
+                for (i = 0; i < n; i++) {
+                        uint16_t x;
+
+                        memcpy(&x, q + i * 2, 2);
+                        values[i] = le16toh(x);
+                }
+                break;
+
+        case 4:
+                for (i = 0; i < n; i++) {
+                        uint32_t x;
+
+                        memcpy(&x, q + i * 4, 4);
+                        values[i] = le32toh(x);
+                }
+                break;
+
+        case 8:
+                for (i = 0; i < n; i++) {
+                        uint64_t x;
+
+                        memcpy(&x, q + i * 8, 8);
+                        values[i] = (size_t) le64toh(x);
+                }
+                break;
+
+        default:
+                assert_not_reached("unknown word width");
+        }
+}
@@ -30,3 +30,6 @@ int bus_gvariant_is_fixed_size(const char *signature) _pure_;
 size_t bus_gvariant_determine_word_size(size_t sz, size_t extra);
 void bus_gvariant_write_word_le(void *p, size_t sz, size_t value);
 size_t bus_gvariant_read_word_le(void *p, size_t sz);
+
+void bus_gvariant_write_words_le(void *p, size_t sz, const size_t *values, size_t n, size_t base);
+void bus_gvariant_read_words_le(const void *p, size_t sz, size_t *values, size_t n);
@@ -25,6 +25,7 @@
 #include <pthread.h>
 
 #include "hashmap.h"
+#include "mempool.h"
 #include "prioq.h"
 #include "list.h"
 #include "util.h"
@@ -110,6 +111,10 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* Cached introspection XML of the vtable's members */
+        char *introspection;
+        bool introspection_trusted;
+
         unsigned last_iteration;
 
         LIST_FIELDS(struct node_vtable, vtables);
@@ -124,6 +129,18 @@ struct vtable_member {
         const sd_bus_vtable *vtable;
 };
 
+/* Dispatch index entry: all vtable members of the same name on the
+ * same interface, regardless of the object path they are registered
+ * on, keyed by path. This way a method call needs a single lookup by
+ * interface and member, after which each path prefix only costs one
+ * lookup by path, even with one vtable registered per object. */
+struct vtable_index {
+        const char *interface;
+        const char *member;
+
+        Hashmap *members;
+};
+
 typedef enum BusSlotType {
         BUS_REPLY_CALLBACK,
         BUS_FILTER_CALLBACK,
@@ -176,6 +193,12 @@ enum bus_auth {
         BUS_AUTH_ANONYMOUS
 };
 
+struct bus_message_pool_stats {
+        uint64_t n_messages;
+        uint64_t n_pool_allocs;
+        uint64_t n_heap_allocs;
+};
+
 struct sd_bus {
         /* We use atomic ref counting here since sd_bus_message
            objects retain references to their originating sd_bus but
@@ -210,6 +233,8 @@ struct sd_bus {
         bool is_system:1;
         bool is_user:1;
         bool allow_interactive_authorization:1;
+        bool accept_memfd:1;
+        bool can_memfd:1;
 
         int use_memfd;
 
@@ -265,8 +290,14 @@ struct sd_bus {
 
         uint64_t creds_mask;
 
+        /* Process data of recent senders, see
+         * bus_creds_extend_by_sender() */
+        Hashmap *creds_cache;
+
         int *fds;
         unsigned n_fds;
+        /* Where the message these fds belong to starts in rbuffer */
+        size_t fds_offset;
 
         char *exec_path;
         char **exec_argv;
@@ -285,6 +316,17 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+        /* Released sd_bus_message objects, body part descriptors and
+         * small body buffers are recycled through these pools. For
+         * the same reason as the memfd cache, they are protected by a
+         * mutex. */
+        pthread_mutex_t message_pool_mutex;
+        struct mempool message_pool;
+        struct mempool body_part_pool;
+        struct mempool body_buffer_pool;
+        struct bus_message_pool_stats message_pool_stats;
+        bool use_message_pool;
+
         pid_t original_pid;
 
         uint64_t hello_flags;
@@ -325,6 +367,9 @@ struct sd_bus {
 
 #define BUS_DEFAULT_TIMEOUT ((usec_t) (25 * USEC_PER_SEC))
 
+/* Body buffers up to this size are allocated from the per-bus pool */
+#define BUS_BODY_BUFFER_POOL_SIZE 256
+
 #define BUS_WQUEUE_MAX 1024
 #define BUS_RQUEUE_MAX 64*1024
 
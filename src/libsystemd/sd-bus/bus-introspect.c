@@ -170,6 +170,41 @@ int introspect_write_interface(struct introspect *i, const sd_bus_vtable *v) {
         return 0;
 }
 
+int introspect_interface_to_string(const sd_bus_vtable *v, bool trusted, char **ret) {
+        struct introspect i = {
+                .trusted = trusted,
+        };
+        int r;
+
+        assert(v);
+        assert(ret);
+
+        /* Generates only the members of the interface, without the
+         * surrounding <interface> element, so that the result may be
+         * reused for every object implementing the vtable */
+
+        i.f = open_memstream(&i.introspection, &i.size);
+        if (!i.f)
+                return -ENOMEM;
+
+        r = introspect_write_interface(&i, v);
+        if (r >= 0) {
+                fflush(i.f);
+                if (ferror(i.f))
+                        r = -ENOMEM;
+        }
+
+        fclose(i.f);
+
+        if (r < 0) {
+                free(i.introspection);
+                return r;
+        }
+
+        *ret = i.introspection;
+        return 0;
+}
+
 int introspect_finish(struct introspect *i, sd_bus *bus, sd_bus_message *m, sd_bus_message **reply) {
         sd_bus_message *q;
         int r;
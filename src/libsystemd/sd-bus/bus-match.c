@@ -66,8 +66,12 @@ static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static inline bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
-                (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST);
+        return t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_ARG_NAMESPACE_LAST;
+}
+
+static inline bool BUS_MATCH_IS_PREFIX(enum bus_match_node_type t) {
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_PATH && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
 }
 
 static void bus_match_node_free(struct bus_match_node *node) {
@@ -259,6 +263,112 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_key(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *key,
+                sd_bus_message *m) {
+
+        struct bus_match_node *found;
+
+        found = hashmap_get(node->compare.children, key);
+        if (!found)
+                return 0;
+
+        return bus_match_run(bus, found, m);
+}
+
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *value,
+                sd_bus_message *m) {
+
+        _cleanup_free_ char *allocated = NULL;
+        char separator, buf[256], *prefix, *e;
+        bool complex;
+        size_t l;
+        int r;
+
+        assert(node);
+        assert(BUS_MATCH_IS_PREFIX(node->type));
+        assert(value);
+
+        /* Instead of testing every value node, enumerate all
+         * patterns that could possibly match the value, and look
+         * each of them up in the hash table.
+         *
+         * For the simple patterns (path_namespace, argXnamespace)
+         * these are the value itself and every prefix of it that
+         * ends right before a separator. For the complex patterns
+         * (argXpath) these are the value itself, every prefix of it
+         * that ends with a separator, and the value with a separator
+         * appended. Values ending in a separator also match all
+         * patterns they are a prefix of, our caller does a full walk
+         * for those. */
+
+        separator = node->type >= BUS_MATCH_ARG_NAMESPACE ? '.' : '/';
+        complex = node->type >= BUS_MATCH_ARG_PATH && node->type <= BUS_MATCH_ARG_PATH_LAST;
+
+        /* The value comes from the peer, so only use the stack for
+         * short ones */
+        l = strlen(value);
+        if (l + 2 <= sizeof(buf))
+                prefix = buf;
+        else {
+                prefix = allocated = malloc(l + 2);
+                if (!prefix)
+                        return -ENOMEM;
+        }
+        memcpy(prefix, value, l + 1);
+
+        r = bus_match_run_key(bus, node, prefix, m);
+        if (r != 0)
+                return r;
+
+        if (bus && bus->match_callbacks_modified)
+                return 0;
+
+        for (e = prefix; *e; e++) {
+                char saved;
+
+                if (*e != separator)
+                        continue;
+
+                if (complex) {
+                        saved = e[1];
+                        e[1] = 0;
+                } else {
+                        saved = e[0];
+                        e[0] = 0;
+                }
+
+                r = bus_match_run_key(bus, node, prefix, m);
+
+                if (complex)
+                        e[1] = saved;
+                else
+                        e[0] = saved;
+
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        if (complex) {
+                prefix[l] = separator;
+                prefix[l+1] = 0;
+
+                r = bus_match_run_key(bus, node, prefix, m);
+                if (r != 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -387,7 +497,39 @@ int bus_match_run(
                 assert_not_reached("Unknown match type.");
         }
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (BUS_MATCH_IS_PREFIX(node->type) &&
+            (test_strv ||
+             (node->type >= BUS_MATCH_ARG_PATH && node->type <= BUS_MATCH_ARG_PATH_LAST && test_str && endswith(test_str, "/")))) {
+                struct bus_match_node *c;
+                Iterator i;
+
+                /* An array argument, or a value that might be a
+                 * prefix of the patterns, so let's test all patterns
+                 * individually... */
+
+                HASHMAP_FOREACH(c, node->compare.children, i) {
+                        if (!value_node_test(c, node->type, test_u8, test_str, test_strv, m))
+                                continue;
+
+                        r = bus_match_run(bus, c, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+
+        } else if (BUS_MATCH_IS_PREFIX(node->type)) {
+
+                /* Lookup all candidate prefixes via hash table */
+
+                if (test_str) {
+                        r = bus_match_run_prefixes(bus, node, test_str, m);
+                        if (r != 0)
+                                return r;
+                }
+
+        } else if (BUS_MATCH_CAN_HASH(node->type)) {
                 struct bus_match_node *found;
 
                 /* Lookup via hash table, nice! So let's jump directly. */
@@ -56,6 +56,60 @@ static void *adjust_pointer(const void *p, void *old_base, size_t sz, void *new_
         return (uint8_t*) new_base + ((uint8_t*) p - (uint8_t*) old_base);
 }
 
+static void *message_pool_alloc(sd_bus *bus, struct mempool *mp, size_t sz, bool *from_pool) {
+        void *p = NULL;
+
+        assert(bus);
+        assert(mp);
+        assert(from_pool);
+
+        assert_se(pthread_mutex_lock(&bus->message_pool_mutex) == 0);
+
+        if (bus->use_message_pool && sz <= mp->tile_size)
+                p = mempool_alloc_tile(mp);
+
+        if (p)
+                bus->message_pool_stats.n_pool_allocs++;
+        else
+                bus->message_pool_stats.n_heap_allocs++;
+
+        if (mp == &bus->message_pool)
+                bus->message_pool_stats.n_messages++;
+
+        assert_se(pthread_mutex_unlock(&bus->message_pool_mutex) == 0);
+
+        *from_pool = !!p;
+        if (p)
+                return p;
+
+        return malloc(sz);
+}
+
+static void *message_pool_alloc0(sd_bus *bus, struct mempool *mp, size_t sz, bool *from_pool) {
+        void *p;
+
+        p = message_pool_alloc(bus, mp, sz, from_pool);
+        if (p)
+                memzero(p, sz);
+
+        return p;
+}
+
+static void message_pool_free(sd_bus *bus, struct mempool *mp, void *p, bool from_pool) {
+
+        if (!from_pool) {
+                free(p);
+                return;
+        }
+
+        assert(bus);
+        assert(mp);
+
+        assert_se(pthread_mutex_lock(&bus->message_pool_mutex) == 0);
+        mempool_free_tile(mp, p);
+        assert_se(pthread_mutex_unlock(&bus->message_pool_mutex) == 0);
+}
+
 static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         assert(m);
         assert(part);
@@ -78,10 +132,10 @@ static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         } else if (part->munmap_this)
                 munmap(part->mmap_begin, part->mapped);
         else if (part->free_this)
-                free(part->data);
+                message_pool_free(m->bus, &m->bus->body_buffer_pool, part->data, part->data_from_pool);
 
         if (part != &m->body)
-                free(part);
+                message_pool_free(m->bus, &m->bus->body_part_pool, part, part->from_pool);
 }
 
 static void message_reset_parts(sd_bus_message *m) {
@@ -121,8 +175,13 @@ static void message_reset_containers(sd_bus_message *m) {
 }
 
 static void message_free(sd_bus_message *m) {
+        sd_bus *bus;
+        unsigned i;
+
         assert(m);
 
+        bus = m->bus;
+
         if (m->free_header)
                 free(m->header);
 
@@ -134,8 +193,6 @@ static void message_free(sd_bus_message *m) {
         if (m->free_kdbus)
                 free(m->kdbus);
 
-        sd_bus_unref(m->bus);
-
         if (m->free_fds) {
                 close_many(m->fds, m->n_fds);
                 free(m->fds);
@@ -155,8 +212,16 @@ static void message_free(sd_bus_message *m) {
 
         free(m->root_container.peeked_signature);
 
+        for (i = 0; i < m->n_bswapped_arrays; i++)
+                free(m->bswapped_arrays[i]);
+        free(m->bswapped_arrays);
+
         bus_creds_done(&m->creds);
-        free(m);
+
+        /* Release the object before dropping the reference to the
+         * bus, as it might have been allocated from its pool. */
+        message_pool_free(bus, &bus->message_pool, m, m->from_pool);
+        sd_bus_unref(bus);
 }
 
 static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz, bool add_offset) {
@@ -440,9 +505,10 @@ int bus_message_from_header(
                 size_t extra,
                 sd_bus_message **ret) {
 
-        _cleanup_free_ sd_bus_message *m = NULL;
+        _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
         struct bus_header *h;
         size_t a, label_sz;
+        bool from_pool;
 
         assert(bus);
         assert(header || header_accessible <= 0);
@@ -477,11 +543,13 @@ int bus_message_from_header(
                 a += label_sz + 1;
         }
 
-        m = malloc0(a);
+        m = message_pool_alloc0(bus, &bus->message_pool, a, &from_pool);
         if (!m)
                 return -ENOMEM;
 
         m->n_ref = 1;
+        m->bus = sd_bus_ref(bus);
+        m->from_pool = from_pool;
         m->sealed = true;
         m->header = header;
         m->header_accessible = header_accessible;
@@ -552,7 +620,6 @@ int bus_message_from_header(
                 m->creds.mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
         }
 
-        m->bus = sd_bus_ref(bus);
         *ret = m;
         m = NULL;
 
@@ -616,14 +683,16 @@ fail:
 
 static sd_bus_message *message_new(sd_bus *bus, uint8_t type) {
         sd_bus_message *m;
+        bool from_pool;
 
         assert(bus);
 
-        m = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        m = message_pool_alloc0(bus, &bus->message_pool, ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header), &from_pool);
         if (!m)
                 return NULL;
 
         m->n_ref = 1;
+        m->from_pool = from_pool;
         m->header = (struct bus_header*) ((uint8_t*) m + ALIGN(sizeof(struct sd_bus_message)));
         m->header->endian = BUS_NATIVE_ENDIAN;
         m->header->type = type;
@@ -1203,14 +1272,17 @@ struct bus_body_part *message_append_part(sd_bus_message *m) {
                 part = &m->body;
                 zero(*part);
         } else {
+                bool from_pool;
+
                 assert(m->body_end);
 
-                part = new0(struct bus_body_part, 1);
+                part = message_pool_alloc0(m->bus, &m->bus->body_part_pool, sizeof(struct bus_body_part), &from_pool);
                 if (!part) {
                         m->poisoned = true;
                         return NULL;
                 }
 
+                part->from_pool = from_pool;
                 m->body_end->next = part;
         }
 
@@ -1294,15 +1366,36 @@ static int part_make_space(
         } else {
                 if (part->allocated == 0 || sz > part->allocated) {
                         size_t new_allocated;
+                        bool from_pool = false;
 
                         new_allocated = sz > 0 ? 2 * sz : 64;
-                        n = realloc(part->data, new_allocated);
+
+                        if (!part->data) {
+                                /* Small buffers are taken from the
+                                 * pool, and we then use all of the
+                                 * tile. */
+                                n = message_pool_alloc(m->bus, &m->bus->body_buffer_pool, new_allocated, &from_pool);
+                                if (from_pool)
+                                        new_allocated = BUS_BODY_BUFFER_POOL_SIZE;
+
+                        } else if (part->data_from_pool) {
+                                /* Outgrew the pooled buffer, move the
+                                 * data to the heap */
+                                n = malloc(new_allocated);
+                                if (n) {
+                                        memcpy(n, part->data, part->size);
+                                        message_pool_free(m->bus, &m->bus->body_buffer_pool, part->data, true);
+                                }
+                        } else
+                                n = realloc(part->data, new_allocated);
+
                         if (!n) {
                                 m->poisoned = true;
                                 return -ENOMEM;
                         }
 
                         part->data = n;
+                        part->data_from_pool = from_pool;
                         part->allocated = new_allocated;
                         part->free_this = true;
                 }
@@ -2129,7 +2222,7 @@ static int bus_message_close_array(sd_bus_message *m, struct bus_container *c) {
                 return 0;
 
         if (c->need_offsets) {
-                size_t payload, sz, i;
+                size_t payload, sz;
                 uint8_t *a;
 
                 /* Variable-width arrays */
@@ -2141,8 +2234,7 @@ static int bus_message_close_array(sd_bus_message *m, struct bus_container *c) {
                 if (!a)
                         return -ENOMEM;
 
-                for (i = 0; i < c->n_offsets; i++)
-                        bus_gvariant_write_word_le(a + sz*i, sz, c->offsets[i] - c->begin);
+                bus_gvariant_write_words_le(a, sz, c->offsets, c->n_offsets, c->begin);
         } else {
                 void *a;
 
@@ -2883,7 +2975,6 @@ static int bus_message_close_header(sd_bus_message *m) {
                 /* Add offset table to end of fields array */
                 if (m->n_header_offsets >= 1) {
                         uint8_t *a;
-                        unsigned i;
 
                         assert(m->fields_size == m->header_offsets[m->n_header_offsets-1]);
 
@@ -2892,8 +2983,7 @@ static int bus_message_close_header(sd_bus_message *m) {
                         if (!a)
                                 return -ENOMEM;
 
-                        for (i = 0; i < m->n_header_offsets; i++)
-                                bus_gvariant_write_word_le(a + sz*i, sz, m->header_offsets[i]);
+                        bus_gvariant_write_words_le(a, sz, m->header_offsets, m->n_header_offsets, 0);
                 }
 
                 /* Add gvariant NUL byte plus signature to the end of
@@ -3698,10 +3788,12 @@ static int bus_message_enter_array(
                 if (!*offsets)
                         return -ENOMEM;
 
+                bus_gvariant_read_words_le(q, sz, *offsets, *n_offsets);
+
                 for (i = 0; i < *n_offsets; i++) {
                         size_t x;
 
-                        x = bus_gvariant_read_word_le((uint8_t*) q + i * sz, sz);
+                        x = (*offsets)[i];
                         if (x > c->item_size - sz)
                                 return -EBADMSG;
                         if (x < p)
@@ -4779,6 +4871,89 @@ _public_ int sd_bus_message_skip(sd_bus_message *m, const char *types) {
         }
 }
 
+static void bswap_array(void *dst, const void *src, size_t element_size, size_t size) {
+        size_t i, n;
+
+        assert(dst);
+        assert(src);
+
+        /* One loop per element size, so that the compiler can turn
+         * this into vector code */
+
+        n = size / element_size;
+
+        switch (element_size) {
+
+        case 2: {
+                const uint16_t *s = src;
+                uint16_t *d = dst;
+
+                for (i = 0; i < n; i++)
+                        d[i] = bswap_16(s[i]);
+                break;
+        }
+
+        case 4: {
+                const uint32_t *s = src;
+                uint32_t *d = dst;
+
+                for (i = 0; i < n; i++)
+                        d[i] = bswap_32(s[i]);
+                break;
+        }
+
+        case 8: {
+                const uint64_t *s = src;
+                uint64_t *d = dst;
+
+                for (i = 0; i < n; i++)
+                        d[i] = bswap_64(s[i]);
+                break;
+        }
+
+        default:
+                assert_not_reached("Unexpected element size");
+        }
+}
+
+static int message_bswap_array(sd_bus_message *m, char type, void **p, size_t sz) {
+        void *q;
+        int element_size;
+
+        assert(m);
+        assert(p);
+
+        /* We never modify received messages, hence return a swapped
+         * copy that lives as long as the message itself */
+
+        if (BUS_MESSAGE_IS_GVARIANT(m))
+                element_size = bus_gvariant_get_size(CHAR_TO_STR(type));
+        else
+                element_size = bus_type_get_size(type);
+        if (element_size < 0)
+                return element_size;
+
+        if (element_size <= 1 || sz == 0)
+                return 0;
+
+        if (sz % element_size != 0)
+                return -EBADMSG;
+
+        if (!GREEDY_REALLOC(m->bswapped_arrays, m->bswapped_arrays_allocated, m->n_bswapped_arrays + 1))
+                return -ENOMEM;
+
+        q = malloc(sz);
+        if (!q)
+                return -ENOMEM;
+
+        bswap_array(q, *p, element_size, sz);
+
+        m->bswapped_arrays[m->n_bswapped_arrays++] = q;
+        *p = q;
+
+        return 0;
+}
+
 _public_ int sd_bus_message_read_array(
                 sd_bus_message *m,
                 char type,
@@ -4796,7 +4971,6 @@ _public_ int sd_bus_message_read_array(
         assert_return(bus_type_is_trivial(type), -EINVAL);
         assert_return(ptr, -EINVAL);
         assert_return(size, -EINVAL);
-        assert_return(!BUS_MESSAGE_NEED_BSWAP(m), -EOPNOTSUPP);
 
         r = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, CHAR_TO_STR(type));
         if (r <= 0)
@@ -4826,6 +5000,12 @@ _public_ int sd_bus_message_read_array(
                 r = message_peek_body(m, &m->rindex, align, sz, &p);
                 if (r < 0)
                         goto fail;
+
+                if (BUS_MESSAGE_NEED_BSWAP(m)) {
+                        r = message_bswap_array(m, type, &p, sz);
+                        if (r < 0)
+                                goto fail;
+                }
         }
 
         r = sd_bus_message_exit_container(m);
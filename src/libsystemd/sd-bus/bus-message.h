@@ -64,6 +64,8 @@ struct bus_body_part {
         bool munmap_this:1;
         bool sealed:1;
         bool is_zero:1;
+        bool from_pool:1;
+        bool data_from_pool:1;
 };
 
 struct sd_bus_message {
@@ -97,6 +99,7 @@ struct sd_bus_message {
         bool free_fds:1;
         bool release_kdbus:1;
         bool poisoned:1;
+        bool from_pool:1;
 
         /* The first and last bytes of the message */
         struct bus_header *header;
@@ -146,6 +149,13 @@ struct sd_bus_message {
 
         size_t header_offsets[_BUS_MESSAGE_HEADER_MAX];
         unsigned n_header_offsets;
+
+        /* Byte-swapped copies of arrays returned by
+         * sd_bus_message_read_array() for messages in non-native
+         * byte order */
+        void **bswapped_arrays;
+        unsigned n_bswapped_arrays;
+        size_t bswapped_arrays_allocated;
 };
 
 static inline bool BUS_MESSAGE_NEED_BSWAP(sd_bus_message *m) {
@@ -871,6 +871,35 @@ static int bus_node_exists(
         return 0;
 }
 
+static int node_vtable_get_introspection(sd_bus *bus, struct node_vtable *c, const char **ret) {
+        int r;
+
+        assert(bus);
+        assert(c);
+        assert(ret);
+
+        /* The XML describing the members of a vtable only depends on
+         * the vtable itself and on whether the connection is trusted,
+         * hence generate it only once per registration. It is freed
+         * together with the slot, so that removing or replacing the
+         * vtable is all it takes to invalidate it. */
+
+        if (!c->introspection || c->introspection_trusted != bus->trusted) {
+                char *x;
+
+                r = introspect_interface_to_string(c->vtable, bus->trusted, &x);
+                if (r < 0)
+                        return r;
+
+                free(c->introspection);
+                c->introspection = x;
+                c->introspection_trusted = bus->trusted;
+        }
+
+        *ret = c->introspection;
+        return 0;
+}
+
 static int process_introspect(
                 sd_bus *bus,
                 sd_bus_message *m,
@@ -909,6 +938,8 @@ static int process_introspect(
         empty = set_isempty(s);
 
         LIST_FOREACH(vtables, c, n->vtables) {
+                const char *x;
+
                 if (require_fallback && !c->is_fallback)
                         continue;
 
@@ -937,10 +968,12 @@ static int process_introspect(
                         fprintf(intro.f, " <interface name=\"%s\">\n", c->interface);
                 }
 
-                r = introspect_write_interface(&intro, c->vtable);
+                r = node_vtable_get_introspection(bus, c, &x);
                 if (r < 0)
                         goto finish;
 
+                fputs(x, intro.f);
+
                 previous_interface = c->interface;
         }
 
@@ -1192,15 +1225,175 @@ static int process_get_managed_objects(
         return 1;
 }
 
+static unsigned long vtable_index_hash_func(const void *a, const uint8_t hash_key[HASH_KEY_SIZE]) {
+        const struct vtable_index *e = a;
+        uint8_t hash_key2[HASH_KEY_SIZE];
+        unsigned long ret;
+
+        assert(e);
+
+        ret = string_hash_func(e->interface, hash_key);
+
+        /* Use a slightly different hash key for the member */
+        memcpy(hash_key2, hash_key, HASH_KEY_SIZE);
+        hash_key2[0]++;
+        ret ^= string_hash_func(e->member, hash_key2);
+
+        return ret;
+}
+
+static int vtable_index_compare_func(const void *a, const void *b) {
+        const struct vtable_index *x = a, *y = b;
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = strcmp(x->interface, y->interface);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->member, y->member);
+}
+
+static const struct hash_ops vtable_index_hash_ops = {
+        .hash = vtable_index_hash_func,
+        .compare = vtable_index_compare_func
+};
+
+static struct vtable_index *vtable_index_get(Hashmap *h, const char *interface, const char *member) {
+        struct vtable_index key = {
+                .interface = interface,
+                .member = member,
+        };
+
+        return hashmap_get(h, &key);
+}
+
+static struct vtable_member *vtable_index_find(struct vtable_index *e, const char *path) {
+        if (!e)
+                return NULL;
+
+        return hashmap_get(e->members, path);
+}
+
+static void vtable_index_free(Hashmap *h, struct vtable_index *e) {
+        hashmap_remove(h, e);
+        hashmap_free(e->members);
+        free(e);
+}
+
+static struct vtable_member *vtable_member_find(Hashmap *h, const char *path, const char *interface, const char *member) {
+        return vtable_index_find(vtable_index_get(h, interface, member), path);
+}
+
+static int vtable_member_add(Hashmap *h, struct vtable_member *m) {
+        struct vtable_index *e;
+        int r;
+
+        assert(h);
+        assert(m);
+
+        e = vtable_index_get(h, m->interface, m->member);
+        if (!e) {
+                size_t li, lm;
+
+                /* The index entry carries its own copy of the key, as
+                 * the members it points to come and go */
+
+                li = strlen(m->interface) + 1;
+                lm = strlen(m->member) + 1;
+
+                e = malloc0(sizeof(struct vtable_index) + li + lm);
+                if (!e)
+                        return -ENOMEM;
+
+                e->interface = memcpy((char*) (e + 1), m->interface, li);
+                e->member = memcpy((char*) (e + 1) + li, m->member, lm);
+
+                e->members = hashmap_new(&string_hash_ops);
+                if (!e->members) {
+                        free(e);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(h, e, e);
+                if (r < 0) {
+                        hashmap_free(e->members);
+                        free(e);
+                        return r;
+                }
+        }
+
+        /* Fails with -EEXIST if the path has the member already */
+        r = hashmap_put(e->members, m->path, m);
+        if (r < 0) {
+                if (hashmap_isempty(e->members))
+                        vtable_index_free(h, e);
+                return r;
+        }
+
+        return 0;
+}
+
+void bus_node_vtable_remove_members(sd_bus *bus, struct node_vtable *c, const char *path) {
+        const sd_bus_vtable *v;
+
+        assert(bus);
+        assert(c);
+        assert(c->interface);
+        assert(path);
+
+        /* The path is passed in explicitly, as c is not linked to
+         * its node yet if registering it failed halfway */
+
+        for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                struct vtable_member *x;
+                struct vtable_index *e;
+                Hashmap *h;
+
+                switch (v->type) {
+
+                case _SD_BUS_VTABLE_METHOD:
+                        h = bus->vtable_methods;
+                        e = vtable_index_get(h, c->interface, v->x.method.member);
+                        break;
+
+                case _SD_BUS_VTABLE_PROPERTY:
+                case _SD_BUS_VTABLE_WRITABLE_PROPERTY:
+                        h = bus->vtable_properties;
+                        e = vtable_index_get(h, c->interface, v->x.property.member);
+                        break;
+
+                default:
+                        continue;
+                }
+
+                if (!e)
+                        continue;
+
+                x = hashmap_get(e->members, path);
+                if (!x || x->parent != c)
+                        continue;
+
+                hashmap_remove(e->members, path);
+                free(x);
+
+                if (hashmap_isempty(e->members))
+                        vtable_index_free(h, e);
+        }
+}
+
 static int object_find_and_run(
                 sd_bus *bus,
                 sd_bus_message *m,
                 const char *p,
+                struct vtable_index *methods,
                 bool require_fallback,
                 bool *found_object) {
 
         struct node *n;
-        struct vtable_member vtable_key, *v;
+        struct vtable_member *v;
         int r;
 
         assert(bus);
@@ -1223,11 +1416,7 @@ static int object_find_and_run(
                 return 0;
 
         /* Then, look for a known method */
-        vtable_key.path = (char*) p;
-        vtable_key.interface = m->interface;
-        vtable_key.member = m->member;
-
-        v = hashmap_get(bus->vtable_methods, &vtable_key);
+        v = vtable_index_find(methods, p);
         if (v) {
                 r = method_callbacks_run(bus, m, v, require_fallback, found_object);
                 if (r != 0)
@@ -1243,18 +1432,17 @@ static int object_find_and_run(
                 get = streq(m->member, "Get");
 
                 if (get || streq(m->member, "Set")) {
+                        const char *iface, *member;
 
                         r = sd_bus_message_rewind(m, true);
                         if (r < 0)
                                 return r;
 
-                        vtable_key.path = (char*) p;
-
-                        r = sd_bus_message_read(m, "ss", &vtable_key.interface, &vtable_key.member);
+                        r = sd_bus_message_read(m, "ss", &iface, &member);
                         if (r < 0)
                                 return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INVALID_ARGS, "Expected interface and member parameters");
 
-                        v = hashmap_get(bus->vtable_properties, &vtable_key);
+                        v = vtable_member_find(bus->vtable_properties, p, iface, member);
                         if (v) {
                                 r = property_get_set_callbacks_run(bus, m, v, require_fallback, get, found_object);
                                 if (r != 0)
@@ -1342,10 +1530,15 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         pl = strlen(m->path);
         do {
                 char prefix[pl+1];
+                struct vtable_index *methods = NULL;
 
                 bus->nodes_modified = false;
 
-                r = object_find_and_run(bus, m, m->path, false, &found_object);
+                /* Look up the method once, for all prefixes */
+                if (m->interface)
+                        methods = vtable_index_get(bus->vtable_methods, m->interface, m->member);
+
+                r = object_find_and_run(bus, m, m->path, methods, false, &found_object);
                 if (r != 0)
                         return r;
 
@@ -1355,7 +1548,7 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
                         if (bus->nodes_modified)
                                 break;
 
-                        r = object_find_and_run(bus, m, prefix, true, &found_object);
+                        r = object_find_and_run(bus, m, prefix, methods, true, &found_object);
                         if (r != 0)
                                 return r;
                 }
@@ -1529,50 +1722,6 @@ _public_ int sd_bus_add_fallback(
         return bus_add_object(bus, slot, true, prefix, callback, userdata);
 }
 
-static unsigned long vtable_member_hash_func(const void *a, const uint8_t hash_key[HASH_KEY_SIZE]) {
-        const struct vtable_member *m = a;
-        uint8_t hash_key2[HASH_KEY_SIZE];
-        unsigned long ret;
-
-        assert(m);
-
-        ret = string_hash_func(m->path, hash_key);
-
-        /* Use a slightly different hash key for the interface */
-        memcpy(hash_key2, hash_key, HASH_KEY_SIZE);
-        hash_key2[0]++;
-        ret ^= string_hash_func(m->interface, hash_key2);
-
-        /* And an even different one for the  member */
-        hash_key2[0]++;
-        ret ^= string_hash_func(m->member, hash_key2);
-
-        return ret;
-}
-
-static int vtable_member_compare_func(const void *a, const void *b) {
-        const struct vtable_member *x = a, *y = b;
-        int r;
-
-        assert(x);
-        assert(y);
-
-        r = strcmp(x->path, y->path);
-        if (r != 0)
-                return r;
-
-        r = strcmp(x->interface, y->interface);
-        if (r != 0)
-                return r;
-
-        return strcmp(x->member, y->member);
-}
-
-static const struct hash_ops vtable_member_hash_ops = {
-        .hash = vtable_member_hash_func,
-        .compare = vtable_member_compare_func
-};
-
 static int add_object_vtable_internal(
                 sd_bus *bus,
                 sd_bus_slot **slot,
@@ -1601,11 +1750,11 @@ static int add_object_vtable_internal(
                       !streq(interface, "org.freedesktop.DBus.Peer") &&
                       !streq(interface, "org.freedesktop.DBus.ObjectManager"), -EINVAL);
 
-        r = hashmap_ensure_allocated(&bus->vtable_methods, &vtable_member_hash_ops);
+        r = hashmap_ensure_allocated(&bus->vtable_methods, &vtable_index_hash_ops);
         if (r < 0)
                 return r;
 
-        r = hashmap_ensure_allocated(&bus->vtable_properties, &vtable_member_hash_ops);
+        r = hashmap_ensure_allocated(&bus->vtable_properties, &vtable_index_hash_ops);
         if (r < 0)
                 return r;
 
@@ -1674,7 +1823,7 @@ static int add_object_vtable_internal(
                         m->member = v->x.method.member;
                         m->vtable = v;
 
-                        r = hashmap_put(bus->vtable_methods, m, m);
+                        r = vtable_member_add(bus->vtable_methods, m);
                         if (r < 0) {
                                 free(m);
                                 goto fail;
@@ -1722,7 +1871,7 @@ static int add_object_vtable_internal(
                         m->member = v->x.property.member;
                         m->vtable = v;
 
-                        r = hashmap_put(bus->vtable_properties, m, m);
+                        r = vtable_member_add(bus->vtable_properties, m);
                         if (r < 0) {
                                 free(m);
                                 goto fail;
@@ -1758,6 +1907,9 @@ static int add_object_vtable_internal(
         return 0;
 
 fail:
+        if (s && s->node_vtable.interface)
+                bus_node_vtable_remove_members(bus, &s->node_vtable, n->path);
+
         sd_bus_slot_unref(s);
         bus_node_gc(bus, n);
 
@@ -1843,7 +1995,6 @@ static int emit_properties_changed_on_interface(
         _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
         bool has_invalidating = false, has_changing = false;
-        struct vtable_member key = {};
         struct node_vtable *c;
         struct node *n;
         char **property;
@@ -1872,9 +2023,6 @@ static int emit_properties_changed_on_interface(
         if (r < 0)
                 return r;
 
-        key.path = prefix;
-        key.interface = interface;
-
         LIST_FOREACH(vtables, c, n->vtables) {
                 if (require_fallback && !c->is_fallback)
                         continue;
@@ -1902,8 +2050,7 @@ static int emit_properties_changed_on_interface(
 
                                 assert_return(member_name_is_valid(*property), -EINVAL);
 
-                                key.member = *property;
-                                v = hashmap_get(bus->vtable_properties, &key);
+                                v = vtable_member_find(bus->vtable_properties, prefix, interface, *property);
                                 if (!v)
                                         return -ENOENT;
 
@@ -1995,8 +2142,7 @@ static int emit_properties_changed_on_interface(
                                 STRV_FOREACH(property, names) {
                                         struct vtable_member *v;
 
-                                        key.member = *property;
-                                        assert_se(v = hashmap_get(bus->vtable_properties, &key));
+                                        assert_se(v = vtable_member_find(bus->vtable_properties, prefix, interface, *property));
                                         assert(c == v->parent);
 
                                         if (!(v->vtable->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
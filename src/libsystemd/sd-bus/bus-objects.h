@@ -25,3 +25,4 @@
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
 void bus_node_gc(sd_bus *b, struct node *n);
+void bus_node_vtable_remove_members(sd_bus *bus, struct node_vtable *c, const char *path);
@@ -109,8 +109,103 @@ static int signature_element_length_internal(
 }
 
 
+typedef struct SignatureCacheEntry {
+        char signature[SIGNATURE_CACHE_KEY_MAX];
+        unsigned valid;
+        int values[_SIGNATURE_PROPERTY_MAX];
+} SignatureCacheEntry;
+
+/* A small direct-mapped cache, so that a remote peer cannot make it
+ * grow. It is per thread, so that no locking is necessary. */
+static thread_local SignatureCacheEntry signature_cache[SIGNATURE_CACHE_ENTRIES];
+
+static SignatureCacheEntry *signature_cache_find(const char *s, bool *found) {
+        SignatureCacheEntry *e;
+        unsigned hash = 2166136261U;
+        size_t n;
+
+        assert(s);
+        assert(found);
+
+        /* FNV-1a, signatures are short and this is much cheaper
+         * than seeding siphash. Longer strings are not cached. */
+        for (n = 0; s[n]; n++) {
+                if (n >= SIGNATURE_CACHE_KEY_MAX - 1)
+                        return NULL;
+
+                hash = (hash ^ (uint8_t) s[n]) * 16777619U;
+        }
+
+        e = signature_cache + hash % SIGNATURE_CACHE_ENTRIES;
+        *found = memcmp(e->signature, s, n + 1) == 0;
+
+        return e;
+}
+
+bool signature_cache_get(const char *s, SignatureProperty property, int *ret) {
+        SignatureCacheEntry *e;
+        bool found;
+
+        assert(property >= 0);
+        assert(property < _SIGNATURE_PROPERTY_MAX);
+        assert(ret);
+
+        e = signature_cache_find(s, &found);
+        if (!e || !found || !(e->valid & (1U << property)))
+                return false;
+
+        *ret = e->values[property];
+        return true;
+}
+
+void signature_cache_put(const char *s, SignatureProperty property, int value) {
+        SignatureCacheEntry *e;
+        bool found;
+
+        assert(property >= 0);
+        assert(property < _SIGNATURE_PROPERTY_MAX);
+
+        e = signature_cache_find(s, &found);
+        if (!e)
+                return;
+
+        if (!found) {
+                strcpy(e->signature, s);
+                e->valid = 0;
+        }
+
+        e->values[property] = value;
+        e->valid |= 1U << property;
+}
+
 int signature_element_length(const char *s, size_t *l) {
-        return signature_element_length_internal(s, true, 0, 0, l);
+        int r;
+
+        if (!s)
+                return -EINVAL;
+
+        assert(l);
+
+        if (bus_type_is_basic(*s) || *s == SD_BUS_TYPE_VARIANT) {
+                *l = 1;
+                return 0;
+        }
+
+        if (!signature_cache_get(s, SIGNATURE_ELEMENT_LENGTH, &r)) {
+                size_t t;
+
+                r = signature_element_length_internal(s, true, 0, 0, &t);
+                if (r >= 0)
+                        r = (int) t;
+
+                signature_cache_put(s, SIGNATURE_ELEMENT_LENGTH, r);
+        }
+
+        if (r < 0)
+                return r;
+
+        *l = (size_t) r;
+        return 0;
 }
 
 bool signature_is_single(const char *s, bool allow_dict_entry) {
@@ -120,7 +215,12 @@ bool signature_is_single(const char *s, bool allow_dict_entry) {
         if (!s)
                 return false;
 
-        r = signature_element_length_internal(s, allow_dict_entry, 0, 0, &t);
+        /* Dict entries are only optionally permitted at the top
+         * level, the cached element length permits them there */
+        if (!allow_dict_entry && *s == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
+                return false;
+
+        r = signature_element_length(s, &t);
         if (r < 0)
                 return false;
 
@@ -149,7 +249,10 @@ bool signature_is_valid(const char *s, bool allow_dict_entry) {
         while (*p) {
                 size_t t;
 
-                r = signature_element_length_internal(p, allow_dict_entry, 0, 0, &t);
+                if (!allow_dict_entry && *p == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
+                        return false;
+
+                r = signature_element_length(p, &t);
                 if (r < 0)
                         return false;
 
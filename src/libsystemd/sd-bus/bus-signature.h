@@ -28,3 +28,20 @@ bool signature_is_pair(const char *s);
 bool signature_is_valid(const char *s, bool allow_dict_entry);
 
 int signature_element_length(const char *s, size_t *l);
+
+/* Properties of a signature string that are expensive to determine,
+ * since they require parsing it recursively, and are hence cached per
+ * thread, keyed by the signature string. */
+typedef enum SignatureProperty {
+        SIGNATURE_ELEMENT_LENGTH,
+        SIGNATURE_GVARIANT_ALIGNMENT,
+        SIGNATURE_GVARIANT_FIXED_SIZE,
+        SIGNATURE_GVARIANT_SIZE,
+        _SIGNATURE_PROPERTY_MAX
+} SignatureProperty;
+
+#define SIGNATURE_CACHE_KEY_MAX 32U
+#define SIGNATURE_CACHE_ENTRIES 64U
+
+bool signature_cache_get(const char *s, SignatureProperty property, int *ret);
+void signature_cache_put(const char *s, SignatureProperty property, int value);
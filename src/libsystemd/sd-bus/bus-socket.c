@@ -28,15 +28,46 @@
 #include "macro.h"
 #include "missing.h"
 #include "utf8.h"
+#include "memfd-util.h"
 #include "sd-daemon.h"
 
 #include "sd-bus.h"
 #include "bus-socket.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-kernel.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* When reading messages we try to read at least this much, so that
+ * multiple small messages may be read with a single syscall */
+#define RBUFFER_SIZE_MIN (64*1024)
+
+/* On connections where both sides agreed to NEGOTIATE_MEMFD, larger
+ * body parts that are backed by a sealed memfd are not copied into
+ * the stream, but the memfd is passed along with the message. Such a
+ * message is preceded by a bus_memfd_frame and one bus_memfd_item per
+ * memfd, and the parts passed as memfds are left out of the message
+ * bytes that follow. The memfds are attached after the message's own
+ * fds. This is only spoken between peers on the same machine, hence
+ * everything is in native byte order. */
+#define BUS_MEMFD_FRAME_MAGIC 'M'
+
+struct bus_memfd_frame {
+        uint8_t magic;
+        uint8_t padding[3];
+        uint32_t n_items;
+        uint64_t size; /* of the message bytes following the items */
+} _packed_;
+
+struct bus_memfd_item {
+        uint64_t offset; /* in the message body */
+        uint64_t memfd_offset;
+        uint64_t size;
+} _packed_;
+
+assert_cc(sizeof(struct bus_memfd_frame) == sizeof(struct bus_header));
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -166,15 +197,15 @@ static int bus_socket_write_auth(sd_bus *b) {
 }
 
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *e, *f, *start;
+        char *e, *f, *g, *start;
         sd_id128_t peer;
         unsigned i;
         int r;
 
         assert(b);
 
-        /* We expect two response lines: "OK" and possibly
-         * "AGREE_UNIX_FD" */
+        /* We expect up to three response lines: "OK", possibly
+         * "AGREE_UNIX_FD" and possibly "AGREE_MEMFD" */
 
         e = memmem(b->rbuffer, b->rbuffer_size, "\r\n", 2);
         if (!e)
@@ -185,9 +216,18 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 if (!f)
                         return 0;
 
-                start = f + 2;
+                if (b->accept_memfd) {
+                        g = memmem(f + 2, b->rbuffer_size - (f - (char*) b->rbuffer) - 2, "\r\n", 2);
+                        if (!g)
+                                return 0;
+
+                        start = g + 2;
+                } else {
+                        g = NULL;
+                        start = f + 2;
+                }
         } else {
-                f = NULL;
+                f = g = NULL;
                 start = e + 2;
         }
 
@@ -220,13 +260,19 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
 
         b->server_id = peer;
 
-        /* And possibly check the second line, too */
+        /* And possibly check the second and third line, too */
 
         if (f)
                 b->can_fds =
                         (f - e == strlen("\r\nAGREE_UNIX_FD")) &&
                         memcmp(e + 2, "AGREE_UNIX_FD", strlen("AGREE_UNIX_FD")) == 0;
 
+        if (g)
+                b->can_memfd =
+                        b->can_fds &&
+                        (g - f == strlen("\r\nAGREE_MEMFD")) &&
+                        memcmp(f + 2, "AGREE_MEMFD", strlen("AGREE_MEMFD")) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -468,6 +514,16 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD")) {
+                        /* Our own extension: larger body parts
+                         * may be passed as sealed memfds, see
+                         * below. */
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || !b->accept_memfd)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -653,7 +709,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (!b->auth_buffer)
                 return -ENOMEM;
 
-        if (b->hello_flags & KDBUS_HELLO_ACCEPT_FD)
+        if ((b->hello_flags & KDBUS_HELLO_ACCEPT_FD) && b->accept_memfd)
+                auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nNEGOTIATE_MEMFD\r\nBEGIN\r\n";
+        else if (b->hello_flags & KDBUS_HELLO_ACCEPT_FD)
                 auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n";
         else
                 auth_suffix = "\r\nBEGIN\r\n";
@@ -778,6 +836,163 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
+static ssize_t bus_socket_send(sd_bus *bus, struct iovec *iov, unsigned n_iov, int *fds, unsigned n_fds) {
+        struct msghdr mh;
+        ssize_t k;
+
+        assert(bus);
+        assert(iov || n_iov == 0);
+        assert(fds || n_fds == 0);
+
+        if (bus->prefer_writev)
+                k = writev(bus->output_fd, iov, n_iov);
+        else {
+                zero(mh);
+
+                if (n_fds > 0) {
+                        struct cmsghdr *control;
+                        control = alloca(CMSG_SPACE(sizeof(int) * n_fds));
+
+                        mh.msg_control = control;
+                        control->cmsg_level = SOL_SOCKET;
+                        control->cmsg_type = SCM_RIGHTS;
+                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+                        memcpy(CMSG_DATA(control), fds, sizeof(int) * n_fds);
+                }
+
+                mh.msg_iov = iov;
+                mh.msg_iovlen = n_iov;
+
+                k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
+                if (k < 0 && errno == ENOTSOCK) {
+                        bus->prefer_writev = true;
+                        k = writev(bus->output_fd, iov, n_iov);
+                }
+        }
+
+        if (k < 0)
+                return errno == EAGAIN ? 0 : -errno;
+
+        return k;
+}
+
+static bool part_pass_as_memfd(sd_bus *bus, sd_bus_message *m, struct bus_body_part *part, unsigned n_memfds) {
+        assert(bus);
+        assert(m);
+        assert(part);
+
+        return bus->can_memfd &&
+                m->header->version == 1 &&
+                part->memfd >= 0 &&
+                part->sealed &&
+                part->size >= MEMFD_MIN_SIZE &&
+                m->n_fds + n_memfds < BUS_FDS_MAX;
+}
+
+static unsigned message_count_memfds(sd_bus *bus, sd_bus_message *m, size_t *memfd_size) {
+        struct bus_body_part *part;
+        unsigned i, n = 0;
+        size_t sz = 0;
+
+        assert(bus);
+        assert(m);
+
+        if (!bus->can_memfd)
+                return 0;
+
+        MESSAGE_FOREACH_PART(part, i, m)
+                if (part_pass_as_memfd(bus, m, part, n)) {
+                        sz += part->size;
+                        n++;
+                }
+
+        if (memfd_size)
+                *memfd_size = sz;
+
+        return n;
+}
+
+size_t bus_socket_message_size(sd_bus *bus, sd_bus_message *m) {
+        size_t memfd_size;
+        unsigned n;
+
+        assert(bus);
+        assert(m);
+
+        /* The number of bytes the message takes up in the stream */
+
+        n = message_count_memfds(bus, m, &memfd_size);
+        if (n <= 0)
+                return BUS_MESSAGE_SIZE(m);
+
+        return sizeof(struct bus_memfd_frame) +
+                n * sizeof(struct bus_memfd_item) +
+                BUS_MESSAGE_SIZE(m) - memfd_size;
+}
+
+static int bus_socket_write_memfd_message(sd_bus *bus, sd_bus_message *m, unsigned n_memfds, size_t *idx) {
+        struct bus_memfd_frame *frame;
+        struct bus_memfd_item *items;
+        struct bus_body_part *part;
+        struct iovec *iov;
+        unsigned i, j = 0, n = 0, n_iov;
+        size_t offset = 0;
+        int *fds;
+        ssize_t k;
+
+        assert(bus);
+        assert(m);
+        assert(n_memfds > 0);
+        assert(idx);
+
+        /* Builds the frame header and the list of memfds from
+         * scratch each time, continuing a partial write works
+         * nonetheless, since they come out the same. */
+
+        frame = alloca0(sizeof(struct bus_memfd_frame) + n_memfds * sizeof(struct bus_memfd_item));
+        items = (struct bus_memfd_item*) (frame + 1);
+
+        fds = newa(int, m->n_fds + n_memfds);
+        if (m->n_fds > 0)
+                memcpy(fds, m->fds, sizeof(int) * m->n_fds);
+
+        iov = newa(struct iovec, 1 + m->n_iovec);
+        iov[0].iov_base = frame;
+        iov[0].iov_len = sizeof(struct bus_memfd_frame) + n_memfds * sizeof(struct bus_memfd_item);
+        iov[1] = m->iovec[0];
+        n_iov = 2;
+
+        frame->magic = BUS_MEMFD_FRAME_MAGIC;
+        frame->n_items = n_memfds;
+        frame->size = m->iovec[0].iov_len;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                if (part_pass_as_memfd(bus, m, part, n)) {
+                        items[n].offset = offset;
+                        items[n].memfd_offset = part->memfd_offset;
+                        items[n].size = part->size;
+                        fds[m->n_fds + n] = part->memfd;
+                        n++;
+                } else {
+                        iov[n_iov++] = m->iovec[1 + i];
+                        frame->size += part->size;
+                }
+
+                offset += part->size;
+        }
+
+        assert(n == n_memfds);
+
+        iovec_advance(iov, &j, *idx);
+
+        k = bus_socket_send(bus, iov + j, n_iov - j, *idx == 0 ? fds : NULL, *idx == 0 ? m->n_fds + n_memfds : 0);
+        if (k <= 0)
+                return (int) k;
+
+        *idx += (size_t) k;
+        return 1;
+}
+
 int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         struct iovec *iov;
         ssize_t k;
@@ -790,13 +1005,17 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         assert(idx);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        if (*idx >= bus_socket_message_size(bus, m))
                 return 0;
 
         r = bus_message_setup_iovec(m);
         if (r < 0)
                 return r;
 
+        j = message_count_memfds(bus, m, NULL);
+        if (j > 0)
+                return bus_socket_write_memfd_message(bus, m, j, idx);
+
         n = m->n_iovec * sizeof(struct iovec);
         iov = alloca(n);
         memcpy(iov, m->iovec, n);
@@ -804,50 +1023,90 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         j = 0;
         iovec_advance(iov, &j, *idx);
 
-        if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
-        else {
-                struct msghdr mh;
-                zero(mh);
+        /* The fds are attached to the first byte of the message
+         * only, don't pass them a second time when continuing a
+         * partial write. */
+        k = bus_socket_send(bus, iov + j, m->n_iovec - j, *idx == 0 ? m->fds : NULL, *idx == 0 ? m->n_fds : 0);
+        if (k <= 0)
+                return (int) k;
 
-                if (m->n_fds > 0) {
-                        struct cmsghdr *control;
-                        control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
+        *idx += (size_t) k;
+        return 1;
+}
 
-                        mh.msg_control = control;
-                        control->cmsg_level = SOL_SOCKET;
-                        control->cmsg_type = SCM_RIGHTS;
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
-                }
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **m, unsigned n, size_t *idx) {
+        struct iovec *iov;
+        unsigned i, j, n_iov = 0;
+        ssize_t k;
+        int r;
 
-                mh.msg_iov = iov;
-                mh.msg_iovlen = m->n_iovec;
+        assert(bus);
+        assert(m);
+        assert(n > 0);
+        assert(idx);
+        assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-                k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
-                if (k < 0 && errno == ENOTSOCK) {
-                        bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
-                }
+        /* Writes the first message (continuing at *idx) followed by
+         * as many of the next messages as possible with a single
+         * syscall. Messages carrying fds or memfds are always written
+         * on their own, so that the receiver can unambiguously
+         * associate the fds with the message they belong to. On
+         * return *idx might point beyond the end of the first
+         * message. */
+
+        if (n == 1 || m[0]->n_fds > 0 || message_count_memfds(bus, m[0], NULL) > 0)
+                return bus_socket_write_message(bus, m[0], idx);
+
+        if (*idx >= BUS_MESSAGE_SIZE(m[0]))
+                return 0;
+
+        for (i = 0; i < n; i++) {
+                if (m[i]->n_fds > 0 || message_count_memfds(bus, m[i], NULL) > 0)
+                        break;
+
+                r = bus_message_setup_iovec(m[i]);
+                if (r < 0)
+                        return r;
+
+                if (n_iov + m[i]->n_iovec > IOV_MAX)
+                        break;
+
+                n_iov += m[i]->n_iovec;
         }
 
-        if (k < 0)
-                return errno == EAGAIN ? 0 : -errno;
+        /* The first message alone might have too many parts */
+        if (i == 0)
+                return bus_socket_write_message(bus, m[0], idx);
+
+        n = i;
+
+        iov = newa(struct iovec, n_iov);
+
+        for (i = 0, j = 0; i < n; i++) {
+                memcpy(iov + j, m[i]->iovec, m[i]->n_iovec * sizeof(struct iovec));
+                j += m[i]->n_iovec;
+        }
+
+        j = 0;
+        iovec_advance(iov, &j, *idx);
+
+        k = bus_socket_send(bus, iov + j, n_iov - j, NULL, 0);
+        if (k <= 0)
+                return (int) k;
 
         *idx += (size_t) k;
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+static int message_need(const void *p, size_t size, bool memfd, size_t *need) {
         uint32_t a, b;
         uint8_t e;
         uint64_t sum;
 
-        assert(bus);
+        assert(p || size == 0);
         assert(need);
-        assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        if (size < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -869,10 +1128,30 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
+        if (((const uint8_t*) p)[0] == BUS_MEMFD_FRAME_MAGIC) {
+                struct bus_memfd_frame f;
+
+                if (!memfd)
+                        return -EBADMSG;
+
+                memcpy(&f, p, sizeof(f));
+
+                if (f.n_items <= 0 || f.n_items >= BUS_FDS_MAX)
+                        return -EBADMSG;
+                if (f.size < sizeof(struct bus_header))
+                        return -EBADMSG;
+                if (f.size >= BUS_MESSAGE_SIZE_MAX)
+                        return -ENOBUFS;
 
-        e = ((const uint8_t*) bus->rbuffer)[0];
+                *need = sizeof(f) + f.n_items * sizeof(struct bus_memfd_item) + (size_t) f.size;
+                return 0;
+        }
+
+        /* Messages are not necessarily aligned in the buffer */
+        memcpy(&a, (const uint8_t*) p + 4, sizeof(a));
+        memcpy(&b, (const uint8_t*) p + 12, sizeof(b));
+
+        e = ((const uint8_t*) p)[0];
         if (e == BUS_LITTLE_ENDIAN) {
                 a = le32toh(a);
                 b = le32toh(b);
@@ -890,54 +1169,360 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
-        sd_bus_message *t;
-        void *b;
+static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+        assert(bus);
+        assert(need);
+        assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
+
+        return message_need(bus->rbuffer, bus->rbuffer_size, bus->can_memfd, need);
+}
+
+static int find_last_message_begin(const void *p, size_t size, size_t begin, bool memfd, size_t *ret) {
+        size_t pos = 0, last = 0;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        /* Finds the offset of the last message that starts at or
+         * after begin. If there is none, returns 0. */
+
+        while (pos < size) {
+                size_t need;
+
+                if (pos >= begin)
+                        last = pos;
+
+                if (size - pos < sizeof(struct bus_header))
+                        break;
+
+                r = message_need((const uint8_t*) p + pos, size - pos, memfd, &need);
+                if (r < 0)
+                        return r;
+
+                pos += need;
+        }
+
+        *ret = last;
+        return 0;
+}
+
+static int bus_socket_make_memfd_message(
+                sd_bus *bus,
+                const void *p,
+                size_t size,
+                int *fds,
+                unsigned n_fds,
+                sd_bus_message **ret) {
+
+        sd_bus_message *m = NULL;
+        struct bus_memfd_frame frame;
+        const uint8_t *items;
+        uint64_t message_size, offset = 0;
+        size_t begin, left;
+        unsigned i, n_regular;
+        uint8_t *b, *q;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
-        assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
+        assert(p);
+        assert(ret);
 
-        r = bus_rqueue_make_room(bus);
-        if (r < 0)
-                return r;
+        /* Turns a message whose larger body parts were passed as
+         * memfds into a message object. On success, takes possession
+         * of the fds, on failure closes them, since the connection
+         * is not usable anymore anyway. */
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
-                if (!b)
-                        return -ENOMEM;
-        } else
-                b = NULL;
-
-        r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
-                                    !bus->bus_client && bus->ucred_valid ? &bus->ucred : NULL,
-                                    !bus->bus_client && bus->label[0] ? bus->label : NULL,
-                                    &t);
+        memcpy(&frame, p, sizeof(frame));
+        items = (const uint8_t*) p + sizeof(frame);
+
+        assert(size == sizeof(frame) + frame.n_items * sizeof(struct bus_memfd_item) + frame.size);
+
+        if (frame.n_items > n_fds) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        n_regular = n_fds - frame.n_items;
+
+        /* First, validate the memfds, so that they are sealed and
+         * large enough, and that the parts are in order */
+        message_size = frame.size;
+        for (i = 0; i < frame.n_items; i++) {
+                struct bus_memfd_item item;
+                uint64_t sz;
+
+                memcpy(&item, items + i * sizeof(item), sizeof(item));
+
+                if (item.size <= 0 || item.offset < offset) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                if (item.size > (uint64_t) (uint32_t) -1 || message_size + item.size > (uint64_t) (uint32_t) -1) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                r = memfd_get_sealed(fds[n_regular + i]);
+                if (r < 0)
+                        goto fail;
+                if (r == 0) {
+                        r = -EPERM;
+                        goto fail;
+                }
+
+                r = memfd_get_size(fds[n_regular + i], &sz);
+                if (r < 0)
+                        goto fail;
+
+                if (item.memfd_offset > sz || item.size > sz - item.memfd_offset) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                offset = item.offset + item.size;
+                message_size += item.size;
+        }
+
+        b = memdup(items + frame.n_items * sizeof(struct bus_memfd_item), frame.size);
+        if (!b) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        if (((struct bus_header*) b)->version != 1) {
+                free(b);
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        r = bus_message_from_header(
+                        bus,
+                        b, frame.size,
+                        b, frame.size,
+                        message_size,
+                        n_regular > 0 ? fds : NULL, n_regular,
+                        !bus->bus_client && bus->ucred_valid ? &bus->ucred : NULL,
+                        !bus->bus_client && bus->label[0] ? bus->label : NULL,
+                        0, &m);
         if (r < 0) {
                 free(b);
-                return r;
+                goto fail;
         }
 
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
+        m->free_header = true;
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        begin = BUS_MESSAGE_BODY_BEGIN(m);
+        if (begin > frame.size) {
+                r = -EBADMSG;
+                goto fail;
+        }
 
-        bus->rqueue[bus->rqueue_size++] = t;
+        /* Then, interleave the inline parts of the body with the
+         * memfds */
+        q = b + begin;
+        left = frame.size - begin;
+        offset = 0;
 
-        return 1;
+        for (i = 0; i <= frame.n_items; i++) {
+                struct bus_memfd_item item;
+                struct bus_body_part *part;
+
+                if (i < frame.n_items)
+                        memcpy(&item, items + i * sizeof(item), sizeof(item));
+                else
+                        item.offset = offset + left;
+
+                if (item.offset - offset > left) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                if (item.offset > offset) {
+                        part = message_append_part(m);
+                        if (!part) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        part->data = q;
+                        part->size = item.offset - offset;
+                        part->sealed = true;
+
+                        q += part->size;
+                        left -= part->size;
+                }
+
+                if (i >= frame.n_items)
+                        break;
+
+                part = message_append_part(m);
+                if (!part) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                part->memfd = fds[n_regular + i];
+                part->memfd_offset = item.memfd_offset;
+                part->size = item.size;
+                part->sealed = true;
+                fds[n_regular + i] = -1;
+
+                offset = item.offset + item.size;
+        }
+
+        r = bus_message_parse_fields(m);
+        if (r < 0)
+                goto fail;
+
+        if (n_regular > 0)
+                m->free_fds = true;
+        else
+                free(fds);
+
+        *ret = m;
+        return 0;
+
+fail:
+        sd_bus_message_unref(m);
+        close_many(fds, n_fds);
+        free(fds);
+        return r;
+}
+
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t pos = 0;
+        bool whole = false;
+        int r = 0, ret = 0;
+
+        assert(bus);
+        assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
+
+        /* Turns all complete messages in the read buffer into
+         * message objects and queues them. Any fds we got are
+         * attached to the message starting at bus->fds_offset. */
+
+        for (;;) {
+                sd_bus_message *t;
+                size_t need;
+                bool with_fds;
+                void *b;
+
+                r = message_need((uint8_t*) bus->rbuffer + pos, bus->rbuffer_size - pos, bus->can_memfd, &need);
+                if (r < 0)
+                        break;
+
+                if (bus->rbuffer_size - pos < need)
+                        break;
+
+                r = bus_rqueue_make_room(bus);
+                if (r < 0)
+                        break;
+
+                with_fds = bus->n_fds > 0 && pos == bus->fds_offset;
+
+                if (((uint8_t*) bus->rbuffer)[pos] == BUS_MEMFD_FRAME_MAGIC) {
+                        r = bus_socket_make_memfd_message(
+                                        bus,
+                                        (uint8_t*) bus->rbuffer + pos, need,
+                                        with_fds ? bus->fds : NULL, with_fds ? bus->n_fds : 0,
+                                        &t);
+                        if (with_fds) {
+                                bus->fds = NULL;
+                                bus->n_fds = 0;
+                        }
+                        if (r < 0)
+                                break;
+
+                        bus->rqueue[bus->rqueue_size++] = t;
+                        pos += need;
+                        ret = 1;
+                        continue;
+                }
+
+                /* If the message fills the whole buffer we can pass
+                 * ownership of it to the message, after trimming
+                 * what we allocated for reading ahead, otherwise
+                 * copy it out. */
+                whole = pos == 0 && need == bus->rbuffer_size;
+                if (whole) {
+                        b = realloc(bus->rbuffer, need);
+                        if (!b) {
+                                r = -ENOMEM;
+                                whole = false;
+                                break;
+                        }
+
+                        bus->rbuffer = b;
+                } else {
+                        b = memdup((const uint8_t*) bus->rbuffer + pos, need);
+                        if (!b) {
+                                r = -ENOMEM;
+                                break;
+                        }
+                }
+
+                r = bus_message_from_malloc(bus,
+                                            b, need,
+                                            with_fds ? bus->fds : NULL, with_fds ? bus->n_fds : 0,
+                                            !bus->bus_client && bus->ucred_valid ? &bus->ucred : NULL,
+                                            !bus->bus_client && bus->label[0] ? bus->label : NULL,
+                                            &t);
+                if (r < 0) {
+                        if (!whole)
+                                free(b);
+                        whole = false;
+                        break;
+                }
+
+                if (with_fds) {
+                        bus->fds = NULL;
+                        bus->n_fds = 0;
+                }
+
+                bus->rqueue[bus->rqueue_size++] = t;
+                pos += need;
+                ret = 1;
+
+                if (whole)
+                        break;
+        }
+
+        if (whole) {
+                bus->rbuffer = NULL;
+                bus->rbuffer_size = 0;
+        } else if (pos > 0) {
+                memmove(bus->rbuffer, (uint8_t*) bus->rbuffer + pos, bus->rbuffer_size - pos);
+                bus->rbuffer_size -= pos;
+
+                /* If we stopped early, the fds still belong to a
+                 * message further down the buffer */
+                if (bus->n_fds > 0) {
+                        assert(bus->fds_offset >= pos);
+                        bus->fds_offset -= pos;
+                }
+        }
+
+        /* Don't keep the buffer around on idle connections */
+        if (bus->rbuffer_size <= 0) {
+                free(bus->rbuffer);
+                bus->rbuffer = NULL;
+        }
+
+        /* If we queued anything, report that, the error will be
+         * seen again on the next invocation. */
+        if (ret > 0)
+                return ret;
+
+        return r;
 }
 
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov;
         ssize_t k;
-        size_t need;
+        size_t need, want, begin;
         int r;
         void *b;
         union {
@@ -947,7 +1532,7 @@ int bus_socket_read_message(sd_bus *bus) {
                             CMSG_SPACE(NAME_MAX)]; /*selinux label */
         } control;
         struct cmsghdr *cmsg;
-        bool handle_cmsg = false;
+        bool handle_cmsg = false, got_fds = false;
 
         assert(bus);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
@@ -957,9 +1542,15 @@ int bus_socket_read_message(sd_bus *bus) {
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
 
-        b = realloc(bus->rbuffer, need);
+        /* If we still have fds for the partially read message at the
+         * beginning of the buffer, read exactly up to its end, so
+         * that we don't get the fds of any later message mixed
+         * up. Otherwise, read as much as we can get. */
+        want = bus->n_fds > 0 ? need : MAX(need, (size_t) RBUFFER_SIZE_MIN);
+
+        b = realloc(bus->rbuffer, want);
         if (!b)
                 return -ENOMEM;
 
@@ -967,7 +1558,7 @@ int bus_socket_read_message(sd_bus *bus) {
 
         zero(iov);
         iov.iov_base = (uint8_t*) bus->rbuffer + bus->rbuffer_size;
-        iov.iov_len = need - bus->rbuffer_size;
+        iov.iov_len = want - bus->rbuffer_size;
 
         if (bus->prefer_readv)
                 k = readv(bus->input_fd, &iov, 1);
@@ -990,6 +1581,7 @@ int bus_socket_read_message(sd_bus *bus) {
         if (k == 0)
                 return -ECONNRESET;
 
+        begin = bus->rbuffer_size;
         bus->rbuffer_size += k;
 
         if (handle_cmsg) {
@@ -1009,7 +1601,7 @@ int bus_socket_read_message(sd_bus *bus) {
                                         return -EIO;
                                 }
 
-                                f = realloc(bus->fds, sizeof(int) + (bus->n_fds + n));
+                                f = realloc(bus->fds, sizeof(int) * (bus->n_fds + n));
                                 if (!f) {
                                         close_many((int*) CMSG_DATA(cmsg), n);
                                         return -ENOMEM;
@@ -1018,6 +1610,7 @@ int bus_socket_read_message(sd_bus *bus) {
                                 memcpy(f + bus->n_fds, CMSG_DATA(cmsg), n * sizeof(int));
                                 bus->fds = f;
                                 bus->n_fds += n;
+                                got_fds = true;
                         } else if (cmsg->cmsg_level == SOL_SOCKET &&
                                    cmsg->cmsg_type == SCM_CREDENTIALS &&
                                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
@@ -1042,13 +1635,20 @@ int bus_socket_read_message(sd_bus *bus) {
                 }
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        if (got_fds) {
+                /* The kernel stops reading right after the data the
+                 * fds were attached to, and they are attached to the
+                 * first byte of a message, which is hence the last
+                 * message starting in what we just read. */
+                r = find_last_message_begin(bus->rbuffer, bus->rbuffer_size, begin, bus->can_memfd, &bus->fds_offset);
+                if (r < 0)
+                        return r;
+        }
+
+        r = bus_socket_make_messages(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
-
         return 1;
 }
 
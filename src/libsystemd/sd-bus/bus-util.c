@@ -1149,6 +1149,124 @@ int bus_map_all_properties(sd_bus *bus,
         return bus_message_map_all_properties(bus, m, map, userdata);
 }
 
+/* Maximum number of GetAll() calls we keep in flight at the same time,
+ * so that neither our nor the peer's queues overflow */
+#define GET_ALL_CALLS_MAX 128U
+
+struct get_all_call {
+        sd_bus_slot *slot;
+        sd_bus_message *reply;
+        unsigned *n_done;
+};
+
+static int get_all_call_handler(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct get_all_call *c = userdata;
+
+        assert(c);
+
+        c->reply = sd_bus_message_ref(m);
+        c->slot = sd_bus_slot_unref(c->slot);
+        (*c->n_done)++;
+
+        return 0;
+}
+
+int bus_get_all_properties_many(sd_bus *bus,
+                                const char *destination,
+                                char **paths,
+                                const char *interface,
+                                sd_bus_message ***ret) {
+        struct get_all_call *calls;
+        sd_bus_message **replies = NULL;
+        unsigned n, n_sent = 0, n_done = 0, i;
+        int r;
+
+        assert(bus);
+        assert(destination);
+        assert(ret);
+
+        /* Pipelines a GetAll() call to each of the specified objects
+         * and returns the replies in the same order as the paths. Each
+         * entry is either a method return or an error message. */
+
+        n = strv_length(paths);
+
+        calls = new0(struct get_all_call, n);
+        if (n > 0 && !calls)
+                return -ENOMEM;
+
+        while (n_done < n) {
+
+                while (n_sent < n && n_sent - n_done < GET_ALL_CALLS_MAX) {
+                        _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+
+                        r = sd_bus_message_new_method_call(
+                                        bus,
+                                        &m,
+                                        destination,
+                                        paths[n_sent],
+                                        "org.freedesktop.DBus.Properties",
+                                        "GetAll");
+                        if (r < 0)
+                                goto finish;
+
+                        r = sd_bus_message_append(m, "s", strempty(interface));
+                        if (r < 0)
+                                goto finish;
+
+                        calls[n_sent].n_done = &n_done;
+
+                        r = sd_bus_call_async(bus, &calls[n_sent].slot, m, get_all_call_handler, calls + n_sent, 0);
+                        if (r < 0)
+                                goto finish;
+
+                        n_sent++;
+                }
+
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        goto finish;
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r < 0)
+                        goto finish;
+        }
+
+        replies = new(sd_bus_message*, n);
+        if (n > 0 && !replies) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        for (i = 0; i < n; i++) {
+                replies[i] = calls[i].reply;
+                calls[i].reply = NULL;
+        }
+
+        *ret = replies;
+        r = 0;
+
+finish:
+        for (i = 0; i < n_sent; i++) {
+                sd_bus_slot_unref(calls[i].slot);
+                sd_bus_message_unref(calls[i].reply);
+        }
+
+        free(calls);
+        return r;
+}
+
+void bus_message_unref_many(sd_bus_message **m, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++)
+                sd_bus_message_unref(m[i]);
+
+        free(m);
+}
+
 int bus_open_transport(BusTransport transport, const char *host, bool user, sd_bus **bus) {
         int r;
 
@@ -143,6 +143,8 @@ static void bus_free(sd_bus *b) {
         hashmap_free_free(b->vtable_methods);
         hashmap_free_free(b->vtable_properties);
 
+        bus_creds_cache_flush(b);
+
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
 
@@ -150,6 +152,11 @@ static void bus_free(sd_bus *b) {
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
 
+        mempool_drop(&b->message_pool);
+        mempool_drop(&b->body_part_pool);
+        mempool_drop(&b->body_buffer_pool);
+        assert_se(pthread_mutex_destroy(&b->message_pool_mutex) == 0);
+
         free(b);
 }
 
@@ -172,6 +179,15 @@ _public_ int sd_bus_new(sd_bus **ret) {
 
         assert_se(pthread_mutex_init(&r->memfd_cache_mutex, NULL) == 0);
 
+        assert_se(pthread_mutex_init(&r->message_pool_mutex, NULL) == 0);
+        r->message_pool.tile_size = ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header);
+        r->message_pool.at_least = 16;
+        r->body_part_pool.tile_size = sizeof(struct bus_body_part);
+        r->body_part_pool.at_least = 16;
+        r->body_buffer_pool.tile_size = BUS_BODY_BUFFER_POOL_SIZE;
+        r->body_buffer_pool.at_least = 16;
+        r->use_message_pool = true;
+
         /* We guarantee that wqueue always has space for at least one
          * entry */
         if (!GREEDY_REALLOC(r->wqueue, r->wqueue_allocated, 1)) {
@@ -268,6 +284,15 @@ _public_ int sd_bus_negotiate_fds(sd_bus *bus, int b) {
         return 0;
 }
 
+_public_ int sd_bus_negotiate_memfd(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus->state == BUS_UNSET, -EPERM);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->accept_memfd = !!b;
+        return 0;
+}
+
 _public_ int sd_bus_negotiate_timestamp(sd_bus *bus, int b) {
         uint64_t new_flags;
         assert_return(bus, -EINVAL);
@@ -1070,7 +1095,7 @@ static int bus_start_fd(sd_bus *b) {
         if (fstat(b->input_fd, &st) < 0)
                 return -errno;
 
-        if (S_ISCHR(b->input_fd))
+        if (S_ISCHR(st.st_mode))
                 return bus_kernel_take_fd(b);
         else
                 return bus_socket_take_fd(b);
@@ -1570,6 +1595,21 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
+static void bus_log_sent_message(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s object=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " error=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, bool hint_sync_call, size_t *idx) {
         int r;
 
@@ -1584,17 +1624,8 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, bool hint_sync_call
         if (r <= 0)
                 return r;
 
-        if (bus->is_kernel || *idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s object=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " error=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->error.message));
+        if (bus->is_kernel || *idx >= bus_socket_message_size(bus, m))
+                bus_log_sent_message(m);
 
         return r;
 }
@@ -1606,28 +1637,43 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
         while (bus->wqueue_size > 0) {
+                unsigned n;
 
-                r = bus_write_message(bus, bus->wqueue[0], false, &bus->windex);
+                /* On sockets, write as many queued messages as
+                 * possible at once. */
+                if (bus->is_kernel)
+                        r = bus_write_message(bus, bus->wqueue[0], false, &bus->windex);
+                else
+                        r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->is_kernel || bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size --;
+
+                /* Find all fully written entries, and drop them
+                 * from the queue. */
+                if (bus->is_kernel) {
                         sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
                         bus->windex = 0;
+                        n = 1;
+                } else {
+                        for (n = 0; n < bus->wqueue_size; n++) {
+                                size_t sz;
+
+                                sz = bus_socket_message_size(bus, bus->wqueue[n]);
+                                if (bus->windex < sz)
+                                        break;
+
+                                bus->windex -= sz;
+                                bus_log_sent_message(bus->wqueue[n]);
+                                sd_bus_message_unref(bus->wqueue[n]);
+                        }
+                }
+
+                if (n > 0) {
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
 
                         ret = 1;
                 }
@@ -1742,7 +1788,7 @@ static int bus_send_internal(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie,
                         return r;
                 }
 
-                if (!bus->is_kernel && idx < BUS_MESSAGE_SIZE(m))  {
+                if (!bus->is_kernel && idx < bus_socket_message_size(bus, m))  {
                         /* Wasn't fully written. So let's remember how
                          * much was written. Note that the first entry
                          * of the wqueue array is always allocated so
@@ -0,0 +1,287 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pthread.h>
+
+#include "log.h"
+#include "util.h"
+#include "macro.h"
+#include "strv.h"
+#include "time-util.h"
+
+#include "sd-bus.h"
+#include "bus-internal.h"
+#include "bus-util.h"
+
+/* Measures throughput of pipelined asynchronous method calls and of
+ * bulk property retrieval over a socketpair. */
+
+static unsigned arg_n_calls = 20000;
+static unsigned arg_n_objects = 5000;
+
+static int object_index(const char *path, unsigned *ret) {
+        const char *e;
+
+        e = startswith(path, "/org/freedesktop/systemd/test/");
+        if (!e)
+                return -ENOENT;
+
+        return safe_atou(e, ret);
+}
+
+static int get_index(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        unsigned i;
+        int r;
+
+        r = object_index(path, &i);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_append(reply, "u", (uint32_t) i);
+}
+
+static int get_name(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        char name[DECIMAL_STR_MAX(unsigned) + 7];
+        unsigned i;
+        int r;
+
+        r = object_index(path, &i);
+        if (r < 0)
+                return r;
+
+        xsprintf(name, "object%u", i);
+
+        return sd_bus_message_append(reply, "s", name);
+}
+
+static const char *object_description = "Test object";
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Index", "u", get_index, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Name", "s", get_name, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Description", "s", NULL, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_VTABLE_END
+};
+
+struct object_info {
+        uint32_t index;
+        char *name;
+        char *description;
+};
+
+static const struct bus_properties_map object_info_map[] = {
+        { "Index",       "u", NULL, offsetof(struct object_info, index)       },
+        { "Name",        "s", NULL, offsetof(struct object_info, name)        },
+        { "Description", "s", NULL, offsetof(struct object_info, description) },
+        {}
+};
+
+static void check_object_info(struct object_info *info, unsigned i) {
+        char name[DECIMAL_STR_MAX(unsigned) + 7];
+
+        xsprintf(name, "object%u", i);
+
+        assert_se(info->index == i);
+        assert_se(streq_ptr(info->name, name));
+        assert_se(streq_ptr(info->description, "Test object"));
+
+        free(info->name);
+        free(info->description);
+        info->name = info->description = NULL;
+}
+
+static void *server(void *p) {
+        int fd = PTR_TO_INT(p);
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/org/freedesktop/systemd/test", "org.freedesktop.systemd.test.Object", vtable, NULL, &object_description) >= 0);
+
+        for (;;) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+                        continue;
+                }
+
+                if (!m)
+                        continue;
+
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Ping")) {
+                        uint32_t i;
+
+                        assert_se(sd_bus_message_read(m, "u", &i) >= 0);
+                        assert_se(sd_bus_reply_method_return(m, "u", i) >= 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+                        break;
+                }
+        }
+
+        assert_se(sd_bus_flush(bus) >= 0);
+
+        return NULL;
+}
+
+static int reply_handler(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        unsigned *n_replies = userdata;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+
+        (*n_replies)++;
+        return 0;
+}
+
+static void test_get_all(sd_bus *bus) {
+        _cleanup_strv_free_ char **paths = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        sd_bus_message **replies = NULL;
+        struct object_info info = {};
+        unsigned i;
+        usec_t t;
+
+        paths = new0(char*, arg_n_objects + 1);
+        assert_se(paths);
+
+        for (i = 0; i < arg_n_objects; i++)
+                assert_se(asprintf(&paths[i], "/org/freedesktop/systemd/test/%u", i) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_objects; i++) {
+                assert_se(bus_map_all_properties(bus, "org.freedesktop.systemd.test", paths[i], object_info_map, &info) >= 0);
+                check_object_info(&info, i);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Sequential GetAll() on %u objects took %s.",
+                 arg_n_objects, format_timespan(ts, sizeof(ts), t, 1));
+
+        t = now(CLOCK_MONOTONIC);
+
+        assert_se(bus_get_all_properties_many(bus, "org.freedesktop.systemd.test", paths, NULL, &replies) >= 0);
+
+        for (i = 0; i < arg_n_objects; i++) {
+                assert_se(!sd_bus_message_is_method_error(replies[i], NULL));
+                assert_se(bus_message_map_all_properties(bus, replies[i], object_info_map, &info) >= 0);
+                check_object_info(&info, i);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Pipelined GetAll() on %u objects took %s.",
+                 arg_n_objects, format_timespan(ts, sizeof(ts), t, 1));
+
+        bus_message_unref_many(replies, arg_n_objects);
+}
+
+static void client(int fd) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i, n_replies = 0;
+        usec_t t;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_calls; i++) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+
+                assert_se(sd_bus_message_new_method_call(bus, &m, NULL, "/", "org.freedesktop.systemd.test", "Ping") >= 0);
+                assert_se(sd_bus_message_append(m, "u", (uint32_t) i) >= 0);
+                assert_se(sd_bus_call_async(bus, NULL, m, reply_handler, &n_replies, 0) >= 0);
+
+                /* Keep the number of calls in flight bounded, so that
+                 * neither our nor the server's write queue overflows */
+                while (i + 1 - n_replies >= BUS_WQUEUE_MAX / 2) {
+                        int r;
+
+                        r = sd_bus_process(bus, NULL);
+                        assert_se(r >= 0);
+
+                        if (r == 0)
+                                assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+                }
+        }
+
+        while (n_replies < arg_n_calls) {
+                int r;
+
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u pipelined calls in %s (%g calls/s).",
+                 arg_n_calls,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) arg_n_calls * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        test_get_all(bus);
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "Exit", NULL, NULL, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        pthread_t s;
+        int fds[2];
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_calls) >= 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_n_objects) >= 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        assert_se(pthread_create(&s, NULL, server, INT_TO_PTR(fds[0])) == 0);
+
+        client(fds[1]);
+
+        assert_se(pthread_join(s, NULL) == 0);
+
+        return 0;
+}
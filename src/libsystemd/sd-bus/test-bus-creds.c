@@ -19,14 +19,194 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <dlfcn.h>
+#include <pthread.h>
+#include <linux/capability.h>
+
+#include "strv.h"
+#include "time-util.h"
+
 #include "sd-bus.h"
+#include "bus-creds.h"
 #include "bus-dump.h"
 #include "bus-util.h"
 
+static unsigned n_proc_reads = 0;
+
+/* Count how often files below /proc are opened, which is how the
+ * creds fields are collected */
+FILE *fopen(const char *path, const char *mode) {
+        static FILE* (*real_fopen)(const char *path, const char *mode) = NULL;
+
+        if (!real_fopen)
+                assert_se(real_fopen = dlsym(RTLD_NEXT, "fopen"));
+
+        if (startswith(path, "/proc/"))
+                __sync_fetch_and_add(&n_proc_reads, 1);
+
+        return real_fopen(path, mode);
+}
+
+static void test_lazy(void) {
+        _cleanup_bus_creds_unref_ sd_bus_creds *creds = NULL;
+        const char *comm;
+        unsigned n;
+        uid_t uid;
+        pid_t pid;
+        int r;
+
+        /* Only the start time is read when the object is created,
+         * and each file only when the first field from it is
+         * accessed, followed by checking the start time again */
+
+        n = n_proc_reads;
+        assert_se(sd_bus_creds_new_from_pid(&creds, 0, _SD_BUS_CREDS_ALL) >= 0);
+        assert_se(n_proc_reads == n + 1);
+
+        assert_se(sd_bus_creds_get_uid(creds, &uid) >= 0);
+        assert_se(uid == getuid());
+        assert_se(n_proc_reads == n + 3);
+
+        assert_se(sd_bus_creds_get_euid(creds, &uid) >= 0);
+        assert_se(uid == geteuid());
+        assert_se(sd_bus_creds_has_effective_cap(creds, 0) >= 0);
+        assert_se(n_proc_reads == n + 3);
+
+        creds = sd_bus_creds_unref(creds);
+
+        /* Fields of a process that is gone can't be read anymore */
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0)
+                _exit(EXIT_SUCCESS);
+
+        r = sd_bus_creds_new_from_pid(&creds, pid, SD_BUS_CREDS_COMM);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+        if (r >= 0)
+                assert_se(sd_bus_creds_get_comm(creds, &comm) == -ESRCH);
+        else
+                assert_se(r == -ESRCH);
+}
+
+static int method_check(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_bus_creds_unref_ sd_bus_creds *creds = NULL;
+        char **cmdline;
+        uid_t euid;
+
+        /* Does what the SELinux access check in PID 1 does for each
+         * method call, plus a capability check */
+        assert_se(sd_bus_query_sender_creds(m,
+                                            SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID|SD_BUS_CREDS_EGID|
+                                            SD_BUS_CREDS_CMDLINE|SD_BUS_CREDS_AUDIT_LOGIN_UID|
+                                            SD_BUS_CREDS_SELINUX_CONTEXT|SD_BUS_CREDS_EFFECTIVE_CAPS|
+                                            SD_BUS_CREDS_AUGMENT,
+                                            &creds) >= 0);
+
+        assert_se(sd_bus_creds_get_euid(creds, &euid) >= 0);
+        assert_se(sd_bus_creds_has_effective_cap(creds, CAP_SYS_ADMIN) >= 0);
+        assert_se(sd_bus_creds_get_cmdline(creds, &cmdline) >= 0);
+        assert_se(!strv_isempty(cmdline));
+
+        return sd_bus_reply_method_return(m, "u", (uint32_t) euid);
+}
+
+static int method_exit(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        bool *quit = userdata;
+
+        *quit = true;
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Check", NULL, "u", method_check, 0),
+        SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void *server(void *p) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        bool quit = false;
+        sd_id128_t id;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, PTR_TO_INT(p), PTR_TO_INT(p)) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/", "org.freedesktop.systemd.test", vtable, &quit) >= 0);
+
+        while (!quit) {
+                int r;
+
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+        }
+
+        assert_se(sd_bus_flush(bus) >= 0);
+
+        return NULL;
+}
+
+static void test_sender_creds(unsigned n_calls) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i, n;
+        pthread_t s;
+        int fds[2];
+        usec_t t;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&s, NULL, server, INT_TO_PTR(fds[0])) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        n = n_proc_reads;
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_calls; i++) {
+                _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
+                uint32_t euid;
+
+                assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "Check", NULL, &reply, NULL) >= 0);
+                assert_se(sd_bus_message_read(reply, "u", &euid) >= 0);
+                assert_se(euid == geteuid());
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+        n = n_proc_reads - n;
+
+        log_info("%u method calls in %s, %u /proc reads (%g per call).",
+                 n_calls, format_timespan(ts, sizeof(ts), t, 1),
+                 n, (double) n / n_calls);
+
+        /* The command line and the start time are read at most once
+         * per cache period. The capabilities are read again for each
+         * call, as they are not shared, followed by checking the start
+         * time. */
+        assert_se(n >= 2 * n_calls);
+        assert_se(n <= 2 * n_calls + 4 * (t / BUS_CREDS_CACHE_USEC + 1));
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "Exit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_bus_creds_unref_ sd_bus_creds *creds = NULL;
         int r;
 
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
         r = sd_bus_creds_new_from_pid(&creds, 0, _SD_BUS_CREDS_ALL);
         assert_se(r >= 0);
 
@@ -41,5 +221,8 @@ int main(int argc, char *argv[]) {
                 bus_creds_dump(creds, NULL, true);
         }
 
+        test_lazy();
+        test_sender_creds(argc > 1 ? (unsigned) atoi(argv[1]) : 10000);
+
         return 0;
 }
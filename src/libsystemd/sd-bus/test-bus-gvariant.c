@@ -31,6 +31,7 @@
 #include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-dump.h"
+#include "bus-type.h"
 
 static void test_bus_gvariant_is_fixed_size(void) {
         assert_se(bus_gvariant_is_fixed_size("") > 0);
@@ -213,12 +214,136 @@ static void test_marshal(void) {
         assert_se(bus_message_dump(m, NULL, BUS_MESSAGE_DUMP_WITH_HEADER) >= 0);
 }
 
+static void append_properties(sd_bus_message *m, unsigned depth) {
+        unsigned i;
+
+        assert_se(sd_bus_message_open_container(m, 'a', "{sv}") >= 0);
+
+        for (i = 0; i < 8; i++) {
+                char name[16];
+
+                xsprintf(name, "Property%u", i);
+
+                assert_se(sd_bus_message_open_container(m, 'e', "sv") >= 0);
+                assert_se(sd_bus_message_append_basic(m, 's', name) >= 0);
+
+                if (i == 0 && depth > 0) {
+                        assert_se(sd_bus_message_open_container(m, 'v', "a{sv}") >= 0);
+                        append_properties(m, depth - 1);
+                        assert_se(sd_bus_message_close_container(m) >= 0);
+                } else if (i % 4 == 0)
+                        assert_se(sd_bus_message_append(m, "v", "s", name) >= 0);
+                else if (i % 4 == 1)
+                        assert_se(sd_bus_message_append(m, "v", "u", i) >= 0);
+                else if (i % 4 == 2)
+                        assert_se(sd_bus_message_append(m, "v", "as", 2, "foo", name) >= 0);
+                else
+                        assert_se(sd_bus_message_append(m, "v", "a(st)", 1, name, (uint64_t) i) >= 0);
+
+                assert_se(sd_bus_message_close_container(m) >= 0);
+        }
+
+        assert_se(sd_bus_message_close_container(m) >= 0);
+}
+
+static unsigned read_all(sd_bus_message *m) {
+        unsigned n = 0;
+
+        /* Walks the message generically, like a dumper would */
+
+        for (;;) {
+                const char *contents;
+                char type;
+                int r;
+
+                r = sd_bus_message_peek_type(m, &type, &contents);
+                assert_se(r >= 0);
+                if (r == 0)
+                        return n;
+
+                if (bus_type_is_container(type) > 0) {
+                        assert_se(sd_bus_message_enter_container(m, type, contents) > 0);
+                        n += read_all(m);
+                        assert_se(sd_bus_message_exit_container(m) > 0);
+                } else {
+                        union {
+                                uint64_t u64;
+                                const char *s;
+                        } basic;
+
+                        assert_se(sd_bus_message_read_basic(m, type, &basic) > 0);
+                        n++;
+                }
+        }
+}
+
+static void test_nested_properties_benchmark(unsigned n_objects, unsigned depth) {
+        _cleanup_bus_close_unref_ sd_bus *bus = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned version;
+        int r;
+
+        /* Deserializes a message carrying many nested a{sv} property
+         * sets, the way GetManagedObjects() replies look like, in both
+         * marshalling formats */
+
+        r = sd_bus_open_system(&bus);
+        if (r < 0)
+                exit(EXIT_TEST_SKIP);
+
+        for (version = 1; version <= 2; version++) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+                unsigned i, n = 0;
+                usec_t t;
+
+                bus->message_version = version;
+                assert_se(sd_bus_message_new_signal(bus, &m, "/foo/bar", "foo.bar", "Waldo") >= 0);
+                bus->message_version = 1;
+
+                assert_se(sd_bus_message_open_container(m, 'a', "{oa{sv}}") >= 0);
+                for (i = 0; i < n_objects; i++) {
+                        char path[32];
+
+                        xsprintf(path, "/object/%u", i);
+
+                        assert_se(sd_bus_message_open_container(m, 'e', "oa{sv}") >= 0);
+                        assert_se(sd_bus_message_append_basic(m, 'o', path) >= 0);
+                        append_properties(m, depth);
+                        assert_se(sd_bus_message_close_container(m) >= 0);
+                }
+                assert_se(sd_bus_message_close_container(m) >= 0);
+
+                assert_se(bus_message_seal(m, 4711, 0) >= 0);
+
+                t = now(CLOCK_MONOTONIC);
+                n = read_all(m);
+                t = now(CLOCK_MONOTONIC) - t;
+
+                assert_se(n == n_objects * (1 + 20 + 19 * depth));
+
+                log_info("Reading %u nested property sets (%s) took %s.",
+                         n_objects, version == 2 ? "GVariant" : "dbus1",
+                         format_timespan(ts, sizeof(ts), t, 1));
+
+                assert_se(sd_bus_message_rewind(m, true) >= 0);
+
+                t = now(CLOCK_MONOTONIC);
+                assert_se(sd_bus_message_skip(m, "a{oa{sv}}") > 0);
+                t = now(CLOCK_MONOTONIC) - t;
+
+                log_info("Skipping %u nested property sets (%s) took %s.",
+                         n_objects, version == 2 ? "GVariant" : "dbus1",
+                         format_timespan(ts, sizeof(ts), t, 1));
+        }
+}
+
 int main(int argc, char *argv[]) {
 
         test_bus_gvariant_is_fixed_size();
         test_bus_gvariant_get_size();
         test_bus_gvariant_get_alignment();
         test_marshal();
+        test_nested_properties_benchmark(argc > 1 ? (unsigned) atoi(argv[1]) : 5000, 3);
 
         return 0;
 }
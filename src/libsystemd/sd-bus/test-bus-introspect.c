@@ -19,8 +19,14 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <pthread.h>
+
 #include "log.h"
+#include "util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "bus-introspect.h"
+#include "bus-util.h"
 
 static int prop_get(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
         return -EINVAL;
@@ -45,11 +51,221 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_END
 };
 
+#define OBJECT_PREFIX "/org/freedesktop/test/unit"
+#define N_UNIT_PROPERTIES 80
+#define N_SERVICE_PROPERTIES 120
+
+static int method_fail(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return -EINVAL;
+}
+
+static const sd_bus_vtable extra_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Frobnicate", "s", "s", method_fail, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_VTABLE_END
+};
+
+static unsigned arg_n_objects = 200;
+static unsigned arg_n_calls = 10000;
+
+static sd_bus_vtable *make_vtable(const char *prefix, unsigned n_properties, char ***names) {
+        sd_bus_vtable *v;
+        unsigned i;
+
+        /* Resembles the large vtables PID 1 registers for its units */
+
+        v = new0(sd_bus_vtable, n_properties + 4);
+        assert_se(v);
+
+        *names = new0(char*, n_properties + 1);
+        assert_se(*names);
+
+        v[0] = (sd_bus_vtable) SD_BUS_VTABLE_START(0);
+
+        for (i = 0; i < n_properties; i++) {
+                assert_se(asprintf(&(*names)[i], "%sProperty%u", prefix, i) >= 0);
+                v[i + 1] = (sd_bus_vtable) SD_BUS_PROPERTY((*names)[i], i % 2 ? "as" : "(stt)", prop_get, 0, i % 3 ? 0 : SD_BUS_VTABLE_PROPERTY_CONST);
+        }
+
+        v[n_properties + 1] = (sd_bus_vtable) SD_BUS_METHOD("Start", "s", "o", method_fail, 0);
+        v[n_properties + 2] = (sd_bus_vtable) SD_BUS_SIGNAL("Changed", "sa{sv}as", 0);
+        v[n_properties + 3] = (sd_bus_vtable) SD_BUS_VTABLE_END;
+
+        return v;
+}
+
+static int object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        *found = userdata;
+        return 1;
+}
+
+static int object_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+        char **l;
+        unsigned i;
+
+        /* Like PID 1, return all objects, regardless of the path
+         * asked for */
+
+        l = new0(char*, arg_n_objects + 1);
+        if (!l)
+                return -ENOMEM;
+
+        for (i = 0; i < arg_n_objects; i++)
+                if (asprintf(&l[i], OBJECT_PREFIX "/%u", i) < 0) {
+                        strv_free(l);
+                        return -ENOMEM;
+                }
+
+        *nodes = l;
+        return 1;
+}
+
+static void *server(void *p) {
+        int fd = PTR_TO_INT(p);
+        _cleanup_strv_free_ char **unit_names = NULL, **service_names = NULL;
+        _cleanup_free_ sd_bus_vtable *unit_vtable = NULL, *service_vtable = NULL;
+        /* Declared last, so that it is released before the vtables */
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        sd_bus_slot *extra = NULL;
+        sd_id128_t id;
+        int r;
+
+        unit_vtable = make_vtable("Unit", N_UNIT_PROPERTIES, &unit_names);
+        service_vtable = make_vtable("Service", N_SERVICE_PROPERTIES, &service_names);
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, OBJECT_PREFIX, "org.freedesktop.test.Unit", unit_vtable, object_find, NULL) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, OBJECT_PREFIX, "org.freedesktop.test.Service", service_vtable, object_find, NULL) >= 0);
+        assert_se(sd_bus_add_node_enumerator(bus, NULL, OBJECT_PREFIX, object_enumerator, NULL) >= 0);
+
+        for (;;) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+                        continue;
+                }
+
+                if (!m)
+                        continue;
+
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "AddInterface")) {
+                        assert_se(!extra);
+                        assert_se(sd_bus_add_fallback_vtable(bus, &extra, OBJECT_PREFIX, "org.freedesktop.test.Extra", extra_vtable, object_find, NULL) >= 0);
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "RemoveInterface")) {
+                        assert_se(extra);
+                        extra = sd_bus_slot_unref(extra);
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+                        break;
+                }
+        }
+
+        sd_bus_slot_unref(extra);
+        assert_se(sd_bus_flush(bus) >= 0);
+
+        return NULL;
+}
+
+static char *introspect_object(sd_bus *bus, unsigned i) {
+        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
+        char path[sizeof(OBJECT_PREFIX) + DECIMAL_STR_MAX(unsigned) + 1];
+        const char *xml;
+        char *s;
+
+        xsprintf(path, OBJECT_PREFIX "/%u", i);
+
+        assert_se(sd_bus_call_method(bus, NULL, path, "org.freedesktop.DBus.Introspectable", "Introspect", NULL, &reply, NULL) >= 0);
+        assert_se(sd_bus_message_read(reply, "s", &xml) > 0);
+
+        s = strdup(xml);
+        assert_se(s);
+
+        return s;
+}
+
+static void test_introspect_objects(void) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        _cleanup_free_ char *first = NULL, *with_extra = NULL, *without_extra = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i;
+        pthread_t s;
+        int fds[2];
+        usec_t t;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&s, NULL, server, INT_TO_PTR(fds[0])) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        first = introspect_object(bus, 0);
+        assert_se(strstr(first, "<interface name=\"org.freedesktop.test.Unit\">"));
+        assert_se(strstr(first, "<property name=\"ServiceProperty119\" type=\"as\" access=\"read\">"));
+        assert_se(!strstr(first, "<interface name=\"org.freedesktop.test.Extra\">"));
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_calls; i++) {
+                _cleanup_free_ char *xml = NULL;
+
+                xml = introspect_object(bus, i % arg_n_objects);
+
+                /* All objects implement the same interfaces, and
+                 * have no children */
+                assert_se(streq(xml, first));
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Introspected %u objects %u times in %s (%g calls/s).",
+                 arg_n_objects, arg_n_calls,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) arg_n_calls * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        /* Registering and removing vtables must be reflected
+         * immediately */
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "AddInterface", NULL, NULL, NULL) >= 0);
+        with_extra = introspect_object(bus, 1);
+        assert_se(strstr(with_extra, "<interface name=\"org.freedesktop.test.Extra\">"));
+        assert_se(strstr(with_extra, "<method name=\"Frobnicate\">"));
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "RemoveInterface", NULL, NULL, NULL) >= 0);
+        without_extra = introspect_object(bus, 1);
+        assert_se(streq(without_extra, first));
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "Exit", NULL, NULL, NULL) >= 0);
+
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
+        _cleanup_free_ char *members = NULL;
         struct introspect intro;
 
         log_set_max_level(LOG_DEBUG);
 
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_calls) >= 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_n_objects) >= 0);
+
         assert_se(introspect_begin(&intro, false) >= 0);
 
         fprintf(intro.f, " <interface name=\"org.foo\">\n");
@@ -59,7 +275,15 @@ int main(int argc, char *argv[]) {
         fflush(intro.f);
         fputs(intro.introspection, stdout);
 
+        assert_se(introspect_interface_to_string(vtable, false, &members) >= 0);
+        assert_se(strstr(intro.introspection, members));
+        assert_se(strstr(members, "org.freedesktop.systemd1.Privileged"));
+
         introspect_free(&intro);
 
+        log_set_max_level(LOG_INFO);
+
+        test_introspect_objects();
+
         return 0;
 }
@@ -82,6 +82,18 @@ static void transaction(sd_bus *b, size_t sz, const char *server_name) {
         assert_se(sd_bus_call(b, m, 0, NULL, &reply) >= 0);
 }
 
+static void print_pool_stats(sd_bus *b) {
+        const struct bus_message_pool_stats *st = &b->message_pool_stats;
+
+        if (st->n_messages <= 0)
+                return;
+
+        printf("%" PRIu64 " messages, %.2f heap allocations/message, %.2f pool allocations/message\n",
+               st->n_messages,
+               (double) st->n_heap_allocs / st->n_messages,
+               (double) st->n_pool_allocs / st->n_messages);
+}
+
 static void client_bisect(const char *address, const char *server_name) {
         _cleanup_bus_message_unref_ sd_bus_message *x = NULL;
         size_t lsize, rsize, csize;
@@ -148,6 +160,8 @@ static void client_bisect(const char *address, const char *server_name) {
                         rsize = csize;
         }
 
+        print_pool_stats(b);
+
         b->use_memfd = 1;
         assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
         assert_se(sd_bus_message_append(x, "t", csize) >= 0);
@@ -173,11 +187,11 @@ static void client_chart(const char *address, const char *server_name) {
 
         assert_se(sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL) >= 0);
 
-        printf("SIZE\tCOPY\tMEMFD\n");
+        printf("SIZE\tCOPY\tMEMFD\tNOPOOL\n");
 
         for (csize = 1; csize <= MAX_SIZE; csize *= 2) {
                 usec_t t;
-                unsigned n_copying, n_memfd;
+                unsigned n_copying, n_memfd, n_nopool;
 
                 printf("%zu\t", csize);
 
@@ -201,9 +215,25 @@ static void client_chart(const char *address, const char *server_name) {
                                 break;
                 }
 
-                printf("%u\n", (unsigned) ((n_memfd * USEC_PER_SEC) / arg_loop_usec));
+                printf("%u\t", (unsigned) ((n_memfd * USEC_PER_SEC) / arg_loop_usec));
+
+                b->use_memfd = 0;
+                b->use_message_pool = false;
+
+                t = now(CLOCK_MONOTONIC);
+                for (n_nopool = 0;; n_nopool++) {
+                        transaction(b, csize, server_name);
+                        if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                                break;
+                }
+
+                printf("%u\n", (unsigned) ((n_nopool * USEC_PER_SEC) / arg_loop_usec));
+
+                b->use_message_pool = true;
         }
 
+        print_pool_stats(b);
+
         b->use_memfd = 1;
         assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
         assert_se(sd_bus_message_append(x, "t", csize) >= 0);
@@ -34,6 +34,7 @@
 #include "util.h"
 
 #include "sd-bus.h"
+#include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-util.h"
 #include "bus-dump.h"
@@ -79,6 +80,152 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+static void *bswap_fields_and_body(void *blob, size_t sz) {
+        struct bus_header *h = blob;
+        uint32_t fields_size, body_size, *p;
+        uint8_t *f, *e;
+        size_t i;
+
+        /* Converts a sealed dbus1 message with a header of string,
+         * object path, signature and uint32 fields and a body of a
+         * single "au" into the other byte order */
+
+        fields_size = h->dbus1.fields_size;
+        body_size = h->dbus1.body_size;
+
+        h->endian = h->endian == BUS_LITTLE_ENDIAN ? BUS_BIG_ENDIAN : BUS_LITTLE_ENDIAN;
+        h->dbus1.body_size = bswap_32(h->dbus1.body_size);
+        h->dbus1.serial = bswap_32(h->dbus1.serial);
+        h->dbus1.fields_size = bswap_32(h->dbus1.fields_size);
+
+        f = (uint8_t*) blob + sizeof(struct bus_header);
+        e = f + fields_size;
+
+        while (f < e) {
+                uint32_t l;
+                char type;
+
+                f = (uint8_t*) ALIGN8((size_t) f);
+
+                /* Skip field code and the variant signature */
+                assert_se(f[1] == 1);
+                type = f[2];
+                f += 4;
+
+                switch (type) {
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        f = (uint8_t*) ALIGN4((size_t) f);
+                        memcpy(&l, f, 4);
+                        *(uint32_t*) f = bswap_32(l);
+                        f += 4 + l + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        f += 1 + f[0] + 1;
+                        break;
+
+                case SD_BUS_TYPE_UINT32:
+                        f = (uint8_t*) ALIGN4((size_t) f);
+                        *(uint32_t*) f = bswap_32(*(uint32_t*) f);
+                        f += 4;
+                        break;
+
+                default:
+                        assert_not_reached("Unexpected header field type");
+                }
+        }
+
+        p = (uint32_t*) ((uint8_t*) blob + sizeof(struct bus_header) + ALIGN8(fields_size));
+        assert_se((uint8_t*) p + body_size == (uint8_t*) blob + sz);
+
+        for (i = 0; i < body_size / 4; i++)
+                p[i] = bswap_32(p[i]);
+
+        return blob;
+}
+
+static void test_array_benchmark(sd_bus *bus, unsigned n) {
+        _cleanup_bus_message_unref_ sd_bus_message *m = NULL, *swapped = NULL, *g = NULL;
+        _cleanup_free_ uint32_t *array = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        const uint32_t *r;
+        unsigned i;
+        void *blob;
+        size_t sz;
+        usec_t t;
+
+        /* Marshals and unmarshals arrays with many elements, in
+         * native and in non-native byte order, as well as the offset
+         * tables of large GVariant arrays */
+
+        array = new(uint32_t, n);
+        assert_se(array);
+
+        for (i = 0; i < n; i++)
+                array[i] = i * 2654435761U;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/foo/bar", "foo.bar", "Waldo") >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_bus_message_append_array(m, 'u', array, n * sizeof(uint32_t)) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("Appending array of %u uint32_t took %s.", n, format_timespan(ts, sizeof(ts), t, 1));
+
+        assert_se(bus_message_seal(m, 4711, 0) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_bus_message_read_array(m, 'u', (const void**) &r, &sz) > 0);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("Reading array of %u uint32_t took %s.", n, format_timespan(ts, sizeof(ts), t, 1));
+
+        assert_se(sz == n * sizeof(uint32_t));
+        assert_se(memcmp(r, array, sz) == 0);
+
+        assert_se(bus_message_get_blob(m, &blob, &sz) >= 0);
+        assert_se(bus_message_from_malloc(bus, bswap_fields_and_body(blob, sz), sz, NULL, 0, NULL, NULL, &swapped) >= 0);
+        assert_se(BUS_MESSAGE_NEED_BSWAP(swapped));
+        assert_se(streq(sd_bus_message_get_member(swapped), "Waldo"));
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_bus_message_read_array(swapped, 'u', (const void**) &r, &sz) > 0);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("Reading byte-swapped array of %u uint32_t took %s.", n, format_timespan(ts, sizeof(ts), t, 1));
+
+        assert_se(sz == n * sizeof(uint32_t));
+        assert_se(memcmp(r, array, sz) == 0);
+
+        bus->message_version = 2; /* dirty hack to enable gvariant */
+        assert_se(sd_bus_message_new_signal(bus, &g, "/foo/bar", "foo.bar", "Waldo") >= 0);
+        bus->message_version = 1;
+
+        assert_se(sd_bus_message_open_container(g, 'a', "s") >= 0);
+        for (i = 0; i < n; i++)
+                assert_se(sd_bus_message_append_basic(g, 's', i % 2 ? "foo" : "waldo") >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_bus_message_close_container(g) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("Writing GVariant offset table for %u strings took %s.", n, format_timespan(ts, sizeof(ts), t, 1));
+
+        assert_se(bus_message_seal(g, 4712, 0) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_bus_message_enter_container(g, 'a', "s") > 0);
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("Reading GVariant offset table for %u strings took %s.", n, format_timespan(ts, sizeof(ts), t, 1));
+
+        for (i = 0; i < n; i++) {
+                const char *x;
+
+                assert_se(sd_bus_message_read_basic(g, 's', &x) > 0);
+                assert_se(streq(x, i % 2 ? "foo" : "waldo"));
+        }
+
+        assert_se(sd_bus_message_exit_container(g) > 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_bus_message_unref_ sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -358,5 +505,7 @@ int main(int argc, char *argv[]) {
         test_bus_label_escape();
         test_bus_path_encode();
 
+        test_array_benchmark(bus, argc > 1 ? (unsigned) atoi(argv[1]) : 1000000);
+
         return 0;
 }
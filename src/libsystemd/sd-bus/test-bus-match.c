@@ -77,6 +77,87 @@ static int match_add(sd_bus_slot *slots, struct bus_match_node *root, const char
         return r;
 }
 
+static unsigned n_hits = 0;
+
+static int count_filter(sd_bus *b, sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_hits++;
+        return 0;
+}
+
+static void test_prefix_scaling(sd_bus *bus, unsigned n_matches, unsigned n_signals) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        sd_bus_message *messages[100] = {};
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i;
+        usec_t t;
+
+        /* Register a large number of path_namespace, argXpath and
+         * argXnamespace matches, and dispatch signals against them,
+         * each of which is expected to hit exactly three of them. */
+
+        assert_se(n_matches >= 3 * ELEMENTSOF(messages));
+
+        slots = new0(sd_bus_slot, n_matches);
+        assert_se(slots);
+
+        for (i = 0; i < n_matches; i++) {
+                struct bus_match_component *components = NULL;
+                unsigned n_components = 0;
+                char match[128];
+
+                if (i % 3 == 0)
+                        xsprintf(match, "type='signal',path_namespace='/org/freedesktop/test/%u'", i / 3);
+                else if (i % 3 == 1)
+                        xsprintf(match, "type='signal',arg0path='/org/freedesktop/test/%u/'", i / 3);
+                else
+                        xsprintf(match, "type='signal',arg1namespace='org.freedesktop.test%u'", i / 3);
+
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+
+                slots[i].match_callback.callback = count_filter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+        }
+
+        for (i = 0; i < ELEMENTSOF(messages); i++) {
+                char path[64], name[64];
+
+                xsprintf(path, "/org/freedesktop/test/%u/object", i);
+                xsprintf(name, "org.freedesktop.test%u.Object", i);
+
+                assert_se(sd_bus_message_new_signal(bus, &messages[i], path, "org.freedesktop.Test", "Changed") >= 0);
+                assert_se(sd_bus_message_append(messages[i], "os", path, name) >= 0);
+                assert_se(bus_message_seal(messages[i], i+1, 0) >= 0);
+        }
+
+        n_hits = 0;
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_signals; i++)
+                assert_se(bus_match_run(NULL, &root, messages[i % ELEMENTSOF(messages)]) == 0);
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(n_hits == 3 * n_signals);
+
+        log_info("Dispatched %u signals against %u matches in %s (%g signals/s).",
+                 n_signals, n_matches,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) n_signals * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        for (i = 0; i < ELEMENTSOF(messages); i++)
+                sd_bus_message_unref(messages[i]);
+
+        for (i = 0; i < n_matches; i++)
+                assert_se(bus_match_remove(&root, &slots[i].match_callback) >= 0);
+
+        assert_se(!root.child);
+}
+
 int main(int argc, char *argv[]) {
         struct bus_match_node root = {
                 .type = BUS_MATCH_ROOT,
@@ -85,7 +166,7 @@ int main(int argc, char *argv[]) {
         _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
         _cleanup_bus_close_unref_ sd_bus *bus = NULL;
         enum bus_match_node_type i;
-        sd_bus_slot slots[19];
+        sd_bus_slot slots[23];
         int r;
 
         r = sd_bus_open_system(&bus);
@@ -110,6 +191,10 @@ int main(int argc, char *argv[]) {
         assert_se(match_add(slots, &root, "arg4='pa'", 16) >= 0);
         assert_se(match_add(slots, &root, "arg4='po'", 17) >= 0);
         assert_se(match_add(slots, &root, "arg4='pu'", 18) >= 0);
+        assert_se(match_add(slots, &root, "arg2path='/prefix/three/'", 19) >= 0);
+        assert_se(match_add(slots, &root, "arg2path='/prefix/th'", 20) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.fo'", 21) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/foo/ba'", 22) >= 0);
 
         bus_match_dump(&root, 0);
 
@@ -119,7 +204,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17 }, 11));
+        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17, 19 }, 12));
 
         assert_se(bus_match_remove(&root, &slots[8].match_callback) >= 0);
         assert_se(bus_match_remove(&root, &slots[13].match_callback) >= 0);
@@ -128,7 +213,25 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19 }, 10));
+
+        /* Values longer than what prefixes are built on the stack for */
+        {
+                _cleanup_bus_message_unref_ sd_bus_message *l = NULL;
+                char long_path[1024], long_arg2[1024], long_arg3[1024];
+
+                xsprintf(long_path, "/foo/%0900u", 0);
+                xsprintf(long_arg2, "/prefix/three/%0900u", 0);
+                xsprintf(long_arg3, "prefix.fo.%0900u", 0);
+
+                assert_se(sd_bus_message_new_signal(bus, &l, long_path, "bar.x", "waldo") >= 0);
+                assert_se(sd_bus_message_append(l, "ssssas", "one", "two", long_arg2, long_arg3, 1, "pi") >= 0);
+                assert_se(bus_message_seal(l, 2, 0) >= 0);
+
+                zero(mask);
+                assert_se(bus_match_run(NULL, &root, l) == 0);
+                assert_se(mask_contains((unsigned[]) { 5, 7, 10, 12, 15, 19, 21 }, 7));
+        }
 
         for (i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
@@ -142,5 +245,7 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        test_prefix_scaling(bus, 10000, argc > 1 ? (unsigned) atoi(argv[1]) : 100000);
+
         return 0;
 }
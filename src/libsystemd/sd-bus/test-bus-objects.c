@@ -32,6 +32,7 @@
 #include "bus-message.h"
 #include "bus-util.h"
 #include "bus-dump.h"
+#include "bus-objects.h"
 
 struct context {
         int fds[2];
@@ -509,6 +510,206 @@ static int client(struct context *c) {
         return 0;
 }
 
+static unsigned n_dispatched = 0;
+
+static int dispatch_method_handler(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        n_dispatched++;
+
+        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+
+        return 1;
+}
+
+static int dispatch_property_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        n_dispatched++;
+        return sd_bus_message_append(reply, "s", path);
+}
+
+static int dispatch_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        if (!object_path_startswith(path, "/org/freedesktop/systemd1/unit"))
+                return 0;
+
+        *found = userdata;
+        return 1;
+}
+
+static const sd_bus_vtable dispatch_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Start", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_METHOD("Stop", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_METHOD("Reload", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_METHOD("Restart", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_PROPERTY("Id", "s", dispatch_property_handler, 0, 0),
+        SD_BUS_PROPERTY("Description", "s", dispatch_property_handler, 0, 0),
+        SD_BUS_PROPERTY("ActiveState", "s", dispatch_property_handler, 0, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void test_dispatch_benchmark(unsigned n_calls) {
+        static const char * const interfaces[] = {
+                "org.freedesktop.systemd.test.Unit",
+                "org.freedesktop.systemd.test.Service",
+                "org.freedesktop.systemd.test.Socket",
+                "org.freedesktop.systemd.test.Timer",
+                "org.freedesktop.systemd.test.Mount",
+                "org.freedesktop.systemd.test.Slice",
+        };
+
+        sd_bus_message *messages[64] = {};
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i;
+        int fds[2];
+        usec_t t;
+
+        /* Dispatches method calls and property reads to objects
+         * served by fallback vtables, similar to how PID 1 exports
+         * its units. No replies are requested, so that only the
+         * dispatching is measured. */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[0], fds[0]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(interfaces); i++)
+                assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/org/freedesktop/systemd1/unit", interfaces[i], dispatch_vtable, dispatch_find, NULL) >= 0);
+
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/systemd1", "org.freedesktop.systemd.test.Manager", dispatch_vtable, NULL) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(messages); i++) {
+                char path[64];
+
+                xsprintf(path, "/org/freedesktop/systemd1/unit/unit_%u_2eservice", i);
+
+                if (i % 2 == 0) {
+                        assert_se(sd_bus_message_new_method_call(bus, &messages[i], NULL, path, interfaces[i % ELEMENTSOF(interfaces)], "Restart") >= 0);
+                        assert_se(sd_bus_message_append(messages[i], "s", "replace") >= 0);
+                } else {
+                        assert_se(sd_bus_message_new_method_call(bus, &messages[i], NULL, path, "org.freedesktop.DBus.Properties", "Get") >= 0);
+                        assert_se(sd_bus_message_append(messages[i], "ss", interfaces[i % ELEMENTSOF(interfaces)], "ActiveState") >= 0);
+                }
+
+                assert_se(sd_bus_message_set_expect_reply(messages[i], false) >= 0);
+                assert_se(bus_message_seal(messages[i], i+1, 0) >= 0);
+        }
+
+        n_dispatched = 0;
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_calls; i++) {
+                /* Method handlers are protected against being run
+                 * twice in the same iteration */
+                bus->iteration_counter++;
+
+                assert_se(bus_process_object(bus, messages[i % ELEMENTSOF(messages)]) > 0);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(n_dispatched == n_calls);
+
+        log_info("Dispatched %u calls in %s (%g calls/s).",
+                 n_calls,
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) n_calls * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        for (i = 0; i < ELEMENTSOF(messages); i++)
+                sd_bus_message_unref(messages[i]);
+
+        safe_close(fds[1]);
+}
+
+/* Both fail to register after some of their members were indexed */
+static const sd_bus_vtable broken_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Frobnicate", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_PROPERTY("Broken", "ss", dispatch_property_handler, 0, 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable duplicate_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Frobnicate", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_METHOD("Start", "s", NULL, dispatch_method_handler, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void test_object_vtables(unsigned n_objects) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        sd_bus_slot **slots;
+        unsigned i;
+        int fds[2];
+        usec_t t;
+
+        /* Registers one vtable per object, calls a method on each
+         * of them and removes them again, which must not take time
+         * quadratic in the number of objects */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[0], fds[0]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        slots = new0(sd_bus_slot*, n_objects);
+        assert_se(slots);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_objects; i++) {
+                char path[64];
+
+                xsprintf(path, "/org/freedesktop/systemd/test/object_%u", i);
+                assert_se(sd_bus_add_object_vtable(bus, &slots[i], path, "org.freedesktop.systemd.test.Object", dispatch_vtable, NULL) >= 0);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Registered %u object vtables in %s.",
+                 n_objects,
+                 format_timespan(ts, sizeof(ts), t, 1));
+
+        /* The same member cannot be registered twice on a path */
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/systemd/test/object_0", "org.freedesktop.systemd.test.Object", dispatch_vtable, NULL) == -EEXIST);
+
+        /* Failing halfway leaves no members behind */
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/systemd/test/object_0", "org.freedesktop.systemd.test.Object", broken_vtable, NULL) == -EINVAL);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/systemd/test/object_0", "org.freedesktop.systemd.test.Object", duplicate_vtable, NULL) == -EEXIST);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/systemd/test/broken", "org.freedesktop.systemd.test.Object", broken_vtable, NULL) == -EINVAL);
+        assert_se(hashmap_size(bus->vtable_methods) == 4);
+
+        n_dispatched = 0;
+
+        for (i = 0; i < n_objects; i++) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+                char path[64];
+
+                xsprintf(path, "/org/freedesktop/systemd/test/object_%u", i);
+
+                assert_se(sd_bus_message_new_method_call(bus, &m, NULL, path, "org.freedesktop.systemd.test.Object", "Start") >= 0);
+                assert_se(sd_bus_message_append(m, "s", "replace") >= 0);
+                assert_se(sd_bus_message_set_expect_reply(m, false) >= 0);
+                assert_se(bus_message_seal(m, i+1, 0) >= 0);
+
+                bus->iteration_counter++;
+                assert_se(bus_process_object(bus, m) > 0);
+        }
+
+        assert_se(n_dispatched == n_objects);
+
+        for (i = 0; i < n_objects; i++)
+                sd_bus_slot_unref(slots[i]);
+        free(slots);
+
+        assert_se(hashmap_isempty(bus->vtable_methods));
+        assert_se(hashmap_isempty(bus->vtable_properties));
+
+        safe_close(fds[1]);
+}
+
 int main(int argc, char *argv[]) {
         struct context c = {};
         pthread_t s;
@@ -541,5 +742,8 @@ int main(int argc, char *argv[]) {
         free(c.something);
         free(c.automatic_string_property);
 
+        test_dispatch_benchmark(argc > 1 ? (unsigned) atoi(argv[1]) : 200000);
+        test_object_vtables(argc > 2 ? (unsigned) atoi(argv[2]) : 20000);
+
         return EXIT_SUCCESS;
 }
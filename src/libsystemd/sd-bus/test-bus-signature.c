@@ -26,6 +26,7 @@
 
 int main(int argc, char *argv[]) {
         char prefix[256];
+        unsigned i;
         int r;
 
         assert_se(signature_is_single("y", false));
@@ -83,6 +84,33 @@ int main(int argc, char *argv[]) {
         assert_se(signature_is_valid("(((((((((((((((((((((((((((((((())))))))))))))))))))))))))))))))", false));
         assert_se(!signature_is_valid("((((((((((((((((((((((((((((((((()))))))))))))))))))))))))))))))))", false));
 
+        /* Parse results are cached, make sure they survive eviction
+         * and that the top-level dict entry check still applies */
+        for (i = 0; i < 4 * SIGNATURE_CACHE_ENTRIES; i++) {
+                static const char types[] = "ybnqiuxtdsogv";
+                char s[8];
+                size_t l;
+
+                xsprintf(s, "(%c%c)u", types[i % 13], types[i / 13 % 13]);
+
+                assert_se(signature_element_length(s, &l) >= 0 && l == 4);
+                assert_se(signature_element_length(s, &l) >= 0 && l == 4);
+                assert_se(!signature_is_single(s, false));
+                assert_se(signature_is_valid(s, false));
+        }
+
+        assert_se(signature_is_single("{ss}", true));
+        assert_se(!signature_is_single("{ss}", false));
+        assert_se(signature_is_valid("a{ss}{ss}", true));
+        assert_se(!signature_is_valid("a{ss}{ss}", false));
+
+        signature_cache_put("(uu)", SIGNATURE_GVARIANT_SIZE, 8);
+        assert_se(signature_cache_get("(uu)", SIGNATURE_GVARIANT_SIZE, &r) && r == 8);
+        assert_se(!signature_cache_get("(uu)", SIGNATURE_GVARIANT_ALIGNMENT, &r));
+
+        signature_cache_put("(sssssssssssssssssssssssssssssssss)", SIGNATURE_GVARIANT_SIZE, -EINVAL);
+        assert_se(!signature_cache_get("(sssssssssssssssssssssssssssssssss)", SIGNATURE_GVARIANT_SIZE, &r));
+
         assert_se(namespace_complex_pattern("", ""));
         assert_se(namespace_complex_pattern("foobar", "foobar"));
         assert_se(namespace_complex_pattern("foobar.waldo", "foobar.waldo"));
@@ -20,22 +20,169 @@
 ***/
 
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include "util.h"
 #include "log.h"
 #include "memfd-util.h"
 
 #include "sd-bus.h"
+#include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-kernel.h"
 #include "bus-dump.h"
+#include "bus-util.h"
 
 #define FIRST_ARRAY 17
 #define SECOND_ARRAY 33
 
 #define STRING_SIZE 123
 
-int main(int argc, char *argv[]) {
+/* Payloads passed as memfds may be larger than what fits into a
+ * message on the stream, hence the copying run is a bit smaller */
+#define MEMFD_PAYLOAD_SIZE (64U*1024U*1024U)
+#define COPY_PAYLOAD_SIZE (BUS_MESSAGE_SIZE_MAX - 4096U)
+
+struct server_info {
+        int fd;
+        bool memfd;
+};
+
+static void *server(void *p) {
+        struct server_info *info = p;
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, info->fd, info->fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_negotiate_memfd(bus, info->memfd) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (;;) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+                        continue;
+                }
+
+                if (!m)
+                        continue;
+
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Payload")) {
+                        struct bus_body_part *part;
+                        bool got_memfd = false;
+                        const uint8_t *q;
+                        uint64_t sum = 0;
+                        unsigned i;
+                        size_t l, j;
+
+                        MESSAGE_FOREACH_PART(part, i, m)
+                                if (part->memfd >= 0)
+                                        got_memfd = true;
+
+                        assert_se(sd_bus_message_read_array(m, 'y', (const void**) &q, &l) > 0);
+
+                        /* Touch every page once */
+                        for (j = 0; j < l; j += page_size())
+                                sum += q[j];
+                        sum += q[l-1];
+
+                        assert_se(sd_bus_reply_method_return(m, "tb", sum, got_memfd) >= 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+                        break;
+                }
+        }
+
+        assert_se(sd_bus_flush(bus) >= 0);
+
+        return NULL;
+}
+
+static void test_socket_memfd(bool memfd, unsigned n_calls) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        _cleanup_close_ int f = -1;
+        struct server_info info;
+        char ts[FORMAT_TIMESPAN_MAX];
+        uint64_t expected = 0;
+        size_t size, j;
+        unsigned i;
+        pthread_t s;
+        uint8_t *p;
+        int fds[2];
+        usec_t t;
+
+        /* Passes large payloads over a socketpair(), either as
+         * memfds, or by copying them into the stream */
+
+        size = memfd ? MEMFD_PAYLOAD_SIZE : COPY_PAYLOAD_SIZE;
+
+        f = memfd_new_and_map(NULL, size, (void**) &p);
+        assert_se(f >= 0);
+
+        for (j = 0; j < size; j++)
+                p[j] = (uint8_t) (j / page_size());
+
+        for (j = 0; j < size; j += page_size())
+                expected += p[j];
+        expected += p[size-1];
+
+        munmap(p, size);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        info.fd = fds[0];
+        info.memfd = memfd;
+        assert_se(pthread_create(&s, NULL, server, &info) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_negotiate_memfd(bus, memfd) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_calls; i++) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL, *reply = NULL;
+                uint64_t sum;
+                int got_memfd;
+
+                assert_se(sd_bus_message_new_method_call(bus, &m, NULL, "/", "org.freedesktop.systemd.test", "Payload") >= 0);
+                assert_se(sd_bus_message_append_array_memfd(m, 'y', f, 0, size) >= 0);
+
+                assert_se(sd_bus_call(bus, m, 0, NULL, &reply) >= 0);
+                assert_se(sd_bus_message_read(reply, "tb", &sum, &got_memfd) > 0);
+
+                assert_se(sum == expected);
+                assert_se(!!got_memfd == memfd);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(bus->can_memfd == memfd);
+
+        log_info("Passed %u payloads of %zu bytes %s in %s (%g MB/s).",
+                 n_calls, size, memfd ? "as memfds" : "inline",
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 (double) n_calls * size * USEC_PER_SEC / MAX(t, (usec_t) 1) / (1024 * 1024));
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "Exit", NULL, NULL, NULL) >= 0);
+
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
+static void test_kdbus(void) {
         _cleanup_free_ char *name = NULL, *bus_name = NULL, *address = NULL;
         const char *unique;
         uint8_t *p;
@@ -54,8 +201,10 @@ int main(int argc, char *argv[]) {
         assert_se(asprintf(&name, "deine-mutter-%u", (unsigned) getpid()) >= 0);
 
         bus_ref = bus_kernel_create_bus(name, false, &bus_name);
-        if (bus_ref == -ENOENT)
-                return EXIT_TEST_SKIP;
+        if (bus_ref == -ENOENT) {
+                log_info("kdbus not available, skipping kdbus test.");
+                return;
+        }
 
         assert_se(bus_ref >= 0);
 
@@ -204,6 +353,15 @@ int main(int argc, char *argv[]) {
 
         sd_bus_unref(a);
         sd_bus_unref(b);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n_calls = argc > 1 ? (unsigned) atoi(argv[1]) : 10;
+
+        test_socket_memfd(false, n_calls);
+        test_socket_memfd(true, n_calls);
+
+        test_kdbus();
 
         return 0;
 }
@@ -1541,8 +1541,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         d = event_get_clock_data(s->event, s->type);
                         assert(d);
 
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
+                        /* Enabled sources sort first, so these
+                         * can only move towards the head */
+                        prioq_reshuffle_up(d->earliest, s, &s->time.earliest_index);
+                        prioq_reshuffle_up(d->latest, s, &s->time.latest_index);
                         d->needs_rearm = true;
                         break;
                 }
@@ -1583,7 +1585,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
 
                 case SOURCE_EXIT:
                         s->enabled = m;
-                        prioq_reshuffle(s->event->exit, s, &s->exit.prioq_index);
+                        prioq_reshuffle_up(s->event->exit, s, &s->exit.prioq_index);
                         break;
 
                 case SOURCE_DEFER:
@@ -38,6 +38,7 @@
 #include "fileio.h"
 #include "special.h"
 #include "mkdir.h"
+#include "strv.h"
 
 int cg_enumerate_processes(const char *controller, const char *path, FILE **_f) {
         _cleanup_free_ char *fs = NULL;
@@ -1610,29 +1611,33 @@ static const char mask_names[] =
 
 int cg_create_everywhere(CGroupControllerMask supported, CGroupControllerMask mask, const char *path) {
         CGroupControllerMask bit = 1;
+        bool created;
         const char *n;
         int r;
 
         /* This one will create a cgroup in our private tree, but also
          * duplicate it in the trees specified in mask, and remove it
-         * in all others */
+         * in all others. Returns > 0 if the cgroup was newly created
+         * in any of the hierarchies. */
 
         /* First create the cgroup in our own hierarchy. */
         r = cg_create(SYSTEMD_CGROUP_CONTROLLER, path);
         if (r < 0)
                 return r;
+        created = r > 0;
 
         /* Then, do the same in the other hierarchies */
         NULSTR_FOREACH(n, mask_names) {
-                if (mask & bit)
-                        cg_create(n, path);
-                else if (supported & bit)
+                if (mask & bit) {
+                        if (cg_create(n, path) > 0)
+                                created = true;
+                } else if (supported & bit)
                         cg_trim(n, path, true);
 
                 bit <<= 1;
         }
 
-        return 0;
+        return created;
 }
 
 int cg_attach_everywhere(CGroupControllerMask supported, const char *path, pid_t pid, cg_migrate_callback_t path_callback, void *userdata) {
@@ -1664,6 +1669,64 @@ int cg_attach_everywhere(CGroupControllerMask supported, const char *path, pid_t
         return 0;
 }
 
+int cg_get_attach_paths(CGroupControllerMask supported, const char *path, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        CGroupControllerMask bit = 1;
+        const char *n;
+        char *fs;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* Returns the cgroup.procs files cg_attach_everywhere()
+         * would write to, so that a process can later attach itself
+         * without allocating memory. The first entry is the one of
+         * our own hierarchy, it is followed by one group per
+         * supported controller, each introduced by an empty string
+         * and listing the path and then its prefixes, in the order
+         * cg_attach_fallback() tries them. */
+
+        r = cg_get_path_and_check(SYSTEMD_CGROUP_CONTROLLER, path, "cgroup.procs", &fs);
+        if (r < 0)
+                return r;
+
+        r = strv_consume(&l, fs);
+        if (r < 0)
+                return r;
+
+        NULSTR_FOREACH(n, mask_names) {
+
+                if (supported & bit) {
+                        char prefix[strlen(path) + 1];
+
+                        r = strv_extend(&l, "");
+                        if (r < 0)
+                                return r;
+
+                        if (cg_get_path_and_check(n, path, "cgroup.procs", &fs) >= 0) {
+                                r = strv_consume(&l, fs);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        PATH_FOREACH_PREFIX(prefix, path)
+                                if (cg_get_path_and_check(n, prefix, "cgroup.procs", &fs) >= 0) {
+                                        r = strv_consume(&l, fs);
+                                        if (r < 0)
+                                                return r;
+                                }
+                }
+
+                bit <<= 1;
+        }
+
+        *ret = l;
+        l = NULL;
+
+        return 0;
+}
+
 int cg_attach_many_everywhere(CGroupControllerMask supported, const char *path, Set* pids, cg_migrate_callback_t path_callback, void *userdata) {
         Iterator i;
         void *pidp;
@@ -23,6 +23,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "conf-parser.h"
 #include "conf-files.h"
@@ -196,26 +199,352 @@ static int next_assignment(const char *unit,
         return 0;
 }
 
-/* Parse a variable assignment line */
-static int parse_line(const char* unit,
-                      const char *filename,
-                      unsigned line,
-                      const char *sections,
-                      ConfigItemLookup lookup,
-                      const void *table,
-                      bool relaxed,
-                      bool allow_include,
-                      char **section,
-                      unsigned *section_line,
-                      bool *section_ignored,
-                      char *l,
-                      void *userdata) {
+typedef enum ConfigLineType {
+        CONFIG_LINE_INCLUDE,
+        CONFIG_LINE_SECTION,
+        CONFIG_LINE_INVALID_SECTION,
+        CONFIG_LINE_ASSIGNMENT,
+        CONFIG_LINE_INVALID_ASSIGNMENT,
+} ConfigLineType;
+
+typedef struct ConfigLine {
+        ConfigLineType type;
+        unsigned line;
+
+        /* The included file name, the section name, the lvalue, or
+         * the unparsable line itself. For assignments the rvalue
+         * follows in the same allocation. */
+        char *key;
+        const char *value;
+
+        /* The included file, if includes are allowed */
+        ConfigFile *include;
+        int include_error;
+} ConfigLine;
+
+struct ConfigFile {
+        char *filename;
+        struct stat st;
+        bool allow_include;
+
+        ConfigLine *lines;
+        unsigned n_lines;
+        size_t n_allocated;
+
+        /* Reading failed after the lines we got */
+        int error;
+
+        /* The strings point into a mapped cache file and are not
+         * ours to free */
+        bool mapped;
+};
+
+ConfigFile *config_file_free(ConfigFile *c) {
+        unsigned i;
+
+        if (!c)
+                return NULL;
+
+        for (i = 0; i < c->n_lines; i++) {
+                if (!c->mapped)
+                        free(c->lines[i].key);
+                config_file_free(c->lines[i].include);
+        }
+
+        free(c->lines);
+        if (!c->mapped)
+                free(c->filename);
+        free(c);
+
+        return NULL;
+}
+
+const char *config_file_get_filename(ConfigFile *c) {
+        assert(c);
+
+        return c->filename;
+}
+
+bool config_file_get_allow_include(ConfigFile *c) {
+        assert(c);
+
+        return c->allow_include;
+}
+
+bool config_file_is_current(ConfigFile *c, const struct stat *st) {
+        assert(c);
+        assert(st);
+
+        /* Checks whether the file we read is still the one found at
+         * its path */
+
+        return c->st.st_dev == st->st_dev &&
+               c->st.st_ino == st->st_ino &&
+               c->st.st_size == st->st_size &&
+               timespec_load(&c->st.st_mtim) == timespec_load(&st->st_mtim);
+}
+
+static bool config_file_stat_matches(ConfigFile *c, bool follow) {
+        struct stat st;
+        unsigned i;
+
+        assert(c);
+
+        if ((follow ? stat(c->filename, &st) : lstat(c->filename, &st)) < 0)
+                return false;
+
+        if (!S_ISREG(st.st_mode) || !config_file_is_current(c, &st))
+                return false;
+
+        if (!c->allow_include)
+                return true;
+
+        for (i = 0; i < c->n_lines; i++) {
+                ConfigLine *l = c->lines + i;
+
+                if (l->type != CONFIG_LINE_INCLUDE)
+                        continue;
+
+                if (l->include) {
+                        if (!config_file_stat_matches(l->include, true))
+                                return false;
+                } else if (access(l->key, F_OK) >= 0)
+                        return false;
+        }
+
+        return true;
+}
+
+/* Checks whether the file and the files it includes are unchanged on
+ * disk since we read them */
+bool config_file_is_up_to_date(ConfigFile *c) {
+
+        /* The file itself is never read through a symlink by
+         * config_file_load_many(), included files are */
+        return config_file_stat_matches(c, false);
+}
+
+usec_t config_file_newest_mtime(ConfigFile *c) {
+        usec_t t;
+        unsigned i;
+
+        assert(c);
+
+        t = timespec_load(&c->st.st_mtim);
+
+        for (i = 0; i < c->n_lines; i++)
+                if (c->lines[i].include)
+                        t = MAX(t, config_file_newest_mtime(c->lines[i].include));
+
+        return t;
+}
+
+/* The binary representation of a ConfigFile, as used by the unit
+ * file cache. It is only ever read by the same build that wrote it,
+ * hence all fields are in native byte order. Every record and string
+ * is padded to a multiple of 8 bytes. */
+typedef struct ConfigFileRecord {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t mtime_sec;
+        uint64_t mtime_nsec;
+        int32_t error;
+        uint32_t allow_include;
+        uint32_t n_lines;
+        uint32_t filename_size;
+        /* followed by the file name and the lines */
+} ConfigFileRecord;
+
+typedef struct ConfigLineRecord {
+        uint32_t type;
+        uint32_t line;
+        int32_t include_error;
+        uint32_t has_include;
+        uint32_t key_size;
+        uint32_t value_offset;
+        /* followed by the key (and value), and the included file */
+} ConfigLineRecord;
+
+static void write_padded(FILE *f, const void *p, size_t size) {
+        static const uint8_t zeroes[8] = {};
+
+        fwrite(p, 1, size, f);
+        fwrite(zeroes, 1, ALIGN8(size) - size, f);
+}
+
+int config_file_serialize(ConfigFile *c, FILE *f) {
+        ConfigFileRecord r = {};
+        unsigned i;
+        int q;
+
+        assert(c);
+        assert(f);
+
+        r.dev = c->st.st_dev;
+        r.ino = c->st.st_ino;
+        r.size = c->st.st_size;
+        r.mtime_sec = c->st.st_mtim.tv_sec;
+        r.mtime_nsec = c->st.st_mtim.tv_nsec;
+        r.error = c->error;
+        r.allow_include = c->allow_include;
+        r.n_lines = c->n_lines;
+        r.filename_size = strlen(c->filename) + 1;
+
+        fwrite(&r, sizeof(r), 1, f);
+        write_padded(f, c->filename, r.filename_size);
+
+        for (i = 0; i < c->n_lines; i++) {
+                ConfigLine *l = c->lines + i;
+                ConfigLineRecord lr = {
+                        .type = l->type,
+                        .line = l->line,
+                        .include_error = l->include_error,
+                        .has_include = !!l->include,
+                };
+
+                lr.key_size = strlen(l->key) + 1;
+                if (l->value) {
+                        lr.value_offset = lr.key_size;
+                        lr.key_size += strlen(l->value) + 1;
+                }
+
+                fwrite(&lr, sizeof(lr), 1, f);
+                write_padded(f, l->key, lr.key_size);
+
+                if (l->include) {
+                        q = config_file_serialize(l->include, f);
+                        if (q < 0)
+                                return q;
+                }
+        }
+
+        return ferror(f) ? -EIO : 0;
+}
+
+static const void *take_bytes(const uint8_t **p, size_t *left, size_t size) {
+        const void *q = *p;
+
+        size = ALIGN8(size);
+        if (size > *left)
+                return NULL;
+
+        *p += size;
+        *left -= size;
+
+        return q;
+}
+
+static bool string_is_terminated(const char *s, size_t size) {
+        return size > 0 && memchr(s, 0, size) == s + size - 1;
+}
+
+static int config_file_deserialize_internal(const uint8_t **p, size_t *left, unsigned depth, ConfigFile **ret) {
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        const ConfigFileRecord *r;
+        unsigned i;
+        int q;
+
+        r = take_bytes(p, left, sizeof(*r));
+        if (!r)
+                return -EBADMSG;
+
+        c = new0(ConfigFile, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->mapped = true;
+        c->st.st_mode = S_IFREG;
+        c->st.st_dev = r->dev;
+        c->st.st_ino = r->ino;
+        c->st.st_size = r->size;
+        c->st.st_mtim.tv_sec = r->mtime_sec;
+        c->st.st_mtim.tv_nsec = r->mtime_nsec;
+        c->error = r->error;
+        c->allow_include = r->allow_include;
+
+        c->filename = (char*) take_bytes(p, left, r->filename_size);
+        if (!c->filename || !string_is_terminated(c->filename, r->filename_size))
+                return -EBADMSG;
+
+        /* Each line takes at least one record, don't let a broken
+         * file make us allocate arbitrary amounts of memory */
+        if ((size_t) r->n_lines > *left / sizeof(ConfigLineRecord))
+                return -EBADMSG;
+
+        c->lines = new0(ConfigLine, r->n_lines);
+        if (r->n_lines > 0 && !c->lines)
+                return -ENOMEM;
+
+        for (i = 0; i < r->n_lines; i++) {
+                ConfigLine *l = c->lines + i;
+                const ConfigLineRecord *lr;
+
+                lr = take_bytes(p, left, sizeof(*lr));
+                if (!lr || lr->type > CONFIG_LINE_INVALID_ASSIGNMENT)
+                        return -EBADMSG;
+
+                l->type = lr->type;
+                l->line = lr->line;
+                l->include_error = lr->include_error;
+
+                l->key = (char*) take_bytes(p, left, lr->key_size);
+                if (!l->key)
+                        return -EBADMSG;
+
+                if (lr->value_offset > 0) {
+                        if (lr->value_offset >= lr->key_size ||
+                            !string_is_terminated(l->key, lr->value_offset) ||
+                            !string_is_terminated(l->key + lr->value_offset, lr->key_size - lr->value_offset))
+                                return -EBADMSG;
+
+                        l->value = l->key + lr->value_offset;
+                } else if (!string_is_terminated(l->key, lr->key_size))
+                        return -EBADMSG;
 
+                /* Count the line before reading the include, so
+                 * that it is freed along with us on failure */
+                c->n_lines++;
+
+                if (lr->has_include) {
+                        /* Includes do not nest */
+                        if (depth > 0 || l->type != CONFIG_LINE_INCLUDE)
+                                return -EBADMSG;
+
+                        q = config_file_deserialize_internal(p, left, depth + 1, &l->include);
+                        if (q < 0)
+                                return q;
+                }
+        }
+
+        c->n_allocated = c->n_lines;
+
+        *ret = c;
+        c = NULL;
+
+        return 0;
+}
+
+/* Reconstruct a file serialized with config_file_serialize() from
+ * memory at *p, advancing *p past it. The result refers to the
+ * strings in that memory, which hence needs to stay around for as
+ * long as the ConfigFile does. */
+int config_file_deserialize(const uint8_t **p, size_t *left, ConfigFile **ret) {
+        assert(p);
+        assert(left);
+        assert(ret);
+        assert(((uintptr_t) *p & 7) == 0);
+
+        return config_file_deserialize_internal(p, left, 0, ret);
+}
+
+static int config_file_add_line(ConfigFile *c, unsigned line, char *l) {
+        ConfigLine *cl;
         char *e;
+        int r;
 
-        assert(filename);
+        assert(c);
         assert(line > 0);
-        assert(lookup);
         assert(l);
 
         l = strstrip(l);
@@ -226,160 +555,137 @@ static int parse_line(const char* unit,
         if (strchr(COMMENTS "\n", *l))
                 return 0;
 
-        if (startswith(l, ".include ")) {
-                _cleanup_free_ char *fn = NULL;
+        if (!GREEDY_REALLOC0(c->lines, c->n_allocated, c->n_lines + 1))
+                return -ENOMEM;
 
-                /* .includes are a bad idea, we only support them here
-                 * for historical reasons. They create cyclic include
-                 * problems and make it difficult to detect
-                 * configuration file changes with an easy
-                 * stat(). Better approaches, such as .d/ drop-in
-                 * snippets exist.
-                 *
-                 * Support for them should be eventually removed. */
+        cl = c->lines + c->n_lines;
+        cl->line = line;
 
-                if (!allow_include) {
-                        log_syntax(unit, LOG_ERR, filename, line, EBADMSG,
-                                   ".include not allowed here. Ignoring.");
-                        return 0;
-                }
+        if (startswith(l, ".include ")) {
 
-                fn = file_in_same_dir(filename, strstrip(l+9));
-                if (!fn)
+                cl->type = CONFIG_LINE_INCLUDE;
+                cl->key = file_in_same_dir(c->filename, strstrip(l+9));
+                if (!cl->key)
                         return -ENOMEM;
 
-                return config_parse(unit, fn, NULL, sections, lookup, table, relaxed, false, false, userdata);
+                c->n_lines++;
+
+                if (c->allow_include) {
+                        r = config_file_load(cl->key, NULL, false, &cl->include);
+                        if (r == -ENOMEM)
+                                return r;
+                        if (r < 0)
+                                cl->include_error = r;
+                }
+
+                return 0;
         }
 
         if (*l == '[') {
                 size_t k;
-                char *n;
 
                 k = strlen(l);
                 assert(k > 0);
 
                 if (l[k-1] != ']') {
-                        log_syntax(unit, LOG_ERR, filename, line, EBADMSG,
-                                   "Invalid section header '%s'", l);
-                        return -EBADMSG;
-                }
-
-                n = strndup(l+1, k-2);
-                if (!n)
-                        return -ENOMEM;
-
-                if (sections && !nulstr_contains(sections, n)) {
-
-                        if (!relaxed && !startswith(n, "X-"))
-                                log_syntax(unit, LOG_WARNING, filename, line, EINVAL,
-                                           "Unknown section '%s'. Ignoring.", n);
-
-                        free(n);
-                        free(*section);
-                        *section = NULL;
-                        *section_line = 0;
-                        *section_ignored = true;
+                        cl->type = CONFIG_LINE_INVALID_SECTION;
+                        cl->key = strdup(l);
                 } else {
-                        free(*section);
-                        *section = n;
-                        *section_line = line;
-                        *section_ignored = false;
+                        cl->type = CONFIG_LINE_SECTION;
+                        cl->key = strndup(l+1, k-2);
                 }
+                if (!cl->key)
+                        return -ENOMEM;
 
+                c->n_lines++;
                 return 0;
         }
 
-        if (sections && !*section) {
+        e = strchr(l, '=');
+        if (!e) {
+                cl->type = CONFIG_LINE_INVALID_ASSIGNMENT;
+                cl->key = strdup(l);
+                if (!cl->key)
+                        return -ENOMEM;
+        } else {
+                size_t k, n;
 
-                if (!relaxed && !*section_ignored)
-                        log_syntax(unit, LOG_WARNING, filename, line, EINVAL,
-                                   "Assignment outside of section. Ignoring.");
+                *e = 0;
+                l = strstrip(l);
+                e = strstrip(e + 1);
 
-                return 0;
-        }
+                k = strlen(l);
+                n = strlen(e);
 
-        e = strchr(l, '=');
-        if (!e) {
-                log_syntax(unit, LOG_WARNING, filename, line, EINVAL, "Missing '='.");
-                return -EBADMSG;
-        }
+                cl->type = CONFIG_LINE_ASSIGNMENT;
+                cl->key = new(char, k + 1 + n + 1);
+                if (!cl->key)
+                        return -ENOMEM;
 
-        *e = 0;
-        e++;
+                memcpy(cl->key, l, k + 1);
+                cl->value = memcpy(cl->key + k + 1, e, n + 1);
+        }
 
-        return next_assignment(unit,
-                               filename,
-                               line,
-                               lookup,
-                               table,
-                               *section,
-                               *section_line,
-                               strstrip(l),
-                               strstrip(e),
-                               relaxed,
-                               userdata);
+        c->n_lines++;
+        return 0;
 }
 
-/* Go through the file and parse each line */
-int config_parse(const char *unit,
-                 const char *filename,
-                 FILE *f,
-                 const char *sections,
-                 ConfigItemLookup lookup,
-                 const void *table,
-                 bool relaxed,
-                 bool allow_include,
-                 bool warn,
-                 void *userdata) {
-
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
+/* Read a file and split it into sections and assignments */
+int config_file_load(const char *filename, FILE *f, bool allow_include, ConfigFile **ret) {
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        _cleanup_free_ char *continuation = NULL;
         _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false;
+        unsigned line = 0;
         int r;
 
         assert(filename);
-        assert(lookup);
+        assert(ret);
+
+        /* This neither logs nor looks at the contents of the
+         * assignments, and hence may be called from any thread. The
+         * result is interpreted by config_file_apply(). */
 
         if (!f) {
                 f = ours = fopen(filename, "re");
-                if (!f) {
-                        /* Only log on request, except for ENOENT,
-                         * since we return 0 to the caller. */
-                        if (warn || errno == ENOENT)
-                                log_full(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
-                                         "Failed to open configuration file '%s': %m", filename);
-                        return errno == ENOENT ? 0 : -errno;
-                }
+                if (!f)
+                        return -errno;
         }
 
-        fd_warn_permissions(filename, fileno(f));
+        c = new0(ConfigFile, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->allow_include = allow_include;
+
+        c->filename = strdup(filename);
+        if (!c->filename)
+                return -ENOMEM;
+
+        if (fstat(fileno(f), &c->st) < 0)
+                return -errno;
 
         while (!feof(f)) {
-                char l[LINE_MAX], *p, *c = NULL, *e;
+                char l[LINE_MAX], *p, *b = NULL, *e;
                 bool escaped = false;
 
                 if (!fgets(l, sizeof(l), f)) {
                         if (feof(f))
                                 break;
 
-                        log_error_errno(errno, "Failed to read configuration file '%s': %m", filename);
-                        return -errno;
+                        c->error = -errno;
+                        break;
                 }
 
                 truncate_nl(l);
 
                 if (continuation) {
-                        c = strappend(continuation, l);
-                        if (!c) {
-                                if (warn)
-                                        log_oom();
+                        b = strappend(continuation, l);
+                        if (!b)
                                 return -ENOMEM;
-                        }
 
                         free(continuation);
                         continuation = NULL;
-                        p = c;
+                        p = b;
                 } else
                         p = l;
 
@@ -393,46 +699,295 @@ int config_parse(const char *unit,
                 if (escaped) {
                         *(e-1) = ' ';
 
-                        if (c)
-                                continuation = c;
+                        if (b)
+                                continuation = b;
                         else {
                                 continuation = strdup(l);
-                                if (!continuation) {
-                                        if (warn)
-                                                log_oom();
+                                if (!continuation)
                                         return -ENOMEM;
-                                }
                         }
 
                         continue;
                 }
 
-                r = parse_line(unit,
-                               filename,
-                               ++line,
-                               sections,
+                r = config_file_add_line(c, ++line, p);
+                free(b);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = c;
+        c = NULL;
+
+        return 0;
+}
+
+typedef struct ConfigFileLoader {
+        char **filenames;
+        bool allow_include;
+        ConfigFile **files;
+        unsigned n_files;
+        unsigned next;
+} ConfigFileLoader;
+
+static void *config_file_loader_thread(void *userdata) {
+        ConfigFileLoader *l = userdata;
+        unsigned i;
+
+        while ((i = __sync_fetch_and_add(&l->next, 1)) < l->n_files) {
+                _cleanup_fclose_ FILE *f = NULL;
+                struct stat st;
+                int fd;
+
+                /* Leave symlinks to the caller, who might want to
+                 * follow them in its own way */
+                fd = open(l->filenames[i], O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+                if (fd < 0)
+                        continue;
+
+                f = fdopen(fd, "re");
+                if (!f) {
+                        safe_close(fd);
+                        continue;
+                }
+
+                if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+                        continue;
+
+                (void) config_file_load(l->filenames[i], f, l->allow_include, l->files + i);
+        }
+
+        return NULL;
+}
+
+/* Load many files on up to n_threads threads, including the calling
+ * one. Returns an array with an entry for each file name, which is
+ * NULL if it could not be loaded. */
+int config_file_load_many(char **filenames, bool allow_include, unsigned n_threads, ConfigFile ***ret) {
+        ConfigFileLoader l = {
+                .filenames = filenames,
+                .allow_include = allow_include,
+                .n_files = strv_length(filenames),
+        };
+        pthread_t threads[CONFIG_FILE_LOAD_THREADS_MAX];
+        unsigned i, n_started = 0;
+
+        assert(ret);
+
+        l.files = new0(ConfigFile*, MAX(l.n_files, 1U));
+        if (!l.files)
+                return -ENOMEM;
+
+        n_threads = CLAMP(n_threads, 1U, (unsigned) CONFIG_FILE_LOAD_THREADS_MAX);
+        n_threads = MIN(n_threads, MAX(l.n_files, 1U));
+
+        /* If we cannot start as many threads as we'd like we just
+         * do with fewer */
+        for (i = 1; i < n_threads; i++) {
+                if (pthread_create(threads + n_started, NULL, config_file_loader_thread, &l) != 0)
+                        break;
+
+                n_started++;
+        }
+
+        config_file_loader_thread(&l);
+
+        for (i = 0; i < n_started; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        *ret = l.files;
+        return 0;
+}
+
+static int config_file_apply_line(
+                const char *unit,
+                ConfigFile *c,
+                ConfigLine *l,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                bool relaxed,
+                const char **section,
+                unsigned *section_line,
+                bool *section_ignored,
+                void *userdata) {
+
+        assert(c);
+        assert(l);
+        assert(lookup);
+
+        switch (l->type) {
+
+        case CONFIG_LINE_INCLUDE:
+                /* .includes are a bad idea, we only support them here
+                 * for historical reasons. They create cyclic include
+                 * problems and make it difficult to detect
+                 * configuration file changes with an easy
+                 * stat(). Better approaches, such as .d/ drop-in
+                 * snippets exist.
+                 *
+                 * Support for them should be eventually removed. */
+
+                if (!c->allow_include) {
+                        log_syntax(unit, LOG_ERR, c->filename, l->line, EBADMSG,
+                                   ".include not allowed here. Ignoring.");
+                        return 0;
+                }
+
+                if (l->include_error == -ENOENT) {
+                        log_debug_errno(l->include_error, "Failed to open configuration file '%s': %m", l->key);
+                        return 0;
+                }
+                if (l->include_error < 0)
+                        return l->include_error;
+
+                return config_file_apply(unit, l->include, sections, lookup, table, relaxed, false, userdata);
+
+        case CONFIG_LINE_INVALID_SECTION:
+                log_syntax(unit, LOG_ERR, c->filename, l->line, EBADMSG,
+                           "Invalid section header '%s'", l->key);
+                return -EBADMSG;
+
+        case CONFIG_LINE_SECTION:
+                if (sections && !nulstr_contains(sections, l->key)) {
+
+                        if (!relaxed && !startswith(l->key, "X-"))
+                                log_syntax(unit, LOG_WARNING, c->filename, l->line, EINVAL,
+                                           "Unknown section '%s'. Ignoring.", l->key);
+
+                        *section = NULL;
+                        *section_line = 0;
+                        *section_ignored = true;
+                } else {
+                        *section = l->key;
+                        *section_line = l->line;
+                        *section_ignored = false;
+                }
+
+                return 0;
+
+        case CONFIG_LINE_ASSIGNMENT:
+        case CONFIG_LINE_INVALID_ASSIGNMENT:
+                break;
+
+        default:
+                assert_not_reached("Unknown line type");
+        }
+
+        if (sections && !*section) {
+
+                if (!relaxed && !*section_ignored)
+                        log_syntax(unit, LOG_WARNING, c->filename, l->line, EINVAL,
+                                   "Assignment outside of section. Ignoring.");
+
+                return 0;
+        }
+
+        if (l->type == CONFIG_LINE_INVALID_ASSIGNMENT) {
+                log_syntax(unit, LOG_WARNING, c->filename, l->line, EINVAL, "Missing '='.");
+                return -EBADMSG;
+        }
+
+        return next_assignment(unit,
+                               c->filename,
+                               l->line,
                                lookup,
                                table,
+                               *section,
+                               *section_line,
+                               l->key,
+                               l->value,
                                relaxed,
-                               allow_include,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               p,
                                userdata);
-                free(c);
+}
+
+/* Go through the lines of a loaded file and interpret each */
+int config_file_apply(const char *unit,
+                      ConfigFile *c,
+                      const char *sections,
+                      ConfigItemLookup lookup,
+                      const void *table,
+                      bool relaxed,
+                      bool warn,
+                      void *userdata) {
+
+        const char *section = NULL;
+        unsigned section_line = 0, i;
+        bool section_ignored = false;
+        int r;
 
+        assert(c);
+        assert(lookup);
+
+        stat_warn_permissions(c->filename, &c->st);
+
+        for (i = 0; i < c->n_lines; i++) {
+                r = config_file_apply_line(unit,
+                                           c,
+                                           c->lines + i,
+                                           sections,
+                                           lookup,
+                                           table,
+                                           relaxed,
+                                           &section,
+                                           &section_line,
+                                           &section_ignored,
+                                           userdata);
                 if (r < 0) {
                         if (warn)
                                 log_warning_errno(r, "Failed to parse file '%s': %m",
-                                                  filename);
+                                                  c->filename);
                         return r;
                 }
         }
 
+        if (c->error < 0)
+                return log_error_errno(c->error, "Failed to read configuration file '%s': %m", c->filename);
+
         return 0;
 }
 
+/* Parse a file in one go */
+int config_parse(const char *unit,
+                 const char *filename,
+                 FILE *f,
+                 const char *sections,
+                 ConfigItemLookup lookup,
+                 const void *table,
+                 bool relaxed,
+                 bool allow_include,
+                 bool warn,
+                 void *userdata) {
+
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        _cleanup_fclose_ FILE *ours = NULL;
+        int r;
+
+        assert(filename);
+        assert(lookup);
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f) {
+                        /* Only log on request, except for ENOENT,
+                         * since we return 0 to the caller. */
+                        if (warn || errno == ENOENT)
+                                log_full(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
+                                         "Failed to open configuration file '%s': %m", filename);
+                        return errno == ENOENT ? 0 : -errno;
+                }
+        }
+
+        r = config_file_load(filename, f, allow_include, &c);
+        if (r < 0) {
+                if (warn)
+                        log_warning_errno(r, "Failed to parse file '%s': %m", filename);
+                return r;
+        }
+
+        return config_file_apply(unit, c, sections, lookup, table, relaxed, warn, userdata);
+}
+
 /* Parse each config file in the specified directories. */
 int config_parse_many(const char *conf_file,
                       const char *conf_file_dirs,
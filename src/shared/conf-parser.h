@@ -23,8 +23,10 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 #include "macro.h"
+#include "time-util.h"
 
 /* An abstract parser for simple, line based, shallow configuration
  * files consisting of variable assignments only. */
@@ -92,6 +94,32 @@ int config_parse(const char *unit,
                  bool warn,
                  void *userdata);
 
+/* A configuration file split into lines, but not interpreted yet */
+typedef struct ConfigFile ConfigFile;
+
+#define CONFIG_FILE_LOAD_THREADS_MAX 16
+
+int config_file_load(const char *filename, FILE *f, bool allow_include, ConfigFile **ret);
+int config_file_load_many(char **filenames, bool allow_include, unsigned n_threads, ConfigFile ***ret);
+ConfigFile *config_file_free(ConfigFile *c);
+const char *config_file_get_filename(ConfigFile *c);
+bool config_file_get_allow_include(ConfigFile *c);
+bool config_file_is_current(ConfigFile *c, const struct stat *st);
+bool config_file_is_up_to_date(ConfigFile *c);
+usec_t config_file_newest_mtime(ConfigFile *c);
+int config_file_serialize(ConfigFile *c, FILE *f);
+int config_file_deserialize(const uint8_t **p, size_t *left, ConfigFile **ret);
+int config_file_apply(const char *unit,
+                      ConfigFile *c,
+                      const char *sections,  /* nulstr */
+                      ConfigItemLookup lookup,
+                      const void *table,
+                      bool relaxed,
+                      bool warn,
+                      void *userdata);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigFile*, config_file_free);
+
 int config_parse_many(const char *conf_file,      /* possibly NULL */
                       const char *conf_file_dirs, /* nulstr */
                       const char *sections,       /* nulstr */
@@ -31,6 +31,10 @@
 #include "strv.h"
 #include "mempool.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef ENABLE_DEBUG_HASHMAP
 #include "list.h"
 #endif
@@ -523,12 +527,14 @@ static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
         }
 }
 
+/* These are called once per probed bucket, so avoid divisions */
 static unsigned next_idx(HashmapBase *h, unsigned idx) {
-        return (idx + 1U) % n_buckets(h);
+        idx++;
+        return idx < n_buckets(h) ? idx : 0;
 }
 
 static unsigned prev_idx(HashmapBase *h, unsigned idx) {
-        return (n_buckets(h) + idx - 1U) % n_buckets(h);
+        return idx > 0 ? idx - 1U : n_buckets(h) - 1U;
 }
 
 static void *entry_value(HashmapBase *h, struct hashmap_base_entry *e) {
@@ -1204,18 +1210,85 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         return 1;
 }
 
+#ifdef __SSE2__
+/* Number of buckets whose DIBs are examined at once when scanning */
+#define DIB_GROUP_SIZE 16U
+
+/*
+ * Scans the DIB bytes of DIB_GROUP_SIZE consecutive buckets, starting
+ * at 'idx', which is at 'distance' from the initial bucket of 'key'.
+ * The entry we are looking for can only be in a bucket whose DIB equals
+ * its distance from the initial bucket. The scan ends at the first free
+ * bucket, or at the first entry that is closer to its own initial bucket
+ * than we are to ours, because Robin Hood would have placed our entry
+ * before it. Free buckets and overflowed DIBs compare greater than any
+ * distance within the group, so only the former need to be tested for
+ * explicitly.
+ * Returns: 1 and the index of the found entry in *ret,
+ *          0 if the key is not in the hashmap,
+ *          -EAGAIN if the scan needs to continue with the next group.
+ */
+static int bucket_scan_group(HashmapBase *h, unsigned idx, unsigned distance,
+                             const void *key, unsigned *ret) {
+        const __m128i offsets = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                              8, 9, 10, 11, 12, 13, 14, 15);
+        __m128i raw, distances;
+        unsigned match, stop, bit;
+
+        raw = _mm_loadu_si128((const __m128i*) (dib_raw_ptr(h) + idx));
+        distances = _mm_add_epi8(offsets, _mm_set1_epi8((char) distance));
+
+        match = _mm_movemask_epi8(_mm_cmpeq_epi8(raw, distances));
+        stop = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(raw, distances), raw)) & ~match;
+        stop |= _mm_movemask_epi8(_mm_cmpeq_epi8(raw, _mm_set1_epi8((char) DIB_RAW_FREE)));
+
+        if (stop)
+                match &= (1U << __builtin_ctz(stop)) - 1;
+
+        for (; match; match &= match - 1) {
+                bit = __builtin_ctz(match);
+
+                if (h->hash_ops->compare(bucket_at(h, idx + bit)->key, key) == 0) {
+                        *ret = idx + bit;
+                        return 1;
+                }
+        }
+
+        return stop ? 0 : -EAGAIN;
+}
+#endif
+
 /*
  * Finds an entry with a matching key
  * Returns: index of the found entry, or IDX_NIL if not found.
  */
 static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key) {
         struct hashmap_base_entry *e;
-        unsigned dib, distance;
+        unsigned dib, distance = 0;
         dib_raw_t *dibs = dib_raw_ptr(h);
 
         assert(idx < n_buckets(h));
 
-        for (distance = 0; ; distance++) {
+#ifdef __SSE2__
+        /* Groups must neither wrap around the end of the table, nor
+         * reach distances that might be stored as DIB_RAW_OVERFLOW */
+        while (idx + DIB_GROUP_SIZE <= n_buckets(h) &&
+               distance + DIB_GROUP_SIZE <= DIB_RAW_OVERFLOW) {
+                unsigned found;
+                int r;
+
+                r = bucket_scan_group(h, idx, distance, key, &found);
+                if (r > 0)
+                        return found;
+                if (r == 0)
+                        return IDX_NIL;
+
+                idx = (idx + DIB_GROUP_SIZE) % n_buckets(h);
+                distance += DIB_GROUP_SIZE;
+        }
+#endif
+
+        for (; ; distance++) {
                 if (dibs[idx] == DIB_RAW_FREE)
                         return IDX_NIL;
 
@@ -1234,6 +1307,31 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
 }
 #define bucket_scan(h, idx, key) base_bucket_scan(HASHMAP_BASE(h), idx, key)
 
+/*
+ * Finds an entry with a matching key, for callers that do not need the
+ * hash value otherwise.
+ * Returns: index of the found entry, or IDX_NIL if not found.
+ */
+static unsigned base_bucket_find(HashmapBase *h, const void *key) {
+        dib_raw_t *dibs;
+        unsigned idx;
+
+        if (h->has_indirect)
+                return base_bucket_scan(h, base_bucket_hash(h, key), key);
+
+        /* Direct storage has only a handful of buckets. Comparing
+         * the key with each of them is cheaper than hashing it. */
+        dibs = dib_raw_ptr(h);
+
+        for (idx = 0; idx < hashmap_type_info[h->type].n_direct_buckets; idx++)
+                if (dibs[idx] != DIB_RAW_FREE &&
+                    h->hash_ops->compare(bucket_at(h, idx)->key, key) == 0)
+                        return idx;
+
+        return IDX_NIL;
+}
+#define bucket_find(h, key) base_bucket_find(HASHMAP_BASE(h), key)
+
 int hashmap_put(Hashmap *h, const void *key, void *value) {
         struct swap_entries swap;
         struct plain_hashmap_entry *e;
@@ -1307,12 +1405,11 @@ int hashmap_replace(Hashmap *h, const void *key, void *value) {
 
 int hashmap_update(Hashmap *h, const void *key, void *value) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
 
         assert(h);
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL)
                 return -ENOENT;
 
@@ -1323,13 +1420,12 @@ int hashmap_update(Hashmap *h, const void *key, void *value) {
 
 void *internal_hashmap_get(HashmapBase *h, const void *key) {
         struct hashmap_base_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
 
         if (!h)
                 return NULL;
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL)
                 return NULL;
 
@@ -1339,13 +1435,12 @@ void *internal_hashmap_get(HashmapBase *h, const void *key) {
 
 void *hashmap_get2(Hashmap *h, const void *key, void **key2) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
 
         if (!h)
                 return NULL;
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL)
                 return NULL;
 
@@ -1357,25 +1452,21 @@ void *hashmap_get2(Hashmap *h, const void *key, void **key2) {
 }
 
 bool internal_hashmap_contains(HashmapBase *h, const void *key) {
-        unsigned hash;
-
         if (!h)
                 return false;
 
-        hash = bucket_hash(h, key);
-        return bucket_scan(h, hash, key) != IDX_NIL;
+        return bucket_find(h, key) != IDX_NIL;
 }
 
 void *internal_hashmap_remove(HashmapBase *h, const void *key) {
         struct hashmap_base_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
         void *data;
 
         if (!h)
                 return NULL;
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL)
                 return NULL;
 
@@ -1388,7 +1479,7 @@ void *internal_hashmap_remove(HashmapBase *h, const void *key) {
 
 void *hashmap_remove2(Hashmap *h, const void *key, void **rkey) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
         void *data;
 
         if (!h) {
@@ -1397,8 +1488,7 @@ void *hashmap_remove2(Hashmap *h, const void *key, void **rkey) {
                 return NULL;
         }
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL) {
                 if (rkey)
                         *rkey = NULL;
@@ -1506,13 +1596,12 @@ int hashmap_remove_and_replace(Hashmap *h, const void *old_key, const void *new_
 
 void *hashmap_remove_value(Hashmap *h, const void *key, void *value) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
 
         if (!h)
                 return NULL;
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL)
                 return NULL;
 
@@ -1789,15 +1878,14 @@ char **internal_hashmap_get_strv(HashmapBase *h) {
 
 void *ordered_hashmap_next(OrderedHashmap *h, const void *key) {
         struct ordered_hashmap_entry *e;
-        unsigned hash, idx;
+        unsigned idx;
 
         assert(key);
 
         if (!h)
                 return NULL;
 
-        hash = bucket_hash(h, key);
-        idx = bucket_scan(h, hash, key);
+        idx = bucket_find(h, key);
         if (idx == IDX_NIL)
                 return NULL;
 
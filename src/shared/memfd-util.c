@@ -99,6 +99,14 @@ int memfd_set_sealed(int fd) {
 
         assert(fd >= 0);
 
+        /* Sealing an already fully sealed memfd is not an error, so
+         * that the same payload may be sent more than once */
+        r = memfd_get_sealed(fd);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                return 0;
+
         r = fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
         if (r < 0)
                 return -errno;
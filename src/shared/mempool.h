@@ -43,7 +43,4 @@ struct mempool pool_name = { \
         .at_least = alloc_at_least, \
 }
 
-
-#ifdef VALGRIND
 void mempool_drop(struct mempool *mp);
-#endif
@@ -66,112 +66,143 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
-static void swap(Prioq *q, unsigned j, unsigned k) {
-        void *saved_data;
-        unsigned *saved_idx;
-
-        assert(q);
-        assert(j < q->n_items);
-        assert(k < q->n_items);
-
-        assert(!q->items[j].idx || *(q->items[j].idx) == j);
-        assert(!q->items[k].idx || *(q->items[k].idx) == k);
+/* The heap is 4-ary rather than binary: it is half as deep, and the
+ * children of an item are next to each other in memory, so that
+ * finding the smallest of them touches a single cache line or two
+ * instead of a new one on every level. */
+#define PRIOQ_ARITY 4U
+
+static inline unsigned parent_idx(unsigned idx) {
+        return (idx - 1) / PRIOQ_ARITY;
+}
 
-        saved_data = q->items[j].data;
-        saved_idx = q->items[j].idx;
-        q->items[j].data = q->items[k].data;
-        q->items[j].idx = q->items[k].idx;
-        q->items[k].data = saved_data;
-        q->items[k].idx = saved_idx;
+static inline unsigned first_child_idx(unsigned idx) {
+        return idx * PRIOQ_ARITY + 1;
+}
 
-        if (q->items[j].idx)
-                *q->items[j].idx = j;
+static inline void set_item(Prioq *q, unsigned k, struct prioq_item item) {
+        q->items[k] = item;
 
-        if (q->items[k].idx)
-                *q->items[k].idx = k;
+        if (item.idx)
+                *item.idx = k;
 }
 
+/* Instead of swapping the item with its parent or child on each
+ * level, the items in its way are moved into the hole it leaves,
+ * and the item itself is stored only once at its final position. */
+
 static unsigned shuffle_up(Prioq *q, unsigned idx) {
+        struct prioq_item item;
+
         assert(q);
+        assert(idx < q->n_items);
+        assert(!q->items[idx].idx || *(q->items[idx].idx) == idx);
+
+        item = q->items[idx];
 
         while (idx > 0) {
                 unsigned k;
 
-                k = (idx-1)/2;
+                k = parent_idx(idx);
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) < 0)
+                if (q->compare_func(q->items[k].data, item.data) < 0)
                         break;
 
-                swap(q, idx, k);
+                set_item(q, idx, q->items[k]);
                 idx = k;
         }
 
+        set_item(q, idx, item);
         return idx;
 }
 
 static unsigned shuffle_down(Prioq *q, unsigned idx) {
+        struct prioq_item item;
+
         assert(q);
+        assert(idx < q->n_items);
+        assert(!q->items[idx].idx || *(q->items[idx].idx) == idx);
 
-        for (;;) {
-                unsigned j, k, s;
+        item = q->items[idx];
 
-                k = (idx+1)*2; /* right child */
-                j = k-1;       /* left child */
+        for (;;) {
+                unsigned j, k, end, s;
 
+                j = first_child_idx(idx);
                 if (j >= q->n_items)
                         break;
 
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
-
-                        /* So our left child is smaller than we are, let's
-                         * remember this fact */
-                        s = j;
-                else
-                        s = idx;
+                end = MIN(j + PRIOQ_ARITY, q->n_items);
 
-                if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
+                /* Find the smallest of our children */
+                s = j;
+                for (k = j + 1; k < end; k++)
+                        if (q->compare_func(q->items[k].data, q->items[s].data) < 0)
+                                s = k;
 
-                        /* So our right child is smaller than we are, let's
-                         * remember this fact */
-                        s = k;
-
-                /* s now points to the smallest of the three items */
-
-                if (s == idx)
-                        /* No swap necessary, we're done */
+                if (q->compare_func(q->items[s].data, item.data) >= 0)
+                        /* Not smaller than we are, we're done */
                         break;
 
-                swap(q, idx, s);
+                set_item(q, idx, q->items[s]);
                 idx = s;
         }
 
+        set_item(q, idx, item);
         return idx;
 }
 
-int prioq_put(Prioq *q, void *data, unsigned *idx) {
-        struct prioq_item *i;
+static unsigned shuffle(Prioq *q, unsigned idx) {
+        assert(q);
+        assert(idx < q->n_items);
+
+        /* Moves an item whose key changed into place. If it is
+         * smaller than its parent it can only move up, since it was
+         * already not larger than its children before. Otherwise it
+         * can only move down. */
+
+        if (idx > 0 &&
+            q->compare_func(q->items[idx].data, q->items[parent_idx(idx)].data) < 0)
+                return shuffle_up(q, idx);
+
+        return shuffle_down(q, idx);
+}
+
+static int ensure_allocated_items(Prioq *q, unsigned n) {
+        struct prioq_item *j;
         unsigned k;
 
         assert(q);
 
-        if (q->n_items >= q->n_allocated) {
-                unsigned n;
-                struct prioq_item *j;
+        if (n <= q->n_allocated)
+                return 0;
 
-                n = MAX((q->n_items+1) * 2, 16u);
-                j = realloc(q->items, sizeof(struct prioq_item) * n);
-                if (!j)
-                        return -ENOMEM;
+        k = MAX(n * 2, 16u);
+        j = realloc(q->items, sizeof(struct prioq_item) * k);
+        if (!j)
+                return -ENOMEM;
 
-                q->items = j;
-                q->n_allocated = n;
-        }
+        q->items = j;
+        q->n_allocated = k;
+
+        return 0;
+}
+
+int prioq_put(Prioq *q, void *data, unsigned *idx) {
+        unsigned k;
+        int r;
+
+        assert(q);
+
+        r = ensure_allocated_items(q, q->n_items + 1);
+        if (r < 0)
+                return r;
 
         k = q->n_items++;
-        i = q->items + k;
-        i->data = data;
-        i->idx = idx;
+        q->items[k] = (struct prioq_item) {
+                .data = data,
+                .idx = idx,
+        };
 
         if (idx)
                 *idx = k;
@@ -181,6 +212,47 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
         return 0;
 }
 
+int prioq_put_many(Prioq *q, void * const *data, unsigned * const *idx, unsigned n) {
+        unsigned i, k;
+        int r;
+
+        assert(q);
+        assert(data || n == 0);
+
+        /* Adds n items at once. idx may be NULL, or point to an
+         * array of n index pointers, each of which may be NULL. */
+
+        r = ensure_allocated_items(q, q->n_items + n);
+        if (r < 0)
+                return r;
+
+        k = q->n_items;
+
+        for (i = 0; i < n; i++) {
+                q->items[k + i] = (struct prioq_item) {
+                        .data = data[i],
+                        .idx = idx ? idx[i] : NULL,
+                };
+
+                if (q->items[k + i].idx)
+                        *q->items[k + i].idx = k + i;
+        }
+
+        q->n_items += n;
+
+        /* When adding only a few items to a large queue, moving each
+         * of them up is cheaper. Otherwise, rebuild the heap bottom-up
+         * in O(n), beginning with the parent of the last item. */
+        if (n < q->n_items / 8) {
+                for (i = k; i < q->n_items; i++)
+                        shuffle_up(q, i);
+        } else if (q->n_items > 1)
+                for (i = parent_idx(q->n_items - 1) + 1; i > 0; i--)
+                        shuffle_down(q, i - 1);
+
+        return 0;
+}
+
 static void remove_item(Prioq *q, struct prioq_item *i) {
         struct prioq_item *l;
 
@@ -200,14 +272,10 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
 
                 k = i - q->items;
 
-                i->data = l->data;
-                i->idx = l->idx;
-                if (i->idx)
-                        *i->idx = k;
+                set_item(q, k, *l);
                 q->n_items--;
 
-                k = shuffle_down(q, k);
-                shuffle_up(q, k);
+                shuffle(q, k);
         }
 }
 
@@ -250,7 +318,6 @@ int prioq_remove(Prioq *q, void *data, unsigned *idx) {
 
 int prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         struct prioq_item *i;
-        unsigned k;
 
         assert(q);
 
@@ -258,9 +325,25 @@ int prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         if (!i)
                 return 0;
 
-        k = i - q->items;
-        k = shuffle_down(q, k);
-        shuffle_up(q, k);
+        shuffle(q, i - q->items);
+        return 1;
+}
+
+int prioq_reshuffle_up(Prioq *q, void *data, unsigned *idx) {
+        struct prioq_item *i;
+
+        assert(q);
+
+        /* Like prioq_reshuffle(), but only for items whose key has
+         * not increased. These can only move towards the head, hence
+         * the children need not be looked at, and an item that stays
+         * where it is costs a single comparison. */
+
+        i = find_item(q, data, idx);
+        if (!i)
+                return 0;
+
+        shuffle_up(q, i - q->items);
         return 1;
 }
 
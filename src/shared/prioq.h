@@ -32,8 +32,10 @@ void prioq_free(Prioq *q);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
 
 int prioq_put(Prioq *q, void *data, unsigned *idx);
+int prioq_put_many(Prioq *q, void * const *data, unsigned * const *idx, unsigned n);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
 int prioq_reshuffle(Prioq *q, void *data, unsigned *idx);
+int prioq_reshuffle_up(Prioq *q, void *data, unsigned *idx);
 
 void *prioq_peek(Prioq *q) _pure_;
 void *prioq_pop(Prioq *q);
@@ -0,0 +1,191 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <string.h>
+
+#include "util.h"
+#include "hashmap.h"
+#include "string-pool.h"
+
+typedef struct StringPoolEntry {
+        unsigned n_ref;
+        size_t length;
+        char s[];
+} StringPoolEntry;
+
+struct StringPool {
+        /* Maps the string data of each entry to the entry itself */
+        Hashmap *entries;
+
+        unsigned n_refs;
+        size_t n_bytes;
+        size_t n_bytes_saved;
+};
+
+static StringPoolEntry *entry_of(const char *s) {
+        return container_of((char*) s, StringPoolEntry, s[0]);
+}
+
+StringPool *string_pool_new(void) {
+        StringPool *p;
+
+        p = new0(StringPool, 1);
+        if (!p)
+                return NULL;
+
+        p->entries = hashmap_new(&string_hash_ops);
+        if (!p->entries) {
+                free(p);
+                return NULL;
+        }
+
+        return p;
+}
+
+StringPool *string_pool_free(StringPool *p) {
+        StringPoolEntry *e;
+
+        if (!p)
+                return NULL;
+
+        while ((e = hashmap_steal_first(p->entries)))
+                free(e);
+
+        hashmap_free(p->entries);
+        free(p);
+
+        return NULL;
+}
+
+const char *string_pool_intern(StringPool *p, const char *s) {
+        StringPoolEntry *e;
+        size_t l;
+
+        assert(p);
+
+        if (!s)
+                return NULL;
+
+        e = hashmap_get(p->entries, s);
+        if (e) {
+                e->n_ref++;
+                p->n_refs++;
+                p->n_bytes_saved += e->length + 1;
+                return e->s;
+        }
+
+        l = strlen(s);
+
+        e = malloc(offsetof(StringPoolEntry, s) + l + 1);
+        if (!e)
+                return NULL;
+
+        e->n_ref = 1;
+        e->length = l;
+        memcpy(e->s, s, l + 1);
+
+        if (hashmap_put(p->entries, e->s, e) < 0) {
+                free(e);
+                return NULL;
+        }
+
+        p->n_refs++;
+        p->n_bytes += l + 1;
+
+        return e->s;
+}
+
+const char *string_pool_ref(StringPool *p, const char *s) {
+        StringPoolEntry *e;
+
+        assert(p);
+
+        if (!s)
+                return NULL;
+
+        /* Cheaper than string_pool_intern() when the string is
+         * already known to be from this pool, as it avoids the
+         * lookup. */
+
+        e = entry_of(s);
+        assert(e->n_ref > 0);
+
+        e->n_ref++;
+        p->n_refs++;
+        p->n_bytes_saved += e->length + 1;
+
+        return s;
+}
+
+const char *string_pool_unref(StringPool *p, const char *s) {
+        StringPoolEntry *e;
+
+        assert(p);
+
+        if (!s)
+                return NULL;
+
+        e = entry_of(s);
+        assert(e->n_ref > 0);
+        assert(p->n_refs > 0);
+
+        p->n_refs--;
+        e->n_ref--;
+
+        if (e->n_ref > 0) {
+                p->n_bytes_saved -= e->length + 1;
+                return NULL;
+        }
+
+        assert_se(hashmap_remove(p->entries, e->s) == e);
+        p->n_bytes -= e->length + 1;
+        free(e);
+
+        return NULL;
+}
+
+int string_pool_replace(StringPool *p, const char **field, const char *s) {
+        const char *n;
+
+        assert(p);
+        assert(field);
+
+        if (s) {
+                n = string_pool_intern(p, s);
+                if (!n)
+                        return -ENOMEM;
+        } else
+                n = NULL;
+
+        string_pool_unref(p, *field);
+        *field = n;
+
+        return 0;
+}
+
+void string_pool_get_stats(StringPool *p, StringPoolStats *ret) {
+        assert(p);
+        assert(ret);
+
+        ret->n_strings = hashmap_size(p->entries);
+        ret->n_refs = p->n_refs;
+        ret->n_bytes = p->n_bytes;
+        ret->n_bytes_saved = p->n_bytes_saved;
+}
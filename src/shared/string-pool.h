@@ -0,0 +1,51 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "macro.h"
+
+/* A pool of reference counted, immutable strings. Interning the
+ * same string twice returns the same pointer, hence strings from
+ * the same pool may be compared with ==. Strings returned by
+ * string_pool_intern() must be released with string_pool_unref()
+ * on the same pool, never with free(). */
+
+typedef struct StringPool StringPool;
+
+typedef struct StringPoolStats {
+        unsigned n_strings;    /* distinct strings in the pool */
+        unsigned n_refs;       /* references handed out */
+        size_t n_bytes;        /* bytes of string data actually stored */
+        size_t n_bytes_saved;  /* bytes a strdup() per reference would have needed on top */
+} StringPoolStats;
+
+StringPool *string_pool_new(void);
+StringPool *string_pool_free(StringPool *p);
+
+const char *string_pool_intern(StringPool *p, const char *s);
+const char *string_pool_ref(StringPool *p, const char *s);
+const char *string_pool_unref(StringPool *p, const char *s);
+
+int string_pool_replace(StringPool *p, const char **field, const char *s);
+
+void string_pool_get_stats(StringPool *p, StringPoolStats *ret);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(StringPool*, string_pool_free);
+#define _cleanup_string_pool_free_ _cleanup_(string_pool_freep)
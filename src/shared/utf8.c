@@ -175,6 +175,14 @@ const char *utf8_is_valid(const char *str) {
         for (p = (const uint8_t*) str; *p; ) {
                 int len;
 
+                /* Plain ASCII needs no further checking, and is
+                 * what large strings such as introspection data
+                 * are mostly made of */
+                if (*p < 0x80) {
+                        p++;
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar((const char *)p);
                 if (len < 0)
                         return NULL;
@@ -4007,10 +4007,58 @@ bool dirent_is_file_with_suffix(const struct dirent *de, const char *suffix) {
         return endswith(de->d_name, suffix);
 }
 
-static int do_execute(char **directories, usec_t timeout, char *argv[]) {
+typedef struct ExecuteChild {
+        const char *path;
+        usec_t start;
+} ExecuteChild;
+
+static pid_t execute_one(const char *path, char *argv[]) {
+        pid_t pid;
+
+        pid = fork();
+        if (pid < 0)
+                return log_error_errno(errno, "Failed to fork: %m");
+        else if (pid == 0) {
+                char *_argv[2];
+
+                assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
+
+                if (!argv) {
+                        _argv[0] = (char*) path;
+                        _argv[1] = NULL;
+                        argv = _argv;
+                } else
+                        argv[0] = (char*) path;
+
+                execv(path, argv);
+                log_error_errno(errno, "Failed to execute %s: %m", path);
+                _exit(EXIT_FAILURE);
+        }
+
+        log_debug("Spawned %s as " PID_FMT ".", path, pid);
+        return pid;
+}
+
+static void execute_log_status(const char *path, int status) {
+
+        if (WIFEXITED(status)) {
+                if (WEXITSTATUS(status) != 0)
+                        log_warning("%s failed with error code %i.", path, WEXITSTATUS(status));
+                else
+                        log_debug("%s succeeded.", path);
+        } else if (WIFSIGNALED(status))
+                log_warning("%s terminated by signal %s.", path, signal_to_string(WTERMSIG(status)));
+        else
+                log_warning("%s failed due to unknown reason.", path);
+}
+
+static int do_execute(char **directories, usec_t timeout, unsigned max_parallel, char *argv[], int timing_fd) {
         _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
         _cleanup_set_free_free_ Set *seen = NULL;
-        char **directory;
+        _cleanup_strv_free_ char **queue = NULL;
+        char **directory, **next;
+        ExecuteChild *c;
+        int r;
 
         /* We fork this all off from a child process so that we can
          * somewhat cleanly make use of SIGALRM to set a time limit */
@@ -4042,8 +4090,6 @@ static int do_execute(char **directories, usec_t timeout, char *argv[]) {
 
                 FOREACH_DIRENT(de, d, break) {
                         _cleanup_free_ char *path = NULL;
-                        pid_t pid;
-                        int r;
 
                         if (!dirent_is_file(de))
                                 continue;
@@ -4066,35 +4112,16 @@ static int do_execute(char **directories, usec_t timeout, char *argv[]) {
                                 continue;
                         }
 
-                        pid = fork();
-                        if (pid < 0) {
-                                log_error_errno(errno, "Failed to fork: %m");
-                                continue;
-                        } else if (pid == 0) {
-                                char *_argv[2];
-
-                                assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
-
-                                if (!argv) {
-                                        _argv[0] = path;
-                                        _argv[1] = NULL;
-                                        argv = _argv;
-                                } else
-                                        argv[0] = path;
-
-                                execv(path, argv);
-                                return log_error_errno(errno, "Failed to execute %s: %m", path);
-                        }
-
-                        log_debug("Spawned %s as " PID_FMT ".", path, pid);
-
-                        r = hashmap_put(pids, UINT_TO_PTR(pid), path);
+                        r = strv_consume(&queue, path);
                         if (r < 0)
                                 return log_oom();
                         path = NULL;
                 }
         }
 
+        if (max_parallel == 0)
+                max_parallel = UINT_MAX;
+
         /* Abort execution of this process after the timout. We simply
          * rely on SIGALRM as default action terminating the process,
          * and turn on alarm(). */
@@ -4102,49 +4129,199 @@ static int do_execute(char **directories, usec_t timeout, char *argv[]) {
         if (timeout != USEC_INFINITY)
                 alarm((timeout + USEC_PER_SEC - 1) / USEC_PER_SEC);
 
-        while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *path = NULL;
+        next = queue;
+        for (;;) {
+                struct rusage ru;
+                int status;
                 pid_t pid;
 
-                pid = PTR_TO_UINT(hashmap_first_key(pids));
-                assert(pid > 0);
+                /* Keep at most max_parallel binaries running, start
+                 * the next one whenever one of them finishes */
+                while (next && *next && hashmap_size(pids) < max_parallel) {
+                        pid = execute_one(*next, argv);
+                        if (pid < 0) {
+                                next++;
+                                continue;
+                        }
+
+                        c = new0(ExecuteChild, 1);
+                        if (!c)
+                                return log_oom();
+
+                        c->path = *next;
+                        c->start = now(CLOCK_MONOTONIC);
+                        next++;
+
+                        r = hashmap_put(pids, UINT_TO_PTR(pid), c);
+                        if (r < 0) {
+                                free(c);
+                                return log_oom();
+                        }
+                }
+
+                if (hashmap_isempty(pids))
+                        break;
+
+                pid = wait4(-1, &status, 0, &ru);
+                if (pid < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+                }
+
+                c = hashmap_remove(pids, UINT_TO_PTR(pid));
+                if (!c)
+                        continue;
 
-                path = hashmap_remove(pids, UINT_TO_PTR(pid));
-                assert(path);
+                execute_log_status(c->path, status);
 
-                wait_for_terminate_and_warn(path, pid, true);
+                if (timing_fd >= 0) {
+                        _cleanup_free_ char *escaped = NULL;
+
+                        /* One line per binary, which stays below
+                         * PIPE_BUF for any sane path and is hence
+                         * written atomically */
+                        escaped = cescape(c->path);
+                        if (escaped)
+                                dprintf(timing_fd, USEC_FMT " " USEC_FMT " %s\n",
+                                        now(CLOCK_MONOTONIC) - c->start,
+                                        timeval_load(&ru.ru_utime) + timeval_load(&ru.ru_stime),
+                                        escaped);
+                }
+
+                free(c);
         }
 
         return 0;
 }
 
-void execute_directories(const char* const* directories, usec_t timeout, char *argv[]) {
+static int read_timings(int fd, ExecuteTiming **ret, unsigned *ret_n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        ExecuteTiming *timings = NULL;
+        size_t n_allocated = 0;
+        unsigned n = 0;
+        char line[LINE_MAX];
+        int r = 0;
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        FOREACH_LINE(line, f, r = -errno) {
+                uint64_t wall, cpu;
+                char *path;
+                int k = 0;
+
+                truncate_nl(line);
+
+                if (sscanf(line, "%" SCNu64 " %" SCNu64 " %n", &wall, &cpu, &k) != 2 || k <= 0) {
+                        log_debug("Failed to parse timing line: %s", line);
+                        continue;
+                }
+
+                r = cunescape(line + k, 0, &path);
+                if (r < 0)
+                        break;
+
+                if (!GREEDY_REALLOC(timings, n_allocated, n + 1)) {
+                        free(path);
+                        r = -ENOMEM;
+                        break;
+                }
+
+                timings[n++] = (ExecuteTiming) {
+                        .path = path,
+                        .wall = wall,
+                        .cpu = cpu,
+                };
+        }
+
+        if (r < 0) {
+                execute_timings_free(timings, n);
+                return r;
+        }
+
+        *ret = timings;
+        *ret_n = n;
+        return 0;
+}
+
+int execute_directories_full(
+                const char* const* directories,
+                usec_t timeout,
+                unsigned max_parallel,
+                char *argv[],
+                ExecuteTiming **ret_timings,
+                unsigned *ret_n_timings) {
+
+        _cleanup_close_pair_ int pipefd[2] = { -1, -1 };
         pid_t executor_pid;
         int r;
         char *name;
         char **dirs = (char**) directories;
 
         assert(!strv_isempty(dirs));
+        assert(!ret_timings == !ret_n_timings);
 
         name = basename(dirs[0]);
         assert(!isempty(name));
 
-        /* Executes all binaries in the directories in parallel and waits
-         * for them to finish. Optionally a timeout is applied. If a file
-         * with the same name exists in more than one directory, the
-         * earliest one wins. */
+        /* Executes all binaries in the directories in parallel, at
+         * most max_parallel at a time (or all of them at once if 0),
+         * and waits for them to finish. Optionally a timeout is
+         * applied. If a file with the same name exists in more than
+         * one directory, the earliest one wins. If requested, the
+         * wall clock and CPU time each binary took is returned, in
+         * the order they finished. */
 
-        executor_pid = fork();
-        if (executor_pid < 0) {
-                log_error_errno(errno, "Failed to fork: %m");
-                return;
+        if (ret_timings)
+                if (pipe2(pipefd, O_CLOEXEC) < 0)
+                        return log_error_errno(errno, "Failed to create pipe: %m");
 
-        } else if (executor_pid == 0) {
-                r = do_execute(dirs, timeout, argv);
+        executor_pid = fork();
+        if (executor_pid < 0)
+                return log_error_errno(errno, "Failed to fork: %m");
+        else if (executor_pid == 0) {
+                pipefd[0] = safe_close(pipefd[0]);
+                r = do_execute(dirs, timeout, max_parallel, argv, pipefd[1]);
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
+        if (ret_timings) {
+                pipefd[1] = safe_close(pipefd[1]);
+
+                /* The executor writes a line for each binary as it
+                 * finishes, we get EOF once it exited */
+                r = read_timings(pipefd[0], ret_timings, ret_n_timings);
+                pipefd[0] = -1;
+                if (r < 0)
+                        log_warning_errno(r, "Failed to read execution times: %m");
+        }
+
         wait_for_terminate_and_warn(name, executor_pid, true);
+
+        if (ret_timings && r < 0) {
+                *ret_timings = NULL;
+                *ret_n_timings = 0;
+        }
+
+        return 0;
+}
+
+void execute_directories(const char* const* directories, usec_t timeout, char *argv[]) {
+        (void) execute_directories_full(directories, timeout, 0, argv, NULL, NULL);
+}
+
+void execute_timings_free(ExecuteTiming *t, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].path);
+
+        free(t);
 }
 
 int kill_and_sigcont(pid_t pid, int sig) {
@@ -6659,20 +6836,27 @@ int open_tmpfile(const char *path, int flags) {
         return fd;
 }
 
-int fd_warn_permissions(const char *path, int fd) {
-        struct stat st;
-
-        if (fstat(fd, &st) < 0)
-                return -errno;
+void stat_warn_permissions(const char *path, const struct stat *st) {
+        assert(path);
+        assert(st);
 
-        if (st.st_mode & 0111)
+        if (st->st_mode & 0111)
                 log_warning("Configuration file %s is marked executable. Please remove executable permission bits. Proceeding anyway.", path);
 
-        if (st.st_mode & 0002)
+        if (st->st_mode & 0002)
                 log_warning("Configuration file %s is marked world-writable. Please remove world writability permission bits. Proceeding anyway.", path);
 
-        if (getpid() == 1 && (st.st_mode & 0044) != 0044)
+        if (getpid() == 1 && (st->st_mode & 0044) != 0044)
                 log_warning("Configuration file %s is marked world-inaccessible. This has no effect as configuration data is accessible via APIs without restrictions. Proceeding anyway.", path);
+}
+
+int fd_warn_permissions(const char *path, int fd) {
+        struct stat st;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        stat_warn_permissions(path, &st);
 
         return 0;
 }
@@ -545,7 +545,15 @@ bool tty_is_console(const char *tty) _pure_;
 int vtnr_from_tty(const char *tty);
 const char *default_term_for_tty(const char *tty);
 
+typedef struct ExecuteTiming {
+        char *path;
+        usec_t wall;
+        usec_t cpu;
+} ExecuteTiming;
+
 void execute_directories(const char* const* directories, usec_t timeout, char *argv[]);
+int execute_directories_full(const char* const* directories, usec_t timeout, unsigned max_parallel, char *argv[], ExecuteTiming **ret_timings, unsigned *ret_n_timings);
+void execute_timings_free(ExecuteTiming *t, unsigned n);
 
 int kill_and_sigcont(pid_t pid, int sig);
 
@@ -985,6 +993,7 @@ int writev_safe(int fd, const struct iovec *w, int j);
 int mkostemp_safe(char *pattern, int flags);
 int open_tmpfile(const char *path, int flags);
 
+void stat_warn_permissions(const char *path, const struct stat *st);
 int fd_warn_permissions(const char *path, int fd);
 
 unsigned long personality_from_string(const char *p);
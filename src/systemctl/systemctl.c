@@ -134,6 +134,7 @@ static unsigned arg_lines = 10;
 static OutputMode arg_output = OUTPUT_SHORT;
 static bool arg_plain = false;
 static bool arg_firmware_setup = false;
+static bool arg_incremental = false;
 
 static bool original_stdout_is_tty;
 
@@ -664,79 +665,110 @@ static int list_units(sd_bus *bus, char **args) {
         return output_units_list(unit_infos, r);
 }
 
-static int get_triggered_units(
+static int get_unit_properties_many(
                 sd_bus *bus,
-                const char* path,
-                char*** ret) {
-
-        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
+                const UnitInfo *unit_infos,
+                unsigned n,
+                const char *suffix,
+                const UnitInfo ***_units,
+                sd_bus_message ***_replies) {
+
+        _cleanup_free_ const UnitInfo **units = NULL;
+        _cleanup_free_ char **paths = NULL;
+        const UnitInfo *u;
+        unsigned c = 0;
         int r;
 
-        r = sd_bus_get_property_strv(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.systemd1.Unit",
-                        "Triggers",
-                        &error,
-                        ret);
+        assert(bus);
+        assert(suffix);
+        assert(_units);
+        assert(_replies);
+
+        /* Fetches the properties of all units of the specified type
+         * with pipelined GetAll() calls */
+
+        units = new(const UnitInfo*, n);
+        paths = new0(char*, n + 1);
+        if (!units || !paths)
+                return log_oom();
 
+        for (u = unit_infos; u < unit_infos + n; u++) {
+                if (!endswith(u->id, suffix))
+                        continue;
+
+                units[c] = u;
+                paths[c++] = (char*) u->unit_path;
+        }
+
+        r = bus_get_all_properties_many(bus, "org.freedesktop.systemd1", paths, NULL, _replies);
         if (r < 0)
-                log_error("Failed to determine triggers: %s", bus_error_message(&error, r));
+                return log_error_errno(r, "Failed to get unit properties: %m");
 
-        return 0;
+        *_units = units;
+        units = NULL;
+
+        return c;
 }
 
-static int get_listening(
+static int map_unit_properties(
                 sd_bus *bus,
-                const char* unit_path,
-                char*** listening) {
+                const UnitInfo *u,
+                sd_bus_message *reply,
+                const struct bus_properties_map *map,
+                void *userdata) {
 
         _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
-        const char *type, *path;
-        int r, n = 0;
+        int r;
 
-        r = sd_bus_get_property(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        unit_path,
-                        "org.freedesktop.systemd1.Socket",
-                        "Listen",
-                        &error,
-                        &reply,
-                        "a(ss)");
-        if (r < 0) {
-                log_error("Failed to get list of listening sockets: %s", bus_error_message(&error, r));
+        if (sd_bus_message_is_method_error(reply, NULL)) {
+                r = sd_bus_error_copy(&error, sd_bus_message_get_error(reply));
+                log_error("Failed to get properties of %s: %s", u->id, bus_error_message(&error, r));
                 return r;
         }
 
-        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ss)");
+        r = bus_message_map_all_properties(bus, reply, map, userdata);
         if (r < 0)
                 return bus_log_parse_error(r);
 
-        while ((r = sd_bus_message_read(reply, "(ss)", &type, &path)) > 0) {
+        return 0;
+}
+
+static int map_listen(sd_bus *bus, const char *member, sd_bus_message *m, sd_bus_error *error, void *userdata) {
+        char ***listening = userdata;
+        const char *type, *path;
+        int r;
+
+        r = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "(ss)");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_read(m, "(ss)", &type, &path)) > 0) {
 
                 r = strv_extend(listening, type);
                 if (r < 0)
-                        return log_oom();
+                        return r;
 
                 r = strv_extend(listening, path);
                 if (r < 0)
-                        return log_oom();
-
-                n++;
+                        return r;
         }
         if (r < 0)
-                return bus_log_parse_error(r);
-
-        r = sd_bus_message_exit_container(reply);
-        if (r < 0)
-                return bus_log_parse_error(r);
+                return r;
 
-        return n;
+        return sd_bus_message_exit_container(m);
 }
 
+struct socket_properties {
+        char **triggered;
+        char **listening;
+};
+
+static const struct bus_properties_map socket_properties_map[] = {
+        { "Triggers", "as",    NULL,       offsetof(struct socket_properties, triggered) },
+        { "Listen",   "a(ss)", map_listen, offsetof(struct socket_properties, listening) },
+        {}
+};
+
 struct socket_info {
         const char *machine;
         const char* id;
@@ -854,11 +886,12 @@ static int list_sockets(sd_bus *bus, char **args) {
         _cleanup_strv_free_ char **machines = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
         _cleanup_free_ struct socket_info *socket_infos = NULL;
-        const UnitInfo *u;
+        _cleanup_free_ const UnitInfo **units = NULL;
+        sd_bus_message **props = NULL;
         struct socket_info *s;
         unsigned cs = 0;
         size_t size = 0;
-        int r = 0, n;
+        int r = 0, n, k;
 
         pager_open_if_enabled();
 
@@ -866,22 +899,22 @@ static int list_sockets(sd_bus *bus, char **args) {
         if (n < 0)
                 return n;
 
-        for (u = unit_infos; u < unit_infos + n; u++) {
+        n = get_unit_properties_many(bus, unit_infos, n, ".socket", &units, &props);
+        if (n < 0)
+                return n;
+
+        for (k = 0; k < n; k++) {
                 _cleanup_strv_free_ char **listening = NULL, **triggered = NULL;
+                struct socket_properties sp = {};
                 int i, c;
 
-                if (!endswith(u->id, ".socket"))
-                        continue;
-
-                r = get_triggered_units(bus, u->unit_path, &triggered);
+                r = map_unit_properties(bus, units[k], props[k], socket_properties_map, &sp);
+                triggered = sp.triggered;
+                listening = sp.listening;
                 if (r < 0)
                         goto cleanup;
 
-                c = get_listening(bus, u->unit_path, &listening);
-                if (c < 0) {
-                        r = c;
-                        goto cleanup;
-                }
+                c = strv_length(listening) / 2;
 
                 if (!GREEDY_REALLOC(socket_infos, size, cs + c)) {
                         r = log_oom();
@@ -890,8 +923,8 @@ static int list_sockets(sd_bus *bus, char **args) {
 
                 for (i = 0; i < c; i++)
                         socket_infos[cs + i] = (struct socket_info) {
-                                .machine = u->machine,
-                                .id = u->id,
+                                .machine = units[k]->machine,
+                                .id = units[k]->id,
                                 .type = listening[i*2],
                                 .path = listening[i*2 + 1],
                                 .triggered = triggered,
@@ -918,82 +951,30 @@ static int list_sockets(sd_bus *bus, char **args) {
                         strv_free(s->triggered);
         }
 
-        return r;
-}
-
-static int get_next_elapse(
-                sd_bus *bus,
-                const char *path,
-                dual_timestamp *next) {
-
-        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
-        dual_timestamp t;
-        int r;
-
-        assert(bus);
-        assert(path);
-        assert(next);
-
-        r = sd_bus_get_property_trivial(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.systemd1.Timer",
-                        "NextElapseUSecMonotonic",
-                        &error,
-                        't',
-                        &t.monotonic);
-        if (r < 0) {
-                log_error("Failed to get next elapsation time: %s", bus_error_message(&error, r));
-                return r;
-        }
-
-        r = sd_bus_get_property_trivial(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.systemd1.Timer",
-                        "NextElapseUSecRealtime",
-                        &error,
-                        't',
-                        &t.realtime);
-        if (r < 0) {
-                log_error("Failed to get next elapsation time: %s", bus_error_message(&error, r));
-                return r;
-        }
+        bus_message_unref_many(props, n);
 
-        *next = t;
-        return 0;
+        return r;
 }
 
-static int get_last_trigger(
-                sd_bus *bus,
-                const char *path,
-                usec_t *last) {
-
-        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
-        int r;
-
-        assert(bus);
-        assert(path);
-        assert(last);
+struct timer_properties {
+        char **triggered;
+        usec_t next_elapse_monotonic;
+        usec_t next_elapse_realtime;
+        usec_t last_trigger;
+};
 
-        r = sd_bus_get_property_trivial(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.systemd1.Timer",
-                        "LastTriggerUSec",
-                        &error,
-                        't',
-                        last);
-        if (r < 0) {
-                log_error("Failed to get last trigger time: %s", bus_error_message(&error, r));
-                return r;
-        }
+static const struct bus_properties_map timer_properties_map[] = {
+        { "Triggers",                "as", NULL, offsetof(struct timer_properties, triggered)             },
+        { "NextElapseUSecMonotonic", "t",  NULL, offsetof(struct timer_properties, next_elapse_monotonic) },
+        { "NextElapseUSecRealtime",  "t",  NULL, offsetof(struct timer_properties, next_elapse_realtime)  },
+        {}
+};
 
-        return 0;
-}
+/* Mapped separately, since failing to get it is not fatal */
+static const struct bus_properties_map timer_last_trigger_map[] = {
+        { "LastTriggerUSec",         "t",  NULL, offsetof(struct timer_properties, last_trigger)          },
+        {}
+};
 
 struct timer_info {
         const char* machine;
@@ -1161,10 +1142,11 @@ static int list_timers(sd_bus *bus, char **args) {
         _cleanup_strv_free_ char **machines = NULL;
         _cleanup_free_ struct timer_info *timer_infos = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
+        _cleanup_free_ const UnitInfo **units = NULL;
+        sd_bus_message **props = NULL;
         struct timer_info *t;
-        const UnitInfo *u;
         size_t size = 0;
-        int n, c = 0;
+        int n, c = 0, k;
         dual_timestamp nw;
         int r = 0;
 
@@ -1174,38 +1156,40 @@ static int list_timers(sd_bus *bus, char **args) {
         if (n < 0)
                 return n;
 
+        n = get_unit_properties_many(bus, unit_infos, n, ".timer", &units, &props);
+        if (n < 0)
+                return n;
+
         dual_timestamp_get(&nw);
 
-        for (u = unit_infos; u < unit_infos + n; u++) {
+        for (k = 0; k < n; k++) {
                 _cleanup_strv_free_ char **triggered = NULL;
-                dual_timestamp next = {};
-                usec_t m, last = 0;
-
-                if (!endswith(u->id, ".timer"))
-                        continue;
-
-                r = get_triggered_units(bus, u->unit_path, &triggered);
-                if (r < 0)
-                        goto cleanup;
+                struct timer_properties tp = {};
+                dual_timestamp next;
+                usec_t m;
 
-                r = get_next_elapse(bus, u->unit_path, &next);
+                r = map_unit_properties(bus, units[k], props[k], timer_properties_map, &tp);
+                triggered = tp.triggered;
                 if (r < 0)
                         goto cleanup;
 
-                get_last_trigger(bus, u->unit_path, &last);
+                if (sd_bus_message_rewind(props[k], true) >= 0)
+                        (void) bus_message_map_all_properties(bus, props[k], timer_last_trigger_map, &tp);
 
                 if (!GREEDY_REALLOC(timer_infos, size, c+1)) {
                         r = log_oom();
                         goto cleanup;
                 }
 
+                next.monotonic = tp.next_elapse_monotonic;
+                next.realtime = tp.next_elapse_realtime;
                 m = calc_next_elapse(&nw, &next);
 
                 timer_infos[c++] = (struct timer_info) {
-                        .machine = u->machine,
-                        .id = u->id,
+                        .machine = units[k]->machine,
+                        .id = units[k]->id,
                         .next_elapse = m,
-                        .last_trigger = last,
+                        .last_trigger = tp.last_trigger,
                         .triggered = triggered,
                 };
 
@@ -1221,6 +1205,8 @@ static int list_timers(sd_bus *bus, char **args) {
         for (t = timer_infos; t < timer_infos + c; t++)
                 strv_free(t->triggered);
 
+        bus_message_unref_many(props, n);
+
         return r;
 }
 
@@ -4197,15 +4183,13 @@ static int print_property(const char *name, sd_bus_message *m, const char *conte
         return 0;
 }
 
-static int show_one(
+static int show_one_reply(
                 const char *verb,
-                sd_bus *bus,
-                const char *path,
+                sd_bus_message *reply,
                 bool show_properties,
                 bool *new_line,
                 bool *ellipsized) {
 
-        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
         _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
         UnitStatusInfo info = {
                 .memory_current = (uint64_t) -1,
@@ -4215,21 +4199,11 @@ static int show_one(
         ExecStatusInfo *p;
         int r;
 
-        assert(path);
+        assert(reply);
         assert(new_line);
 
-        log_debug("Showing one %s", path);
-
-        r = sd_bus_call_method(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.DBus.Properties",
-                        "GetAll",
-                        &error,
-                        &reply,
-                        "s", "");
-        if (r < 0) {
+        if (sd_bus_message_is_method_error(reply, NULL)) {
+                r = sd_bus_error_copy(&error, sd_bus_message_get_error(reply));
                 log_error("Failed to get properties: %s", bus_error_message(&error, r));
                 return r;
         }
@@ -4317,6 +4291,88 @@ static int show_one(
         return r;
 }
 
+static int show_one(
+                const char *verb,
+                sd_bus *bus,
+                const char *path,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
+        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        assert(path);
+
+        log_debug("Showing one %s", path);
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        &error,
+                        &reply,
+                        "s", "");
+        if (r < 0) {
+                log_error("Failed to get properties: %s", bus_error_message(&error, r));
+                return r;
+        }
+
+        return show_one_reply(verb, reply, show_properties, new_line, ellipsized);
+}
+
+#define SHOW_CHUNK_MAX 256U
+
+static int show_many(
+                const char *verb,
+                sd_bus *bus,
+                char **paths,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        unsigned n, i, j;
+        int r, ret = 0;
+
+        /* Fetch the properties of a chunk of objects at a time, with
+         * the GetAll() calls pipelined, instead of waiting for a full
+         * round trip for each object. */
+
+        n = strv_length(paths);
+
+        for (i = 0; i < n; i += SHOW_CHUNK_MAX) {
+                char *chunk[SHOW_CHUNK_MAX + 1];
+                sd_bus_message **replies = NULL;
+                unsigned k;
+
+                k = MIN(n - i, SHOW_CHUNK_MAX);
+                memcpy(chunk, paths + i, k * sizeof(char*));
+                chunk[k] = NULL;
+
+                r = bus_get_all_properties_many(bus, "org.freedesktop.systemd1", chunk, NULL, &replies);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get properties: %m");
+
+                for (j = 0; j < k; j++) {
+                        log_debug("Showing one %s", chunk[j]);
+
+                        r = show_one_reply(verb, replies[j], show_properties, new_line, ellipsized);
+                        if (r < 0) {
+                                bus_message_unref_many(replies, k);
+                                return r;
+                        } else if (r > 0 && ret == 0)
+                                ret = r;
+                }
+
+                bus_message_unref_many(replies, k);
+        }
+
+        return ret;
+}
+
 static int get_unit_dbus_path_by_pid(
                 sd_bus *bus,
                 uint32_t pid,
@@ -4362,9 +4418,10 @@ static int show_all(
 
         _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
+        _cleanup_strv_free_ char **paths = NULL;
         const UnitInfo *u;
         unsigned c;
-        int r, ret = 0;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -4376,21 +4433,17 @@ static int show_all(
 
         qsort_safe(unit_infos, c, sizeof(UnitInfo), compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
+        paths = new0(char*, c + 1);
+        if (!paths)
+                return log_oom();
 
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
+        for (u = unit_infos; u < unit_infos + c; u++) {
+                paths[u - unit_infos] = unit_dbus_path_from_name(u->id);
+                if (!paths[u - unit_infos])
                         return log_oom();
-
-                r = show_one(verb, bus, p, show_properties, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
         }
 
-        return ret;
+        return show_many(verb, bus, paths, show_properties, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -4478,10 +4531,11 @@ static int show(sd_bus *bus, char **args) {
                         ret = show_all(args[0], bus, false, &new_line, &ellipsized);
         } else {
                 _cleanup_free_ char **patterns = NULL;
+                _cleanup_strv_free_ char **paths = NULL;
                 char **name;
 
                 STRV_FOREACH(name, args + 1) {
-                        _cleanup_free_ char *unit = NULL;
+                        char *unit = NULL;
                         uint32_t id;
 
                         if (safe_atou32(*name, &id) < 0) {
@@ -4503,12 +4557,9 @@ static int show(sd_bus *bus, char **args) {
                                 }
                         }
 
-                        r = show_one(args[0], bus, unit, show_properties,
-                                     &new_line, &ellipsized);
+                        r = strv_consume(&paths, unit);
                         if (r < 0)
-                                return r;
-                        else if (r > 0 && ret == 0)
-                                ret = r;
+                                return log_oom();
                 }
 
                 if (!strv_isempty(patterns)) {
@@ -4519,20 +4570,23 @@ static int show(sd_bus *bus, char **args) {
                                 log_error_errno(r, "Failed to expand names: %m");
 
                         STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *unit;
+                                char *unit;
 
                                 unit = unit_dbus_path_from_name(*name);
                                 if (!unit)
                                         return log_oom();
 
-                                r = show_one(args[0], bus, unit, show_properties,
-                                             &new_line, &ellipsized);
+                                r = strv_consume(&paths, unit);
                                 if (r < 0)
-                                        return r;
-                                else if (r > 0 && ret == 0)
-                                        ret = r;
+                                        return log_oom();
                         }
                 }
+
+                r = show_many(args[0], bus, paths, show_properties, &new_line, &ellipsized);
+                if (r < 0)
+                        return r;
+                else if (r > 0 && ret == 0)
+                        ret = r;
         }
 
         if (ellipsized && !arg_quiet)
@@ -4817,6 +4871,7 @@ static int daemon_reload(sd_bus *bus, char **args) {
                         streq(args[0], "reboot")        ? "Reboot" :
                         streq(args[0], "kexec")         ? "KExec" :
                         streq(args[0], "exit")          ? "Exit" :
+                        arg_incremental                 ? "ReloadIncremental" :
                                     /* "daemon-reload" */ "Reload";
         }
 
@@ -6018,6 +6073,8 @@ static void systemctl_help(void) {
                "                              short-precise, short-monotonic, verbose,\n"
                "                              export, json, json-pretty, json-sse, cat)\n"
                "     --firmware-setup Tell the firmware to show the setup menu on next boot\n"
+               "     --incremental    With daemon-reload, only reload units whose\n"
+               "                      configuration changed\n"
                "     --plain          Print unit dependencies as a list instead of a tree\n\n"
                "Unit Commands:\n"
                "  list-units [PATTERN...]         List loaded units\n"
@@ -6198,6 +6255,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_JOB_MODE,
                 ARG_PRESET_MODE,
                 ARG_FIRMWARE_SETUP,
+                ARG_INCREMENTAL,
         };
 
         static const struct option options[] = {
@@ -6241,6 +6299,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "recursive",           no_argument,       NULL, 'r'                     },
                 { "preset-mode",         required_argument, NULL, ARG_PRESET_MODE         },
                 { "firmware-setup",      no_argument,       NULL, ARG_FIRMWARE_SETUP      },
+                { "incremental",         no_argument,       NULL, ARG_INCREMENTAL         },
                 {}
         };
 
@@ -6485,6 +6544,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_firmware_setup = true;
                         break;
 
+                case ARG_INCREMENTAL:
+                        arg_incremental = true;
+                        break;
+
                 case ARG_STATE: {
                         const char *word, *state;
                         size_t size;
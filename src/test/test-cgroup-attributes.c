@@ -0,0 +1,240 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "manager.h"
+#include "cgroup-util.h"
+#include "event-util.h"
+#include "strv.h"
+#include "fileio.h"
+#include "time-util.h"
+#include "test-synthetic.h"
+
+/* Starts many slices with resource settings in one parent slice,
+ * reloads the manager, and starts one more slice in the same parent,
+ * which makes all its siblings realized again. Counts the write
+ * syscalls that takes, and checks that the attributes in the cgroup
+ * tree are right, also after a cgroup was removed and created
+ * again. Needs to be allowed to create cgroups. */
+
+static unsigned arg_n_units = SYNTHETIC_N_UNITS(100, 5000);
+
+static void make_unit_dir(const char *dir) {
+        unsigned i;
+
+        for (i = 0; i <= arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18], contents[LINE_MAX];
+
+                if (i < arg_n_units)
+                        xsprintf(name, "bench-%u.slice", i);
+                else
+                        xsprintf(name, "%s", "bench-late.slice");
+
+                xsprintf(contents,
+                         "[Unit]\n"
+                         "DefaultDependencies=no\n"
+                         "[Slice]\n"
+                         "CPUShares=%u\n"
+                         "BlockIOWeight=%u\n"
+                         "MemoryLimit=%uM\n"
+                         "DeviceAllow=/dev/null rw\n",
+                         100 + i % 100, 100 + i % 900, 100 + i % 100);
+
+                synthetic_write_unit(dir, name, contents, 0);
+        }
+
+        synthetic_write_unit(dir, "bench.slice",
+                             "[Unit]\n"
+                             "DefaultDependencies=no\n", 0);
+}
+
+static uint64_t write_syscalls(void) {
+        _cleanup_free_ char *s = NULL;
+        uint64_t n;
+        char *p;
+
+        assert_se(read_full_file("/proc/self/io", &s, NULL) >= 0);
+
+        p = strstr(s, "syscw:");
+        assert_se(p);
+        assert_se(sscanf(p, "syscw: %" SCNu64, &n) == 1);
+
+        return n;
+}
+
+static int on_post(sd_event_source *s, void *userdata) {
+        Manager *m = userdata;
+
+        if (hashmap_isempty(m->jobs) && !m->cgroup_queue)
+                m->exit_code = MANAGER_EXIT;
+
+        return 0;
+}
+
+static void run(Manager *m) {
+        _cleanup_event_source_unref_ sd_event_source *post = NULL;
+
+        assert_se(sd_event_add_post(m->event, &post, on_post, m) >= 0);
+        assert_se(manager_loop(m) == MANAGER_EXIT);
+}
+
+static void start_unit(Manager *m, const char *name, JobType type) {
+        Unit *u;
+        Job *j;
+
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        assert_se(manager_add_job(m, type, u, JOB_REPLACE, false, NULL, &j) == 0);
+}
+
+static void assert_cpu_shares(Manager *m, const char *name, unsigned long shares) {
+        _cleanup_free_ char *v = NULL;
+        unsigned long k;
+        Unit *u;
+
+        u = manager_get_unit(m, name);
+        assert_se(u);
+        assert_se(u->cgroup_path);
+
+        assert_se(cg_get_attribute("cpu", u->cgroup_path, "cpu.shares", &v) >= 0);
+        assert_se(safe_atolu(v, &k) >= 0);
+        assert_se(k == shares);
+}
+
+int main(int argc, char *argv[]) {
+        char ts[FORMAT_TIMESPAN_MAX], tr[FORMAT_TIMESPAN_MAX], tl[FORMAT_TIMESPAN_MAX];
+        uint64_t n_start, n_late;
+        usec_t t_start, t_reload, t_late;
+        CGroupContext *c;
+        Manager *m;
+        unsigned i;
+        char *dir;
+        Unit *u;
+
+        if (access("/proc/self/io", R_OK) < 0) {
+                printf("Skipping test: /proc/self/io: %m\n");
+                return EXIT_TEST_SKIP;
+        }
+
+        if (synthetic_setup("test-cgroup-attributes", argc, argv, &arg_n_units, make_unit_dir, &dir) < 0)
+                return EXIT_TEST_SKIP;
+
+        m = synthetic_manager_new();
+
+        start_unit(m, "bench.slice", JOB_START);
+        run(m);
+
+        u = manager_get_unit(m, "bench.slice");
+        if (!u->cgroup_realized || (m->cgroup_supported & CGROUP_CPU) == 0) {
+                printf("Skipping test: cannot create cgroups with the cpu controller\n");
+                manager_free(m);
+                synthetic_cleanup(dir);
+                return EXIT_TEST_SKIP;
+        }
+
+        /* Keep the "Looping too fast" messages out of the counts */
+        log_set_max_level(LOG_ERR);
+
+        n_start = write_syscalls();
+        t_start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18];
+
+                xsprintf(name, "bench-%u.slice", i);
+                start_unit(m, name, JOB_START);
+        }
+        run(m);
+        t_start = now(CLOCK_MONOTONIC) - t_start;
+        n_start = write_syscalls() - n_start;
+
+        /* After a reload no cgroup is known to be realized, and
+         * starting another slice realizes all its siblings
+         * again. Their attributes are all in place already. */
+        t_reload = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload(m) >= 0);
+        t_reload = now(CLOCK_MONOTONIC) - t_reload;
+
+        n_late = write_syscalls();
+        t_late = now(CLOCK_MONOTONIC);
+        start_unit(m, "bench-late.slice", JOB_START);
+        run(m);
+        t_late = now(CLOCK_MONOTONIC) - t_late;
+        n_late = write_syscalls() - n_late;
+
+        log_set_max_level(LOG_INFO);
+        log_info("Starting %u slices took %s and %" PRIu64 " write syscalls, "
+                 "reloading %s, starting one more slice %s and %" PRIu64 " write syscalls.",
+                 arg_n_units,
+                 format_timespan(ts, sizeof(ts), t_start, USEC_PER_MSEC), n_start,
+                 format_timespan(tr, sizeof(tr), t_reload, USEC_PER_MSEC),
+                 format_timespan(tl, sizeof(tl), t_late, USEC_PER_MSEC), n_late);
+
+        /* Only the new slice got its attributes written */
+        assert_se(n_start >= arg_n_units * 3);
+        assert_se(n_late <= 2 * n_start / arg_n_units);
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18];
+
+                xsprintf(name, "bench-%u.slice", i);
+                u = manager_get_unit(m, name);
+                assert_se(u->cgroup_realized);
+        }
+        assert_cpu_shares(m, "bench-1.slice", 101);
+        assert_cpu_shares(m, "bench-late.slice", 100 + arg_n_units % 100);
+
+        /* A changed value is written */
+        u = manager_get_unit(m, "bench-2.slice");
+        c = unit_get_cgroup_context(u);
+        c->cpu_shares = 2000;
+        u->cgroup_realized_mask &= ~CGROUP_CPU;
+        assert_se(unit_realize_cgroup(u) >= 0);
+        assert_cpu_shares(m, "bench-2.slice", 2000);
+
+        /* A cgroup that was removed gets all attributes again */
+        start_unit(m, "bench-1.slice", JOB_STOP);
+        run(m);
+        u = manager_get_unit(m, "bench-1.slice");
+        assert_se(!u || !u->cgroup_path);
+        start_unit(m, "bench-1.slice", JOB_START);
+        run(m);
+        assert_cpu_shares(m, "bench-1.slice", 101);
+
+        /* Slices don't take their members down with them */
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18];
+
+                xsprintf(name, "bench-%u.slice", i);
+                start_unit(m, name, JOB_STOP);
+        }
+        start_unit(m, "bench-late.slice", JOB_STOP);
+        run(m);
+
+        start_unit(m, "bench.slice", JOB_STOP);
+        run(m);
+        u = manager_get_unit(m, "bench.slice");
+        assert_se(!u || !u->cgroup_path);
+
+        manager_free(m);
+        synthetic_cleanup(dir);
+
+        return 0;
+}
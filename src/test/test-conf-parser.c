@@ -0,0 +1,176 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "conf-parser.h"
+#include "fileio.h"
+#include "rm-rf.h"
+#include "strv.h"
+#include "util.h"
+
+static char *setting_a = NULL;
+static char **setting_list = NULL;
+
+static const ConfigTableItem items[] = {
+        { "Section", "A",    config_parse_string, 0, &setting_a    },
+        { "Section", "List", config_parse_strv,   0, &setting_list },
+        {}
+};
+
+static void reset(void) {
+        free(setting_a);
+        setting_a = NULL;
+        strv_free(setting_list);
+        setting_list = NULL;
+}
+
+static void write_file(const char *dir, const char *name, const char *contents) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, contents) >= 0);
+}
+
+static int parse(const char *dir, const char *name, bool allow_include) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+
+        return config_parse(NULL, p, NULL, "Section\0", config_item_table_lookup, items, false, allow_include, false, NULL);
+}
+
+static void test_config_parse(const char *dir) {
+        write_file(dir, "simple.conf",
+                   "# comment\n"
+                   "[Section]\n"
+                   "  A =  foo bar  \n"
+                   "List=a \\\n"
+                   "b\\\n"
+                   "c\n"
+                   "Unknown=1\n"
+                   "[Other]\n"
+                   "A=ignored\n");
+        assert_se(parse(dir, "simple.conf", false) == 0);
+        assert_se(streq_ptr(setting_a, "foo bar"));
+        assert_se(strv_equal(setting_list, STRV_MAKE("a", "b", "c")));
+        reset();
+
+        write_file(dir, "include.conf",
+                   "[Section]\n"
+                   "A=before\n"
+                   ".include simple.conf\n"
+                   "List=d\n");
+        assert_se(parse(dir, "include.conf", true) == 0);
+        assert_se(streq_ptr(setting_a, "foo bar"));
+        assert_se(strv_equal(setting_list, STRV_MAKE("a", "b", "c", "d")));
+        reset();
+
+        /* Includes are ignored where not allowed, as are missing
+         * included files */
+        assert_se(parse(dir, "include.conf", false) == 0);
+        assert_se(streq_ptr(setting_a, "before"));
+        reset();
+
+        write_file(dir, "missing.conf",
+                   "[Section]\n"
+                   ".include nonexistent.conf\n"
+                   "A=after\n");
+        assert_se(parse(dir, "missing.conf", true) == 0);
+        assert_se(streq_ptr(setting_a, "after"));
+        reset();
+
+        /* Parsing stops at the first bad line */
+        write_file(dir, "bad.conf",
+                   "[Section]\n"
+                   "A=first\n"
+                   "garbage\n"
+                   "A=second\n");
+        assert_se(parse(dir, "bad.conf", false) == -EBADMSG);
+        assert_se(streq_ptr(setting_a, "first"));
+        reset();
+
+        write_file(dir, "bad-section.conf",
+                   "[Section\n"
+                   "A=first\n");
+        assert_se(parse(dir, "bad-section.conf", false) == -EBADMSG);
+        assert_se(!setting_a);
+
+        /* Lines without '=' outside of any section are ignored */
+        write_file(dir, "outside.conf",
+                   "garbage\n"
+                   "[Section]\n"
+                   "A=first\n");
+        assert_se(parse(dir, "outside.conf", false) == 0);
+        assert_se(streq_ptr(setting_a, "first"));
+        reset();
+
+        assert_se(parse(dir, "nonexistent.conf", false) == 0);
+}
+
+static void test_config_file_load_many(const char *dir) {
+        _cleanup_strv_free_ char **paths = NULL;
+        ConfigFile **files = NULL;
+        unsigned i, n_threads;
+        const char *p;
+
+        p = strjoina(dir, "/link.conf");
+        assert_se(symlink("simple.conf", p) >= 0);
+
+        assert_se(strv_extend(&paths, strjoina(dir, "/simple.conf")) >= 0);
+        assert_se(strv_extend(&paths, strjoina(dir, "/include.conf")) >= 0);
+        assert_se(strv_extend(&paths, strjoina(dir, "/nonexistent.conf")) >= 0);
+        assert_se(strv_extend(&paths, p) >= 0);
+        assert_se(strv_extend(&paths, dir) >= 0);
+
+        for (n_threads = 1; n_threads <= 4; n_threads++) {
+                assert_se(config_file_load_many(paths, true, n_threads, &files) >= 0);
+
+                /* Missing files, symlinks and directories are
+                 * skipped */
+                assert_se(files[0] && files[1]);
+                assert_se(!files[2] && !files[3] && !files[4]);
+
+                assert_se(streq(config_file_get_filename(files[1]), paths[1]));
+                assert_se(config_file_apply(NULL, files[1], "Section\0", config_item_table_lookup, items, false, true, NULL) == 0);
+                assert_se(streq_ptr(setting_a, "foo bar"));
+                assert_se(strv_equal(setting_list, STRV_MAKE("a", "b", "c", "d")));
+                reset();
+
+                for (i = 0; i < strv_length(paths); i++)
+                        config_file_free(files[i]);
+                free(files);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        char dir[] = "/tmp/test-conf-parser.XXXXXX";
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        test_config_parse(dir);
+        test_config_file_load_many(dir);
+
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
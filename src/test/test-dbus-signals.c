@@ -0,0 +1,285 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "manager.h"
+#include "dbus.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "event-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "test-synthetic.h"
+
+/* Starts a target that pulls in many others and restarts it a few
+ * times in a row, and counts the signals and bytes the manager sends
+ * on a private bus connection meanwhile, with and without coalescing
+ * and the UnitsChanged signal. */
+
+static unsigned arg_n_units = SYNTHETIC_N_UNITS(100, 5000);
+static unsigned arg_n_restarts = 3;
+
+typedef struct Counter {
+        Manager *manager;
+        sd_bus *client;
+        Unit *all;
+        unsigned n_restarts;
+
+        unsigned n_signals;
+        unsigned n_units_changed;
+        size_t n_bytes;
+
+        /* unit name → last active state seen in UnitsChanged */
+        Hashmap *states;
+} Counter;
+
+static void make_unit_dir(const char *dir) {
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *p;
+        unsigned i;
+
+        p = strjoina(dir, "/all.target");
+        f = fopen(p, "we");
+        assert_se(f);
+
+        fputs("[Unit]\n"
+              "DefaultDependencies=no\n", f);
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18], contents[LINE_MAX];
+
+                xsprintf(name, "synthetic-%u.target", i);
+
+                /* Some ordering, so that not all units change in
+                 * the same main loop iteration */
+                if (i >= 10)
+                        xsprintf(contents,
+                                 "[Unit]\n"
+                                 "DefaultDependencies=no\n"
+                                 "PartOf=all.target\n"
+                                 "After=synthetic-%u.target\n", i / 10);
+                else
+                        xsprintf(contents, "%s",
+                                 "[Unit]\n"
+                                 "DefaultDependencies=no\n"
+                                 "PartOf=all.target\n");
+
+                synthetic_write_unit(dir, name, contents, 0);
+
+                fprintf(f, "Wants=%s\n", name);
+        }
+
+        assert_se(fflush(f) == 0);
+}
+
+static int on_message(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Counter *c = userdata;
+        const char *id, *load, *active, *sub, *path;
+        int r;
+
+        if (!sd_bus_message_is_signal(m, NULL, NULL))
+                return 0;
+
+        c->n_signals++;
+        c->n_bytes += BUS_MESSAGE_SIZE(m);
+
+        if (!sd_bus_message_is_signal(m, "org.freedesktop.systemd1.Manager", "UnitsChanged"))
+                return 0;
+
+        c->n_units_changed++;
+
+        assert_se(sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "(sosss)") > 0);
+        while ((r = sd_bus_message_read(m, "(sosss)", &id, &path, &load, &active, &sub)) > 0) {
+                char *k, *v;
+
+                assert_se(streq(load, "loaded"));
+
+                v = strdup(active);
+                assert_se(v);
+
+                free(hashmap_remove2(c->states, id, (void**) &k));
+                free(k);
+
+                k = strdup(id);
+                assert_se(k);
+                assert_se(hashmap_put(c->states, k, v) > 0);
+        }
+        assert_se(r == 0);
+
+        return 0;
+}
+
+static bool all_sent(Counter *c) {
+        Manager *m = c->manager;
+        Iterator i;
+        sd_bus *b;
+        int n = 0;
+
+        if (!hashmap_isempty(m->jobs) ||
+            m->dbus_unit_queue ||
+            m->dbus_job_queue ||
+            m->dbus_coalesce_event_source ||
+            !set_isempty(m->dbus_units_changed))
+                return false;
+
+        SET_FOREACH(b, m->private_buses, i)
+                if (b->wqueue_size > 0)
+                        return false;
+
+        if (c->client->rqueue_size > 0)
+                return false;
+
+        assert_se(ioctl(sd_bus_get_fd(c->client), FIONREAD, &n) >= 0);
+        return n == 0;
+}
+
+static int on_post(sd_event_source *s, void *userdata) {
+        Counter *c = userdata;
+        Job *j;
+
+        /* Restart everything as soon as the previous job is done */
+        if (c->n_restarts > 0 && hashmap_isempty(c->manager->jobs)) {
+                assert_se(manager_add_job(c->manager, JOB_RESTART, c->all, JOB_REPLACE, false, NULL, &j) == 0);
+                c->n_restarts--;
+                return 0;
+        }
+
+        if (c->n_restarts == 0 && all_sent(c))
+                c->manager->exit_code = MANAGER_EXIT;
+
+        return 0;
+}
+
+static void test_signals(usec_t coalesce, bool units_changed, Counter *ret) {
+        _cleanup_event_source_unref_ sd_event_source *post = NULL;
+        char ts[FORMAT_TIMESPAN_MAX], tc[FORMAT_TIMESPAN_MAX];
+        int pair[2];
+        Counter c = {};
+        sd_bus *server;
+        Manager *m;
+        Unit *u;
+        Job *j;
+        usec_t t;
+        int r, q;
+
+        m = synthetic_manager_new();
+
+        m->dbus_coalesce_usec = coalesce;
+        m->send_units_changed = units_changed;
+
+        c.manager = m;
+        c.states = hashmap_new(&string_hash_ops);
+        assert_se(c.states);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(bus_add_private_connection(m, pair[0]) >= 0);
+
+        assert_se(sd_bus_new(&c.client) >= 0);
+        assert_se(sd_bus_set_fd(c.client, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_start(c.client) >= 0);
+        assert_se(sd_bus_add_filter(c.client, NULL, on_message, &c) >= 0);
+        assert_se(sd_bus_attach_event(c.client, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        /* The client sends everything up to BEGIN in one go, and
+         * the server needs another nudge to act on the rest of it
+         * once it sent its replies */
+        server = set_first(m->private_buses);
+        assert_se(server);
+
+        while (server->state != BUS_RUNNING || c.client->state != BUS_RUNNING) {
+                r = sd_bus_process(server, NULL);
+                assert_se(r >= 0);
+                q = sd_bus_process(c.client, NULL);
+                assert_se(q >= 0);
+
+                if (r == 0 && q == 0)
+                        assert_se(sd_event_run(m->event, USEC_PER_SEC) >= 0);
+        }
+
+        assert_se(manager_load_unit(m, "all.target", NULL, NULL, &u) >= 0);
+        c.all = u;
+        c.n_restarts = arg_n_restarts;
+        assert_se(sd_event_add_post(m->event, &post, on_post, &c) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, false, NULL, &j) == 0);
+        assert_se(manager_loop(m) == MANAGER_EXIT);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Coalescing %s, UnitsChanged %s: %u signals, %zu bytes, took %s.",
+                 coalesce > 0 ? format_timespan(tc, sizeof(tc), coalesce, 0) : "off",
+                 units_changed ? "on" : "off",
+                 c.n_signals, c.n_bytes,
+                 format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC));
+
+        assert_se(unit_active_state(u) == UNIT_ACTIVE);
+
+        if (units_changed) {
+                unsigned i;
+
+                /* Every unit was reported, and the last thing we
+                 * heard about it is that it is active */
+                assert_se(c.n_units_changed > 0);
+                for (i = 0; i < arg_n_units; i++) {
+                        char name[DECIMAL_STR_MAX(unsigned) + 18];
+
+                        xsprintf(name, "synthetic-%u.target", i);
+                        assert_se(streq_ptr(hashmap_get(c.states, name), "active"));
+                }
+        } else
+                assert_se(c.n_units_changed == 0);
+
+        post = sd_event_source_unref(post);
+        sd_bus_flush(c.client);
+        sd_bus_close(c.client);
+        c.client = sd_bus_unref(c.client);
+        hashmap_free_free_free(c.states);
+        c.states = NULL;
+        c.manager = NULL;
+
+        manager_free(m);
+
+        *ret = c;
+}
+
+int main(int argc, char *argv[]) {
+        Counter plain, coalesced, aggregated;
+        char *dir;
+
+        if (synthetic_setup("test-dbus-signals", argc, argv, &arg_n_units, make_unit_dir, &dir) < 0)
+                return EXIT_TEST_SKIP;
+
+        test_signals(0, false, &plain);
+        test_signals(500 * USEC_PER_MSEC, false, &coalesced);
+        test_signals(500 * USEC_PER_MSEC, true, &aggregated);
+
+        /* With many units, the manager queues more signals than it
+         * may and drops some, hence only compare the bytes */
+        assert_se(coalesced.n_bytes < plain.n_bytes);
+        assert_se(aggregated.n_units_changed > 0);
+
+        synthetic_cleanup(dir);
+
+        return 0;
+}
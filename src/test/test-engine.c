@@ -24,7 +24,89 @@
 #include <string.h>
 
 #include "manager.h"
+#include "target.h"
 #include "bus-util.h"
+#include "time-util.h"
+
+/* A synthetic graph of targets, each wanting and ordered after a
+ * handful of children, with the children of each target ordered in a
+ * chain, and all of them pulling in a few shared targets, much like
+ * everything pulls in basic.target, and a unit that does not exist. */
+
+#define N_SHARED 16
+
+static Unit *bench_unit(Manager *m, const char *prefix, unsigned i) {
+        char name[DECIMAL_STR_MAX(unsigned) + 21];
+        Unit *u;
+
+        xsprintf(name, "bench-%s%u.target", prefix, i);
+
+        u = manager_get_unit(m, name);
+        if (u)
+                return u;
+
+        u = unit_new(m, sizeof(Target));
+        assert_se(u);
+        assert_se(unit_add_name(u, name) >= 0);
+        u->load_state = UNIT_LOADED;
+        u->allow_isolate = true;
+
+        return u;
+}
+
+static void bench_transactions(Manager *m, unsigned n_units) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i, k;
+        Unit *root, *missing;
+        usec_t t;
+        Job *j;
+
+        missing = bench_unit(m, "missing-", 0);
+        missing->load_state = UNIT_NOT_FOUND;
+        missing->load_error = -ENOENT;
+
+        for (i = 1; i < n_units; i++) {
+                Unit *u, *parent;
+
+                u = bench_unit(m, "", i);
+                parent = bench_unit(m, "", (i - 1) / 8);
+
+                assert_se(unit_add_two_dependencies(parent, UNIT_AFTER, i % 3 == 0 ? UNIT_REQUIRES : UNIT_WANTS, u, true) >= 0);
+
+                if ((i - 1) % 8 != 0)
+                        assert_se(unit_add_dependency(u, UNIT_AFTER, bench_unit(m, "", i - 1), true) >= 0);
+
+                for (k = 0; k < N_SHARED; k++)
+                        assert_se(unit_add_two_dependencies(u, UNIT_AFTER, UNIT_WANTS, bench_unit(m, "shared-", k), true) >= 0);
+
+                assert_se(unit_add_dependency(u, UNIT_WANTS, missing, true) >= 0);
+        }
+
+        root = bench_unit(m, "", 0);
+
+        for (k = 0; k < 3; k++) {
+                t = now(CLOCK_MONOTONIC);
+                assert_se(manager_add_job(m, JOB_START, root, JOB_REPLACE, false, NULL, &j) == 0);
+                t = now(CLOCK_MONOTONIC) - t;
+
+                assert_se(hashmap_size(m->jobs) == n_units + N_SHARED);
+                log_info("Starting %u units took %s.", n_units, format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC));
+
+                manager_clear_jobs(m);
+        }
+
+        /* Ordering cycles are found and broken */
+        assert_se(unit_add_dependency(bench_unit(m, "", n_units - 1), UNIT_AFTER, bench_unit(m, "", (n_units - 2) / 8), true) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, root, JOB_ISOLATE, false, NULL, &j) == 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(hashmap_size(m->jobs) < n_units + N_SHARED);
+        log_info("Isolating %u units with an ordering cycle took %s.", n_units, format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC));
+
+        manager_clear_jobs(m);
+}
 
 int main(int argc, char *argv[]) {
         _cleanup_bus_error_free_ sd_bus_error err = SD_BUS_ERROR_NULL;
@@ -106,6 +188,10 @@ int main(int argc, char *argv[]) {
         assert_se(manager_add_job(m, JOB_START, h, JOB_FAIL, false, NULL, &j) == 0);
         manager_dump_jobs(m, stdout, "\t");
 
+        printf("Benchmark:\n");
+        manager_clear_jobs(m);
+        bench_transactions(m, argc > 1 ? (unsigned) atoi(argv[1]) : 20000);
+
         manager_free(m);
 
         return 0;
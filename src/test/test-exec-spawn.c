@@ -0,0 +1,186 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "execute.h"
+#include "exit-status.h"
+#include "strv.h"
+#include "time-util.h"
+#include "util.h"
+
+/* Checks that the clone() and the fork() spawn paths behave the same,
+ * and measures how much CPU time we spend spawning many trivial
+ * commands while our own address space is large. Run as
+ * "test-exec-spawn 10000 256" for numbers closer to a big system. */
+
+static unsigned arg_n_spawns = 1000;
+static unsigned arg_heap_mb = 64;
+
+static int wait_for_exit_status(pid_t pid) {
+        siginfo_t si = {};
+
+        assert_se(wait_for_terminate(pid, &si) >= 0);
+        assert_se(si.si_code == CLD_EXITED);
+
+        return si.si_status;
+}
+
+static pid_t spawn(ExecCommand *command, ExecContext *context, int *fds, unsigned n_fds) {
+        ExecParameters params = {
+                .fds = fds,
+                .n_fds = n_fds,
+                .apply_permissions = true,
+                .apply_chroot = true,
+                .unit_id = "test-exec-spawn.service",
+                .bus_endpoint_fd = -1,
+        };
+        pid_t pid;
+
+        assert_se(exec_spawn(command, context, &params, NULL, &pid) >= 0);
+        assert_se(pid > 0);
+
+        return pid;
+}
+
+static void test_spawn(bool use_clone) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        ExecCommand command = {};
+        ExecContext context = {};
+        int fds[1];
+
+        log_info("/* %s(%s) */", __func__, use_clone ? "clone" : "fork");
+
+        exec_spawn_set_clone(use_clone);
+        exec_context_init(&context);
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+        fds[0] = pipe_fds[0];
+
+        /* Passed fds are moved to 3, LISTEN_PID must be the PID of
+         * the spawned process itself. Note that "$$" is expanded to
+         * "$" by us. */
+        context.environment = strv_new("FOO=bar", NULL);
+        context.working_directory = strdup("/proc");
+        assert_se(context.environment && context.working_directory);
+
+        assert_se(exec_command_set(&command, "/bin/sh", "-c",
+                                   "test \"$LISTEN_PID\" = $$$$ && "
+                                   "test \"$LISTEN_FDS\" = 1 && "
+                                   "test -e /proc/$$$$/fd/3 && "
+                                   "test \"$FOO\" = bar && "
+                                   "test \"$(pwd)\" = /proc",
+                                   NULL) >= 0);
+
+        assert_se(wait_for_exit_status(spawn(&command, &context, fds, 1)) == EXIT_SUCCESS);
+        assert_se(fds[0] == pipe_fds[0]);
+
+        /* Nothing else leaks into the child */
+        assert_se(exec_command_set(&command, "/bin/sh", "-c", "test ! -e /proc/$$$$/fd/3", NULL) >= 0);
+        assert_se(wait_for_exit_status(spawn(&command, &context, NULL, 0)) == EXIT_SUCCESS);
+
+        assert_se(exec_command_set(&command, "/bin/sh", "-c", "exit 7", NULL) >= 0);
+        assert_se(wait_for_exit_status(spawn(&command, &context, NULL, 0)) == 7);
+
+        /* Failures are reported through the exit status */
+        assert_se(exec_command_set(&command, "/nonexistent", NULL) >= 0);
+        assert_se(wait_for_exit_status(spawn(&command, &context, NULL, 0)) == EXIT_EXEC);
+
+        free(context.working_directory);
+        context.working_directory = strdup("/nonexistent");
+        assert_se(context.working_directory);
+        assert_se(exec_command_set(&command, "/bin/true", NULL) >= 0);
+        assert_se(wait_for_exit_status(spawn(&command, &context, NULL, 0)) == EXIT_CHDIR);
+
+        exec_command_done(&command);
+        exec_context_done(&context);
+}
+
+static usec_t rusage_cpu(void) {
+        struct rusage ru;
+
+        assert_se(getrusage(RUSAGE_SELF, &ru) >= 0);
+
+        return timeval_load(&ru.ru_utime) + timeval_load(&ru.ru_stime);
+}
+
+static void test_benchmark(bool use_clone) {
+        char ts[FORMAT_TIMESPAN_MAX], tc[FORMAT_TIMESPAN_MAX];
+        ExecCommand command = {};
+        ExecContext context = {};
+        usec_t t, c;
+        unsigned i;
+
+        exec_spawn_set_clone(use_clone);
+        exec_context_init(&context);
+        assert_se(exec_command_set(&command, "/bin/true", NULL) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        c = rusage_cpu();
+
+        for (i = 0; i < arg_n_spawns; i++)
+                assert_se(wait_for_exit_status(spawn(&command, &context, NULL, 0)) == EXIT_SUCCESS);
+
+        c = rusage_cpu() - c;
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%s: %u spawns with %u MiB heap took %s, %s CPU time in the parent.",
+                 use_clone ? "clone" : "fork",
+                 arg_n_spawns, arg_heap_mb,
+                 format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC),
+                 format_timespan(tc, sizeof(tc), c, USEC_PER_MSEC));
+
+        exec_command_done(&command);
+        exec_context_done(&context);
+}
+
+int main(int argc, char *argv[]) {
+        size_t heap_size;
+        void *heap;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_spawns) >= 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_heap_mb) >= 0);
+
+        test_spawn(false);
+        test_spawn(true);
+
+        /* Make our address space resemble that of a busy PID 1,
+         * whose heap consists of small allocations, hence avoid huge
+         * pages which would make fork() artificially cheap */
+        heap_size = MAX((size_t) arg_heap_mb * 1024 * 1024, page_size());
+        heap = mmap(NULL, heap_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        assert_se(heap != MAP_FAILED);
+        (void) madvise(heap, heap_size, MADV_NOHUGEPAGE);
+        memset(heap, 0x55, heap_size);
+
+        test_benchmark(false);
+        test_benchmark(true);
+
+        assert_se(munmap(heap, heap_size) >= 0);
+
+        return 0;
+}
@@ -19,6 +19,10 @@
 
 #include "util.h"
 #include "hashmap.h"
+#include "set.h"
+#include "strv.h"
+#include "log.h"
+#include "time-util.h"
 
 void test_hashmap_funcs(void);
 void test_ordered_hashmap_funcs(void);
@@ -77,7 +81,146 @@ static void test_string_compare_func(void) {
         assert_se(string_compare_func("fred", "fred") == 0);
 }
 
+enum {
+        BENCHMARK_INSERT,
+        BENCHMARK_LOOKUP,
+        BENCHMARK_MISS,
+        BENCHMARK_ITERATE,
+        BENCHMARK_REMOVE,
+        BENCHMARK_SET,
+        _BENCHMARK_MAX
+};
+
+static const char* const benchmark_names[_BENCHMARK_MAX] = {
+        [BENCHMARK_INSERT] = "insert",
+        [BENCHMARK_LOOKUP] = "lookup",
+        [BENCHMARK_MISS] = "miss",
+        [BENCHMARK_ITERATE] = "iterate",
+        [BENCHMARK_REMOVE] = "remove",
+        [BENCHMARK_SET] = "set",
+};
+
+static void test_hashmap_benchmark_one(const struct hash_ops *ops, void **keys, unsigned n_keys, unsigned n_maps, unsigned n_rounds, const char *name) {
+        _cleanup_free_ Hashmap **maps = NULL;
+        _cleanup_free_ Set **sets = NULL;
+        usec_t t, total[_BENCHMARK_MAX] = {};
+        unsigned i, j, k;
+
+        /* Operates on n_maps maps and sets with n_keys entries each,
+         * so that both tiny and large maps can be measured. The
+         * whole cycle is repeated n_rounds times. */
+
+        maps = new0(Hashmap*, n_maps);
+        sets = new0(Set*, n_maps);
+        assert_se(maps && sets);
+
+        for (k = 0; k < n_rounds; k++) {
+
+                for (j = 0; j < n_maps; j++) {
+                        maps[j] = hashmap_new(ops);
+                        sets[j] = set_new(ops);
+                        assert_se(maps[j] && sets[j]);
+                }
+
+                t = now(CLOCK_MONOTONIC);
+                for (j = 0; j < n_maps; j++)
+                        for (i = 0; i < n_keys; i++)
+                                assert_se(hashmap_put(maps[j], keys[i], keys[i]) == 1);
+                total[BENCHMARK_INSERT] += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (j = 0; j < n_maps; j++)
+                        for (i = 0; i < n_keys; i++)
+                                assert_se(hashmap_get(maps[j], keys[i]) == keys[i]);
+                total[BENCHMARK_LOOKUP] += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (j = 0; j < n_maps; j++)
+                        for (i = 0; i < n_keys; i++)
+                                assert_se(!hashmap_get(maps[j], keys[n_keys + i]));
+                total[BENCHMARK_MISS] += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (j = 0; j < n_maps; j++) {
+                        Iterator it;
+                        unsigned n = 0;
+                        void *v;
+
+                        HASHMAP_FOREACH(v, maps[j], it)
+                                n++;
+
+                        assert_se(n == n_keys);
+                }
+                total[BENCHMARK_ITERATE] += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (j = 0; j < n_maps; j++)
+                        for (i = 0; i < n_keys; i++)
+                                assert_se(hashmap_remove(maps[j], keys[i]) == keys[i]);
+                total[BENCHMARK_REMOVE] += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (j = 0; j < n_maps; j++)
+                        for (i = 0; i < n_keys; i++)
+                                assert_se(set_put(sets[j], keys[i]) == 1);
+                for (j = 0; j < n_maps; j++)
+                        for (i = 0; i < 2 * n_keys; i++)
+                                assert_se(set_contains(sets[j], keys[i]) == (i < n_keys));
+                total[BENCHMARK_SET] += now(CLOCK_MONOTONIC) - t;
+
+                for (j = 0; j < n_maps; j++) {
+                        assert_se(hashmap_isempty(maps[j]));
+                        assert_se(set_size(sets[j]) == n_keys);
+
+                        hashmap_free(maps[j]);
+                        set_free(sets[j]);
+                }
+        }
+
+        log_info("%u %s of %u entries, %s keys:", n_maps, n_maps > 1 ? "maps" : "map", n_keys, name);
+
+        for (i = 0; i < _BENCHMARK_MAX; i++) {
+                unsigned n = n_keys * n_maps * n_rounds * (i == BENCHMARK_SET ? 3 : 1);
+
+                log_info("        %-8s %6.1f ns/op", benchmark_names[i], (double) total[i] * 1000 / n);
+        }
+}
+
+static void test_hashmap_benchmark(unsigned n_rounds) {
+        _cleanup_strv_free_ char **strings = NULL;
+        void *pointers[2000];
+        unsigned i;
+
+        /* Twice as many keys as needed, the second half is used for
+         * lookups of absent keys */
+
+        strings = new0(char*, ELEMENTSOF(pointers) + 1);
+        assert_se(strings);
+
+        for (i = 0; i < ELEMENTSOF(pointers); i++) {
+                assert_se(asprintf(&strings[i], "unit-%u.service", i) >= 0);
+                pointers[i] = strings[i];
+        }
+
+        test_hashmap_benchmark_one(&string_hash_ops, (void**) strings, 1000, 1, n_rounds, "string");
+        test_hashmap_benchmark_one(&trivial_hash_ops, pointers, 1000, 1, n_rounds, "pointer");
+
+        /* Most maps in PID 1 only have a handful of entries */
+        test_hashmap_benchmark_one(&string_hash_ops, (void**) strings, 3, 100, n_rounds, "string");
+        test_hashmap_benchmark_one(&trivial_hash_ops, pointers, 3, 100, n_rounds, "pointer");
+        test_hashmap_benchmark_one(&string_hash_ops, (void**) strings, 8, 100, n_rounds, "string");
+        test_hashmap_benchmark_one(&trivial_hash_ops, pointers, 8, 100, n_rounds, "pointer");
+}
+
 int main(int argc, const char *argv[]) {
+        unsigned n_rounds = 100;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n_rounds) >= 0);
+
         test_hashmap_funcs();
         test_ordered_hashmap_funcs();
 
@@ -85,4 +228,6 @@ int main(int argc, const char *argv[]) {
         test_uint64_compare_func();
         test_trivial_compare_func();
         test_string_compare_func();
+
+        test_hashmap_benchmark(n_rounds);
 }
@@ -0,0 +1,230 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "log.h"
+#include "fileio.h"
+#include "time-util.h"
+#include "mount-table.h"
+
+/* Feeds synthetic mountinfo snapshots of a container host to the
+ * mount table, and checks which mount points it reports as
+ * changed. */
+
+static unsigned arg_n_mounts = 20000;
+
+typedef struct SyntheticMount {
+        int id;
+        char *where;
+        const char *options;
+        bool mounted;
+} SyntheticMount;
+
+static void write_snapshot(const char *path, SyntheticMount *mounts, unsigned n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i;
+
+        f = fopen(path, "we");
+        assert_se(f);
+
+        fputs("1 0 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n", f);
+
+        for (i = 0; i < n; i++) {
+                if (!mounts[i].mounted)
+                        continue;
+
+                fprintf(f,
+                        "%i 1 0:%u / %s %s shared:%u - overlay overlay rw,lowerdir=/var/lib/l%u,upperdir=/var/lib/u%u,workdir=/var/lib/w%u\n",
+                        mounts[i].id, 100 + i, mounts[i].where, mounts[i].options, i, i, i, i);
+        }
+
+        assert_se(fflush(f) == 0);
+        assert_se(!ferror(f));
+}
+
+static unsigned update(MountTable *t, const char *path, const char *what) {
+        _cleanup_(mnt_free_tablep) struct libmnt_table *tb = NULL;
+        _cleanup_set_free_free_ Set *changed = NULL;
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        usec_t t1, t2;
+        unsigned n;
+
+        tb = mnt_new_table();
+        assert_se(tb);
+
+        t1 = now(CLOCK_MONOTONIC);
+        assert_se(mnt_table_parse_file(tb, path) >= 0);
+        t2 = now(CLOCK_MONOTONIC);
+        assert_se(mount_table_update(t, tb, &changed) >= 0);
+        t2 = now(CLOCK_MONOTONIC) - t2;
+        t1 = now(CLOCK_MONOTONIC) - t1 - t2;
+
+        n = set_size(changed);
+
+        log_info("%-28s %6u mounts, %5u changed: parse %s, diff %s",
+                 what, mount_table_size(t), n,
+                 format_timespan(ts1, sizeof(ts1), t1, 1),
+                 format_timespan(ts2, sizeof(ts2), t2, 1));
+
+        return n;
+}
+
+static void test_churn(const char *path) {
+        _cleanup_(mount_table_freep) MountTable *t = NULL;
+        SyntheticMount *mounts;
+        int next_id;
+        unsigned i;
+
+        mounts = new0(SyntheticMount, arg_n_mounts);
+        assert_se(mounts);
+
+        for (i = 0; i < arg_n_mounts; i++) {
+                mounts[i].id = 100 + i;
+                assert_se(asprintf(&mounts[i].where, "/var/lib/containers/%u/merged", i) >= 0);
+                mounts[i].options = "rw,relatime";
+                mounts[i].mounted = i < arg_n_mounts - 100;
+        }
+        next_id = 100 + arg_n_mounts;
+
+        t = mount_table_new();
+        assert_se(t);
+
+        write_snapshot(path, mounts, arg_n_mounts);
+        assert_se(update(t, path, "initial") == arg_n_mounts - 100 + 1);
+        assert_se(mount_table_size(t) == arg_n_mounts - 100 + 1);
+
+        /* Nothing happened */
+        assert_se(update(t, path, "unchanged") == 0);
+
+        /* 100 containers stop, and 100 others start */
+        for (i = 0; i < 100; i++) {
+                mounts[arg_n_mounts - 200 + i].mounted = false;
+                mounts[arg_n_mounts - 100 + i].mounted = true;
+        }
+
+        write_snapshot(path, mounts, arg_n_mounts);
+        assert_se(update(t, path, "100 umounts, 100 mounts") == 200);
+        assert_se(mount_table_size(t) == arg_n_mounts - 100 + 1);
+        assert_se(!mount_table_get_by_where(t, mounts[arg_n_mounts - 200].where));
+        assert_se(mount_table_get_by_where(t, mounts[arg_n_mounts - 1].where));
+
+        /* Some containers are restarted, which mounts the same
+         * directory again with a new mount ID */
+        for (i = 1; i < 50; i++)
+                mounts[i].id = next_id++;
+
+        write_snapshot(path, mounts, arg_n_mounts);
+        assert_se(update(t, path, "49 remounts with new ID") == 49);
+
+        /* Some are remounted read-only */
+        for (i = 1; i < 11; i++)
+                mounts[i].options = "ro,relatime";
+
+        write_snapshot(path, mounts, arg_n_mounts);
+        assert_se(update(t, path, "10 remounts read-only") == 10);
+        assert_se(startswith(mount_table_get_by_where(t, mounts[1].where)->options, "ro,relatime"));
+        assert_se(startswith(mount_table_get_by_where(t, mounts[11].where)->options, "rw,relatime"));
+
+        /* One is moved elsewhere, which changes both the old and
+         * the new mount point */
+        free(mounts[2].where);
+        mounts[2].where = strdup("/var/lib/containers/moved/merged");
+        assert_se(mounts[2].where);
+
+        write_snapshot(path, mounts, arg_n_mounts);
+        assert_se(update(t, path, "1 moved") == 2);
+        assert_se(!mount_table_get_by_where(t, "/var/lib/containers/2/merged"));
+        assert_se(mount_table_get_by_where(t, mounts[2].where)->id == mounts[2].id);
+
+        assert_se(update(t, path, "unchanged") == 0);
+
+        for (i = 0; i < arg_n_mounts; i++)
+                free(mounts[i].where);
+        free(mounts);
+}
+
+static void test_stacked(const char *path) {
+        _cleanup_(mount_table_freep) MountTable *t = NULL;
+        MountTableEntry *e;
+
+        t = mount_table_new();
+        assert_se(t);
+
+        assert_se(write_string_file(path,
+                                    "1 0 8:1 / / rw - ext4 /dev/sda1 rw\n"
+                                    "20 1 8:2 / /mnt rw - ext4 /dev/sda2 rw\n"
+                                    "21 20 8:3 / /mnt rw - ext4 /dev/sda3 rw\n"
+                                    "22 1 0:30 / /with\\040space rw - tmpfs tmpfs rw\n") >= 0);
+        assert_se(update(t, path, "stacked") == 3);
+
+        /* The last one is visible */
+        e = mount_table_get_by_where(t, "/mnt");
+        assert_se(e);
+        assert_se(e->id == 21);
+        assert_se(streq(e->what, "/dev/sda3"));
+
+        e = mount_table_get_by_where(t, "/with space");
+        assert_se(e);
+        assert_se(e->id == 22);
+
+        /* Unmounting the top reveals the lower one again */
+        assert_se(write_string_file(path,
+                                    "1 0 8:1 / / rw - ext4 /dev/sda1 rw\n"
+                                    "20 1 8:2 / /mnt rw - ext4 /dev/sda2 rw\n"
+                                    "22 1 0:30 / /with\\040space rw - tmpfs tmpfs rw\n") >= 0);
+        assert_se(update(t, path, "stacked, top unmounted") == 1);
+
+        e = mount_table_get_by_where(t, "/mnt");
+        assert_se(e);
+        assert_se(e->id == 20);
+        assert_se(streq(e->what, "/dev/sda2"));
+
+        assert_se(write_string_file(path, "1 0 8:1 / / rw - ext4 /dev/sda1 rw\n") >= 0);
+        assert_se(update(t, path, "all unmounted") == 2);
+        assert_se(!mount_table_get_by_where(t, "/mnt"));
+        assert_se(!mount_table_get_by_where(t, "/with space"));
+        assert_se(mount_table_size(t) == 1);
+}
+
+int main(int argc, char *argv[]) {
+        char path[] = "/tmp/test-mount-table.XXXXXX";
+        int fd;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_mounts) >= 0);
+        assert_se(arg_n_mounts >= 1000);
+
+        fd = mkostemp_safe(path, O_RDWR|O_CLOEXEC);
+        assert_se(fd >= 0);
+        safe_close(fd);
+
+        test_stacked(path);
+        test_churn(path);
+
+        unlink(path);
+
+        return 0;
+}
@@ -22,9 +22,11 @@
 #include <stdlib.h>
 
 #include "util.h"
+#include "log.h"
 #include "set.h"
 #include "prioq.h"
 #include "siphash24.h"
+#include "time-util.h"
 
 #define SET_SIZE 1024*4
 
@@ -166,10 +168,237 @@ static void test_struct(void) {
         set_free(s);
 }
 
+static void drain(Prioq *q, unsigned n) {
+        unsigned previous = 0, i;
+
+        for (i = 0; i < n; i++) {
+                struct test *t;
+
+                assert_se(prioq_size(q) == n - i);
+
+                t = prioq_pop(q);
+                assert_se(t);
+
+                assert_se(previous <= t->value);
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
+static void test_put_many(void) {
+        struct test t[SET_SIZE];
+        void *data[SET_SIZE];
+        unsigned *idx[SET_SIZE];
+        unsigned i;
+        Prioq *q;
+
+        srand(0);
+
+        q = prioq_new(test_compare);
+        assert_se(q);
+
+        for (i = 0; i < SET_SIZE; i++) {
+                t[i].value = (unsigned) rand() % 1000;
+                data[i] = t + i;
+                idx[i] = &t[i].idx;
+        }
+
+        /* All at once, so that the heap is built bottom-up */
+        assert_se(prioq_put_many(q, data, idx, SET_SIZE) >= 0);
+        for (i = 0; i < SET_SIZE; i += 2)
+                assert_se(prioq_remove(q, t + i, &t[i].idx) > 0);
+        drain(q, SET_SIZE / 2);
+
+        /* A few more on top of a large queue */
+        assert_se(prioq_put_many(q, data, idx, SET_SIZE - 16) >= 0);
+        assert_se(prioq_put_many(q, data + SET_SIZE - 16, idx + SET_SIZE - 16, 16) >= 0);
+        for (i = 1; i < SET_SIZE; i += 2)
+                assert_se(prioq_remove(q, t + i, &t[i].idx) > 0);
+        drain(q, SET_SIZE / 2);
+
+        /* Without index pointers */
+        assert_se(prioq_put_many(q, data, NULL, SET_SIZE) >= 0);
+        assert_se(prioq_put_many(q, NULL, NULL, 0) >= 0);
+        drain(q, SET_SIZE);
+
+        prioq_free(q);
+}
+
+static void test_reshuffle(void) {
+        struct test t[SET_SIZE];
+        unsigned i;
+        Prioq *q;
+
+        srand(0);
+
+        q = prioq_new(test_compare);
+        assert_se(q);
+
+        for (i = 0; i < SET_SIZE; i++) {
+                t[i].value = (unsigned) rand() % 1000;
+                assert_se(prioq_put(q, t + i, &t[i].idx) >= 0);
+        }
+
+        for (i = 0; i < SET_SIZE * 16; i++) {
+                struct test *x;
+
+                x = t + rand() % SET_SIZE;
+
+                if (rand() % 2) {
+                        x->value = (unsigned) rand() % 1000;
+                        assert_se(prioq_reshuffle(q, x, &x->idx) > 0);
+                } else {
+                        x->value -= MIN(x->value, (unsigned) rand() % 100);
+                        assert_se(prioq_reshuffle_up(q, x, &x->idx) > 0);
+                }
+        }
+
+        /* Removal by index only works if all indexes are right */
+        for (i = 0; i < SET_SIZE; i += 2)
+                assert_se(prioq_remove(q, t + i, &t[i].idx) > 0);
+
+        drain(q, SET_SIZE / 2);
+        prioq_free(q);
+}
+
+/* Mimics how sd-event uses its queues: there are a few hundred
+ * sources, whose keys are changed far more often than the queue is
+ * popped. */
+
+struct source {
+        uint64_t key;
+        unsigned idx;
+};
+
+static int source_compare(const void *a, const void *b) {
+        const struct source *x = a, *y = b;
+
+        if (x->key < y->key)
+                return -1;
+        if (x->key > y->key)
+                return 1;
+
+        return 0;
+}
+
+static void log_benchmark(const char *name, unsigned n_ops, usec_t t) {
+        log_info("%-36s %8u ops %8.1f ns/op", name, n_ops, (double) t * NSEC_PER_USEC / MAX(n_ops, 1U));
+}
+
+static void test_benchmark(unsigned n_sources, unsigned n_rounds) {
+        _cleanup_free_ struct source *s = NULL;
+        _cleanup_free_ unsigned **idx = NULL;
+        _cleanup_free_ void **data = NULL;
+        unsigned i, n_ops;
+        Prioq *q;
+        usec_t t;
+
+        s = new0(struct source, n_sources);
+        data = new(void*, n_sources);
+        idx = new(unsigned*, n_sources);
+        assert_se(s && data && idx);
+
+        srand(0);
+
+        for (i = 0; i < n_sources; i++) {
+                s[i].key = (uint64_t) rand();
+                data[i] = s + i;
+                idx[i] = &s[i].idx;
+        }
+
+        q = prioq_new(source_compare);
+        assert_se(q);
+
+        t = now(CLOCK_MONOTONIC);
+        for (n_ops = 0; n_ops < n_rounds; n_ops++) {
+                for (i = 0; i < n_sources; i++)
+                        assert_se(prioq_put(q, s + i, &s[i].idx) >= 0);
+                while (prioq_pop(q))
+                        ;
+        }
+        log_benchmark("put one by one, pop all", n_ops * n_sources, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (n_ops = 0; n_ops < n_rounds; n_ops++) {
+                assert_se(prioq_put_many(q, data, idx, n_sources) >= 0);
+                while (prioq_pop(q))
+                        ;
+        }
+        log_benchmark("put many, pop all", n_ops * n_sources, now(CLOCK_MONOTONIC) - t);
+
+        assert_se(prioq_put_many(q, data, idx, n_sources) >= 0);
+
+        /* Like event_prepare(): the head is marked as prepared in this
+         * iteration and moves to the back */
+        t = now(CLOCK_MONOTONIC);
+        for (n_ops = 0; n_ops < n_rounds * n_sources; n_ops++) {
+                struct source *x;
+
+                x = prioq_peek(q);
+                x->key += UINT32_MAX;
+                assert_se(prioq_reshuffle(q, x, &x->idx) > 0);
+        }
+        log_benchmark("reshuffle head to back (prepare)", n_ops, now(CLOCK_MONOTONIC) - t);
+
+        /* Like rescheduling timers: keys change randomly, and a few
+         * elapse */
+        t = now(CLOCK_MONOTONIC);
+        for (n_ops = 0; n_ops < n_rounds * n_sources; n_ops++) {
+                struct source *x;
+
+                x = s + rand() % n_sources;
+                x->key = (x->key & ~(uint64_t) UINT32_MAX) + (unsigned) rand();
+                assert_se(prioq_reshuffle(q, x, &x->idx) > 0);
+
+                if (n_ops % 64 == 0) {
+                        x = prioq_pop(q);
+                        assert_se(prioq_put(q, x, &x->idx) >= 0);
+                }
+        }
+        log_benchmark("reshuffle random (timers)", n_ops, now(CLOCK_MONOTONIC) - t);
+
+        /* Like enabling sources: keys only decrease, mostly without
+         * the source moving */
+        t = now(CLOCK_MONOTONIC);
+        for (n_ops = 0; n_ops < n_rounds * n_sources; n_ops++) {
+                struct source *x;
+
+                x = s + rand() % n_sources;
+                x->key -= MIN(x->key, 1U);
+                assert_se(prioq_reshuffle(q, x, &x->idx) > 0);
+        }
+        log_benchmark("reshuffle decreased", n_ops, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (n_ops = 0; n_ops < n_rounds * n_sources; n_ops++) {
+                struct source *x;
+
+                x = s + rand() % n_sources;
+                x->key -= MIN(x->key, 1U);
+                assert_se(prioq_reshuffle_up(q, x, &x->idx) > 0);
+        }
+        log_benchmark("reshuffle_up decreased", n_ops, now(CLOCK_MONOTONIC) - t);
+
+        prioq_free(q);
+}
+
 int main(int argc, char* argv[]) {
+        unsigned n_rounds = 100;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n_rounds) >= 0);
 
         test_unsigned();
         test_struct();
+        test_put_many();
+        test_reshuffle();
+
+        test_benchmark(512, n_rounds);
 
         return 0;
 }
@@ -0,0 +1,305 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "manager.h"
+#include "socket.h"
+#include "strv.h"
+#include "time-util.h"
+#include "test-synthetic.h"
+
+/* Changes a few unit files in various ways, and checks that an
+ * incremental reload ends up with the same units and dependencies
+ * as a full reload of a second manager that had loaded the same
+ * units before. */
+
+static unsigned arg_n_units = SYNTHETIC_N_UNITS(100, 1000);
+
+static const char* const names[] = {
+        "a.service",
+        "c.service",
+        "e.socket",
+        "f.service",
+        "t.target",
+};
+
+static void make_unit_dir(const char *dir) {
+        const char *p;
+        unsigned i;
+
+        synthetic_write_unit(dir, "a.service",
+                   "[Unit]\n"
+                   "Description=A\n"
+                   "Wants=b.service g.service\n"
+                   "After=b.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n", USEC_PER_HOUR);
+
+        synthetic_write_unit(dir, "b.service",
+                   "[Unit]\n"
+                   "Description=B\n"
+                   "Wants=old.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n", USEC_PER_HOUR);
+
+        /* c.service configures dependencies on b.service, which
+         * must survive reloading the latter alone */
+        synthetic_write_unit(dir, "c.service",
+                   "[Unit]\n"
+                   "Description=C\n"
+                   "Requires=b.service\n"
+                   "Before=b.service\n"
+                   "Conflicts=f.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n", USEC_PER_HOUR);
+
+        /* A reference from a unit that is not reloaded */
+        synthetic_write_unit(dir, "e.socket",
+                   "[Socket]\n"
+                   "ListenStream=/nonexistent/e\n"
+                   "Service=b.service\n", USEC_PER_HOUR);
+
+        /* An alias, loaded by its other name */
+        p = strjoina(dir, "/f.service");
+        assert_se(symlink("b.service", p) >= 0);
+
+        synthetic_write_unit(dir, "t.target",
+                   "[Unit]\n"
+                   "Description=T\n", USEC_PER_HOUR);
+
+        p = strjoina(dir, "/t.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+        p = strjoina(dir, "/t.target.wants/a.service");
+        assert_se(symlink("../a.service", p) >= 0);
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18], contents[LINE_MAX];
+
+                xsprintf(name, "synthetic-%u.service", i);
+                xsprintf(contents,
+                         "[Unit]\n"
+                         "Description=Synthetic unit %u\n"
+                         "After=synthetic-%u.service\n"
+                         "[Service]\n"
+                         "ExecStart=/bin/true\n", i, i + 1);
+
+                synthetic_write_unit(dir, name, contents, USEC_PER_HOUR);
+        }
+}
+
+static void change_unit_dir(const char *dir) {
+        const char *p;
+
+        /* A changed fragment */
+        synthetic_write_unit(dir, "b.service",
+                   "[Unit]\n"
+                   "Description=B changed\n"
+                   "Wants=new.service\n"
+                   "Before=a.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/false\n", 0);
+
+        /* A new drop-in */
+        p = strjoina(dir, "/synthetic-0.service.d");
+        assert_se(mkdir(p, 0755) >= 0);
+        synthetic_write_unit(p, "override.conf",
+                   "[Unit]\n"
+                   "Description=Overridden\n", 0);
+
+        /* A unit that had no fragment before */
+        synthetic_write_unit(dir, "g.service",
+                   "[Unit]\n"
+                   "Description=G\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n", 0);
+
+        /* A new .wants/ entry */
+        p = strjoina(dir, "/t.target.wants/c.service");
+        assert_se(symlink("../c.service", p) >= 0);
+}
+
+static void load_units(Manager *m) {
+        unsigned i;
+        Unit *u;
+
+        for (i = 0; i < ELEMENTSOF(names); i++)
+                assert_se(manager_load_unit(m, names[i], NULL, NULL, &u) >= 0);
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18];
+
+                xsprintf(name, "synthetic-%u.service", i);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        }
+}
+
+static char **dump_units(Manager *m) {
+        char **l = NULL;
+        Iterator i;
+        const char *k;
+        Unit *u;
+
+        /* Everything about the units that comes from their
+         * configuration, in a canonical order */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                _cleanup_strv_free_ char **s = NULL;
+                _cleanup_free_ char *line = NULL, *deps = NULL;
+                UnitDependency d;
+                Iterator j;
+                Unit *other;
+
+                if (u->id != k) {
+                        assert_se(asprintf(&line, "%s alias of %s", k, u->id) >= 0);
+                        assert_se(strv_consume(&l, line) >= 0);
+                        line = NULL;
+                        continue;
+                }
+
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                        SET_FOREACH(other, u->dependencies[d], j) {
+                                char *e;
+
+                                assert_se(asprintf(&e, "%s:%s", unit_dependency_to_string(d), other->id) >= 0);
+                                assert_se(strv_consume(&s, e) >= 0);
+                        }
+
+                strv_sort(s);
+                deps = strv_join(s, " ");
+                assert_se(deps);
+
+                assert_se(asprintf(&line, "%s %s \"%s\" %s %s [%s]",
+                                   u->id,
+                                   unit_load_state_to_string(u->load_state),
+                                   strna(u->description),
+                                   strna(u->fragment_path),
+                                   unit_active_state_to_string(unit_active_state(u)),
+                                   deps) >= 0);
+                assert_se(strv_consume(&l, line) >= 0);
+                line = NULL;
+        }
+
+        strv_sort(l);
+
+        return l;
+}
+
+static void assert_same_dumps(char **x, char **y) {
+        char **i;
+
+        STRV_FOREACH(i, x)
+                if (!strv_contains(y, *i))
+                        log_error("Only after incremental reload: %s", *i);
+
+        STRV_FOREACH(i, y)
+                if (!strv_contains(x, *i))
+                        log_error("Only in reference: %s", *i);
+
+        assert_se(strv_equal(x, y));
+}
+
+static Manager *new_manager(void) {
+        Manager *m;
+
+        m = synthetic_manager_new();
+        load_units(m);
+
+        return m;
+}
+
+int main(int argc, char *argv[]) {
+        char ts[FORMAT_TIMESPAN_MAX], tf[FORMAT_TIMESPAN_MAX];
+        _cleanup_strv_free_ char **before = NULL, **after = NULL;
+        Manager *m, *full;
+        usec_t t, t_full;
+        Unit *u, *b;
+        char *dir;
+
+        if (synthetic_setup("test-reload-incremental", argc, argv, &arg_n_units, make_unit_dir, &dir) < 0)
+                return EXIT_TEST_SKIP;
+
+        m = new_manager();
+        full = new_manager();
+
+        assert_se(manager_get_unit(m, "f.service") == manager_get_unit(m, "b.service"));
+        assert_se(manager_get_unit(m, "g.service")->load_state == UNIT_NOT_FOUND);
+
+        /* Nothing changed, nothing to do */
+        before = dump_units(m);
+        assert_se(manager_reload_incremental(m) == 0);
+        after = dump_units(m);
+        assert_same_dumps(after, before);
+
+        change_unit_dir(dir);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload_incremental(m) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        t_full = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload(full) >= 0);
+        t_full = now(CLOCK_MONOTONIC) - t_full;
+
+        log_info("Incremental reload of %u units took %s, full reload %s.",
+                 hashmap_size(m->units),
+                 format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC),
+                 format_timespan(tf, sizeof(tf), t_full, USEC_PER_MSEC));
+
+        strv_free(before);
+        strv_free(after);
+        before = dump_units(full);
+        after = dump_units(m);
+        assert_same_dumps(after, before);
+
+        b = manager_get_unit(m, "b.service");
+        assert_se(b && streq(b->description, "B changed"));
+        assert_se(manager_get_unit(m, "f.service") == b);
+        assert_se(UNIT_DEREF(SOCKET(manager_get_unit(m, "e.socket"))->service) == b);
+
+        u = manager_get_unit(m, "g.service");
+        assert_se(u && u->load_state == UNIT_LOADED);
+
+        u = manager_get_unit(m, "synthetic-0.service");
+        assert_se(u && streq(u->description, "Overridden"));
+
+        /* Untouched units keep working after their dependencies
+         * were replaced underneath them */
+        u = manager_get_unit(m, "c.service");
+        assert_se(set_contains(u->dependencies[UNIT_REQUIRES], b));
+        assert_se(set_contains(b->dependencies[UNIT_REQUIRED_BY], u));
+        assert_se(set_contains(u->dependencies[UNIT_WANTED_BY], manager_get_unit(m, "t.target")));
+
+        /* And a second time there is nothing to do again */
+        strv_free(before);
+        before = dump_units(m);
+        assert_se(manager_reload_incremental(m) == 0);
+        strv_free(after);
+        after = dump_units(m);
+        assert_same_dumps(after, before);
+
+        manager_free(m);
+        manager_free(full);
+        synthetic_cleanup(dir);
+
+        return 0;
+}
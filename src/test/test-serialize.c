@@ -0,0 +1,206 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "manager.h"
+#include "service.h"
+#include "strv.h"
+#include "time-util.h"
+#include "test-synthetic.h"
+
+/* Serializes a manager with many units that have some runtime state
+ * and jobs, deserializes that into a second manager that loaded the
+ * same units, as a daemon-reexec would, and checks that the state
+ * survived, in both the text and the binary format. */
+
+static unsigned arg_n_units = SYNTHETIC_N_UNITS(100, 50000);
+
+static void make_unit_dir(const char *dir) {
+        unsigned i;
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18], contents[LINE_MAX];
+
+                xsprintf(name, "synthetic-%u.service", i);
+                xsprintf(contents,
+                         "[Unit]\n"
+                         "Description=Synthetic unit %u\n"
+                         "DefaultDependencies=no\n"
+                         "[Service]\n"
+                         "ExecStart=/bin/true\n", i);
+
+                synthetic_write_unit(dir, name, contents, 0);
+        }
+}
+
+static Manager *new_manager(void) {
+        Manager *m;
+        unsigned i;
+
+        m = synthetic_manager_new();
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18];
+                Unit *u;
+
+                xsprintf(name, "synthetic-%u.service", i);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        }
+
+        return m;
+}
+
+static void make_state(Manager *m) {
+        unsigned i;
+
+        /* Something for most of the generic and service specific
+         * fields to write out, and a few jobs */
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18];
+                Service *s;
+                Unit *u;
+
+                xsprintf(name, "synthetic-%u.service", i);
+                u = manager_get_unit(m, name);
+                assert_se(u);
+                s = SERVICE(u);
+
+                u->inactive_exit_timestamp = (dual_timestamp) { 1000 + i, 2000 + i };
+                u->active_enter_timestamp = (dual_timestamp) { 3000 + i, 4000 + i };
+                u->condition_timestamp = (dual_timestamp) { 5000 + i, 6000 + i };
+                u->condition_result = i % 2;
+                u->cpuacct_usage_base = i * 1000;
+
+                s->watchdog_timestamp = (dual_timestamp) { 7000 + i, 8000 + i };
+                s->result = i % 3 == 0 ? SERVICE_FAILURE_EXIT_CODE : SERVICE_SUCCESS;
+                s->reload_result = i % 5 == 0 ? SERVICE_FAILURE_TIMEOUT : SERVICE_SUCCESS;
+
+                free(s->status_text);
+                assert_se(asprintf(&s->status_text, "Processing request %u of many", i) >= 0);
+
+                if (i % 10 == 0) {
+                        Job *j;
+
+                        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, false, NULL, &j) == 0);
+                }
+        }
+}
+
+static char **dump_units(Manager *m) {
+        char **l = NULL;
+        Iterator i;
+        Unit *u;
+
+        HASHMAP_FOREACH(u, m->units, i) {
+                char *line;
+
+                if (!startswith(u->id, "synthetic-"))
+                        continue;
+
+                assert_se(asprintf(&line, "%s "USEC_FMT" "USEC_FMT" "USEC_FMT" "USEC_FMT" "USEC_FMT" %i %"PRIu64" %i %i %s %s %s %s",
+                                   u->id,
+                                   u->inactive_exit_timestamp.realtime,
+                                   u->inactive_exit_timestamp.monotonic,
+                                   u->active_enter_timestamp.realtime,
+                                   u->condition_timestamp.monotonic,
+                                   SERVICE(u)->watchdog_timestamp.realtime,
+                                   u->condition_result,
+                                   u->cpuacct_usage_base,
+                                   SERVICE(u)->result,
+                                   SERVICE(u)->reload_result,
+                                   strna(SERVICE(u)->status_text),
+                                   u->job ? job_type_to_string(u->job->type) : "-",
+                                   u->job ? job_state_to_string(u->job->state) : "-",
+                                   yes_no(u->job && u->job->id == manager_get_job(m, u->job->id)->id)) >= 0);
+
+                assert_se(strv_consume(&l, line) >= 0);
+        }
+
+        strv_sort(l);
+
+        return l;
+}
+
+static void test_serialize(Manager *m, char **reference, SerializationFormat format) {
+        char ts[FORMAT_TIMESPAN_MAX], td[FORMAT_TIMESPAN_MAX];
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        Manager *other;
+        usec_t t, d;
+        off_t size;
+
+        fds = fdset_new();
+        assert_se(fds);
+
+        assert_se(manager_open_serialization(m, &f) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, format, false) >= 0);
+        assert_se(fflush(f) == 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        size = ftello(f);
+        assert_se(fseeko(f, 0, SEEK_SET) >= 0);
+
+        other = new_manager();
+
+        d = now(CLOCK_MONOTONIC);
+        assert_se(manager_deserialize(other, f, fds) >= 0);
+        d = now(CLOCK_MONOTONIC) - d;
+
+        log_info("%s: serializing %u units took %s, deserializing %s, %llu bytes.",
+                 serialization_format_to_string(format),
+                 hashmap_size(m->units),
+                 format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC),
+                 format_timespan(td, sizeof(td), d, USEC_PER_MSEC),
+                 (unsigned long long) size);
+
+        l = dump_units(other);
+        assert_se(strv_equal(l, reference));
+        assert_se(hashmap_size(other->jobs) == hashmap_size(m->jobs));
+
+        manager_free(other);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_strv_free_ char **reference = NULL;
+        Manager *m;
+        char *dir;
+
+        if (synthetic_setup("test-serialize", argc, argv, &arg_n_units, make_unit_dir, &dir) < 0)
+                return EXIT_TEST_SKIP;
+
+        m = new_manager();
+
+        make_state(m);
+        reference = dump_units(m);
+
+        test_serialize(m, reference, SERIALIZATION_TEXT);
+        test_serialize(m, reference, SERIALIZATION_BINARY);
+
+        manager_free(m);
+        synthetic_cleanup(dir);
+
+        return 0;
+}
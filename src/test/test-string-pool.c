@@ -0,0 +1,122 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <string.h>
+
+#include "util.h"
+#include "string-pool.h"
+
+static void test_string_pool_intern(void) {
+        _cleanup_string_pool_free_ StringPool *p = NULL;
+        char buf[] = "/etc/systemd/system/getty@.service";
+        const char *a, *b, *c;
+        StringPoolStats st;
+
+        p = string_pool_new();
+        assert_se(p);
+
+        assert_se(!string_pool_intern(p, NULL));
+
+        a = string_pool_intern(p, "/etc/systemd/system/getty@.service");
+        assert_se(a);
+        assert_se(streq(a, buf));
+
+        /* Equal strings yield the same pointer */
+        b = string_pool_intern(p, buf);
+        assert_se(b == a);
+
+        c = string_pool_intern(p, "Getty on %I");
+        assert_se(c);
+        assert_se(c != a);
+
+        string_pool_get_stats(p, &st);
+        assert_se(st.n_strings == 2);
+        assert_se(st.n_refs == 3);
+        assert_se(st.n_bytes == sizeof(buf) + strlen("Getty on %I") + 1);
+        assert_se(st.n_bytes_saved == sizeof(buf));
+
+        assert_se(string_pool_ref(p, a) == a);
+        string_pool_get_stats(p, &st);
+        assert_se(st.n_refs == 4);
+        assert_se(st.n_bytes_saved == 2 * sizeof(buf));
+
+        assert_se(!string_pool_unref(p, a));
+        assert_se(!string_pool_unref(p, b));
+        string_pool_get_stats(p, &st);
+        assert_se(st.n_strings == 2);
+        assert_se(st.n_bytes_saved == 0);
+
+        /* The last reference drops the entry */
+        assert_se(!string_pool_unref(p, a));
+        string_pool_get_stats(p, &st);
+        assert_se(st.n_strings == 1);
+        assert_se(st.n_refs == 1);
+        assert_se(st.n_bytes == strlen("Getty on %I") + 1);
+
+        a = string_pool_intern(p, buf);
+        assert_se(a);
+        assert_se(streq(a, buf));
+
+        /* Leave references behind, string_pool_free() must clean
+         * them up */
+}
+
+static void test_string_pool_replace(void) {
+        _cleanup_string_pool_free_ StringPool *p = NULL;
+        const char *field = NULL, *other;
+        StringPoolStats st;
+
+        p = string_pool_new();
+        assert_se(p);
+
+        assert_se(string_pool_replace(p, &field, "foo") >= 0);
+        assert_se(streq(field, "foo"));
+
+        other = string_pool_intern(p, "foo");
+        assert_se(other == field);
+
+        /* Replacing a string with itself must not drop it */
+        assert_se(string_pool_replace(p, &field, field) >= 0);
+        assert_se(field == other);
+
+        assert_se(string_pool_replace(p, &field, "bar") >= 0);
+        assert_se(streq(field, "bar"));
+
+        string_pool_get_stats(p, &st);
+        assert_se(st.n_strings == 2);
+        assert_se(st.n_refs == 2);
+
+        assert_se(string_pool_replace(p, &field, NULL) >= 0);
+        assert_se(!field);
+
+        string_pool_unref(p, other);
+
+        string_pool_get_stats(p, &st);
+        assert_se(st.n_strings == 0);
+        assert_se(st.n_refs == 0);
+        assert_se(st.n_bytes == 0);
+        assert_se(st.n_bytes_saved == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_string_pool_intern();
+        test_string_pool_replace();
+
+        return 0;
+}
@@ -0,0 +1,108 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "fileio.h"
+#include "rm-rf.h"
+#include "test-synthetic.h"
+
+int synthetic_setup(const char *name, int argc, char *argv[], unsigned *n_units, void (*populate)(const char *dir), char **ret_dir) {
+        Manager *m = NULL;
+        char *dir;
+        int r;
+
+        assert(name);
+        assert(n_units);
+        assert(populate);
+        assert(ret_dir);
+
+        /* Creates the unit directory and makes it the only one the
+         * manager looks at. Returns a negative error if no manager
+         * can be run here, in which case the test is to be
+         * skipped. */
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], n_units) >= 0);
+
+        dir = strjoin("/tmp/", name, ".XXXXXX", NULL);
+        assert_se(dir);
+        assert_se(mkdtemp(dir));
+
+        populate(dir);
+        assert_se(set_unit_path(dir) >= 0);
+
+        r = manager_new(SYSTEMD_USER, true, &m);
+        if (IN_SET(r, -EPERM, -EACCES, -EADDRINUSE, -EHOSTDOWN, -ENOENT)) {
+                printf("Skipping test: manager_new: %s\n", strerror(-r));
+                synthetic_cleanup(dir);
+                return r;
+        }
+        assert_se(r >= 0);
+        manager_free(m);
+
+        *ret_dir = dir;
+        return 0;
+}
+
+void synthetic_cleanup(char *dir) {
+        if (!dir)
+                return;
+
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+        free(dir);
+}
+
+void synthetic_write_unit(const char *dir, const char *name, const char *contents, usec_t age) {
+        struct timespec ts[2];
+        const char *p;
+
+        assert(dir);
+        assert(name);
+        assert(contents);
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, contents) >= 0);
+
+        if (age <= 0)
+                return;
+
+        /* Files modified just now are not cached, hence make them
+         * look older if needed */
+        timespec_store(&ts[0], now(CLOCK_REALTIME) - age);
+        ts[1] = ts[0];
+        assert_se(utimensat(AT_FDCWD, p, ts, 0) >= 0);
+}
+
+Manager *synthetic_manager_new(void) {
+        Manager *m = NULL;
+
+        assert_se(manager_new(SYSTEMD_USER, true, &m) >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        return m;
+}
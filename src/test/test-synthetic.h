@@ -0,0 +1,41 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "manager.h"
+#include "time-util.h"
+
+/* Shared by the tests that run a user manager on a temporary
+ * directory of synthetic units. As part of "make check" they only
+ * use a few units, the -benchmark variants in manual_tests use as
+ * many as a big system has. Either takes the number of units as
+ * first argument, too. */
+
+#ifdef SYNTHETIC_BENCHMARK
+#  define SYNTHETIC_N_UNITS(check, benchmark) (benchmark)
+#else
+#  define SYNTHETIC_N_UNITS(check, benchmark) (check)
+#endif
+
+int synthetic_setup(const char *name, int argc, char *argv[], unsigned *n_units, void (*populate)(const char *dir), char **ret_dir);
+void synthetic_cleanup(char *dir);
+
+void synthetic_write_unit(const char *dir, const char *name, const char *contents, usec_t age);
+Manager *synthetic_manager_new(void);
@@ -0,0 +1,286 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "manager.h"
+#include "service.h"
+#include "strv.h"
+#include "fileio.h"
+#include "time-util.h"
+#include "test-synthetic.h"
+
+/* Loads a large synthetic unit directory: many instances of a few
+ * templates, plus units with a fragment of their own, once with the
+ * files read ahead of time on all CPUs, once serially, and once with
+ * the files taken from the unit file cache. */
+
+static unsigned arg_n_units = SYNTHETIC_N_UNITS(200, 5000);
+
+static void write_unit(const char *dir, const char *name, const char *contents) {
+        synthetic_write_unit(dir, name, contents, USEC_PER_HOUR);
+}
+
+static void make_unit_dir(const char *dir) {
+        const char *p;
+        unsigned i;
+
+        write_unit(dir, "synthetic@.service",
+                   "[Unit]\n"
+                   "Description=Synthetic template instance\n"
+                   "SourcePath=/etc/synthetic.orig\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+
+        p = strjoina(dir, "/synthetic@.service.d");
+        assert_se(mkdir(p, 0755) >= 0);
+        write_unit(p, "override.conf",
+                   "[Unit]\n"
+                   "SourcePath=/etc//synthetic\n"
+                   "[Service]\n"
+                   "Environment=SYNTHETIC=1\n");
+
+        write_unit(dir, "synthetic-named@.service",
+                   "[Unit]\n"
+                   "Description=Synthetic instance %i\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true %i\n");
+
+        for (i = 0; i < arg_n_units / 4; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 18], contents[LINE_MAX];
+
+                xsprintf(name, "synthetic-%u.service", i);
+                xsprintf(contents,
+                         "[Unit]\n"
+                         "Description=Synthetic unit %u\n"
+                         "[Service]\n"
+                         "ExecStart=/bin/true\n", i);
+
+                write_unit(dir, name, contents);
+        }
+}
+
+static usec_t load_units(Manager *m) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        const char *template_path = NULL, *source_path = NULL;
+        unsigned i;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_units; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 26];
+                Unit *u;
+
+                switch (i % 4) {
+
+                case 0:
+                        xsprintf(name, "synthetic-%u.service", i / 4);
+                        break;
+
+                case 1:
+                        xsprintf(name, "synthetic-named@%u.service", i);
+                        break;
+
+                default:
+                        xsprintf(name, "synthetic@%u.service", i);
+                        break;
+                }
+
+                assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+                assert_se(u->load_state == UNIT_LOADED);
+                assert_se(u->fragment_path);
+                assert_se(u->description);
+
+                /* All instances of a template share one copy of
+                 * its path, so comparing pointers is enough */
+                if (i % 4 >= 2) {
+                        if (!template_path)
+                                template_path = u->fragment_path;
+
+                        assert_se(u->fragment_path == template_path);
+                        assert_se(streq(u->description, "Synthetic template instance"));
+
+                        /* The drop-in replaced the template's value */
+                        if (!source_path)
+                                source_path = u->source_path;
+
+                        assert_se(u->source_path == source_path);
+                        assert_se(streq(u->source_path, "/etc/synthetic"));
+                        assert_se(strv_contains(SERVICE(u)->exec_context.environment, "SYNTHETIC=1"));
+                }
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Loaded %u units in %s.", arg_n_units, format_timespan(ts, sizeof(ts), t, 1));
+
+        return t;
+}
+
+static void unload_units(Manager *m) {
+        Unit *u;
+
+        while ((u = hashmap_first(m->units)))
+                unit_free(u);
+}
+
+static void test_preparse(Manager *m) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        usec_t t, t_load, t_serial;
+
+        unload_units(m);
+
+        /* Like a reload: read all files, then load the units */
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_preparse_unit_files(m) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        /* All fragments, and the one drop-in */
+        assert_se(hashmap_size(m->preparsed_files) == arg_n_units / 4 + 3);
+
+        t_load = load_units(m);
+        unload_units(m);
+
+        manager_free_preparsed_files(m);
+        assert_se(!m->preparsed_files);
+
+        t_serial = load_units(m);
+
+        log_info("Reading ahead took %s, loading %s, loading serially %s.",
+                 format_timespan(a, sizeof(a), t, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), t_load, USEC_PER_MSEC),
+                 format_timespan(c, sizeof(c), t_serial, USEC_PER_MSEC));
+}
+
+static void test_cache(Manager *m, const char *dir) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n_files = arg_n_units / 4 + 3;
+        uint64_t hits, misses;
+        usec_t t, t_load;
+        Unit *u;
+
+        unload_units(m);
+
+        m->unit_cache_path = strappend(dir, ".cache");
+        assert_se(m->unit_cache_path);
+
+        /* Populate the cache */
+        hits = m->unit_cache_hits;
+        misses = m->unit_cache_misses;
+        assert_se(manager_preparse_unit_files(m) >= 0);
+        assert_se(m->unit_cache_hits == hits);
+        assert_se(m->unit_cache_misses == misses + n_files);
+        assert_se(access(m->unit_cache_path, F_OK) >= 0);
+        manager_free_preparsed_files(m);
+
+        /* Everything comes from the cache now */
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_preparse_unit_files(m) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+        assert_se(m->unit_cache_hits == hits + n_files);
+        assert_se(hashmap_size(m->preparsed_files) == n_files);
+
+        t_load = load_units(m);
+        unload_units(m);
+        manager_free_preparsed_files(m);
+
+        log_info("Reading from the cache took %s, loading %s.",
+                 format_timespan(a, sizeof(a), t, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), t_load, USEC_PER_MSEC));
+
+        /* A modified file is read again */
+        write_unit(dir, "synthetic-0.service",
+                   "[Unit]\n"
+                   "Description=Modified synthetic unit\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+
+        hits = m->unit_cache_hits;
+        misses = m->unit_cache_misses;
+        assert_se(manager_preparse_unit_files(m) >= 0);
+        assert_se(m->unit_cache_hits == hits + n_files - 1);
+        assert_se(m->unit_cache_misses == misses + 1);
+
+        assert_se(manager_load_unit(m, "synthetic-0.service", NULL, NULL, &u) >= 0);
+        assert_se(streq(u->description, "Modified synthetic unit"));
+
+        unload_units(m);
+        manager_free_preparsed_files(m);
+
+        /* A broken cache is ignored */
+        assert_se(write_string_file(m->unit_cache_path, "garbage") >= 0);
+        hits = m->unit_cache_hits;
+        assert_se(manager_preparse_unit_files(m) >= 0);
+        assert_se(m->unit_cache_hits == hits);
+        assert_se(hashmap_size(m->preparsed_files) == n_files);
+        manager_free_preparsed_files(m);
+
+        assert_se(unlink(m->unit_cache_path) >= 0);
+}
+
+static void report_strings(Manager *m) {
+        char a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX];
+        StringPoolStats st;
+
+        string_pool_get_stats(m->strings, &st);
+
+        log_info("%u interned strings, %u references, %s stored, %s saved.",
+                 st.n_strings, st.n_refs,
+                 format_bytes(a, sizeof(a), st.n_bytes),
+                 format_bytes(b, sizeof(b), st.n_bytes_saved));
+
+        /* Each unit refers to a fragment path and a description, and
+         * half of the units share both with each other */
+        assert_se(st.n_refs >= 2 * arg_n_units);
+        assert_se(st.n_strings < st.n_refs);
+        assert_se(st.n_bytes_saved > (arg_n_units / 2 - 1) * strlen("Synthetic template instance"));
+}
+
+int main(int argc, char *argv[]) {
+        StringPoolStats st;
+        Manager *m;
+        char *dir;
+
+        if (synthetic_setup("test-unit-load", argc, argv, &arg_n_units, make_unit_dir, &dir) < 0)
+                return EXIT_TEST_SKIP;
+
+        m = synthetic_manager_new();
+
+        load_units(m);
+        report_strings(m);
+
+        test_preparse(m);
+        test_cache(m, dir);
+
+        /* Dropping all units must release every string again */
+        unload_units(m);
+
+        string_pool_get_stats(m->strings, &st);
+        assert_se(st.n_strings == 0);
+        assert_se(st.n_bytes == 0);
+
+        manager_free(m);
+        synthetic_cleanup(dir);
+
+        return 0;
+}
@@ -1301,6 +1301,119 @@ static void test_execute_directory(void) {
         (void) rm_rf(template_hi, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+static void execute_parallel(const char *dir, unsigned max_parallel, ExecuteTiming **timings, unsigned *n) {
+        const char *dirs[] = { dir, NULL };
+
+        assert_se(execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, max_parallel, NULL, timings, n) >= 0);
+}
+
+static unsigned read_marker(const char *markers, const char *prefix, unsigned i) {
+        char name[DECIMAL_STR_MAX(unsigned) + 16];
+        _cleanup_free_ char *line = NULL;
+        unsigned k;
+
+        xsprintf(name, "%s.sleep%u", prefix, i);
+        assert_se(read_one_line_file(strjoina(markers, "/", name), &line) >= 0);
+        assert_se(safe_atou(line, &k) >= 0);
+
+        return k;
+}
+
+static void check_overlap(const char *dir, const char *markers, unsigned max_parallel, unsigned want) {
+        ExecuteTiming *timings;
+        unsigned n, i, most = 0;
+        char w[DECIMAL_STR_MAX(unsigned)];
+
+        (void) rm_rf(markers, REMOVE_PHYSICAL);
+        xsprintf(w, "%u", want);
+        assert_se(write_string_file(strjoina(markers, "/want"), w) == 0);
+
+        execute_parallel(dir, max_parallel, &timings, &n);
+        assert_se(n == 4);
+        execute_timings_free(timings, n);
+
+        /* None started while more than allowed were running, and
+         * at some point as many as we waited for ran at once */
+        for (i = 0; i < n; i++) {
+                if (max_parallel > 0)
+                        assert_se(read_marker(markers, "first", i) <= max_parallel);
+                most = MAX(most, read_marker(markers, "seen", i));
+        }
+        assert_se(most == want);
+}
+
+static void test_execute_directory_parallel(void) {
+        char template[] = "/tmp/test-execute_directory_parallel.XXXXXXX";
+        char markers[] = "/tmp/test-execute_directory_parallel-markers.XXXXXXX";
+        ExecuteTiming *timings;
+        unsigned n, i;
+        bool busy = false;
+
+        /* Four generators that leave a marker when they start and
+         * when they are done, and wait in between until as many of
+         * them run at the same time as asked for, or until all of
+         * them were started. Nothing here depends on how long that
+         * takes, so that a loaded machine doesn't make this fail. */
+
+        assert_se(mkdtemp(template));
+        assert_se(mkdtemp(markers));
+
+        for (i = 0; i < 4; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 6];
+                _cleanup_free_ char *script = NULL;
+                const char *p;
+
+                assert_se(asprintf(&script,
+                                   "#!/bin/sh\n"
+                                   "m=%s\n"
+                                   "n=$(basename $0)\n"
+                                   "touch $m/start.$n\n"
+                                   "r=$(($(ls $m | grep -c ^start) - $(ls $m | grep -c ^end)))\n"
+                                   "echo $r > $m/first.$n\n"
+                                   "i=0\n"
+                                   "while [ $i -lt 600 ]; do\n"
+                                   "        s=$(ls $m | grep -c ^start)\n"
+                                   "        r=$((s - $(ls $m | grep -c ^end)))\n"
+                                   "        [ $r -ge $(cat $m/want) ] && break\n"
+                                   "        [ $s -ge 4 ] && break\n"
+                                   "        sleep 0.1\n"
+                                   "        i=$((i + 1))\n"
+                                   "done\n"
+                                   "echo $r > $m/seen.$n\n"
+                                   "touch $m/end.$n\n", markers) >= 0);
+
+                xsprintf(name, "sleep%u", i);
+                p = strjoina(template, "/", name);
+                assert_se(write_string_file(p, script) == 0);
+                assert_se(chmod(p, 0755) == 0);
+        }
+
+        /* All at once, not one after the other */
+        check_overlap(template, markers, 0, 4);
+
+        /* Two at a time, in two rounds */
+        check_overlap(template, markers, 2, 2);
+
+        assert_se(write_string_file(strjoina(template, "/busy"),
+                                    "#!/bin/sh\ni=0\nwhile [ $i -lt 100000 ]; do i=$((i+1)); done\n") == 0);
+        assert_se(chmod(strjoina(template, "/busy"), 0755) == 0);
+
+        assert_se(write_string_file(strjoina(markers, "/want"), "0") == 0);
+        execute_parallel(template, 0, &timings, &n);
+        assert_se(n == 5);
+        for (i = 0; i < n; i++)
+                if (endswith(timings[i].path, "/busy")) {
+                        assert_se(timings[i].cpu > 0);
+                        busy = true;
+                } else
+                        assert_se(startswith(timings[i].path, template));
+        assert_se(busy);
+        execute_timings_free(timings, n);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+        (void) rm_rf(markers, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static void test_unquote_first_word(void) {
         const char *p, *original;
         char *t;
@@ -1635,6 +1748,7 @@ int main(int argc, char *argv[]) {
         test_search_and_fopen_nulstr();
         test_glob_exists();
         test_execute_directory();
+        test_execute_directory_parallel();
         test_unquote_first_word();
         test_unquote_many_words();
         test_parse_proc_cmdline();